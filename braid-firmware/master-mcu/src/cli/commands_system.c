@@ -1,5 +1,7 @@
 #include "freertos/FreeRTOS.h"
 #include <esp_console.h>
+#include <esp_cpu.h>
+#include <esp_timer.h>
 #include <esp_system.h>
 #include <string.h>
 
@@ -7,9 +9,13 @@
 #include "commands_system.h"
 #include "core/boot.h"
 #include "core/factory_data.h"
+#include "crypto_backend.h"
 #include "hal/anti_tamper.h"
 #include "hal/flash.h"
+#include "hal/sensors.h"
+#include "proto_payload.h"
 #include "serial.h"
+#include "sha256.h"
 
 #define FILE_BUF_LEN (2048)
 
@@ -26,6 +32,9 @@ static esp_err_t register_root_ca_write();
 static esp_err_t register_device_cert_write();
 static esp_err_t register_print_tamper();
 static esp_err_t register_erase_tamper();
+static esp_err_t register_sensors_link();
+static esp_err_t register_sensors_update();
+static esp_err_t register_sha256_bench();
 
 esp_err_t register_commands_system() {
     esp_err_t ret = ESP_OK;
@@ -38,6 +47,9 @@ esp_err_t register_commands_system() {
     ret |= register_device_cert_write();
     ret |= register_print_tamper();
     ret |= register_erase_tamper();
+    ret |= register_sensors_link();
+    ret |= register_sensors_update();
+    ret |= register_sha256_bench();
     return ret;
 }
 
@@ -291,4 +303,205 @@ static esp_err_t register_erase_tamper() {
         .func = &erase_tamper,
     };
     return esp_console_cmd_register(&cmd);
+}
+
+static void print_histogram(const char *name, const ProtoHistogram *histogram) {
+    SerialPrintf("%s (ms):\n", name);
+    for (uint32_t i = 0; i < PROTO_HISTOGRAM_BUCKETS; i++) {
+        if (histogram->buckets[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            SerialPrintf("  0: %" PRIu32 "\n", histogram->buckets[i]);
+        } else if (i == PROTO_HISTOGRAM_BUCKETS - 1) {
+            SerialPrintf("  >=%" PRIu32 ": %" PRIu32 "\n", (uint32_t)1 << (i - 1), histogram->buckets[i]);
+        } else {
+            SerialPrintf("  %" PRIu32 "-%" PRIu32 ": %" PRIu32 "\n",
+                         (uint32_t)1 << (i - 1),
+                         ((uint32_t)1 << i) - 1,
+                         histogram->buckets[i]);
+        }
+    }
+}
+
+static esp_err_t print_sensors_link(int argc, char **argv) {
+    SensorsLinkStatus link;
+    esp_err_t ret = Sensors_GetLinkStatus(&link);
+
+    if (ret == ESP_OK) {
+        SerialPrintf("baud rate: %" PRIu32 "\n", link.baudRate);
+        SerialPrintf("rx: %" PRIu32 " bytes, %" PRIu32 " frames\n", link.proto.rxBytes, link.proto.rxFrames);
+        SerialPrintf("tx: %" PRIu32 " bytes, %" PRIu32 " frames, %" PRIu32 " retransmitted\n",
+                     link.proto.txBytes,
+                     link.proto.txFrames,
+                     link.proto.retransmits);
+        SerialPrintf("crc errors: %" PRIu32 "\n", link.proto.crcErrors);
+        SerialPrintf("resyncs: %" PRIu32 " (%" PRIu32 " bytes discarded)\n",
+                     link.proto.resyncs,
+                     link.proto.discardedBytes);
+        SerialPrintf("hmac failures: %" PRIu32 "\n", link.hmacFailures);
+        SerialPrintf("fallbacks: %" PRIu32 "\n", link.proto.baudFallbacks);
+        print_histogram("frame interval", &link.proto.rxInterval);
+        print_histogram("sample age", &link.sampleAge);
+    }
+
+    return ret;
+}
+
+static esp_err_t register_sensors_link() {
+    const esp_console_cmd_t cmd = {
+        .command = "sensors-link",
+        .help = "Print the state of the link towards the sensors MCU\n"
+                "  Usage:   sensors-link\n"
+                "  Example: sensors-link",
+        .hint = NULL,
+        .func = &print_sensors_link,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+static esp_err_t sensors_update(int argc, char **argv) {
+    static const char *states[] = {
+        [PROTO_FW_STATE_IDLE] = "idle",
+        [PROTO_FW_STATE_RECEIVING] = "in progress",
+        [PROTO_FW_STATE_DONE] = "done",
+        [PROTO_FW_STATE_FAILED] = "failed",
+    };
+    SensorsUpdateStatus update;
+    esp_err_t ret = ESP_OK;
+
+    if (argc == 2 && strcmp(argv[1], "start") == 0) {
+        ret = Sensors_StartUpdate();
+        SerialPrintf("Status: %s\n", (ret != ESP_OK) ? "Failure" : "Success");
+        return ret;
+    }
+
+    ret = Sensors_GetUpdateStatus(&update);
+    if (ret == ESP_OK) {
+        SerialPrintf("state: %s\n", (update.state <= PROTO_FW_STATE_FAILED) ? states[update.state] : "unknown");
+        SerialPrintf("error: %u\n", update.error);
+        SerialPrintf("written: %" PRIu32 "/%" PRIu32 " bytes\n", update.written, update.length);
+        SerialPrintf("elapsed: %" PRIu32 " ms\n", update.elapsedMs);
+        if (update.elapsedMs > 0) {
+            SerialPrintf("throughput: %" PRIu32 " B/s\n", (uint32_t)(update.written * 1000ull / update.elapsedMs));
+        }
+    }
+
+    return ret;
+}
+
+static esp_err_t register_sensors_update() {
+    const esp_console_cmd_t cmd = {
+        .command = "sensors-update",
+        .help = "Prints the progress of the sensors MCU firmware update.\n"
+                "  If start is provided, streams the image received over MQTT again.\n"
+                "  Usage:   sensors-update [start]\n"
+                "  Example: sensors-update",
+        .hint = NULL,
+        .func = &sensors_update,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+static esp_err_t sha256_bench(int argc, char **argv) {
+    /* FIPS 180-2 example: SHA-256 of "abc" */
+    static const uint8_t abcDigest[SHA256_HASH_SIZE] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+    const uint32_t count = 64;
+    const uint32_t verifyCount = 1000;
+    size_t length = 1024;
+    SHA256_HASH digest;
+    SHA256_HASH reference;
+    CryptoSha256Ctx ctx;
+    HmacKeyCtx key;
+    SensorPayload payload;
+
+    if (argc == 2) {
+        length = atoi(argv[1]);
+    }
+    if (length == 0 || length > FILE_BUF_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    Sha256Calculate("abc", 3, &digest);
+    if (memcmp(digest.bytes, abcDigest, SHA256_HASH_SIZE) != 0) {
+        SerialPrintf("Status: Failure, wrong digest\n");
+        return ESP_FAIL;
+    }
+
+    memset(file_buf, 0x5a, length);
+    esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < count; i++) {
+        Sha256Calculate(file_buf, length, &digest);
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    SerialPrintf("SHA256_UNROLLED=%d\n", SHA256_UNROLLED);
+    SerialPrintf("%" PRIu32 " x %zu bytes: %" PRIu32 " cycles, %" PRIu32 ".%02" PRIu32 " cycles/B\n",
+                 count,
+                 length,
+                 cycles,
+                 cycles / (count * length),
+                 (uint32_t)((cycles % (count * length)) * 100ull / (count * length)));
+
+    /* the same buffer through the backend of the HMAC, which must agree with the software */
+    start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < count; i++) {
+        Crypto_Sha256Init(&ctx);
+        Crypto_Sha256Update(&ctx, file_buf, length);
+        Crypto_Sha256Final(&ctx, digest.bytes);
+    }
+    cycles = esp_cpu_get_cycle_count() - start;
+    Sha256Calculate(file_buf, length, &reference);
+    if (memcmp(digest.bytes, reference.bytes, SHA256_HASH_SIZE) != 0) {
+        SerialPrintf("Status: Failure, the backend digest differs\n");
+        return ESP_FAIL;
+    }
+
+    SerialPrintf("CRYPTO_BACKEND=%d\n", CRYPTO_BACKEND);
+    SerialPrintf("%" PRIu32 " x %zu bytes: %" PRIu32 " cycles, %" PRIu32 ".%02" PRIu32 " cycles/B\n",
+                 count,
+                 length,
+                 cycles,
+                 cycles / (count * length),
+                 (uint32_t)((cycles % (count * length)) * 100ull / (count * length)));
+
+    /* what Sensors_MsgCallback spends on each SensorPayload, with a test key */
+    memset(file_buf, 0xa5, HMAC_KEY_LENGTH);
+    Crypto_HMACKeyInit(&key, file_buf, HMAC_KEY_LENGTH);
+    memset(&payload, 0, sizeof(payload));
+    PayloadHash(&payload, &key);
+
+    int64_t startUs = esp_timer_get_time();
+    start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < verifyCount; i++) {
+        if (!PayloadVerify(&payload, &key)) {
+            Crypto_HMACKeyWipe(&key);
+            SerialPrintf("Status: Failure, payload not verified\n");
+            return ESP_FAIL;
+        }
+    }
+    cycles = esp_cpu_get_cycle_count() - start;
+    uint32_t elapsedUs = (uint32_t)(esp_timer_get_time() - startUs);
+    Crypto_HMACKeyWipe(&key);
+
+    SerialPrintf("PayloadVerify, %zu bytes: %" PRIu32 " cycles, %" PRIu32 " verifies/s\n",
+                 sizeof(payload),
+                 cycles / verifyCount,
+                 (uint32_t)(verifyCount * 1000000ull / elapsedUs));
+
+    return ESP_OK;
+}
+
+static esp_err_t register_sha256_bench() {
+    const esp_console_cmd_t cmd = {
+        .command = "sha256-bench",
+        .help = "Checks the SHA-256 builds and prints their cycles per byte, and the cost of PayloadVerify\n"
+                "  Usage:   sha256-bench [length]\n"
+                "  Example: sha256-bench 64",
+        .hint = NULL,
+        .func = &sha256_bench,
+    };
+    return esp_console_cmd_register(&cmd);
 }
\ No newline at end of file
@@ -68,3 +68,7 @@ TimestampSeconds Time_GetUnixTimestamp(void) {
 
     return result;
 }
+
+bool Time_IsSet(void) {
+    return Time_GetUnixTimestamp() >= TIME_VALID_SINCE_SECONDS;
+}
@@ -24,6 +24,9 @@ typedef uint32_t TimestampSeconds;
 
 #define SMOOTH_SYNC_LIMIT_SECONDS 30u * 60u
 
+/** earliest plausible time (2024-01-01), anything before means that the clock was never set */
+#define TIME_VALID_SINCE_SECONDS 1704067200u
+
 /** rappresents a day of the week */
 enum DayOfWeek {
     DOW_SUNDAY = 0,
@@ -60,6 +63,13 @@ TimestampSeconds Time_GetUnixTimestampFromTm(struct tm *tm);
  */
 TimestampSeconds Time_GetUnixTimestamp(void);
 
+/**
+ * @brief Tells whether the system time was ever set, from the network or kept across deep sleep
+ *
+ * @return `true` if the current time can be trusted
+ */
+bool Time_IsSet(void);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
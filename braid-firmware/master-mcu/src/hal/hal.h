@@ -4,6 +4,7 @@
 
 #include "core/boot.h"
 #include "core/factory_data.h"
+#include "crypto_hmac.h"
 #include "proto.h"
 
 #ifdef __cplusplus
@@ -12,6 +13,8 @@ extern "C" {
 
 extern ProtoCtx protoCtx;
 extern FactoryData factoryData;
+/** @brief The HMAC key of `factoryData`, shared with the sensors MCU */
+extern HmacKeyCtx sensorsKey;
 
 /**
  * @brief Early setup for critical peripherals such as the serial/UART. Should never fail
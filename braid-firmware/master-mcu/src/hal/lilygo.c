@@ -8,6 +8,7 @@
 #include <esp_vfs_dev.h>
 #include <esp_vfs_usb_serial_jtag.h>
 #include <stdint.h>
+#include <sys/param.h>
 
 #include "cli/serial.h"
 #include "core/factory_data.h"
@@ -32,6 +33,13 @@ static const char *TAG = "hal/lilygo";
 
 static GPRS_Params modemParams;
 
+// Longest sleep of Task_Sensors, which bounds how long a shutdown request may wait
+#define SENSORS_TASK_MAX_WAIT_MS (1000u)
+// Longest wait for a fresh sample before a report
+#define SENSORS_SAMPLE_TIMEOUT_MS (2000u)
+// Longest sleep of Task_GPRS between two shutdown checks, while it waits for sensors events
+#define GPRS_TASK_MAX_WAIT_MS (1000u)
+
 void Task_GPRS(void *arg);
 void Task_GPS(void *arg);
 void Task_Sensors(void *arg);
@@ -109,17 +117,33 @@ void Task_Sensors(void *arg) {
             break;
         }
 
-        if (ProtoProcessMessage(&protoCtx) != PROTO_SUCCESS) {
+        // Sleep until the sensors MCU sends something, a protocol timer expires or a request is queued
+        Sensors_WaitForData(MIN(ProtoNextTimeoutMs(&protoCtx), SENSORS_TASK_MAX_WAIT_MS));
+
+        ProtoErrorCode status = Sensors_SendRequest();
+        if (status == PROTO_ERROR_HAL) {
+            ESP_LOGE(TAG, "task_sensors: failed to send request");
+            errorHandler();
+        } else if (status != PROTO_SUCCESS && status != PROTO_ERROR_BUSY) {
+            ESP_LOGW(TAG, "task_sensors: request dropped (0x%02x)", status);
+        }
+
+        // Corrupted or unexpected frames are dealt with by the protocol, only the UART failing is fatal
+        status = ProtoProcessMessage(&protoCtx);
+        if (status == PROTO_ERROR_HAL) {
             ESP_LOGE(TAG, "task_sensors: failed during cmd processing");
             errorHandler();
+        } else if (status != PROTO_SUCCESS) {
+            ESP_LOGD(TAG, "task_sensors: message discarded (0x%02x)", status);
         }
 
-        if (ProtoReceive(&protoCtx) != PROTO_SUCCESS) {
+        status = ProtoReceive(&protoCtx);
+        if (status == PROTO_ERROR_HAL) {
             ESP_LOGE(TAG, "task_sensors: failed during recv");
             errorHandler();
+        } else if (status != PROTO_SUCCESS) {
+            ESP_LOGD(TAG, "task_sensors: receive error (0x%02x)", status);
         }
-
-        vTaskDelay(1);
     }
 
     vTaskDelete(NULL);
@@ -169,6 +193,35 @@ static void Mqtt_ShadowHandler(const char *topic, const uint8_t *data, size_t le
 
     // The time between reports depends on the duration of the GPS task
     Boot_SetDuration(BOOT_GPS, pl.reportDelay);
+
+    // Forwarded to the sensors MCU, only the keys present change
+    if (Sensors_SetConfig(&pl.sensorConfig) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not save the sensors configuration");
+    }
+}
+
+static void Mqtt_SensorsFirmwareHandler(const char *topic, const uint8_t *data, size_t length) {
+    // Streamed to the sensors MCU by Task_Sensors once complete
+    esp_err_t status = Sensors_StoreFirmwareChunk(length, data);
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Sensors firmware piece dropped (%s)", esp_err_to_name(status));
+    }
+}
+
+/**
+ * @brief Fills the report with the latest data of the sensors and of the GPS
+ */
+static void Lilygo_FillReport(ShadowPayload *payload) {
+    Sensors_GetLastData(&payload->sensorData);
+    if (Sensors_GetLastSampleTime(&payload->sensorTime) != ESP_OK) {
+        payload->sensorTime = 0;
+    }
+    // Populate GPS position
+    GPS_LoadData(&payload->gpsPosition);
+    // Link diagnostics, only encoded when enabled
+    Sensors_GetLinkStatus(&payload->linkStatus);
+    // Reported back, so that the backend sees the configuration in use
+    Sensors_GetConfig(&payload->sensorConfig);
 }
 
 void Task_GPRS(void *arg) {
@@ -178,18 +231,23 @@ void Task_GPRS(void *arg) {
     ShadowPayload payload;
 
     Boot_RegisterTask();
+    // The periodic report is not caused by an event
+    memset(&payload.sensorEvent, 0, sizeof(payload.sensorEvent));
 
     while (true) {
         // Time sync
         epoch = GPRS_GetDatetime(modem);
         ESP_LOGD(TAG, "Current time is %lld", epoch);
         Time_Set(epoch);
+        Sensors_SyncTime();
 
         // Fetch sensor data
         Sensors_LoadData();
-        Sensors_GetLastData(&payload.sensorData);
-        // Populate GPS position
-        GPS_LoadData(&payload.gpsPosition);
+        // In pull mode the sensors MCU samples only when asked
+        if (Sensors_RequestSamples(1) == ESP_OK && Sensors_WaitForSamples(SENSORS_SAMPLE_TIMEOUT_MS) != ESP_OK) {
+            ESP_LOGW(TAG, "No fresh sample from the sensors MCU, reporting the last one");
+        }
+        Lilygo_FillReport(&payload);
         // Encode the shadow
         int actualSize = Shadow_Encode(1, ACTION_PUT, &payload, shadowBuf, sizeof(shadowBuf));
         if (actualSize > 0) {
@@ -204,6 +262,14 @@ void Task_GPRS(void *arg) {
         Mqtt_ComposeTopicSub(
             factoryData.deviceId, MQTT_TOPIC_TYPE_AGENT, MQTT_TOPIC_DESIRED, "ADMIN", topicBuf, sizeof(topicBuf));
         Mqtt_Sub(topicBuf, Mqtt_ShadowHandler);
+        memset(topicBuf, 0, sizeof(topicBuf));
+        Mqtt_ComposeTopicSub(factoryData.deviceId,
+                             MQTT_TOPIC_TYPE_AGENT,
+                             MQTT_TOPIC_SENSORS_FIRMWARE,
+                             "ADMIN",
+                             topicBuf,
+                             sizeof(topicBuf));
+        Mqtt_Sub(topicBuf, Mqtt_SensorsFirmwareHandler);
 
         // Publish messages
         memset(topicBuf, 0, sizeof(topicBuf));
@@ -220,7 +286,14 @@ void Task_GPRS(void *arg) {
                 Boot_SetShutdownReady();
             }
 
-            vTaskDelay(pdMS_TO_TICKS(1000));
+            // Events of the sensors MCU are reported right away over the open connection
+            if (Sensors_WaitForEvent(&payload.sensorEvent, GPRS_TASK_MAX_WAIT_MS) == ESP_OK) {
+                Lilygo_FillReport(&payload);
+                actualSize = Shadow_Encode(1, ACTION_PUT, &payload, shadowBuf, sizeof(shadowBuf));
+                if (actualSize <= 0 || Mqtt_Pub(topicBuf, shadowBuf, actualSize) != ESP_OK) {
+                    ESP_LOGW(TAG, "Could not report the sensors event %u", payload.sensorEvent.type);
+                }
+            }
         }
     }
 
@@ -252,6 +325,9 @@ void Task_AntiTamper(void *arg) {
 
                         ESP_ERROR_CHECK(Tamper_RegisterEvent(&event));
                         ESP_LOGI(TAG, "Tamper detected, erasing factory data");
+                        // Nothing derived from the key may survive in RAM until the restart
+                        Crypto_HMACKeyWipe(&sensorsKey);
+                        Crypto_Wipe(factoryData.key, HMAC_KEY_LENGTH);
                         ESP_ERROR_CHECK(FactoryData_Erase());
                         esp_restart();
                     }
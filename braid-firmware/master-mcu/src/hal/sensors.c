@@ -1,12 +1,20 @@
 #include <driver/gpio.h>
 #include <driver/uart.h>
 #include <esp_check.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
+#include <sys/time.h>
 
+#include "build_config.h"
 #include "core/factory_data.h"
+#include "crc.h"
+#include "fw_update.h"
 #include "hal/flash.h"
 #include "log_extra.h"
 #include "proto_payload.h"
@@ -14,21 +22,73 @@
 
 static const char *TAG = "hal/sensors";
 
+// Posted to the UART event queue to wake Task_Sensors when a request is queued
+#define SENSORS_EVENT_REQUEST UART_EVENT_MAX
+// Time between two synchronizations of the sensors MCU clock, which runs on its LSI
+#define SENSORS_TIME_SYNC_PERIOD_MS (10u * 60u * 1000u)
+// Events waiting for the uplink. The sensors MCU has a single one in flight, so a few are plenty
+#define SENSORS_EVENT_QUEUE_LEN (4u)
+// Time without any status from the sensors MCU after which the image is announced again
+#define SENSORS_UPDATE_TIMEOUT_MS (10u * 1000u)
+// Announcements and rewinds in a row before the update is given up
+#define SENSORS_UPDATE_MAX_RETRIES (8u)
+// Largest image the bootloader could take
+#define SENSORS_FIRMWARE_MAX_LEN (FW_UPDATE_MAX_BLOCKS * PROTO_FW_BLOCK_LEN)
+
 static QueueHandle_t uart_queue;
 static SensorData sensorData = {
-    .humidity = 0.0f,
-    .temperature = 0.0f,
-    .acceleration_mg = {0, 0, 0},
+    .humidity = 0,
+    .temperature = 0,
+    .acceleration = {0, 0, 0},
 };
+static TimestampSeconds sensorDataTime;
 static SemaphoreHandle_t sensorDataMutex;
+static SemaphoreHandle_t samplesReady;
+static QueueHandle_t eventQueue;
+static ProtoCtx *sensorsProto;
+// Request to send, and samples still expected. Protected by `sensorDataMutex`
+static bool requestPending;
+static uint8_t requestCount;
+static uint32_t samplesMissing;
+// Sampling configuration, and whether it still has to be sent. Protected by `sensorDataMutex`
+static ProtoSensorConfigPayload sensorConfig;
+static bool configPending;
+// Whether the time has to be sent, and when it was sent last. Protected by `sensorDataMutex`
+static bool timeSyncPending;
+static uint32_t timeSyncAt;
+static uint32_t hmacFailures;
+static ProtoHistogram sampleAge;
+static uint32_t sampleMinDelay;
+static bool sampleMinDelayValid;
+// Image being received over MQTT, piece by piece. Only touched by the MQTT task
+// Public key the sensors MCU images are signed with, the same as in the bootloader
+static const uint8_t signingKey[ED25519_PUBLIC_KEY_SIZE] = {CFG_FW_SIGNING_KEY};
+static uint8_t *upload;
+static ProtoFwBeginPayload uploadImage;
+static uint32_t uploadReceived;
+// Image streamed to the sensors MCU, and how far it got. Protected by `sensorDataMutex`
+static ProtoFwBeginPayload firmwareImage;
+static uint8_t *firmware;
+static SensorsUpdateStatus update;
+static bool beginPending;
+static bool blocksAccepted;
+static uint32_t nextBlock;
+static uint32_t updateStartedAt;
+static uint32_t updateActivityAt;
+static uint8_t updateRetries;
 
 static int Sensors_ProtoWrite(void *writeCtx, size_t length, const uint8_t *data);
 static int Sensors_ProtoRead(void *readCtx, size_t length, uint8_t *data);
-static void Sensors_MsgCallback(void *cbCtx, ProtoMsgType msgType, uint8_t *payload);
+static uint32_t Sensors_ProtoTimeMs(void);
+static int Sensors_ProtoSetBaudRate(void *writeCtx, uint32_t baudRate);
+static void Sensors_MsgCallback(void *cbCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload);
+static ProtoErrorCode Sensors_SendFirmware(void);
+static bool Sensors_FirmwareReady(void);
 
 esp_err_t Sensors_UARTInit(ProtoCtx *protoCtx, int uartNum, gpio_num_t txPin, gpio_num_t rxPin) {
     uart_config_t uart_config;
-    uart_config.baud_rate = 115200;
+    // Both sides start at the default rate, a faster one is negotiated once connected
+    uart_config.baud_rate = PROTO_BAUD_DEFAULT;
     uart_config.data_bits = UART_DATA_8_BITS;
     uart_config.parity = UART_PARITY_DISABLE;
     uart_config.stop_bits = UART_STOP_BITS_1;
@@ -45,14 +105,238 @@ esp_err_t Sensors_UARTInit(ProtoCtx *protoCtx, int uartNum, gpio_num_t txPin, gp
         ESP_LOGE(TAG, "Error creating mutex");
         return ESP_FAIL;
     }
+    samplesReady = xSemaphoreCreateBinary();
+    if (samplesReady == NULL) {
+        ESP_LOGE(TAG, "Error creating semaphore");
+        return ESP_FAIL;
+    }
+    eventQueue = xQueueCreate(SENSORS_EVENT_QUEUE_LEN, sizeof(ProtoEventPayload));
+    if (eventQueue == NULL) {
+        ESP_LOGE(TAG, "Error creating queue");
+        return ESP_FAIL;
+    }
+
+    // Sent as soon as the sensors MCU connects
+    if (Flash_Exists(PARTITION_USER, "sensors_cfg")) {
+        Flash_Load(PARTITION_USER, "sensors_cfg", &sensorConfig, sizeof(sensorConfig));
+    }
 
+    ProtoInit(protoCtx);
     protoCtx->write = Sensors_ProtoWrite;
     protoCtx->read = Sensors_ProtoRead;
+    protoCtx->getTimeMs = Sensors_ProtoTimeMs;
     protoCtx->messageCallback = Sensors_MsgCallback;
+    protoCtx->window = PROTO_WINDOW_SIZE;
+    protoCtx->cobs = 1;
+    protoCtx->setBaudRate = Sensors_ProtoSetBaudRate;
+    protoCtx->maxBaudRate = SENSORS_UART_MAX_BAUD_RATE;
+    protoCtx->pull = 1;
+    sensorsProto = protoCtx;
+
+    // An update interrupted by a restart of the master goes on
+    if (Flash_Exists(PARTITION_USER, "sensors_fw")) {
+        Sensors_StartUpdate();
+    }
+
+    return ESP_OK;
+}
+
+bool Sensors_WaitForData(uint32_t timeoutMs) {
+    uart_event_t event;
+    size_t buffered = 0;
+
+    // Blocks are sent as soon as the window has room, not with the next event
+    if (Sensors_FirmwareReady()) {
+        return true;
+    }
+
+    // Bytes left over from a previous event are not announced again
+    if (uart_get_buffered_data_len(UART_NUM_2, &buffered) == ESP_OK && buffered > 0) {
+        return true;
+    }
+
+    // Round up, so that a short deadline does not turn into a busy loop
+    TickType_t ticks = (timeoutMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    if (xQueueReceive(uart_queue, &event, ticks) != pdTRUE) {
+        return false;
+    }
+
+    switch (event.type) {
+    case SENSORS_EVENT_REQUEST:
+        // Not data, but the request has to be sent
+        return true;
+    case UART_DATA:
+        // RX FIFO full or RX timeout: the second one marks the end of a burst
+        return true;
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+        // Bytes were lost anyway: start over from a clean buffer, the protocol recovers the frames
+        ESP_LOGW(TAG, "UART overflow, flushing the input");
+        uart_flush_input(UART_NUM_2);
+        xQueueReset(uart_queue);
+        return false;
+    default:
+        // Framing and parity errors end up as CRC errors
+        ESP_LOGD(TAG, "UART event %d", event.type);
+        return true;
+    }
+}
+
+esp_err_t Sensors_RequestSamples(uint8_t count) {
+    if (sensorsProto == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!(sensorsProto->state.features & PROTO_FEATURE_PULL)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    requestPending = true;
+    requestCount = count;
+    samplesMissing = count;
+    // Forget the completion of an older request
+    xSemaphoreTake(samplesReady, 0);
+    xSemaphoreGive(sensorDataMutex);
+
+    // The link belongs to Task_Sensors, which may be waiting for data
+    uart_event_t event = {.type = SENSORS_EVENT_REQUEST};
+    xQueueSend(uart_queue, &event, 0);
 
     return ESP_OK;
 }
 
+esp_err_t Sensors_WaitForSamples(uint32_t timeoutMs) {
+    return (xSemaphoreTake(samplesReady, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t Sensors_WaitForEvent(ProtoEventPayload *out, uint32_t timeoutMs) {
+    if (eventQueue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return (xQueueReceive(eventQueue, out, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void Sensors_SyncTime(void) {
+    if (sensorsProto == NULL || xSemaphoreTake(sensorDataMutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+    timeSyncPending = true;
+    xSemaphoreGive(sensorDataMutex);
+
+    uart_event_t event = {.type = SENSORS_EVENT_REQUEST};
+    xQueueSend(uart_queue, &event, 0);
+}
+
+ProtoErrorCode Sensors_SendRequest(void) {
+    ProtoErrorCode status = PROTO_SUCCESS;
+
+    if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) == pdTRUE) {
+        // The LSI of the sensors MCU drifts with temperature
+        if (Sensors_ProtoTimeMs() - timeSyncAt >= SENSORS_TIME_SYNC_PERIOD_MS) {
+            timeSyncPending = true;
+        }
+        // Built right before sending, never sequenced: it is late only by the time on the wire
+        if (timeSyncPending && Time_IsSet()) {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            ProtoTimeSyncPayload sync = {
+                .seconds = (uint32_t)now.tv_sec,
+                .milliseconds = (uint16_t)(now.tv_usec / 1000),
+            };
+            status = ProtoSend(sensorsProto, PROTO_MSG_TYPE_TIME_SYNC, sizeof(sync), (uint8_t *)&sync);
+            timeSyncAt = Sensors_ProtoTimeMs();
+        }
+        timeSyncPending = false;
+
+        // The configuration goes first, so that the samples requested already use it
+        if (status == PROTO_SUCCESS && configPending) {
+            status = ProtoSend(
+                sensorsProto, PROTO_MSG_TYPE_SENSOR_CONFIG, sizeof(sensorConfig), (uint8_t *)&sensorConfig);
+            // A full window frees up with the next acknowledgement, then the message is sent again
+            configPending = (status == PROTO_ERROR_BUSY);
+        }
+        if (status == PROTO_SUCCESS && requestPending) {
+            ProtoSensorRequestPayload request = {.count = requestCount};
+            status = ProtoSend(sensorsProto, PROTO_MSG_TYPE_SENSOR_REQUEST, sizeof(request), (uint8_t *)&request);
+            requestPending = (status == PROTO_ERROR_BUSY);
+        }
+        if (status == PROTO_SUCCESS) {
+            status = Sensors_SendFirmware();
+        }
+        xSemaphoreGive(sensorDataMutex);
+    }
+
+    return status;
+}
+
+esp_err_t Sensors_SetConfig(const ProtoSensorConfigPayload *config) {
+    esp_err_t status = ESP_OK;
+
+    if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ProtoSensorConfigPayload updated = sensorConfig;
+    if (config->samplePeriodMs != 0) {
+        updated.samplePeriodMs = config->samplePeriodMs;
+    }
+    if (config->accelOdr != PROTO_ACCEL_ODR_KEEP) {
+        updated.accelOdr = config->accelOdr;
+    }
+    if (config->accelScale != PROTO_ACCEL_SCALE_KEEP) {
+        updated.accelScale = config->accelScale;
+    }
+    if (config->humidityPrecision != PROTO_HUMIDITY_PRECISION_KEEP) {
+        updated.humidityPrecision = config->humidityPrecision;
+    }
+    if (config->batchSize != 0) {
+        updated.batchSize = config->batchSize;
+    }
+
+    // Every shadow carries the configuration: only changes are written and sent
+    bool changed = memcmp(&updated, &sensorConfig, sizeof(updated)) != 0;
+    if (changed) {
+        sensorConfig = updated;
+        configPending = true;
+        status = Flash_Save(PARTITION_USER, "sensors_cfg", &sensorConfig, sizeof(sensorConfig));
+    }
+    xSemaphoreGive(sensorDataMutex);
+
+    if (changed) {
+        uart_event_t event = {.type = SENSORS_EVENT_REQUEST};
+        xQueueSend(uart_queue, &event, 0);
+    }
+
+    return status;
+}
+
+esp_err_t Sensors_GetConfig(ProtoSensorConfigPayload *out) {
+    if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *out = sensorConfig;
+    xSemaphoreGive(sensorDataMutex);
+
+    return ESP_OK;
+}
+
+esp_err_t Sensors_GetLastSampleTime(TimestampSeconds *out) {
+    esp_err_t status = ESP_ERR_NOT_FOUND;
+
+    if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) == pdTRUE) {
+        if (sensorDataTime != 0) {
+            *out = sensorDataTime;
+            status = ESP_OK;
+        }
+        xSemaphoreGive(sensorDataMutex);
+    }
+
+    return status;
+}
+
 esp_err_t Sensors_GetLastData(SensorData *out) {
     esp_err_t status = ESP_ERR_NOT_ALLOWED;
 
@@ -65,6 +349,153 @@ esp_err_t Sensors_GetLastData(SensorData *out) {
     return status;
 }
 
+esp_err_t Sensors_GetLinkStatus(SensorsLinkStatus *out) {
+    if (sensorsProto == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Plain 32-bit reads: the counters may be a few frames apart, which is fine for diagnostics
+    out->baudRate = sensorsProto->state.baudRate;
+    out->proto = sensorsProto->state.stats;
+    out->hmacFailures = hmacFailures;
+    out->sampleAge = sampleAge;
+
+    return ESP_OK;
+}
+
+esp_err_t Sensors_StoreFirmwareChunk(size_t length, const uint8_t *data) {
+    SensorsFirmwareChunk chunk;
+
+    // The image goes to the sensors MCU once complete, like Sensors_StartUpdate nothing is taken before the link is up
+    if (sensorsProto == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (length < sizeof(chunk)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&chunk, data, sizeof(chunk));
+    const uint8_t *bytes = &data[sizeof(chunk)];
+    size_t count = length - sizeof(chunk);
+
+    if (chunk.image.length == 0 || chunk.image.length > SENSORS_FIRMWARE_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // The first piece starts over, whatever was received before
+    if (chunk.offset == 0) {
+        free(upload);
+        upload = malloc(chunk.image.length);
+        if (upload == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        uploadImage = chunk.image;
+        uploadReceived = 0;
+    }
+    // A piece of another image, or a gap: QoS 0 does not retransmit, the backend publishes the image again
+    if (upload == NULL || memcmp(&chunk.image, &uploadImage, sizeof(uploadImage)) != 0 ||
+        chunk.offset != uploadReceived || count > uploadImage.length - uploadReceived) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&upload[uploadReceived], bytes, count);
+    uploadReceived += count;
+    if (uploadReceived < uploadImage.length) {
+        return ESP_OK;
+    }
+
+    // Checked here too: the sensors MCU would only refuse it after the whole transfer
+    esp_err_t status = ESP_ERR_INVALID_CRC;
+    if (FwUpdateVerify(upload, uploadImage.length, uploadImage.signature, signingKey)) {
+        status = Flash_Save(PARTITION_USER, "sensors_fw_hdr", &uploadImage, sizeof(uploadImage));
+    }
+    if (status == ESP_OK) {
+        status = Flash_Save(PARTITION_USER, "sensors_fw", upload, uploadImage.length);
+    }
+    free(upload);
+    upload = NULL;
+    uploadReceived = 0;
+
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Sensors MCU image refused (%s)", esp_err_to_name(status));
+        return status;
+    }
+    ESP_LOGI(TAG,
+             "Sensors MCU image %u.%u.%u received (%" PRIu32 " bytes)",
+             uploadImage.version[0],
+             uploadImage.version[1],
+             uploadImage.version[2],
+             uploadImage.length);
+
+    return Sensors_StartUpdate();
+}
+
+esp_err_t Sensors_StartUpdate(void) {
+    ProtoFwBeginPayload image;
+
+    if (sensorsProto == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!Flash_Exists(PARTITION_USER, "sensors_fw_hdr") || !Flash_Exists(PARTITION_USER, "sensors_fw")) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_RETURN_ON_ERROR(Flash_Load(PARTITION_USER, "sensors_fw_hdr", &image, sizeof(image)), TAG, "No image header");
+    if (image.length == 0 || image.length > SENSORS_FIRMWARE_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *loaded = malloc(image.length);
+    if (loaded == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t status = Flash_Load(PARTITION_USER, "sensors_fw", loaded, image.length);
+    if (status != ESP_OK) {
+        free(loaded);
+        return status;
+    }
+
+    if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) != pdTRUE) {
+        free(loaded);
+        return ESP_ERR_TIMEOUT;
+    }
+    free(firmware);
+    firmware = loaded;
+    firmwareImage = image;
+    memset(&update, 0, sizeof(update));
+    update.state = PROTO_FW_STATE_RECEIVING;
+    update.length = image.length;
+    // The application restarts into the bootloader when it receives the announcement, which the bootloader gets again
+    beginPending = true;
+    blocksAccepted = false;
+    nextBlock = 0;
+    updateRetries = 0;
+    updateStartedAt = Sensors_ProtoTimeMs();
+    updateActivityAt = updateStartedAt;
+    xSemaphoreGive(sensorDataMutex);
+
+    uart_event_t event = {.type = SENSORS_EVENT_REQUEST};
+    xQueueSend(uart_queue, &event, 0);
+
+    return ESP_OK;
+}
+
+esp_err_t Sensors_GetUpdateStatus(SensorsUpdateStatus *out) {
+    if (sensorDataMutex == NULL || xSemaphoreTake(sensorDataMutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *out = update;
+    if (update.state == PROTO_FW_STATE_RECEIVING) {
+        out->elapsedMs = Sensors_ProtoTimeMs() - updateStartedAt;
+    }
+    // Between two statuses, the blocks acknowledged by the window
+    if (update.state == PROTO_FW_STATE_RECEIVING && blocksAccepted) {
+        uint8_t inFlight = sensorsProto->state.txNext - sensorsProto->state.txBase;
+        uint32_t acked = (nextBlock > inFlight) ? nextBlock - inFlight : 0;
+        out->written = MAX(out->written, MIN(acked * PROTO_FW_BLOCK_LEN, update.length));
+    }
+    xSemaphoreGive(sensorDataMutex);
+
+    return ESP_OK;
+}
+
 esp_err_t Sensors_SaveData() {
     if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) == pdTRUE) {
         esp_err_t status = Flash_Save(PARTITION_USER, "sensors", &sensorData, sizeof(SensorData));
@@ -95,60 +526,383 @@ static int Sensors_ProtoWrite(void *writeCtx, size_t length, const uint8_t *data
  * @brief Implementation for `ProtoCtx.read`
  */
 static int Sensors_ProtoRead(void *readCtx, size_t length, uint8_t *data) {
-    return uart_read_bytes(UART_NUM_2, data, length, 100);
+    size_t buffered = 0;
+
+    if (uart_get_buffered_data_len(UART_NUM_2, &buffered) != ESP_OK) {
+        return -1;
+    }
+
+    // Never block here: Task_Sensors waits on the driver events instead
+    if (buffered == 0) {
+        return 0;
+    }
+
+    // Take everything the driver holds in a single call
+    return uart_read_bytes(UART_NUM_2, data, MIN(length, buffered), 0);
+}
+
+/**
+ * @brief Implementation for `ProtoCtx.getTimeMs`
+ */
+static uint32_t Sensors_ProtoTimeMs(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/**
+ * @brief Implementation for `ProtoCtx.setBaudRate`
+ */
+static int Sensors_ProtoSetBaudRate(void *writeCtx, uint32_t baudRate) {
+    // The frame queued last must leave at the old rate
+    if (uart_wait_tx_done(UART_NUM_2, pdMS_TO_TICKS(100)) != ESP_OK) {
+        return -1;
+    }
+
+    return (uart_set_baudrate(UART_NUM_2, baudRate) == ESP_OK) ? 0 : -1;
+}
+
+/**
+ * @brief Adds the age of a sample to the `sampleAge` histogram
+ *
+ * @param synced Whether `timestampMs` is a Unix time
+ * @param timestampMs When the sample was taken, in milliseconds
+ */
+static void Sensors_RecordSampleAge(bool synced, uint64_t timestampMs) {
+    if (synced && Time_IsSet()) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        uint64_t nowMs = (uint64_t)now.tv_sec * 1000u + now.tv_usec / 1000;
+
+        ProtoHistogramAdd(&sampleAge, (nowMs > timestampMs) ? (uint32_t)MIN(nowMs - timestampMs, UINT32_MAX) : 0);
+        return;
+    }
+
+    // Clock offset plus latency: the smallest one seen is taken as the offset alone
+    uint32_t delay = Sensors_ProtoTimeMs() - (uint32_t)timestampMs;
+
+    if (!sampleMinDelayValid || (int32_t)(delay - sampleMinDelay) < 0) {
+        sampleMinDelay = delay;
+        sampleMinDelayValid = true;
+    }
+    ProtoHistogramAdd(&sampleAge, delay - sampleMinDelay);
 }
 
-static void printData(SensorPayload *payload) {
+static void printData(const SensorData *data) {
     ESP_LOGD(TAG,
-             "temp: %.3f\thum: %.3f\taccel: % 0.3fg (x) % 0.3fg (y) % 0.3fg (z)",
-             payload->data.temperature / 1000.0,
-             payload->data.humidity / 1000.0,
-             payload->data.acceleration_mg[0] / 1000.0,
-             payload->data.acceleration_mg[1] / 1000.0,
-             payload->data.acceleration_mg[2] / 1000.0);
+             "temp: %.2f\thum: %.2f\taccel: % 0.3fg (x) % 0.3fg (y) % 0.3fg (z)",
+             data->temperature / 100.0,
+             data->humidity / 100.0,
+             PayloadAccelerationMg(data->acceleration[0], data->accelScale) / 1000.0,
+             PayloadAccelerationMg(data->acceleration[1], data->accelScale) / 1000.0,
+             PayloadAccelerationMg(data->acceleration[2], data->accelScale) / 1000.0);
+}
+
+/**
+ * @brief Converts a sample of the sensors MCU firmwares sending a single `SensorPayload`. The acceleration gets the
+ * smallest full scale that holds it
+ */
+static void Sensors_FromV1(const SensorDataV1 *in, SensorData *out) {
+    float peak = 0.0f;
+    for (size_t i = 0; i < 3; i++) {
+        peak = MAX(peak, fabsf(in->acceleration_mg[i]));
+    }
+
+    uint8_t scale = PROTO_ACCEL_SCALE_2G;
+    while (scale < PROTO_ACCEL_SCALE_16G && PayloadAccelerationMg(INT16_MAX, scale) < peak) {
+        scale++;
+    }
+    // milli-g of a 12-bit digit, i.e. of 16 counts
+    float mgPerDigit = (float)PayloadAccelerationMg(16, scale);
+
+    memset(out, 0, sizeof(*out));
+    out->temperature = (int16_t)(in->temperature / 10);
+    out->humidity = (int16_t)(in->humidity / 10);
+    out->accelScale = scale;
+    for (size_t i = 0; i < 3; i++) {
+        float counts = roundf(in->acceleration_mg[i] * 16.0f / mgPerDigit);
+        out->acceleration[i] = (int16_t)MIN(MAX(counts, (float)INT16_MIN), (float)INT16_MAX);
+    }
 }
 
 static void printPayload(uint8_t *payload) {
     size_t offset = 0;
 
     ESP_LOG_LINE_BEGIN(ESP_LOG_VERBOSE, TAG, "data[ ");
-    for (offset = 0; offset < sizeof(SensorData); offset++) {
+    for (offset = 0; offset < sizeof(SensorDataV1); offset++) {
         ESP_LOG_LINE(TAG, "%02x ", *(payload + offset));
     }
     ESP_LOG_LINE(TAG, "]\t");
 
     ESP_LOG_LINE(TAG, "hash[ ");
     for (offset = 0; offset < 32; offset++) {
-        ESP_LOG_LINE(TAG, "%02x ", *(payload + sizeof(SensorData) + offset));
+        ESP_LOG_LINE(TAG, "%02x ", *(payload + sizeof(SensorDataV1) + offset));
     }
     ESP_LOG_LINE_END(TAG, "]");
 }
 
+/**
+ * @brief Ends the update. The image is erased once written, or refused by the sensors MCU. It is kept if the sensors
+ * MCU stopped answering, for `Sensors_StartUpdate` or the next boot to try again
+ */
+static void Sensors_EndUpdate(uint8_t state, uint8_t error) {
+    update.state = state;
+    update.error = error;
+    update.elapsedMs = Sensors_ProtoTimeMs() - updateStartedAt;
+    free(firmware);
+    firmware = NULL;
+    if (state == PROTO_FW_STATE_DONE || error != PROTO_FW_ERROR_NONE) {
+        Flash_Erase(PARTITION_USER, "sensors_fw_hdr");
+        Flash_Erase(PARTITION_USER, "sensors_fw");
+    }
+
+    if (state == PROTO_FW_STATE_DONE) {
+        ESP_LOGI(TAG, "Sensors MCU updated: %" PRIu32 " bytes in %" PRIu32 " ms", update.length, update.elapsedMs);
+    } else {
+        ESP_LOGW(TAG, "Sensors MCU update failed (error %u)", error);
+    }
+}
+
+/**
+ * @brief Tells whether a block of the update can be sent right away. Plain reads, as `Sensors_GetLinkStatus`: a stale
+ * answer only costs a wait or a `PROTO_ERROR_BUSY`
+ */
+static bool Sensors_FirmwareReady(void) {
+    if (sensorsProto == NULL || update.state != PROTO_FW_STATE_RECEIVING || !blocksAccepted) {
+        return false;
+    }
+
+    uint8_t inFlight = sensorsProto->state.txNext - sensorsProto->state.txBase;
+    return nextBlock < FW_UPDATE_BLOCKS(firmwareImage.length) && inFlight < sensorsProto->state.window;
+}
+
+/**
+ * @brief Announces the image, or sends the next blocks until the window is full. Must hold `sensorDataMutex`
+ */
+static ProtoErrorCode Sensors_SendFirmware(void) {
+    ProtoErrorCode status = PROTO_SUCCESS;
+
+    if (update.state != PROTO_FW_STATE_RECEIVING) {
+        return PROTO_SUCCESS;
+    }
+
+    // A lost status, or a sensors MCU stuck in its application: announce the image again
+    if (Sensors_ProtoTimeMs() - updateActivityAt >= SENSORS_UPDATE_TIMEOUT_MS) {
+        if (++updateRetries > SENSORS_UPDATE_MAX_RETRIES) {
+            Sensors_EndUpdate(PROTO_FW_STATE_FAILED, PROTO_FW_ERROR_NONE);
+            return PROTO_SUCCESS;
+        }
+        beginPending = true;
+        blocksAccepted = false;
+        updateActivityAt = Sensors_ProtoTimeMs();
+    }
+
+    if (beginPending) {
+        status = ProtoSend(sensorsProto, PROTO_MSG_TYPE_FW_BEGIN, sizeof(firmwareImage), (uint8_t *)&firmwareImage);
+        beginPending = (status == PROTO_ERROR_BUSY);
+        return status;
+    }
+
+    // Blocks only go to the bootloader, once it accepted the image
+    uint32_t blocks = FW_UPDATE_BLOCKS(firmwareImage.length);
+    while (blocksAccepted && nextBlock < blocks) {
+        uint32_t offset = nextBlock * PROTO_FW_BLOCK_LEN;
+        size_t length = MIN(PROTO_FW_BLOCK_LEN, firmwareImage.length - offset);
+        ProtoFwBlockHeader header = {
+            .index = (uint16_t)nextBlock,
+            .crc = Crc16(length, &firmware[offset]),
+        };
+        ProtoSegment segments[] = {
+            {.data = (const uint8_t *)&header, .length = sizeof(header)},
+            {.data = &firmware[offset], .length = length},
+        };
+
+        // Sent straight from the image, the window keeps its own copy
+        status = ProtoSendv(sensorsProto, PROTO_MSG_TYPE_FW_BLOCK, 2, segments);
+        if (status != PROTO_SUCCESS) {
+            break;
+        }
+        nextBlock++;
+        // Room in the window means the blocks before were acknowledged
+        updateActivityAt = Sensors_ProtoTimeMs();
+    }
+
+    return status;
+}
+
+/**
+ * @brief Follows the status reported by the bootloader
+ */
+static void Sensors_FirmwareStatus(const ProtoFwStatusPayload *status) {
+    if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+    if (update.state != PROTO_FW_STATE_RECEIVING) {
+        xSemaphoreGive(sensorDataMutex);
+        return;
+    }
+
+    updateActivityAt = Sensors_ProtoTimeMs();
+    update.written = MIN((uint32_t)status->nextBlock * PROTO_FW_BLOCK_LEN, update.length);
+    update.error = status->error;
+
+    switch (status->state) {
+    case PROTO_FW_STATE_RECEIVING:
+        // Accepted, resumed or refused a block: go on from the first block missing
+        if (status->error != PROTO_FW_ERROR_NONE && ++updateRetries > SENSORS_UPDATE_MAX_RETRIES) {
+            Sensors_EndUpdate(PROTO_FW_STATE_FAILED, status->error);
+            break;
+        }
+        if (status->error == PROTO_FW_ERROR_NONE) {
+            updateRetries = 0;
+        }
+        blocksAccepted = true;
+        nextBlock = status->nextBlock;
+        break;
+    case PROTO_FW_STATE_DONE:
+        update.written = update.length;
+        Sensors_EndUpdate(PROTO_FW_STATE_DONE, PROTO_FW_ERROR_NONE);
+        break;
+    case PROTO_FW_STATE_FAILED:
+        Sensors_EndUpdate(PROTO_FW_STATE_FAILED, status->error);
+        break;
+    default:
+        // The bootloader restarted and lost the announcement
+        beginPending = true;
+        blocksAccepted = false;
+        break;
+    }
+    xSemaphoreGive(sensorDataMutex);
+}
+
 /**
  * @brief Implementation for `ProtoCtx.messageCallback`
  */
-static void Sensors_MsgCallback(void *cbCtx, ProtoMsgType msgType, uint8_t *payload) {
-    FactoryData *factoryData = (FactoryData *)cbCtx;
-    bool verified = PayloadVerify((SensorPayload *)payload, factoryData->key, HMAC_KEY_LENGTH);
+static void Sensors_MsgCallback(void *cbCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload) {
+    const HmacKeyCtx *key = (const HmacKeyCtx *)cbCtx;
+
+    // The link is negotiated by the protocol itself, pings carry no sensor data
+    if (msgType == PROTO_MSG_TYPE_PING) {
+        ESP_LOGI(TAG, "Connected to sensors MCU");
+
+        // The sensors MCU may have restarted, its clock offset is measured again and its RTC set
+        sampleMinDelayValid = false;
+
+        // A restart also dropped the configuration and the request in progress: send them again
+        if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) == pdTRUE) {
+            ProtoSensorConfigPayload unset = {0};
+            configPending = memcmp(&sensorConfig, &unset, sizeof(unset)) != 0;
+            timeSyncPending = true;
+            if (samplesMissing > 0 && (sensorsProto->state.features & PROTO_FEATURE_PULL)) {
+                requestPending = true;
+                requestCount = (uint8_t)samplesMissing;
+            }
+            // The application restarts into the bootloader, the bootloader answers with where to resume
+            if (update.state == PROTO_FW_STATE_RECEIVING) {
+                beginPending = true;
+                blocksAccepted = false;
+                updateActivityAt = Sensors_ProtoTimeMs();
+            }
+            xSemaphoreGive(sensorDataMutex);
+        }
+
+        // The master drives the baud rate negotiation
+        ProtoErrorCode status = ProtoBaudStart(sensorsProto);
+        if (status != PROTO_SUCCESS && status != PROTO_ERROR_INVALID_STATE) {
+            ESP_LOGW(TAG, "Could not start the baud rate negotiation (0x%02x)", status);
+        }
+        return;
+    }
+
+    // Not authenticated either: an event only makes the uplink report sooner
+    if (msgType == PROTO_MSG_TYPE_EVENT && payloadLength >= sizeof(ProtoEventPayload)) {
+        ProtoEventPayload event;
+        memcpy(&event, payload, sizeof(event));
+        ESP_LOGW(TAG, "Sensors MCU event %u (detail %u)", event.type, event.detail);
+
+        // The oldest event makes room: the report reads the current state anyway
+        if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+            ProtoEventPayload dropped;
+            xQueueReceive(eventQueue, &dropped, 0);
+            xQueueSend(eventQueue, &event, 0);
+        }
+        return;
+    }
+
+    // Not authenticated: the bootloader checks the signature of the image itself
+    if (msgType == PROTO_MSG_TYPE_FW_STATUS && payloadLength >= sizeof(ProtoFwStatusPayload)) {
+        ProtoFwStatusPayload status;
+        memcpy(&status, payload, sizeof(status));
+        Sensors_FirmwareStatus(&status);
+        return;
+    }
+
+    // Status answer to an unsequenced request, not authenticated
+    if (msgType == PROTO_MSG_TYPE_RESPONSE && payloadLength == 1) {
+        ESP_LOGV(TAG, "Sensors MCU answered 0x%02x", payload[0]);
+        return;
+    }
+
+    bool verified = false;
+    if (msgType == PROTO_MSG_TYPE_SENSOR_BATCH) {
+        SensorBatch *batch = (SensorBatch *)payload;
+        verified = payloadLength >= offsetof(SensorBatch, samples) &&
+                   payloadLength == SENSOR_BATCH_LENGTH(batch->count) &&
+                   PayloadBatchVerify(batch, key);
+    } else {
+        verified = payloadLength == sizeof(SensorPayload) && PayloadVerify((SensorPayload *)payload, key);
+    }
     ESP_LOGV(TAG, "Received message of type 0x%02x: payload is %s", msgType, verified ? "verified" : "invalid");
     if (!verified) {
+        hmacFailures++;
         ESP_LOGD(TAG, "Discarding invalid message of type 0x%02x", msgType);
         return;
     }
 
     switch (msgType) {
-    case PROTO_MSG_TYPE_PING:
-        ESP_LOGI(TAG, "Connected to sensors MCU");
-        break;
-    case PROTO_MSG_TYPE_RESPONSE:
+    case PROTO_MSG_TYPE_RESPONSE: {
+        SensorData converted;
         printPayload(payload);
-        printData((SensorPayload *)payload);
+        Sensors_FromV1(&((SensorPayload *)payload)->data, &converted);
+        printData(&converted);
 
         if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) == pdTRUE) {
-            sensorData = ((SensorPayload *)payload)->data;
+            sensorData = converted;
+            sensorDataTime = 0;
             xSemaphoreGive(sensorDataMutex);
         }
         break;
+    }
+    case PROTO_MSG_TYPE_SENSOR_BATCH: {
+        SensorBatch *batch = (SensorBatch *)payload;
+        const uint16_t *offsets = SENSOR_BATCH_OFFSETS(batch);
+        bool synced = (batch->flags & SENSOR_BATCH_FLAG_SYNCED) != 0;
+        uint64_t timestampMs = 0;
+
+        for (uint8_t i = 0; i < batch->count; i++) {
+            timestampMs = batch->epoch * 1000ull + offsets[i] * SENSOR_BATCH_OFFSET_MS;
+            ESP_LOGV(TAG,
+                     "Sample %u/%u taken at %" PRIu64 " ms (%s)",
+                     i + 1,
+                     batch->count,
+                     timestampMs,
+                     synced ? "unix" : "uptime");
+            printData(&batch->samples[i]);
+            Sensors_RecordSampleAge(synced, timestampMs);
+        }
+
+        // Only the most recent sample is kept
+        if (xSemaphoreTake(sensorDataMutex, portMAX_DELAY) == pdTRUE) {
+            sensorData = batch->samples[batch->count - 1];
+            sensorDataTime = synced ? (TimestampSeconds)(timestampMs / 1000u) : 0;
+            if (samplesMissing > 0) {
+                samplesMissing -= MIN(samplesMissing, batch->count);
+                if (samplesMissing == 0) {
+                    xSemaphoreGive(samplesReady);
+                }
+            }
+            xSemaphoreGive(sensorDataMutex);
+        }
+        break;
+    }
     default:
         break;
     }
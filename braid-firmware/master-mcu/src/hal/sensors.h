@@ -1,13 +1,60 @@
 #pragma once
 
+#include <driver/gpio.h>
+
+#include "core/time.h"
 #include "proto.h"
 
 #define SENSORS_UART_BUFFER_SIZE (2048u)
+/** Highest baud rate proposed to the sensors MCU */
+#define SENSORS_UART_MAX_BAUD_RATE (2000000u)
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * @brief State of the UART link towards the sensors MCU
+ */
+typedef struct SensorsLinkStatus {
+    /** Current baud rate */
+    uint32_t baudRate;
+    /** Counters of the protocol layer */
+    ProtoStats proto;
+    /** Messages dropped because their HMAC did not match */
+    uint32_t hmacFailures;
+    /** Time between sampling and reception of the sensor samples, in milliseconds. Until the sensors MCU clock is
+     * synchronized, ages are relative to the fastest sample seen since the last connection */
+    ProtoHistogram sampleAge;
+} SensorsLinkStatus;
+
+/**
+ * @brief Piece of a sensors MCU image, as published on `MQTT_TOPIC_SENSORS_FIRMWARE`, followed by its data. Pieces
+ * are published in order, and must fit a single MQTT message
+ */
+typedef struct SensorsFirmwareChunk {
+    /** Announcement of the whole image, the same in every piece */
+    ProtoFwBeginPayload image;
+    /** Offset of the data in the image */
+    uint32_t offset;
+} __attribute__((packed)) SensorsFirmwareChunk;
+
+/**
+ * @brief Progress of the update of the sensors MCU firmware
+ */
+typedef struct SensorsUpdateStatus {
+    /** A `ProtoFwState`, `PROTO_FW_STATE_IDLE` if no update was started */
+    uint8_t state;
+    /** Last `ProtoFwError` reported by the sensors MCU */
+    uint8_t error;
+    /** Bytes of the image acknowledged by the sensors MCU */
+    uint32_t written;
+    /** Length of the image */
+    uint32_t length;
+    /** Time since the update started, or what it took once over, in milliseconds */
+    uint32_t elapsedMs;
+} SensorsUpdateStatus;
+
 /**
  * @brief Initializes the UART connecion towards the sensors MCU
  *
@@ -19,6 +66,82 @@ extern "C" {
  */
 esp_err_t Sensors_UARTInit(ProtoCtx *protoCtx, int uartNum, gpio_num_t txPin, gpio_num_t rxPin);
 
+/**
+ * @brief Blocks until the UART driver reports received bytes, or the timeout expires. Returns right away while blocks
+ * of a firmware update wait for room in the window
+ *
+ * @param timeoutMs Maximum time to wait, in milliseconds
+ * @return `true` if there may be bytes to read
+ */
+bool Sensors_WaitForData(uint32_t timeoutMs);
+
+/**
+ * @brief Asks the sensors MCU for new samples. The request is sent by the task running the link, see
+ * `Sensors_SendRequest`. Replaces a request still in progress
+ *
+ * @param count Number of samples, the first one is taken right away
+ * @return `ESP_ERR_NOT_SUPPORTED` if the sensors MCU does not support pull mode: it samples continuously anyway
+ */
+esp_err_t Sensors_RequestSamples(uint8_t count);
+
+/**
+ * @brief Blocks until all the samples asked with `Sensors_RequestSamples` are received
+ *
+ * @param timeoutMs Maximum time to wait, in milliseconds
+ * @return `ESP_ERR_TIMEOUT` if the samples did not arrive in time
+ */
+esp_err_t Sensors_WaitForSamples(uint32_t timeoutMs);
+
+/**
+ * @brief Blocks until the sensors MCU reports an event. Events are acknowledged by the protocol as soon as they arrive,
+ * and queued here for the task reporting them
+ *
+ * @param[out] out The event
+ * @param timeoutMs Maximum time to wait, in milliseconds
+ * @return `ESP_ERR_TIMEOUT` if no event arrived in time
+ */
+esp_err_t Sensors_WaitForEvent(ProtoEventPayload *out, uint32_t timeoutMs);
+
+/**
+ * @brief Sends the time, the configuration and the request queued by `Sensors_SyncTime`, `Sensors_SetConfig` and
+ * `Sensors_RequestSamples`, if any, then as many blocks of a firmware update as the window takes. Must be called by
+ * the task running the link
+ *
+ * @return The `ProtoSend` status. What was not sent stays queued on `PROTO_ERROR_BUSY`
+ */
+ProtoErrorCode Sensors_SendRequest(void);
+
+/**
+ * @brief Changes how the sensors MCU samples. The configuration is saved to flash and sent again every time the
+ * sensors MCU connects
+ *
+ * @param[in] config The fields to change, those set to `0` are kept
+ * @return `ESP_OK` if the configuration was saved, otherwise a relevant error code
+ */
+esp_err_t Sensors_SetConfig(const ProtoSensorConfigPayload *config);
+
+/**
+ * @brief Copies the sampling configuration into the given struct. Fields never set are `0`
+ *
+ * @param[out] out Reference to the configuration to initialize
+ * @return `ESP_ERR_TIMEOUT` if the configuration could not be read
+ */
+esp_err_t Sensors_GetConfig(ProtoSensorConfigPayload *out);
+
+/**
+ * @brief Sends the system time to the sensors MCU, which timestamps its samples with it. Also done when the sensors
+ * MCU connects and periodically, to be called when the system time is set
+ */
+void Sensors_SyncTime(void);
+
+/**
+ * @brief Tells when the most recent sensor data was sampled
+ *
+ * @param[out] out Unix time of the sample, in seconds
+ * @return `ESP_ERR_NOT_FOUND` if the sample has no synchronized timestamp
+ */
+esp_err_t Sensors_GetLastSampleTime(TimestampSeconds *out);
+
 /**
  * @brief Copies the most recent sensor data into the given struct
  *
@@ -27,6 +150,42 @@ esp_err_t Sensors_UARTInit(ProtoCtx *protoCtx, int uartNum, gpio_num_t txPin, gp
  */
 esp_err_t Sensors_GetLastData(SensorData *out);
 
+/**
+ * @brief Copies the state of the link towards the sensors MCU into the given struct
+ *
+ * @param[out] out Reference to the status to initialize
+ * @return `ESP_ERR_INVALID_STATE` if the link was not initialized
+ */
+esp_err_t Sensors_GetLinkStatus(SensorsLinkStatus *out);
+
+/**
+ * @brief Adds a piece of a sensors MCU image received over MQTT. Once the image is complete and its signature
+ * verified, it is saved to flash and the update starts
+ *
+ * @param length Length of the message
+ * @param[in] data The message, a `SensorsFirmwareChunk` followed by its data
+ * @return `ESP_ERR_INVALID_ARG` if a piece is missing: the image must be published again from the start
+ * @return `ESP_ERR_INVALID_CRC` if the signature of the complete image does not match
+ * @return `ESP_ERR_INVALID_STATE` if the link was not initialized
+ */
+esp_err_t Sensors_StoreFirmwareChunk(size_t length, const uint8_t *data);
+
+/**
+ * @brief Streams the image saved to flash to the sensors MCU, which restarts into its bootloader to receive it. The
+ * transfer resumes where it stopped if the link or either side restarts, also when the master boots
+ *
+ * @return `ESP_ERR_NOT_FOUND` if no image was saved
+ */
+esp_err_t Sensors_StartUpdate(void);
+
+/**
+ * @brief Copies the progress of the sensors MCU update into the given struct
+ *
+ * @param[out] out Reference to the status to initialize
+ * @return `ESP_ERR_TIMEOUT` if the status could not be read
+ */
+esp_err_t Sensors_GetUpdateStatus(SensorsUpdateStatus *out);
+
 /**
  * @brief Writes sensors data to flash
  *
@@ -22,6 +22,7 @@ static const char *TAG = "main";
 static Boot_Mode bootMode = BOOT_GPS;
 ProtoCtx protoCtx;
 FactoryData factoryData;
+HmacKeyCtx sensorsKey;
 
 static ATCAIfaceCfg cfg_ateccx08a_i2c = {
     ATCA_I2C_IFACE, ATECC608A, CONFIG_ATCA_I2C_ADDRESS, 0, CONFIG_ATCA_I2C_BAUD_RATE, 1500, 20, NULL};
@@ -63,7 +64,9 @@ extern "C" void app_main() {
     case BOOT_GPS:
         // fall through
     case BOOT_MQTT:
-        protoCtx.messageCallbackCtx = &factoryData;
+        // Every sample is verified with the key: its states are derived once and for all
+        Crypto_HMACKeyInit(&sensorsKey, factoryData.key, HMAC_KEY_LENGTH);
+        protoCtx.messageCallbackCtx = &sensorsKey;
 
         ESP_ERROR_CHECK(Hal_Setup(bootMode));
     }
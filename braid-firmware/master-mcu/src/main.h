@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/factory_data.h"
+#include "crypto_hmac.h"
 #include "defines.h"
 #include "proto.h"
 
@@ -10,6 +11,8 @@ extern "C" {
 
 extern ProtoCtx protoCtx;
 extern FactoryData factoryData;
+/** @brief The HMAC key of `factoryData`, shared with the sensors MCU */
+extern HmacKeyCtx sensorsKey;
 
 void errorHandler();
 
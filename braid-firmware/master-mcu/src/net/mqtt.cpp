@@ -43,6 +43,7 @@ static const char *topicsSub[] = {
     [MQTT_TOPIC_DESIRED] = "shadow/desired",
     [MQTT_TOPIC_DESIRED_BATCH] = "shadow/desired/batch",
     [MQTT_TOPIC_COMMAND_SUB] = "command",
+    [MQTT_TOPIC_SENSORS_FIRMWARE] = "sensors/firmware",
 };
 
 static void Mqtt_UnknownTopicHandler(const uint8_t *data, size_t length) {
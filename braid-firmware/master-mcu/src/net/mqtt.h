@@ -33,6 +33,7 @@ typedef enum Mqtt_TopicSub {
     MQTT_TOPIC_DESIRED,
     MQTT_TOPIC_DESIRED_BATCH,
     MQTT_TOPIC_COMMAND_SUB,
+    MQTT_TOPIC_SENSORS_FIRMWARE,
 } Mqtt_TopicSub;
 
 /**
@@ -1,5 +1,6 @@
 #include "cbor.h"
 #include "esp_err.h"
+#include <sys/param.h>
 
 #include "build_config.h"
 #include "core/time.h"
@@ -9,8 +10,121 @@
     (XSTR(CFG_FW_VERSION_MAJOR) "." XSTR(CFG_FW_VERSION_MINOR) "." XSTR(CFG_FW_VERSION_PATCH) "-" XSTR(                \
         CFG_FW_VERSION_COMMIT))
 
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+// Layout of the reported samples: 2 has hundredths for TEMP and HUMID, raw counts and ACC_SCALE for the acceleration
+#define SHADOW_SENSOR_DATA_VERSION 2
+
 static const char *TAG = "net/shadow";
 
+// Shadow values of the sensor configuration enums, indexed by the enum
+static const uint16_t accelOdrHz[] = {
+    [PROTO_ACCEL_ODR_1HZ] = 1,
+    [PROTO_ACCEL_ODR_10HZ] = 10,
+    [PROTO_ACCEL_ODR_25HZ] = 25,
+    [PROTO_ACCEL_ODR_50HZ] = 50,
+    [PROTO_ACCEL_ODR_100HZ] = 100,
+    [PROTO_ACCEL_ODR_200HZ] = 200,
+    [PROTO_ACCEL_ODR_400HZ] = 400,
+};
+static const uint16_t accelScaleG[] = {
+    [PROTO_ACCEL_SCALE_2G] = 2,
+    [PROTO_ACCEL_SCALE_4G] = 4,
+    [PROTO_ACCEL_SCALE_8G] = 8,
+    [PROTO_ACCEL_SCALE_16G] = 16,
+};
+// Shadow names of the sensors MCU events, indexed by `ProtoEventType`
+static const char *eventNames[] = {
+    [PROTO_EVENT_TAMPER] = "TAMPER",
+    [PROTO_EVENT_SHOCK] = "SHOCK",
+    [PROTO_EVENT_SENSOR_FAULT] = "SENSOR_FAULT",
+};
+
+/**
+ * @brief Finds the enum value encoded in the shadow as `value`, `0` (keep) if there is none
+ */
+static uint8_t Shadow_FindEnum(const uint16_t *table, size_t length, int64_t value) {
+    for (size_t i = 1; i < length; i++) {
+        if (table[i] == value) {
+            return (uint8_t)i;
+        }
+    }
+
+    ESP_LOGW(TAG, "Unsupported value %lld", value);
+    return 0;
+}
+
+static void Shadow_SensorConfigEncode(CborEncoder *pl, const ProtoSensorConfigPayload *config) {
+    if (config->samplePeriodMs != 0) {
+        cbor_encode_text_stringz(pl, "PERIOD");
+        cbor_encode_uint(pl, config->samplePeriodMs);
+    }
+    if (config->accelOdr != PROTO_ACCEL_ODR_KEEP && config->accelOdr < ARRAY_SIZE(accelOdrHz)) {
+        cbor_encode_text_stringz(pl, "ACC_ODR");
+        cbor_encode_uint(pl, accelOdrHz[config->accelOdr]);
+    }
+    if (config->accelScale != PROTO_ACCEL_SCALE_KEEP && config->accelScale < ARRAY_SIZE(accelScaleG)) {
+        cbor_encode_text_stringz(pl, "ACC_FS");
+        cbor_encode_uint(pl, accelScaleG[config->accelScale]);
+    }
+    if (config->humidityPrecision != PROTO_HUMIDITY_PRECISION_KEEP) {
+        cbor_encode_text_stringz(pl, "HUMID_LP");
+        cbor_encode_uint(pl, config->humidityPrecision == PROTO_HUMIDITY_PRECISION_LOW);
+    }
+    if (config->batchSize != 0) {
+        cbor_encode_text_stringz(pl, "BATCH");
+        cbor_encode_uint(pl, config->batchSize);
+    }
+}
+
+#if CFG_SHADOW_LINK_STATS
+static void Shadow_HistogramEncode(CborEncoder *parent, const ProtoHistogram *histogram) {
+    CborEncoder buckets;
+    cbor_encoder_create_array(parent, &buckets, PROTO_HISTOGRAM_BUCKETS);
+
+    for (uint32_t i = 0; i < PROTO_HISTOGRAM_BUCKETS; i++) {
+        cbor_encode_uint(&buckets, histogram->buckets[i]);
+    }
+
+    cbor_encoder_close_container(parent, &buckets);
+}
+
+static void Shadow_LinkEncode(CborEncoder *parent, const SensorsLinkStatus *link) {
+    CborEncoder lk;
+    cbor_encoder_create_map(parent, &lk, CborIndefiniteLength);
+
+    cbor_encode_text_stringz(&lk, "BAUD");
+    cbor_encode_uint(&lk, link->baudRate);
+    cbor_encode_text_stringz(&lk, "RX_B");
+    cbor_encode_uint(&lk, link->proto.rxBytes);
+    cbor_encode_text_stringz(&lk, "TX_B");
+    cbor_encode_uint(&lk, link->proto.txBytes);
+    cbor_encode_text_stringz(&lk, "RX_F");
+    cbor_encode_uint(&lk, link->proto.rxFrames);
+    cbor_encode_text_stringz(&lk, "TX_F");
+    cbor_encode_uint(&lk, link->proto.txFrames);
+    cbor_encode_text_stringz(&lk, "RETX");
+    cbor_encode_uint(&lk, link->proto.retransmits);
+    cbor_encode_text_stringz(&lk, "CRC_ERR");
+    cbor_encode_uint(&lk, link->proto.crcErrors);
+    cbor_encode_text_stringz(&lk, "RESYNC");
+    cbor_encode_uint(&lk, link->proto.resyncs);
+    cbor_encode_text_stringz(&lk, "DISCARD");
+    cbor_encode_uint(&lk, link->proto.discardedBytes);
+    cbor_encode_text_stringz(&lk, "HMAC_ERR");
+    cbor_encode_uint(&lk, link->hmacFailures);
+    cbor_encode_text_stringz(&lk, "FALLBACK");
+    cbor_encode_uint(&lk, link->proto.baudFallbacks);
+
+    cbor_encode_text_stringz(&lk, "RX_INT");
+    Shadow_HistogramEncode(&lk, &link->proto.rxInterval);
+    cbor_encode_text_stringz(&lk, "AGE");
+    Shadow_HistogramEncode(&lk, &link->sampleAge);
+
+    cbor_encoder_close_container(parent, &lk);
+}
+#endif
+
 static void Shadow_PayloadEncode(CborEncoder *parent, const ShadowPayload *payload) {
     CborEncoder pl;
     cbor_encoder_create_map(parent, &pl, CborIndefiniteLength);
@@ -19,18 +133,31 @@ static void Shadow_PayloadEncode(CborEncoder *parent, const ShadowPayload *paylo
     cbor_encode_text_stringz(&pl, VERSION_STR_SHORT);
     cbor_encode_text_stringz(&pl, "DELAY");
     cbor_encode_uint(&pl, payload->reportDelay);
+    Shadow_SensorConfigEncode(&pl, &payload->sensorConfig);
 
+    if (payload->sensorTime != 0) {
+        cbor_encode_text_stringz(&pl, "SENS_TS");
+        cbor_encode_uint(&pl, payload->sensorTime);
+    }
+    // Samples are reported as read by the sensors MCU, the backend converts them
+    cbor_encode_text_stringz(&pl, "SENS_VER");
+    cbor_encode_uint(&pl, SHADOW_SENSOR_DATA_VERSION);
     cbor_encode_text_stringz(&pl, "HUMID");
     cbor_encode_int(&pl, payload->sensorData.humidity);
     cbor_encode_text_stringz(&pl, "TEMP");
     cbor_encode_int(&pl, payload->sensorData.temperature);
 
     cbor_encode_text_stringz(&pl, "ACC_X");
-    cbor_encode_float(&pl, payload->sensorData.acceleration_mg[0]);
+    cbor_encode_int(&pl, payload->sensorData.acceleration[0]);
     cbor_encode_text_stringz(&pl, "ACC_Y");
-    cbor_encode_float(&pl, payload->sensorData.acceleration_mg[1]);
+    cbor_encode_int(&pl, payload->sensorData.acceleration[1]);
     cbor_encode_text_stringz(&pl, "ACC_Z");
-    cbor_encode_float(&pl, payload->sensorData.acceleration_mg[2]);
+    cbor_encode_int(&pl, payload->sensorData.acceleration[2]);
+    if (payload->sensorData.accelScale != PROTO_ACCEL_SCALE_KEEP &&
+        payload->sensorData.accelScale < ARRAY_SIZE(accelScaleG)) {
+        cbor_encode_text_stringz(&pl, "ACC_SCALE");
+        cbor_encode_uint(&pl, accelScaleG[payload->sensorData.accelScale]);
+    }
 
     cbor_encode_text_stringz(&pl, "LAT");
     cbor_encode_float(&pl, payload->gpsPosition.lat);
@@ -45,6 +172,18 @@ static void Shadow_PayloadEncode(CborEncoder *parent, const ShadowPayload *paylo
     cbor_encode_text_stringz(&pl, "H_ACC");
     cbor_encode_float(&pl, payload->gpsPosition.accuracy);
 
+    if (payload->sensorEvent.type != 0 && payload->sensorEvent.type < ARRAY_SIZE(eventNames)) {
+        cbor_encode_text_stringz(&pl, "EVENT");
+        cbor_encode_text_stringz(&pl, eventNames[payload->sensorEvent.type]);
+        cbor_encode_text_stringz(&pl, "EVENT_DET");
+        cbor_encode_uint(&pl, payload->sensorEvent.detail);
+    }
+
+#if CFG_SHADOW_LINK_STATS
+    cbor_encode_text_stringz(&pl, "LINK");
+    Shadow_LinkEncode(&pl, &payload->linkStatus);
+#endif
+
     cbor_encoder_close_container(parent, &pl);
 }
 
@@ -114,10 +253,11 @@ static esp_err_t Shadow_DecodePayload(CborValue *parent, ShadowPayload *payload)
     CborValue pl;
 
     payload->sensorData = (SensorData){
-        .humidity = 0.0,
-        .temperature = 0.0,
-        .acceleration_mg = {0},
+        .humidity = 0,
+        .temperature = 0,
+        .acceleration = {0},
     };
+    payload->sensorConfig = (ProtoSensorConfigPayload){0};
 
     CBOR_CHECK(cbor_value_enter_container(parent, &pl));
 
@@ -139,6 +279,45 @@ static esp_err_t Shadow_DecodePayload(CborValue *parent, ShadowPayload *payload)
             CBOR_CHECK(cbor_value_get_int64(&pl, &value));
 
             payload->reportDelay = (uint32_t)value;
+        } else if (strcmp(keyBuf, "PERIOD") == 0) {
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
+
+            payload->sensorConfig.samplePeriodMs = (uint16_t)MIN(MAX(value, 0), UINT16_MAX);
+        } else if (strcmp(keyBuf, "ACC_ODR") == 0) {
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
+
+            payload->sensorConfig.accelOdr = Shadow_FindEnum(accelOdrHz, ARRAY_SIZE(accelOdrHz), value);
+        } else if (strcmp(keyBuf, "ACC_FS") == 0) {
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
+
+            payload->sensorConfig.accelScale = Shadow_FindEnum(accelScaleG, ARRAY_SIZE(accelScaleG), value);
+        } else if (strcmp(keyBuf, "HUMID_LP") == 0) {
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
+
+            payload->sensorConfig.humidityPrecision =
+                (value != 0) ? PROTO_HUMIDITY_PRECISION_LOW : PROTO_HUMIDITY_PRECISION_HIGH;
+        } else if (strcmp(keyBuf, "BATCH") == 0) {
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
+
+            payload->sensorConfig.batchSize = (uint8_t)MIN(MAX(value, 0), SENSOR_BATCH_MAX_SAMPLES);
+        } else if (strcmp(keyBuf, "SENS_TS") == 0 || strcmp(keyBuf, "SENS_VER") == 0 ||
+                   strcmp(keyBuf, "ACC_SCALE") == 0) {
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
         } else if (strcmp(keyBuf, "HUMID") == 0) {
             CBOR_CHECK_TYPE(&pl, CborIntegerType);
             int64_t value;
@@ -148,14 +327,17 @@ static esp_err_t Shadow_DecodePayload(CborValue *parent, ShadowPayload *payload)
             int64_t value;
             CBOR_CHECK(cbor_value_get_int64(&pl, &value));
         } else if (strcmp(keyBuf, "ACC_X") == 0) {
-            float value = 0;
-            CBOR_GET_FLOAT_OR_DOUBLE(&pl, &value);
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
         } else if (strcmp(keyBuf, "ACC_Y") == 0) {
-            float value = 0;
-            CBOR_GET_FLOAT_OR_DOUBLE(&pl, &value);
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
         } else if (strcmp(keyBuf, "ACC_Z") == 0) {
-            float value = 0;
-            CBOR_GET_FLOAT_OR_DOUBLE(&pl, &value);
+            CBOR_CHECK_TYPE(&pl, CborIntegerType);
+            int64_t value;
+            CBOR_CHECK(cbor_value_get_int64(&pl, &value));
         } else if (strcmp(keyBuf, "LAT") == 0) {
             float value = 0;
             CBOR_GET_FLOAT_OR_DOUBLE(&pl, &value);
@@ -174,6 +356,9 @@ static esp_err_t Shadow_DecodePayload(CborValue *parent, ShadowPayload *payload)
         } else if (strcmp(keyBuf, "H_ACC") == 0) {
             float value = 0;
             CBOR_GET_FLOAT_OR_DOUBLE(&pl, &value);
+        } else if (strcmp(keyBuf, "LINK") == 0) {
+            // Reported only, skipped as a whole by the advance below
+            CBOR_CHECK_TYPE(&pl, CborMapType);
         } else {
             ESP_LOGW(TAG, "Unknown payload key: '%s'", keyBuf);
         }
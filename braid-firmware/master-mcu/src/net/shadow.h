@@ -3,6 +3,7 @@
 #include <esp_check.h>
 
 #include "hal/gps.h"
+#include "hal/sensors.h"
 #include "proto_payload.h"
 
 #ifdef __cplusplus
@@ -43,11 +44,23 @@ typedef struct ShadowPayload {
     /// @brief The latest sensor data
     SensorData sensorData;
 
+    /// @brief When `sensorData` was sampled, `0` if unknown
+    TimestampSeconds sensorTime;
+
     /// @brief The latest GPS position
     GPS_Position gpsPosition;
 
     /// @brief Controls the time between network connections/reports
     uint64_t reportDelay;
+
+    /// @brief How the sensors MCU samples. Fields set to `0` are not encoded, or were not found when decoding
+    ProtoSensorConfigPayload sensorConfig;
+
+    /// @brief State of the sensors link, only encoded when `CFG_SHADOW_LINK_STATS` is set
+    SensorsLinkStatus linkStatus;
+
+    /// @brief Event of the sensors MCU which caused this report. Not encoded if `type` is `0`
+    ProtoEventPayload sensorEvent;
 } ShadowPayload;
 
 /**
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+# tool to generate the CRC16 lookup tables in shared/src/crc.c
+
+import argparse
+import sys
+
+POLYNOMIAL = 0xA001  # reflected 0x8005
+COLUMNS = 14
+
+parser = argparse.ArgumentParser("gen_crc_tables.py", description="Utility to generate the slice-by-N CRC16 tables")
+parser.add_argument("--slices", help="number of tables to generate", type=int, default=4)
+parser.add_argument(
+    "--output",
+    type=argparse.FileType("w"),
+    default=sys.stdout,
+    help="output file to write",
+)
+
+
+def byte_table() -> list[int]:
+    table = []
+    for n in range(256):
+        crc = n
+        for _ in range(8):
+            crc = (crc >> 1) ^ POLYNOMIAL if crc & 1 else crc >> 1
+        table.append(crc)
+    return table
+
+
+def slice_tables(slices: int) -> list[list[int]]:
+    """Table k holds the CRC of a byte followed by k zero bytes"""
+    tables = [byte_table()]
+    for _ in range(1, slices):
+        previous = tables[-1]
+        tables.append([(crc >> 8) ^ tables[0][crc & 0xFF] for crc in previous])
+    return tables
+
+
+def main():
+    args = parser.parse_args()
+    out = args.output
+
+    out.write(f"static const uint16_t crc16Table[CRC16_TABLE_SLICES][256] = {{\n")
+    for index, table in enumerate(slice_tables(args.slices)):
+        if index == 1:
+            out.write("#if CRC16_TABLE_SLICES > 1\n")
+        out.write("    {\n")
+        for row in range(0, len(table), COLUMNS):
+            values = ", ".join(f"0x{value:04X}" for value in table[row : row + COLUMNS])
+            out.write(f"        {values},\n")
+        out.write("    },\n")
+    if args.slices > 1:
+        out.write("#endif\n")
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -8,7 +8,8 @@ SEMVER_RE = re.compile(
 
 """
 Generates build flags for PlatformIO. By default generates the version defines by parsing git rev information. 
-Also reads the `EXTRA_FLAGS` environment variable and adds those flags to the compiler command
+Also reads the `EXTRA_FLAGS` environment variable and adds those flags to the compiler command, and the
+`FW_SIGNING_PUBLIC_KEY` one, the hex public key printed by `sign_sensors_fw.py keygen`, for `CFG_FW_SIGNING_KEY`
 """
 
 
@@ -42,6 +43,13 @@ def main():
         "CFG_FW_VERSION_COMMIT": commit_short,
     }
 
+    signing_key = os.environ.get("FW_SIGNING_PUBLIC_KEY", "")
+    if signing_key:
+        key_bytes = bytes.fromhex(signing_key)
+        if len(key_bytes) != 32:
+            raise ValueError("FW_SIGNING_PUBLIC_KEY is not a 32 bytes Ed25519 public key")
+        version_defines["CFG_FW_SIGNING_KEY"] = ",".join(f"0x{b:02x}" for b in key_bytes)
+
     version_defines_str = " ".join([f"-D{flag}={value}" for flag, value in version_defines.items()])
     print(version_defines_str + " " + extra_flags)
 
@@ -0,0 +1,114 @@
+import argparse
+import struct
+from pathlib import Path
+
+from cryptography.hazmat.primitives import serialization
+from cryptography.hazmat.primitives.asymmetric.ed25519 import Ed25519PrivateKey
+
+"""
+Signs the sensors MCU images. `keygen` creates the private signing key, which must stay off the devices, and prints
+the public key to build the firmwares with (`FW_SIGNING_PUBLIC_KEY`, see `generate_build_flags.py`). `sign` writes the
+`ProtoFwBeginPayload` announcing an image: its length, its version and its Ed25519 signature. It is the header of
+every `SensorsFirmwareChunk` published to the master, followed by the offset of the piece.
+"""
+
+# Length of the image flashed by the bootloader, see FW_UPDATE_MAX_BLOCKS and PROTO_FW_BLOCK_LEN
+MAX_IMAGE_LENGTH = 64 * 512
+
+
+def parse_version(s: str):
+    parts = s.strip("v").split(".")
+    if len(parts) != 3:
+        raise argparse.ArgumentTypeError("Version must be major.minor.patch")
+    return [int(part) for part in parts]
+
+
+def load_key(path: Path) -> Ed25519PrivateKey:
+    key = serialization.load_pem_private_key(path.read_bytes(), password=None)
+    if not isinstance(key, Ed25519PrivateKey):
+        raise ValueError(f"{path} is not an Ed25519 private key")
+    return key
+
+
+def public_hex(key: Ed25519PrivateKey) -> str:
+    return key.public_key().public_bytes(serialization.Encoding.Raw, serialization.PublicFormat.Raw).hex()
+
+
+def keygen_command(args):
+    if args.key.exists():
+        raise FileExistsError(f"{args.key} exists, it would be lost")
+    key = Ed25519PrivateKey.generate()
+    args.key.write_bytes(
+        key.private_bytes(
+            serialization.Encoding.PEM, serialization.PrivateFormat.PKCS8, serialization.NoEncryption()
+        )
+    )
+    args.key.chmod(0o600)
+    print(public_hex(key))
+
+
+def sign_command(args):
+    image = args.image.read_bytes()
+    if len(image) == 0 or len(image) > MAX_IMAGE_LENGTH:
+        raise ValueError(f"{args.image} is {len(image)} bytes, the bootloader takes 1 to {MAX_IMAGE_LENGTH}")
+    key = load_key(args.key)
+    signature = key.sign(image)
+    with args.output.open("wb+") as f:
+        # ProtoFwBeginPayload: uint32_t length, uint8_t version[3], uint8_t reserved, uint8_t signature[64]
+        f.write(struct.pack("<I3BB", len(image), *args.version, 0))
+        f.write(signature)
+    print(f"signed {len(image)} bytes with key {public_hex(key)}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="signs the sensors MCU images")
+
+    subparsers = parser.add_subparsers(title="subcommands", required=True)
+
+    parser_keygen = subparsers.add_parser("keygen", help="Create a signing key and print its public key")
+    parser_keygen.add_argument(
+        "--key",
+        "-k",
+        help="the private key file to create, PEM",
+        type=Path,
+        required=True,
+    )
+    parser_keygen.set_defaults(handler=keygen_command)
+
+    parser_sign = subparsers.add_parser("sign", help="Write the announcement of an image, with its signature")
+    parser_sign.add_argument(
+        "--key",
+        "-k",
+        help="the private key file, PEM",
+        type=Path,
+        required=True,
+    )
+    parser_sign.add_argument(
+        "--image",
+        "-i",
+        help="the raw image, for example .pio/build/nucleo_l031k6/firmware.bin",
+        type=Path,
+        required=True,
+    )
+    parser_sign.add_argument(
+        "--version",
+        "-v",
+        help="the firmware version of the image, for example 1.2.3",
+        type=parse_version,
+        required=True,
+    )
+    parser_sign.add_argument(
+        "--output",
+        "-o",
+        help="the output file path",
+        default=Path.cwd() / "firmware.hdr",
+        type=Path,
+    )
+    parser_sign.set_defaults(handler=sign_command)
+
+    args = parser.parse_args()
+    args.handler(args)
+
+
+if __name__ == "__main__":
+    main()
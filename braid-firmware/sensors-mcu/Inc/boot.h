@@ -0,0 +1,78 @@
+#pragma once
+
+#include "stm32l0xx.h"
+#include <stdbool.h>
+
+#include "fw_update.h"
+
+/*!
+ * Flash layout
+ *
+ * +------------+------------------------------+
+ * | 0x08000000 | bootloader, 16 KiB, WRP      |
+ * | 0x08004000 | application, 16 KiB          |
+ * +------------+------------------------------+
+ *
+ * Must match STM32L031K6Tx_BOOT.ld and STM32L031K6Tx_FLASH.ld.
+ */
+
+/** @brief Start of the application, and of its vector table */
+#define BOOT_APP_ADDRESS (FLASH_BASE + 0x4000u)
+
+/** @brief Room for the application, in bytes */
+#define BOOT_APP_LENGTH (16u * 1024u)
+
+/** @brief Last word of the bootloader, left out of STM32L031K6Tx_BOOT.ld: `Flash_WriteTest` writes it */
+#define BOOT_WRP_TEST_ADDRESS (BOOT_APP_ADDRESS - 4u)
+
+/** @brief Write protection sectors (4 KiB each) covering the bootloader */
+#define BOOT_WRP_SECTORS (OB_WRP_Pages0to31 | OB_WRP_Pages32to63 | OB_WRP_Pages64to95 | OB_WRP_Pages96to127)
+
+/** @brief Location of the `BootRecord` in the data EEPROM, right after the `FactoryData` */
+#define BOOT_RECORD_ADDRESS (DATA_EEPROM_BASE + 0x100u)
+
+/** @brief Marks a `BootRecord` written by this firmware */
+#define BOOT_RECORD_MAGIC (0xB0070002u)
+
+/** @brief What the application and the bootloader tell each other across a restart, stored in the EEPROM */
+typedef struct BootRecord {
+    /** @brief `BOOT_RECORD_MAGIC`, anything else if the record was never written */
+    uint32_t magic;
+
+    /** @brief Set by the application to stay in the bootloader after the restart */
+    uint32_t requested;
+
+    /** @brief Progress of the last image received by the bootloader */
+    FwUpdateProgress progress;
+} BootRecord;
+
+/**
+ * @brief Reads the boot record from the EEPROM
+ *
+ * @param[out] record The record, cleared if it was never written
+ */
+void Boot_Load(BootRecord *record);
+
+/**
+ * @brief Writes the boot record to the EEPROM. Only the words which changed are written
+ *
+ * @param[in] record The record to write
+ * @return HAL_StatusTypeDef `HAL_OK` if no errors were encountered, `HAL_ERR` otherwise
+ */
+HAL_StatusTypeDef Boot_Save(const BootRecord *record);
+
+/**
+ * @brief Makes the next restart stay in the bootloader, to receive a new application
+ *
+ * @return HAL_StatusTypeDef `HAL_OK` if no errors were encountered, `HAL_ERR` otherwise
+ */
+HAL_StatusTypeDef Boot_RequestUpdate(void);
+
+/**
+ * @brief Tells whether the application can be started: its vector table looks sane, and no update of it was left
+ * unfinished. An application flashed with a debugger, and never updated, is valid
+ *
+ * @param[in] record The boot record
+ * @return `true` if the application can be started
+ */
+bool Boot_AppValid(const BootRecord *record);
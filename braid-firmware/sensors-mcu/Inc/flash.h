@@ -3,26 +3,26 @@
 #include "stm32l0xx.h"
 
 /**
- * @brief Enables read and write protection for the given pages
+ * @brief Enables read and write protection for the given pages, and releases any other protected page
  * @param pages  The sector mask to use (see `FLASH_OBProgramInitTypeDef.WRPSector`)
  * @return `HAL_ERROR` if errors were encountered, `HAL_OK` if the operation was successful
  */
 HAL_StatusTypeDef Flash_EnableProtection(uint32_t pages);
 
 /**
- * @brief Disables read and write protection for the given pages
+ * @brief Disables read and write protection for the given pages, if any of them is protected
  * @param pages  The sector mask to use (see `FLASH_OBProgramInitTypeDef.WRPSector`)
  * @return `HAL_ERROR` if errors were encountered, `HAL_OK` if the operation was successful
  */
 HAL_StatusTypeDef Flash_DisableProtection(uint32_t pages);
 
 /**
- * @brief Checks if a write to a page is successful or not. Can be used to check that flash protection was successfully
- * applied.
- * @param pageAddr  Page to test writing on (absolute address)
- * @return `HAL_ERROR` if errors were encountered, `HAL_OK` if the operation was successful
+ * @brief Checks that flash protection was successfully applied, by writing a word of a protected page. The word is
+ * written if the protection does not hold, so it must be one that nothing reads.
+ * @param address  Word to test writing on (absolute address)
+ * @return `HAL_OK` if the write was refused by the write protection, `HAL_ERROR` otherwise
  */
-HAL_StatusTypeDef Flash_WriteTest(uint32_t pageAddr);
+HAL_StatusTypeDef Flash_WriteTest(uint32_t address);
 
 /**
  * @brief Erases the whole flash. Necessary after disabling flash protection.
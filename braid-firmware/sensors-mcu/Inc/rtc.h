@@ -39,6 +39,10 @@ extern RTC_HandleTypeDef hrtc;
 #define RTC_BK_REGISTER_BYTES (4u)
 /** @brief Backup registers available */
 #define RTC_BK_REGISTERS (5u)
+/** @brief Errors up to this are corrected by shifting the sub-seconds, bigger ones by setting the calendar */
+#define RTC_MAX_SHIFT_MS (1000)
+/** @brief Shortest time between two synchronizations to correct the RTC rate from */
+#define RTC_RATE_MIN_INTERVAL_MS (60000u)
 /* USER CODE END Private defines */
 
 void MX_RTC_Init(void);
@@ -47,6 +51,12 @@ void MX_RTC_Init(void);
 bool RTC_CheckTamper2();
 
 bool RTC_CheckTamper3();
+
+void RTC_SetUnixTime(uint32_t seconds, uint16_t milliseconds);
+
+bool RTC_IsSynchronized(void);
+
+uint64_t RTC_GetUnixTimeMs(void);
 /* USER CODE END Prototypes */
 
 #ifdef __cplusplus
@@ -104,6 +104,32 @@ int16_t sht4x_measure(void);
  */
 int16_t sht4x_read(int32_t *temperature, int32_t *humidity);
 
+/**
+ * Same as sht4x_measure_blocking_read(), with the results in 16 bits:
+ * temperature in [degree Celsius] and relative humidity in [percent relative
+ * humidity], both multiplied by 100.
+ *
+ * @param temperature   the address for the result of the temperature
+ * measurement
+ * @param humidity      the address for the result of the relative humidity
+ * measurement
+ * @return              0 if the command was successful, else an error code.
+ */
+int16_t sht4x_measure_blocking_read_centi(int16_t *temperature, int16_t *humidity);
+
+/**
+ * Same as sht4x_read(), with the results in 16 bits: temperature in [degree
+ * Celsius] and relative humidity in [percent relative humidity], both
+ * multiplied by 100.
+ *
+ * @param temperature   the address for the result of the temperature
+ * measurement
+ * @param humidity      the address for the result of the relative humidity
+ * measurement
+ * @return              0 if the command was successful, else an error code.
+ */
+int16_t sht4x_read_centi(int16_t *temperature, int16_t *humidity);
+
 /**
  * Enable or disable the SHT's low power mode
  *
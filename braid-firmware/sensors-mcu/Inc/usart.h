@@ -30,6 +30,7 @@ extern "C" {
 
 /* USER CODE BEGIN Includes */
 #include "proto.h"
+#include <stdbool.h>
 /* USER CODE END Includes */
 
 extern UART_HandleTypeDef huart2;
@@ -42,6 +43,12 @@ void MX_USART2_UART_Init(void);
 
 /* USER CODE BEGIN Prototypes */
 extern ProtoCtx protoCtx;
+
+/**
+ * @brief Tells whether the DMA stored bytes not yet read by the protocol.
+ * Updated when the line goes idle after a burst, or every half of the receive buffer
+ */
+bool Sensors_ProtoRxPending(void);
 /* USER CODE END Prototypes */
 
 #ifdef __cplusplus
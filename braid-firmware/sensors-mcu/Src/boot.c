@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include "boot.h"
+#include "factory_data.h"
+
+/** @brief End of the RAM, where the initial stack pointer of the application may point */
+#define BOOT_RAM_END (SRAM_BASE + 8u * 1024u)
+
+_Static_assert(sizeof(FactoryData) <= BOOT_RECORD_ADDRESS - DATA_EEPROM_BASE, "FactoryData overlaps the BootRecord");
+_Static_assert(sizeof(BootRecord) % sizeof(uint32_t) == 0, "BootRecord is written word by word");
+
+void Boot_Load(BootRecord *record) {
+    memcpy(record, (const void *)BOOT_RECORD_ADDRESS, sizeof(BootRecord));
+
+    // Never written: the application was flashed with a debugger
+    if (record->magic != BOOT_RECORD_MAGIC) {
+        memset(record, 0, sizeof(BootRecord));
+        record->magic = BOOT_RECORD_MAGIC;
+    }
+}
+
+HAL_StatusTypeDef Boot_Save(const BootRecord *record) {
+    const uint32_t *words = (const uint32_t *)record;
+    const __IO uint32_t *stored = (const __IO uint32_t *)BOOT_RECORD_ADDRESS;
+
+    HAL_StatusTypeDef status = HAL_FLASHEx_DATAEEPROM_Unlock();
+    if (status != HAL_OK) {
+        return status;
+    }
+
+    // Every word written costs an erase and a program cycle: the progress changes a single one per block
+    for (size_t i = 0; i < sizeof(BootRecord) / sizeof(uint32_t) && status == HAL_OK; i++) {
+        if (stored[i] != words[i]) {
+            status = HAL_FLASHEx_DATAEEPROM_Program(
+                FLASH_TYPEPROGRAMDATA_WORD, BOOT_RECORD_ADDRESS + i * sizeof(uint32_t), words[i]);
+        }
+    }
+
+    if (HAL_FLASHEx_DATAEEPROM_Lock() != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    return status;
+}
+
+HAL_StatusTypeDef Boot_RequestUpdate(void) {
+    BootRecord record;
+
+    Boot_Load(&record);
+    record.requested = 1;
+
+    return Boot_Save(&record);
+}
+
+bool Boot_AppValid(const BootRecord *record) {
+    const uint32_t *vectors = (const uint32_t *)BOOT_APP_ADDRESS;
+
+    // The flash erases to zero: an empty application has neither a stack nor a reset handler
+    bool sane = vectors[0] > SRAM_BASE && vectors[0] <= BOOT_RAM_END && vectors[1] > BOOT_APP_ADDRESS &&
+                vectors[1] < BOOT_APP_ADDRESS + BOOT_APP_LENGTH;
+
+    return sane && (record->progress.length == 0 || record->progress.valid);
+}
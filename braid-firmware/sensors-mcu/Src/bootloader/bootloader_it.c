@@ -0,0 +1,47 @@
+/**
+ * @file bootloader_it.c
+ * @brief Interrupt handlers of the bootloader, the subset of stm32l0xx_it.c for the UART link
+ */
+#include "main.h"
+
+extern DMA_HandleTypeDef hdma_usart2_rx;
+extern DMA_HandleTypeDef hdma_usart2_tx;
+extern UART_HandleTypeDef huart2;
+
+/**
+ * @brief This function handles Non maskable Interrupt.
+ */
+void NMI_Handler(void) {
+    while (1) {
+    }
+}
+
+/**
+ * @brief This function handles Hard fault interrupt.
+ */
+void HardFault_Handler(void) {
+    while (1) {
+    }
+}
+
+/**
+ * @brief This function handles System tick timer.
+ */
+void SysTick_Handler(void) {
+    HAL_IncTick();
+}
+
+/**
+ * @brief This function handles DMA1 channel 4, channel 5, channel 6 and channel 7 interrupts.
+ */
+void DMA1_Channel4_5_6_7_IRQHandler(void) {
+    HAL_DMA_IRQHandler(&hdma_usart2_tx);
+    HAL_DMA_IRQHandler(&hdma_usart2_rx);
+}
+
+/**
+ * @brief This function handles USART2 global interrupt / USART2 wake-up interrupt through EXTI line 26.
+ */
+void USART2_IRQHandler(void) {
+    HAL_UART_IRQHandler(&huart2);
+}
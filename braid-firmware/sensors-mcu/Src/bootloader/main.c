@@ -0,0 +1,252 @@
+/**
+ * @file main.c
+ * @brief Resident bootloader of the sensors MCU, built by the `bootloader` environment.
+ *
+ * Starts the application right away, unless it asked for an update or its last update was left unfinished. Then
+ * receives the image streamed by the master over the same link as the application, and restarts once it is written
+ * and its signature verified. Blocks are programmed by half pages while the DMA keeps receiving the next ones.
+ */
+#include <string.h>
+#include <sys/param.h>
+
+#include "boot.h"
+#include "build_config.h"
+#include "dma.h"
+#include "fw_update.h"
+#include "gpio.h"
+#include "main.h"
+#include "proto.h"
+#include "usart.h"
+
+/** @brief Time without any update message after which a valid application is started again, in milliseconds */
+#define BOOT_IDLE_TIMEOUT_MS (30000u)
+
+/** @brief Longest wait for the master to acknowledge the final status before the restart, in milliseconds */
+#define BOOT_DONE_TIMEOUT_MS (1000u)
+
+/** @brief Unit of the fast flash programming, 16 words */
+#define BOOT_HALF_PAGE_SIZE (FLASH_PAGE_SIZE / 2u)
+
+/** CRC errors and a full window are recovered by the protocol itself */
+#define PROTO_CHECK(x)                                                                                                 \
+    do {                                                                                                               \
+        ProtoErrorCode protoErr_ = (x);                                                                                \
+        if (protoErr_ != PROTO_SUCCESS && protoErr_ != PROTO_ERROR_CRC && protoErr_ != PROTO_ERROR_BUSY) {             \
+            Error_Handler();                                                                                           \
+        }                                                                                                              \
+    } while (0)
+
+_Static_assert(PROTO_MSG_PAYLOAD_MAX_LEN >= PROTO_FW_BLOCK_PAYLOAD_LEN + 1,
+               "PROTO_MSG_PAYLOAD_MAX_LEN does not fit a sequenced PROTO_MSG_TYPE_FW_BLOCK");
+
+static BootRecord bootRecord;
+static FwUpdateCtx fwUpdate;
+
+/** @brief Public key the images are signed with. The private one never comes near a device */
+static const uint8_t signingKey[ED25519_PUBLIC_KEY_SIZE] = {CFG_FW_SIGNING_KEY};
+
+/** @brief Status to send to the master, the latest one replaces an older one not sent yet */
+static ProtoFwStatusPayload pendingStatus;
+static bool statusPending;
+
+/** @brief Time of the last update message */
+static uint32_t lastActivity;
+
+static void SystemClock_Config(void);
+static void Boot_MsgCallback(void *cbCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload);
+static int Boot_Program(void *halCtx, uint32_t offset, size_t length, const uint8_t *data);
+static int Boot_SaveProgress(void *halCtx, const FwUpdateProgress *progress);
+static void Boot_Restart(void);
+static void Boot_StartApp(void);
+
+int main(void) {
+    // Decided before anything is initialized, so that the application starts as from a reset
+    Boot_Load(&bootRecord);
+    if (!bootRecord.requested && Boot_AppValid(&bootRecord)) {
+        Boot_StartApp();
+    }
+
+    HAL_Init();
+    SystemClock_Config();
+    MX_GPIO_Init();
+    MX_DMA_Init();
+    MX_USART2_UART_Init();
+    HAL_GPIO_WritePin(LD3_GPIO_Port, LD3_Pin, GPIO_PIN_SET);
+
+    // Same link as the application, receiving images instead of sampling. The baud rate negotiation and the events are
+    // built out to fit the flash: a whole image still takes only a few seconds at 115200 baud
+    protoCtx.pull = 0;
+    protoCtx.fwUpdate = 1;
+    protoCtx.messageCallback = Boot_MsgCallback;
+
+    fwUpdate.program = Boot_Program;
+    fwUpdate.save = Boot_SaveProgress;
+    fwUpdate.image = (const uint8_t *)BOOT_APP_ADDRESS;
+    fwUpdate.maxLength = BOOT_APP_LENGTH;
+    fwUpdate.publicKey = signingKey;
+    FwUpdateInit(&fwUpdate, &bootRecord.progress);
+
+    ERR_CHECK_CUSTOM(ProtoPing(&protoCtx), PROTO_SUCCESS);
+    lastActivity = HAL_GetTick();
+    uint32_t doneAt = 0;
+    bool done = false;
+
+    while (1) {
+        PROTO_CHECK(ProtoProcessMessage(&protoCtx));
+
+        if (statusPending) {
+            ProtoErrorCode status =
+                ProtoSend(&protoCtx, PROTO_MSG_TYPE_FW_STATUS, sizeof(pendingStatus), (uint8_t *)&pendingStatus);
+            statusPending = (status == PROTO_ERROR_BUSY);
+            PROTO_CHECK(status);
+        }
+
+        // The new application starts once the master knows, or the old one if the master went away
+        if (fwUpdate.state == PROTO_FW_STATE_DONE && !statusPending && !done) {
+            done = true;
+            doneAt = HAL_GetTick();
+        }
+        if (done && (protoCtx.state.txBase == protoCtx.state.txNext || HAL_GetTick() - doneAt > BOOT_DONE_TIMEOUT_MS)) {
+            Boot_Restart();
+        }
+        if (HAL_GetTick() - lastActivity > BOOT_IDLE_TIMEOUT_MS && Boot_AppValid(&bootRecord)) {
+            Boot_Restart();
+        }
+
+        // The DMA receives in the background, SysTick wakes the core every millisecond for the timers
+        if (!Sensors_ProtoRxPending()) {
+            HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+        }
+        PROTO_CHECK(ProtoReceive(&protoCtx));
+    }
+}
+
+/**
+ * @brief System Clock Configuration: HSI16 without the PLL, the UART needs no more
+ */
+static void SystemClock_Config(void) {
+    RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+    RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+    RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
+
+    __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1);
+
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+    RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+    RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+    if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK) {
+        Error_Handler();
+    }
+
+    RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+    RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+    RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK) {
+        Error_Handler();
+    }
+
+    PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_USART2;
+    PeriphClkInit.Usart2ClockSelection = RCC_USART2CLKSOURCE_PCLK1;
+    if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+/**
+ * @brief Implementation for `ProtoCtx.messageCallback`. Blocks are written right here: the DMA keeps receiving the
+ * rest of the window meanwhile, and the block is acknowledged once written. The last one also waits for the check of
+ * the signature, seconds long: the master sends it again meanwhile, and the copies are dropped
+ */
+static void Boot_MsgCallback(void *cbCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload) {
+    switch (msgType) {
+    case PROTO_MSG_TYPE_FW_BEGIN:
+        if (payloadLength < sizeof(ProtoFwBeginPayload)) {
+            break;
+        }
+        FwUpdateBegin(&fwUpdate, (const ProtoFwBeginPayload *)payload, &pendingStatus);
+        statusPending = true;
+        lastActivity = HAL_GetTick();
+        break;
+    case PROTO_MSG_TYPE_FW_BLOCK:
+        if (FwUpdateBlock(&fwUpdate, payloadLength, payload, &pendingStatus)) {
+            statusPending = true;
+        }
+        lastActivity = HAL_GetTick();
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Implementation for `FwUpdateCtx.program`. Erases the pages of the block, then writes it by half pages, which
+ * take as long as a single word each
+ */
+static int Boot_Program(void *halCtx, uint32_t offset, size_t length, const uint8_t *data) {
+    uint32_t address = BOOT_APP_ADDRESS + offset;
+    uint32_t pageError = 0;
+    FLASH_EraseInitTypeDef erase = {
+        .TypeErase = FLASH_TYPEERASE_PAGES,
+        .PageAddress = address,
+        .NbPages = (length + FLASH_PAGE_SIZE - 1u) / FLASH_PAGE_SIZE,
+    };
+
+    HAL_StatusTypeDef status = HAL_FLASH_Unlock();
+    if (status == HAL_OK) {
+        status = HAL_FLASHEx_Erase(&erase, &pageError);
+    }
+    for (size_t done = 0; status == HAL_OK && done < length; done += BOOT_HALF_PAGE_SIZE) {
+        // The tail of the last block is padded with the erased value
+        uint32_t words[BOOT_HALF_PAGE_SIZE / sizeof(uint32_t)] = {0};
+        memcpy(words, &data[done], MIN(BOOT_HALF_PAGE_SIZE, length - done));
+        status = HAL_FLASHEx_HalfPageProgram(address + done, words);
+    }
+    HAL_FLASH_Lock();
+
+    return (status == HAL_OK) ? 0 : -1;
+}
+
+/**
+ * @brief Implementation for `FwUpdateCtx.save`
+ */
+static int Boot_SaveProgress(void *halCtx, const FwUpdateProgress *progress) {
+    bootRecord.progress = *progress;
+
+    return (Boot_Save(&bootRecord) == HAL_OK) ? 0 : -1;
+}
+
+/**
+ * @brief Restarts into the application, if it is valid, or back into the bootloader
+ */
+static void Boot_Restart(void) {
+    bootRecord.requested = 0;
+    Boot_Save(&bootRecord);
+
+    HAL_NVIC_SystemReset();
+}
+
+/**
+ * @brief Jumps to the reset handler of the application, with its stack and its vector table
+ */
+static void Boot_StartApp(void) {
+    const uint32_t *vectors = (const uint32_t *)BOOT_APP_ADDRESS;
+
+    SCB->VTOR = BOOT_APP_ADDRESS;
+    __set_MSP(vectors[0]);
+    ((void (*)(void))vectors[1])();
+}
+
+/**
+ * @brief  This function is executed in case of error occurrence.
+ * @retval None
+ */
+void Error_Handler(void) {
+    __disable_irq();
+    while (1) {
+        HAL_GPIO_TogglePin(LD3_GPIO_Port, LD3_Pin);
+        HAL_Delay(100);
+    }
+}
@@ -1,5 +1,6 @@
 #include <string.h>
 
+#include "crypto_hmac.h"
 #include "factory_data.h"
 #include "rtc.h"
 
@@ -49,7 +50,8 @@ HAL_StatusTypeDef FactoryData_Load(FactoryData *data) {
 }
 
 void FactoryData_Unload(FactoryData *data) {
-    memset(data, 0, sizeof(FactoryData));
+    // A plain memset of a buffer never read again may be optimized away
+    Crypto_Wipe(data, sizeof(FactoryData));
 }
 
 HAL_StatusTypeDef FactoryData_EraseSecrets(FactoryData *data) {
@@ -32,8 +32,20 @@ HAL_StatusTypeDef Flash_EnableProtection(uint32_t pages) {
         return status;
     }
 
+    // Release the pages protected beyond the desired ones, like all of them by the firmware before the bootloader,
+    // keeping the read protection level
+    uint32_t protected = OptionsBytes.WRPSector;
+    if ((protected & ~pages) != 0) {
+        OptionsBytes.OptionType = OPTIONBYTE_WRP;
+        OptionsBytes.WRPState = OB_WRPSTATE_DISABLE;
+        OptionsBytes.WRPSector = protected & ~pages;
+        if (HAL_FLASHEx_OBProgram(&OptionsBytes) != HAL_OK) {
+            return HAL_ERROR;
+        }
+    }
+
     // Check if desired pages are not yet write protected
-    if ((OptionsBytes.WRPSector & pages) != pages) {
+    if ((protected & pages) != pages) {
         // Enable write protection
         OptionsBytes.OptionType = OPTIONBYTE_WRP | OPTIONBYTE_RDP;
         OptionsBytes.WRPState = OB_WRPSTATE_ENABLE;
@@ -43,7 +55,9 @@ HAL_StatusTypeDef Flash_EnableProtection(uint32_t pages) {
         if (HAL_FLASHEx_OBProgram(&OptionsBytes) != HAL_OK) {
             return HAL_ERROR;
         }
+    }
 
+    if (protected != pages) {
         // Generate System Reset to load the new option byte values
         status = HAL_FLASH_OB_Launch();
         if (status != HAL_OK) {
@@ -67,12 +81,12 @@ HAL_StatusTypeDef Flash_DisableProtection(uint32_t pages) {
         return status;
     }
 
-    // Check if desired pages are already write protected
-    if ((OptionsBytes.WRPSector & pages) == pages) {
+    // Check if any of the desired pages is write protected
+    if ((OptionsBytes.WRPSector & pages) != 0) {
         // Restore write protected pages
         OptionsBytes.OptionType = OPTIONBYTE_WRP | OPTIONBYTE_RDP;
         OptionsBytes.WRPState = OB_WRPSTATE_DISABLE;
-        OptionsBytes.WRPSector = pages;
+        OptionsBytes.WRPSector = OptionsBytes.WRPSector & pages;
         OptionsBytes.RDPLevel = OB_RDP_LEVEL_0;
         if (HAL_FLASHEx_OBProgram(&OptionsBytes) != HAL_OK) {
             return HAL_ERROR;
@@ -94,17 +108,19 @@ HAL_StatusTypeDef Flash_DisableProtection(uint32_t pages) {
     return HAL_FLASH_Lock();
 }
 
-HAL_StatusTypeDef Flash_WriteTest(uint32_t pageAddr) {
+HAL_StatusTypeDef Flash_WriteTest(uint32_t address) {
+    HAL_StatusTypeDef status = HAL_ERROR;
+
     HAL_FLASH_Unlock();
 
-    // Check that it is not allowed to write in this page
-    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, pageAddr, TEST_DATA) != HAL_OK) {
-        if (HAL_FLASH_GetError() != HAL_FLASH_ERROR_WRP) {
-            return HAL_ERROR;
-        }
+    // The protection only holds if the write is refused, and refused because of it
+    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address, TEST_DATA) != HAL_OK &&
+        (HAL_FLASH_GetError() & HAL_FLASH_ERROR_WRP) != 0) {
+        status = HAL_OK;
     }
 
-    return HAL_FLASH_Lock();
+    HAL_FLASH_Lock();
+    return status;
 }
 
 HAL_StatusTypeDef Flash_Erase(uint32_t firstPageAddr, uint32_t lastPageAddr) {
@@ -18,6 +18,7 @@
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "dma.h"
 #include "gpio.h"
 #include "i2c.h"
 #include "rtc.h"
@@ -25,6 +26,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "boot.h"
 #include "factory_data.h"
 #include "flash.h"
 #include "proto.h"
@@ -42,12 +44,39 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/** @brief Default time between two samples, in milliseconds */
+#define SAMPLE_PERIOD_MS (500u)
 
+/** @brief Shortest sampling period accepted from the master, in milliseconds */
+#define SAMPLE_PERIOD_MIN_MS (100u)
+
+/** @brief Number of samples sent together in a `SensorBatch`, under a single hash */
+#ifndef SENSOR_BATCH_SAMPLES
+#define SENSOR_BATCH_SAMPLES (8u)
+#endif
+#if SENSOR_BATCH_SAMPLES > SENSOR_BATCH_MAX_SAMPLES
+#error "SENSOR_BATCH_SAMPLES does not fit a SensorBatch"
+#endif
+
+/** @brief Acceleration on any axis, gravity included, which raises a `PROTO_EVENT_SHOCK`, in milli-g */
+#ifndef SHOCK_THRESHOLD_MG
+#define SHOCK_THRESHOLD_MG (1500)
+#endif
+
+/** @brief Longest wait for the master to acknowledge a tamper event before the restart, in milliseconds */
+#define TAMPER_ACK_TIMEOUT_MS (250u)
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
 /* USER CODE BEGIN PM */
-
+/** CRC errors and a full window are recovered by the protocol itself */
+#define PROTO_CHECK(x)                                                                                                 \
+    do {                                                                                                               \
+        ProtoErrorCode protoErr_ = (x);                                                                                \
+        if (protoErr_ != PROTO_SUCCESS && protoErr_ != PROTO_ERROR_CRC && protoErr_ != PROTO_ERROR_BUSY) {             \
+            Error_Handler();                                                                                           \
+        }                                                                                                              \
+    } while (0)
 /* USER CODE END PM */
 
 /* Private variables ---------------------------------------------------------*/
@@ -60,13 +89,54 @@ bool FlashProtectionEnabled = false;
 #endif
 
 FactoryData eepromData;
-SensorPayload sensorPayload;
+/** @brief The key of `eepromData`, ready to hash the batches. Only wiped on tamper */
+static HmacKeyCtx hmacKey;
+SensorData sensorData;
+SensorBatch sensorBatch;
+/** @brief Set once `sensorBatch` is hashed and waits for room in the window: no sample is added to it meanwhile */
+static bool batchReady;
+
+/** @brief Samples still to take for the master, in pull mode */
+static uint8_t requestedSamples;
+/** @brief Set when a request arrives, to take its first sample right away */
+static bool requestReceived;
+
+/** @brief Sampling configuration, changed with `PROTO_MSG_TYPE_SENSOR_CONFIG` */
+static uint16_t samplePeriodMs = SAMPLE_PERIOD_MS;
+static uint8_t batchSize = SENSOR_BATCH_SAMPLES;
+/** @brief Full scale of the accelerometer, a `ProtoAccelScale` sent along with the raw counts */
+static uint8_t accelScale = PROTO_ACCEL_SCALE_2G;
+/** @brief Configuration received but not applied yet: the sensors are not touched from the receive path */
+static ProtoSensorConfigPayload pendingConfig;
+static bool configPending;
+
+/** @brief Time of the master received but not applied yet, and when it was received */
+static ProtoTimeSyncPayload pendingTimeSync;
+static uint32_t pendingTimeSyncTick;
+static bool timeSyncPending;
+
+/** @brief Event raised while the previous one was not acknowledged yet, sent as soon as it is */
+static ProtoEventPayload pendingEvent;
+static bool eventPending;
+/** @brief Conditions already reported, so that an event is raised only when they start */
+static bool shockActive;
+static uint8_t sensorFaults;
+
+/** @brief The master announced a new image: restart into the bootloader to receive it */
+static bool updateRequested;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 /* USER CODE BEGIN PFP */
-
+static void Sensors_MsgCallback(void *cbCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload);
+static void Sensors_ApplyConfig(stmdev_ctx_t *stmdevCtx, const ProtoSensorConfigPayload *config);
+static void Sensors_SendBatch(void);
+static void Sensors_RaiseEvent(ProtoEventType type, uint16_t detail);
+static void Sensors_SetFault(ProtoEventSensor sensor, bool failed);
+static void Sensors_CheckTamper(void);
+static void Sensors_Tampered(uint8_t input);
+static void Sensors_EnterBootloader(void);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -80,7 +150,8 @@ void SystemClock_Config(void);
  */
 int main(void) {
     /* USER CODE BEGIN 1 */
-
+    // Started by the bootloader, which may not have set the vector table if the startup code reset it
+    SCB->VTOR = BOOT_APP_ADDRESS;
     /* USER CODE END 1 */
 
     /* MCU Configuration--------------------------------------------------------*/
@@ -101,6 +172,7 @@ int main(void) {
 
     /* Initialize all configured peripherals */
     MX_GPIO_Init();
+    MX_DMA_Init();
     MX_I2C1_Init();
     MX_USART2_UART_Init();
     MX_RTC_Init();
@@ -110,12 +182,13 @@ int main(void) {
         FlashProtectionEnabled = false;
     }
 
+    // Only the bootloader is protected, it writes the application pages itself
     if (FlashProtectionEnabled) {
-        uint32_t page128 = FLASH_BASE + FLASH_PAGE_SIZE * 128;
-        ERR_CHECK(Flash_EnableProtection(OB_WRP_AllPages));
-        ERR_CHECK(Flash_WriteTest(page128));
+        ERR_CHECK(Flash_EnableProtection(BOOT_WRP_SECTORS));
+        ERR_CHECK(Flash_WriteTest(BOOT_WRP_TEST_ADDRESS));
     } else {
-        ERR_CHECK(Flash_DisableProtection(OB_WRP_AllPages));
+        // The firmware before the bootloader protected all the pages
+        ERR_CHECK(Flash_DisableProtection(BOOT_WRP_SECTORS | OB_WRP_AllPages));
     }
 
     // Read the EEPROM
@@ -136,6 +209,8 @@ int main(void) {
         HAL_GPIO_WritePin(LD3_GPIO_Port, LD3_Pin, GPIO_PIN_RESET);
         HAL_Delay(900);
     }
+    // The key is read once: the EEPROM copy is not touched again until a tamper erases it
+    Crypto_HMACKeyInit(&hmacKey, eepromData.key, HMAC_KEY_LENGTH);
     FactoryData_Unload(&eepromData);
 
     // Init the temp/humid sensor
@@ -149,57 +224,142 @@ int main(void) {
     while (lis2dh_probe(&stmdevCtx) != 0) {
     }
 
+    protoCtx.messageCallback = Sensors_MsgCallback;
     /* USER CODE END 2 */
 
     /* Infinite loop */
     /* USER CODE BEGIN WHILE */
     int16_t data_raw_acceleration[3];
+    int16_t temperature;
+    int16_t humidity;
     lis2dh12_reg_t reg;
 
     ERR_CHECK_CUSTOM(ProtoPing(&protoCtx), PROTO_SUCCESS);
     while (1) {
+        if (updateRequested) {
+            Sensors_EnterBootloader();
+        }
+
+        uint32_t loopStart = HAL_GetTick();
+        // In pull mode the sensors are read only while the master asks for samples
+        bool pull = (protoCtx.state.features & PROTO_FEATURE_PULL) != 0;
+
         ERR_CHECK_CUSTOM(ProtoProcessMessage(&protoCtx), PROTO_SUCCESS);
 
-        // Check for tampering
-        if (RTC_CheckTamper2()) {
-            ERR_CHECK(FactoryData_Load(&eepromData));
-            eepromData.tamper2 = 1;
-            ERR_CHECK(FactoryData_EraseSecrets(&eepromData));
-            FactoryData_Unload(&eepromData);
-            HAL_NVIC_SystemReset();
+        // A batch kept for a full window goes first
+        if (batchReady) {
+            Sensors_SendBatch();
+        }
+
+        Sensors_CheckTamper();
+
+        if (eventPending && ProtoEventAcked(&protoCtx)) {
+            eventPending = false;
+            Sensors_RaiseEvent((ProtoEventType)pendingEvent.type, pendingEvent.detail);
         }
-        if (RTC_CheckTamper3()) {
-            ERR_CHECK(FactoryData_Load(&eepromData));
-            eepromData.tamper3 = 1;
-            ERR_CHECK(FactoryData_EraseSecrets(&eepromData));
-            FactoryData_Unload(&eepromData);
-            HAL_NVIC_SystemReset();
+
+        if (configPending) {
+            Sensors_ApplyConfig(&stmdevCtx, &pendingConfig);
+            memset(&pendingConfig, 0, sizeof(pendingConfig));
+            configPending = false;
         }
 
-        // Read output only if new value available
-        ERR_CHECK_CUSTOM(lis2dh12_xl_data_ready_get(&stmdevCtx, &reg.byte), 0);
-        if (reg.byte) {
-            // Read accelerometer data
-            memset(data_raw_acceleration, 0, 3 * sizeof(int16_t));
-            lis2dh12_acceleration_raw_get(&stmdevCtx, data_raw_acceleration);
-            sensorPayload.data.acceleration_mg[0] = lis2dh12_from_fs2_hr_to_mg(data_raw_acceleration[0]);
-            sensorPayload.data.acceleration_mg[1] = lis2dh12_from_fs2_hr_to_mg(data_raw_acceleration[1]);
-            sensorPayload.data.acceleration_mg[2] = lis2dh12_from_fs2_hr_to_mg(data_raw_acceleration[2]);
+        if (timeSyncPending) {
+            // The samples taken so far count from the old time base
+            if (sensorBatch.count > 0) {
+                Sensors_SendBatch();
+            }
+            uint64_t masterMs = (uint64_t)pendingTimeSync.seconds * 1000u + pendingTimeSync.milliseconds +
+                                (HAL_GetTick() - pendingTimeSyncTick);
+            RTC_SetUnixTime((uint32_t)(masterMs / 1000u), (uint16_t)(masterMs % 1000u));
+            timeSyncPending = false;
         }
 
-        // Measure temperature and relative humidity and store into variables temperature, humidity (each output
-        // multiplied by 1000)
-        ERR_CHECK_CUSTOM(sht4x_measure_blocking_read(&sensorPayload.data.temperature, &sensorPayload.data.humidity),
-                         STATUS_OK);
+        if (!pull || requestedSamples > 0) {
+            // Unix time once the master sent its clock, time since the start until then
+            bool synced = RTC_IsSynchronized();
+            uint64_t sampleMs = synced ? RTC_GetUnixTimeMs() : loopStart;
+            uint8_t flags = synced ? SENSOR_BATCH_FLAG_SYNCED : 0;
+
+            // A batch has a single time base, and offsets of 16 bits
+            if (sensorBatch.count > 0 &&
+                (flags != sensorBatch.flags || sampleMs - sensorBatch.epoch * 1000ull > SENSOR_BATCH_MAX_SPAN_MS)) {
+                Sensors_SendBatch();
+            }
+            if (sensorBatch.count == 0) {
+                sensorBatch.flags = flags;
+                sensorBatch.epoch = (uint32_t)(sampleMs / 1000u);
+            }
+
+            // Read output only if new value available. A sensor which stops answering is reported, and its last
+            // values are sent until it comes back
+            int32_t status = lis2dh12_xl_data_ready_get(&stmdevCtx, &reg.byte);
+            Sensors_SetFault(PROTO_EVENT_SENSOR_ACCEL, status != 0);
+            if (status == 0 && reg.byte) {
+                // Read accelerometer data
+                memset(data_raw_acceleration, 0, 3 * sizeof(int16_t));
+                lis2dh12_acceleration_raw_get(&stmdevCtx, data_raw_acceleration);
+                // Sent as read: no floating point on this MCU, the master converts them with the scale
+                memcpy(sensorData.acceleration, data_raw_acceleration, sizeof(sensorData.acceleration));
+                sensorData.accelScale = accelScale;
+
+                int32_t peak = 0;
+                for (size_t i = 0; i < 3; i++) {
+                    int32_t mg = PayloadAccelerationMg(data_raw_acceleration[i], accelScale);
+                    if (mg < 0) {
+                        mg = -mg;
+                    }
+                    if (mg > peak) {
+                        peak = mg;
+                    }
+                }
+                if (peak >= SHOCK_THRESHOLD_MG && !shockActive) {
+                    Sensors_RaiseEvent(PROTO_EVENT_SHOCK, (uint16_t)peak);
+                }
+                shockActive = peak >= SHOCK_THRESHOLD_MG;
+            }
+
+            // Measure temperature and relative humidity (each output multiplied by 100)
+            status = sht4x_measure_blocking_read_centi(&temperature, &humidity);
+            Sensors_SetFault(PROTO_EVENT_SENSOR_HUMIDITY, status != STATUS_OK);
+            if (status == STATUS_OK) {
+                sensorData.temperature = temperature;
+                sensorData.humidity = humidity;
+            }
+
+            // The sensors are still read for the events while a batch waits, its samples are fixed by the hash
+            if (!batchReady) {
+                sensorBatch.offsets[sensorBatch.count] =
+                    (uint16_t)((sampleMs - sensorBatch.epoch * 1000ull) / SENSOR_BATCH_OFFSET_MS);
+                sensorBatch.samples[sensorBatch.count] = sensorData;
+                sensorBatch.count++;
+                if (pull) {
+                    requestedSamples--;
+                }
+            }
+        }
 
-        ERR_CHECK(FactoryData_Load(&eepromData));
-        PayloadHash(&sensorPayload, eepromData.key, HMAC_KEY_LENGTH);
-        FactoryData_Unload(&eepromData);
-        ERR_CHECK_CUSTOM(
-            ProtoSend(&protoCtx, PROTO_MSG_TYPE_RESPONSE, sizeof(SensorPayload), (uint8_t *)&sensorPayload),
-            PROTO_SUCCESS);
+        // Send the samples once the batch is full or the request is complete
+        if (sensorBatch.count >= batchSize || (pull && requestedSamples == 0 && sensorBatch.count > 0)) {
+            Sensors_SendBatch();
+        }
 
-        HAL_Delay(500);
+        // Listen to the master (acknowledgements, pings, requests) until the next sample is due, or a new request
+        // wants its first sample now. The DMA receives in the background: sleep until it reports a burst, SysTick
+        // still wakes the core every millisecond for the timers
+        requestReceived = false;
+        while (HAL_GetTick() - loopStart < samplePeriodMs && !requestReceived && !updateRequested) {
+            if (!Sensors_ProtoRxPending()) {
+                HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+            }
+            // The tamper interrupt wakes the core: the secrets are erased now, not once the period, up to 65 s, is over
+            Sensors_CheckTamper();
+            PROTO_CHECK(ProtoReceive(&protoCtx));
+            // The acknowledgement just received may have made room for it
+            if (batchReady) {
+                Sensors_SendBatch();
+            }
+        }
         /* USER CODE END WHILE */
 
         /* USER CODE BEGIN 3 */
@@ -256,7 +416,211 @@ void SystemClock_Config(void) {
 }
 
 /* USER CODE BEGIN 4 */
+/**
+ * @brief Implementation for `ProtoCtx.messageCallback`
+ */
+static void Sensors_MsgCallback(void *cbCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload) {
+    switch (msgType) {
+    case PROTO_MSG_TYPE_SENSOR_REQUEST:
+        if (payloadLength >= sizeof(ProtoSensorRequestPayload)) {
+            requestedSamples = ((ProtoSensorRequestPayload *)payload)->count;
+            requestReceived = true;
+            // Cancelled: the samples already taken are not wanted anymore
+            if (requestedSamples == 0) {
+                sensorBatch.count = 0;
+                batchReady = false;
+            }
+        }
+        break;
+    case PROTO_MSG_TYPE_SENSOR_CONFIG:
+        if (payloadLength >= sizeof(ProtoSensorConfigPayload)) {
+            const ProtoSensorConfigPayload *config = (ProtoSensorConfigPayload *)payload;
+            // Merged with a configuration still pending, only the fields set are changed
+            if (config->samplePeriodMs != 0) {
+                pendingConfig.samplePeriodMs = config->samplePeriodMs;
+            }
+            if (config->accelOdr != PROTO_ACCEL_ODR_KEEP) {
+                pendingConfig.accelOdr = config->accelOdr;
+            }
+            if (config->accelScale != PROTO_ACCEL_SCALE_KEEP) {
+                pendingConfig.accelScale = config->accelScale;
+            }
+            if (config->humidityPrecision != PROTO_HUMIDITY_PRECISION_KEEP) {
+                pendingConfig.humidityPrecision = config->humidityPrecision;
+            }
+            if (config->batchSize != 0) {
+                pendingConfig.batchSize = config->batchSize;
+            }
+            configPending = true;
+        }
+        break;
+    case PROTO_MSG_TYPE_TIME_SYNC:
+        if (payloadLength >= sizeof(ProtoTimeSyncPayload)) {
+            memcpy(&pendingTimeSync, payload, sizeof(pendingTimeSync));
+            pendingTimeSyncTick = HAL_GetTick();
+            timeSyncPending = true;
+        }
+        break;
+    case PROTO_MSG_TYPE_PING:
+        // The master (re)started, it asks again for what it needs
+        requestedSamples = 0;
+        break;
+    case PROTO_MSG_TYPE_FW_BEGIN:
+        // The image is announced again to the bootloader, after the restart
+        updateRequested = true;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Hashes and sends the samples collected. If the window is full the hashed batch is kept, and the next call
+ * sends it as is
+ */
+static void Sensors_SendBatch(void) {
+    if (!batchReady) {
+        PayloadBatchHash(&sensorBatch, &hmacKey);
+        batchReady = true;
+    }
+
+    ProtoErrorCode status = ProtoSend(
+        &protoCtx, PROTO_MSG_TYPE_SENSOR_BATCH, SENSOR_BATCH_LENGTH(sensorBatch.count), (uint8_t *)&sensorBatch);
+    if (status == PROTO_ERROR_BUSY) {
+        return;
+    }
+    PROTO_CHECK(status);
+    sensorBatch.count = 0;
+    batchReady = false;
+}
+
+/**
+ * @brief Sends an event to the master, or keeps it until the previous one is acknowledged. Only the latest event
+ * waits: the master reads the current state anyway when it wakes up
+ */
+static void Sensors_RaiseEvent(ProtoEventType type, uint16_t detail) {
+    ProtoErrorCode status = ProtoSendEvent(&protoCtx, type, detail);
+
+    if (status == PROTO_ERROR_BUSY) {
+        pendingEvent.type = (uint8_t)type;
+        pendingEvent.detail = detail;
+        eventPending = true;
+        return;
+    }
+    // An older master does not know about events
+    if (status != PROTO_ERROR_INVALID_STATE) {
+        PROTO_CHECK(status);
+    }
+}
 
+/**
+ * @brief Tracks whether a sensor answers, and raises `PROTO_EVENT_SENSOR_FAULT` when it stops
+ */
+static void Sensors_SetFault(ProtoEventSensor sensor, bool failed) {
+    if (failed && !(sensorFaults & sensor)) {
+        Sensors_RaiseEvent(PROTO_EVENT_SENSOR_FAULT, sensor);
+    }
+    sensorFaults = failed ? (sensorFaults | sensor) : (sensorFaults & ~sensor);
+}
+
+/**
+ * @brief Erases the secrets and resets if a tamper input was triggered
+ */
+static void Sensors_CheckTamper(void) {
+    if (RTC_CheckTamper2()) {
+        Sensors_Tampered(2);
+    }
+    if (RTC_CheckTamper3()) {
+        Sensors_Tampered(3);
+    }
+}
+
+/**
+ * @brief Erases the secrets and restarts. The master is told right after the erase, which never waits for the link,
+ * and the restart waits a little for its acknowledgement: after it the firmware only blinks the tamper code
+ *
+ * @param input The tamper input which fired, 2 or 3
+ */
+static void Sensors_Tampered(uint8_t input) {
+    Crypto_HMACKeyWipe(&hmacKey);
+    ERR_CHECK(FactoryData_Load(&eepromData));
+    if (input == 2) {
+        eepromData.tamper2 = 1;
+    } else {
+        eepromData.tamper3 = 1;
+    }
+    ERR_CHECK(FactoryData_EraseSecrets(&eepromData));
+    FactoryData_Unload(&eepromData);
+
+    uint32_t start = HAL_GetTick();
+    bool sent = false;
+    while (HAL_GetTick() - start < TAMPER_ACK_TIMEOUT_MS) {
+        if (!sent) {
+            // Another event may still wait for its acknowledgement
+            ProtoErrorCode status = ProtoSendEvent(&protoCtx, PROTO_EVENT_TAMPER, input);
+            if (status != PROTO_SUCCESS && status != PROTO_ERROR_BUSY) {
+                break;
+            }
+            sent = status == PROTO_SUCCESS;
+        } else if (ProtoEventAcked(&protoCtx)) {
+            break;
+        }
+        if (ProtoReceive(&protoCtx) == PROTO_ERROR_HAL) {
+            break;
+        }
+    }
+
+    HAL_NVIC_SystemReset();
+}
+
+/**
+ * @brief Restarts into the bootloader to receive the image announced. Nothing else is waited for: the bootloader pings
+ * the master, which announces the image again
+ */
+static void Sensors_EnterBootloader(void) {
+    ERR_CHECK(Boot_RequestUpdate());
+
+    HAL_NVIC_SystemReset();
+}
+
+/**
+ * @brief Applies the fields set in a sampling configuration. Values out of range are ignored
+ */
+static void Sensors_ApplyConfig(stmdev_ctx_t *stmdevCtx, const ProtoSensorConfigPayload *config) {
+    static const lis2dh12_odr_t odrs[] = {
+        [PROTO_ACCEL_ODR_1HZ] = LIS2DH12_ODR_1Hz,
+        [PROTO_ACCEL_ODR_10HZ] = LIS2DH12_ODR_10Hz,
+        [PROTO_ACCEL_ODR_25HZ] = LIS2DH12_ODR_25Hz,
+        [PROTO_ACCEL_ODR_50HZ] = LIS2DH12_ODR_50Hz,
+        [PROTO_ACCEL_ODR_100HZ] = LIS2DH12_ODR_100Hz,
+        [PROTO_ACCEL_ODR_200HZ] = LIS2DH12_ODR_200Hz,
+        [PROTO_ACCEL_ODR_400HZ] = LIS2DH12_ODR_400Hz,
+    };
+    static const lis2dh12_fs_t scales[] = {
+        [PROTO_ACCEL_SCALE_2G] = LIS2DH12_2g,
+        [PROTO_ACCEL_SCALE_4G] = LIS2DH12_4g,
+        [PROTO_ACCEL_SCALE_8G] = LIS2DH12_8g,
+        [PROTO_ACCEL_SCALE_16G] = LIS2DH12_16g,
+    };
+
+    if (config->samplePeriodMs >= SAMPLE_PERIOD_MIN_MS) {
+        samplePeriodMs = config->samplePeriodMs;
+    }
+    if (config->accelOdr != PROTO_ACCEL_ODR_KEEP && config->accelOdr < sizeof(odrs) / sizeof(odrs[0])) {
+        ERR_CHECK_CUSTOM(lis2dh12_data_rate_set(stmdevCtx, odrs[config->accelOdr]), 0);
+    }
+    if (config->accelScale != PROTO_ACCEL_SCALE_KEEP && config->accelScale < sizeof(scales) / sizeof(scales[0])) {
+        ERR_CHECK_CUSTOM(lis2dh12_full_scale_set(stmdevCtx, scales[config->accelScale]), 0);
+        accelScale = config->accelScale;
+    }
+    if (config->humidityPrecision == PROTO_HUMIDITY_PRECISION_HIGH ||
+        config->humidityPrecision == PROTO_HUMIDITY_PRECISION_LOW) {
+        sht4x_enable_low_power_mode(config->humidityPrecision == PROTO_HUMIDITY_PRECISION_LOW);
+    }
+    if (config->batchSize > 0 && config->batchSize <= SENSOR_BATCH_MAX_SAMPLES) {
+        batchSize = config->batchSize;
+    }
+}
 /* USER CODE END 4 */
 
 /**
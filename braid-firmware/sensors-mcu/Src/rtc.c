@@ -31,6 +31,11 @@ typedef enum TamperStatus {
 
 __IO TamperStatus tamper2 = INTACT;
 __IO TamperStatus tamper3 = INTACT;
+
+/** @brief Set once the calendar holds the time of the master */
+static bool rtcSynchronized = false;
+/** @brief Time of the last synchronization, the reference to measure the RTC rate against */
+static uint64_t lastSyncMs;
 /* USER CODE END 0 */
 
 RTC_HandleTypeDef hrtc;
@@ -169,4 +174,153 @@ void HAL_RTCEx_Tamper2EventCallback(RTC_HandleTypeDef *hrtc) {
 void HAL_RTCEx_Tamper3EventCallback(RTC_HandleTypeDef *hrtc) {
     tamper3 = TAMPERED;
 }
+
+/**
+ * @brief Days since 1970-01-01 of a date of the proleptic Gregorian calendar
+ */
+static uint32_t RTC_DaysFromCivil(uint32_t year, uint32_t month, uint32_t day) {
+    year -= (month <= 2);
+    uint32_t era = year / 400;
+    uint32_t yoe = year - era * 400;
+    uint32_t doy = (153 * ((month > 2) ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+/**
+ * @brief Date of the proleptic Gregorian calendar of a number of days since 1970-01-01
+ */
+static void RTC_CivilFromDays(uint32_t days, RTC_DateTypeDef *date) {
+    days += 719468;
+    uint32_t era = days / 146097;
+    uint32_t doe = days - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint32_t month = (mp < 10) ? mp + 3 : mp - 9;
+
+    date->Date = doy - (153 * mp + 2) / 5 + 1;
+    date->Month = month;
+    date->Year = yoe + era * 400 + (month <= 2) - 2000;
+    // 1970-01-01 was a Thursday, the RTC counts from Monday = 1
+    date->WeekDay = (days - 719468 + 3) % 7 + 1;
+}
+
+/**
+ * @brief Reads the calendar as milliseconds since 1970-01-01
+ */
+static uint64_t RTC_ReadMs(void) {
+    RTC_TimeTypeDef time;
+    RTC_DateTypeDef date;
+
+    // The date must be read after the time, which locks the calendar shadow registers until then
+    HAL_RTC_GetTime(&hrtc, &time, RTC_FORMAT_BIN);
+    HAL_RTC_GetDate(&hrtc, &date, RTC_FORMAT_BIN);
+
+    uint64_t seconds = (uint64_t)RTC_DaysFromCivil(2000 + date.Year, date.Month, date.Date) * 86400u +
+                       time.Hours * 3600u + time.Minutes * 60u + time.Seconds;
+    // Right after a shift the sub-seconds may still belong to the previous second
+    uint32_t elapsed = (time.SubSeconds <= time.SecondFraction) ? time.SecondFraction - time.SubSeconds : 0;
+
+    return seconds * 1000u + elapsed * 1000u / (time.SecondFraction + 1);
+}
+
+/**
+ * @brief Sets the calendar, to the second
+ */
+static void RTC_WriteSeconds(uint64_t seconds) {
+    RTC_TimeTypeDef time = {0};
+    RTC_DateTypeDef date = {0};
+
+    RTC_CivilFromDays((uint32_t)(seconds / 86400u), &date);
+    time.Hours = (seconds % 86400u) / 3600u;
+    time.Minutes = (seconds % 3600u) / 60u;
+    time.Seconds = seconds % 60u;
+    time.DayLightSaving = RTC_DAYLIGHTSAVING_NONE;
+    time.StoreOperation = RTC_STOREOPERATION_RESET;
+
+    ERR_CHECK(HAL_RTC_SetTime(&hrtc, &time, RTC_FORMAT_BIN));
+    ERR_CHECK(HAL_RTC_SetDate(&hrtc, &date, RTC_FORMAT_BIN));
+}
+
+/**
+ * @brief Changes the synchronous prescaler, which sets the length of a second in LSI cycles
+ */
+static void RTC_WriteSynchPrediv(uint32_t synchPrediv) {
+    __HAL_RTC_WRITEPROTECTION_DISABLE(&hrtc);
+    ERR_CHECK(RTC_EnterInitMode(&hrtc));
+    // Two separate writes, as required by the reference manual
+    hrtc.Instance->PRER = synchPrediv;
+    hrtc.Instance->PRER |= hrtc.Init.AsynchPrediv << RTC_PRER_PREDIV_A_Pos;
+    CLEAR_BIT(hrtc.Instance->ISR, RTC_ISR_INIT);
+    __HAL_RTC_WRITEPROTECTION_ENABLE(&hrtc);
+    ERR_CHECK(HAL_RTC_WaitForSynchro(&hrtc));
+
+    hrtc.Init.SynchPrediv = synchPrediv;
+}
+
+/**
+ * @brief Disciplines the RTC with the time of the master. The LSI is far from its nominal frequency and drifts with
+ * temperature: the rate is corrected by scaling the synchronous prescaler with the drift measured since the previous
+ * synchronization, then the phase by shifting the sub-seconds or, for big errors, by setting the calendar
+ *
+ * @param seconds Unix time of the master, in seconds
+ * @param milliseconds Milliseconds elapsed in `seconds`
+ */
+void RTC_SetUnixTime(uint32_t seconds, uint16_t milliseconds) {
+    uint64_t masterMs = (uint64_t)seconds * 1000u + milliseconds;
+    uint64_t rtcMs = RTC_ReadMs();
+
+    if (rtcSynchronized && masterMs > lastSyncMs + RTC_RATE_MIN_INTERVAL_MS) {
+        uint64_t masterElapsed = masterMs - lastSyncMs;
+        uint64_t rtcElapsed = rtcMs - lastSyncMs;
+        uint32_t synchPrediv = (uint32_t)(((hrtc.Init.SynchPrediv + 1) * rtcElapsed + masterElapsed / 2) /
+                                          masterElapsed) -
+                               1;
+
+        // Anything beyond the LSI tolerance means that the master clock itself was stepped
+        if (rtcElapsed > masterElapsed / 2 && rtcElapsed < masterElapsed * 2 && synchPrediv <= RTC_PRER_PREDIV_S &&
+            synchPrediv != hrtc.Init.SynchPrediv) {
+            RTC_WriteSynchPrediv(synchPrediv);
+        }
+    }
+
+    int64_t error = (int64_t)(masterMs - rtcMs);
+    if (!rtcSynchronized || error <= -RTC_MAX_SHIFT_MS || error >= RTC_MAX_SHIFT_MS) {
+        // The calendar restarts at the beginning of the second, the milliseconds are left to the shift
+        RTC_WriteSeconds(masterMs / 1000u);
+        error = (int64_t)(masterMs % 1000u);
+    }
+
+    uint32_t fraction = hrtc.Init.SynchPrediv + 1;
+    if (error > 0) {
+        // Ahead by one second, then back by the rest
+        ERR_CHECK(
+            HAL_RTCEx_SetSynchroShift(&hrtc, RTC_SHIFTADD1S_SET, (uint32_t)(1000 - error) * fraction / 1000u));
+    } else if (error < 0) {
+        ERR_CHECK(HAL_RTCEx_SetSynchroShift(&hrtc, RTC_SHIFTADD1S_RESET, (uint32_t)(-error) * fraction / 1000u));
+    }
+
+    lastSyncMs = masterMs;
+    rtcSynchronized = true;
+}
+
+/**
+ * @brief Tells whether the RTC was synchronized with the master since the start
+ *
+ * @return `true` if `RTC_GetUnixTimeMs` returns the Unix time
+ */
+bool RTC_IsSynchronized(void) {
+    return rtcSynchronized;
+}
+
+/**
+ * @brief Reads the time kept by the RTC. Only meaningful if `RTC_IsSynchronized`
+ *
+ * @return Unix time, in milliseconds
+ */
+uint64_t RTC_GetUnixTimeMs(void) {
+    return RTC_ReadMs();
+}
 /* USER CODE END 1 */
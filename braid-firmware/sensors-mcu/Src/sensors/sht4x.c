@@ -81,6 +81,29 @@ int16_t sht4x_read(int32_t *temperature, int32_t *humidity) {
     return ret;
 }
 
+int16_t sht4x_measure_blocking_read_centi(int16_t *temperature, int16_t *humidity) {
+    int16_t ret;
+
+    ret = sht4x_measure();
+    if (ret)
+        return ret;
+    sensirion_sleep_usec(sht4x_cmd_measure_delay_us);
+    return sht4x_read_centi(temperature, humidity);
+}
+
+int16_t sht4x_read_centi(int16_t *temperature, int16_t *humidity) {
+    uint16_t words[2];
+    int16_t ret = sensirion_i2c_read_words(SHT4X_ADDRESS, words, SENSIRION_NUM_WORDS(words));
+    /**
+     * same formulas as sht4x_read(), scaled by 100 instead of 1000:
+     * 17500 / 65535 ~= 4375 / 2^14 and 12500 / 65535 ~= 3125 / 2^14
+     */
+    *temperature = (int16_t)(((4375 * (int32_t)words[0]) >> 14) - 4500);
+    *humidity = (int16_t)(((3125 * (int32_t)words[1]) >> 14) - 600);
+
+    return ret;
+}
+
 int16_t sht4x_probe(void) {
     uint32_t serial;
 
@@ -56,6 +56,9 @@
 
 /* External variables --------------------------------------------------------*/
 extern RTC_HandleTypeDef hrtc;
+extern DMA_HandleTypeDef hdma_usart2_rx;
+extern DMA_HandleTypeDef hdma_usart2_tx;
+extern UART_HandleTypeDef huart2;
 /* USER CODE BEGIN EV */
 
 /* USER CODE END EV */
@@ -148,6 +151,33 @@ void RTC_IRQHandler(void) {
     /* USER CODE END RTC_IRQn 1 */
 }
 
+/**
+ * @brief This function handles DMA1 channel 4, channel 5, channel 6 and channel 7 interrupts.
+ */
+void DMA1_Channel4_5_6_7_IRQHandler(void) {
+    /* USER CODE BEGIN DMA1_Channel4_5_6_7_IRQn 0 */
+
+    /* USER CODE END DMA1_Channel4_5_6_7_IRQn 0 */
+    HAL_DMA_IRQHandler(&hdma_usart2_tx);
+    HAL_DMA_IRQHandler(&hdma_usart2_rx);
+    /* USER CODE BEGIN DMA1_Channel4_5_6_7_IRQn 1 */
+
+    /* USER CODE END DMA1_Channel4_5_6_7_IRQn 1 */
+}
+
+/**
+ * @brief This function handles USART2 global interrupt / USART2 wake-up interrupt through EXTI line 26.
+ */
+void USART2_IRQHandler(void) {
+    /* USER CODE BEGIN USART2_IRQn 0 */
+
+    /* USER CODE END USART2_IRQn 0 */
+    HAL_UART_IRQHandler(&huart2);
+    /* USER CODE BEGIN USART2_IRQn 1 */
+
+    /* USER CODE END USART2_IRQn 1 */
+}
+
 /* USER CODE BEGIN 1 */
 
 /* USER CODE END 1 */
@@ -25,15 +25,51 @@
 #include <string.h>
 
 #define UART_TIMEOUT (2000)
+// USART2 oversamples by 16 from the 32 MHz PCLK1
+#define UART_MAX_BAUD_RATE (2000000)
+// Both ring sizes must be powers of two. The TX ring must hold at least a whole frame. The bootloader needs a larger
+// RX ring: the DMA keeps receiving the window while the core is stalled by flash programming
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE (512u)
+#endif
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE (512u)
+#endif
 
 __IO ITStatus UartReady = RESET;
 ProtoCtx protoCtx;
 
+// Circular DMA target. `rxWritten` and `rxRead` count bytes since startup, their difference is what is still unread
+static uint8_t rxBuffer[UART_RX_BUFFER_SIZE];
+static volatile uint32_t rxWritten;
+static uint32_t rxRead;
+
+// Bytes between `txTail` and `txHead` wait to be sent, the first `txInFlight` ones are being sent by the DMA
+static uint8_t txBuffer[UART_TX_BUFFER_SIZE];
+static volatile uint32_t txHead;
+static volatile uint32_t txTail;
+static volatile uint32_t txInFlight;
+
+// Event frame sent ahead of the ring as soon as the DMA is done with its current chunk
+static uint8_t txUrgent[PROTO_EVENT_FRAME_MAX_LEN];
+static volatile uint32_t txUrgentLength;
+static volatile uint8_t txUrgentInFlight;
+
 static int Sensors_ProtoWrite(void *writeCtx, size_t length, const uint8_t *data);
+#if PROTO_EVENTS_ENABLE
+static int Sensors_ProtoWriteUrgent(void *writeCtx, size_t length, const uint8_t *data);
+#endif
 static int Sensors_ProtoRead(void *readCtx, size_t length, uint8_t *data);
+#if PROTO_BAUD_ENABLE
+static int Sensors_ProtoSetBaudRate(void *writeCtx, uint32_t baudRate);
+#endif
+static HAL_StatusTypeDef Sensors_StartReception(void);
+static HAL_StatusTypeDef Sensors_StartTransmission(void);
 /* USER CODE END 0 */
 
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
 
 /* USART2 init function */
 
@@ -59,9 +95,25 @@ void MX_USART2_UART_Init(void) {
         Error_Handler();
     }
     /* USER CODE BEGIN USART2_Init 2 */
+    ProtoInit(&protoCtx);
     protoCtx.write = Sensors_ProtoWrite;
+#if PROTO_EVENTS_ENABLE
+    protoCtx.writeUrgent = Sensors_ProtoWriteUrgent;
+#endif
     protoCtx.read = Sensors_ProtoRead;
+    protoCtx.getTimeMs = HAL_GetTick;
     protoCtx.messageCallback = NULL;
+    protoCtx.window = PROTO_WINDOW_SIZE;
+    protoCtx.cobs = 1;
+#if PROTO_BAUD_ENABLE
+    protoCtx.setBaudRate = Sensors_ProtoSetBaudRate;
+    protoCtx.maxBaudRate = UART_MAX_BAUD_RATE;
+#endif
+    protoCtx.pull = 1;
+
+    if (Sensors_StartReception() != HAL_OK) {
+        Error_Handler();
+    }
     /* USER CODE END USART2_Init 2 */
 }
 
@@ -86,6 +138,42 @@ void HAL_UART_MspInit(UART_HandleTypeDef *uartHandle) {
         GPIO_InitStruct.Alternate = GPIO_AF4_USART2;
         HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+        /* USART2 DMA Init */
+        /* USART2_RX Init */
+        hdma_usart2_rx.Instance = DMA1_Channel5;
+        hdma_usart2_rx.Init.Request = DMA_REQUEST_4;
+        hdma_usart2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        hdma_usart2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_usart2_rx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_usart2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_usart2_rx.Init.Mode = DMA_CIRCULAR;
+        hdma_usart2_rx.Init.Priority = DMA_PRIORITY_HIGH;
+        if (HAL_DMA_Init(&hdma_usart2_rx) != HAL_OK) {
+            Error_Handler();
+        }
+
+        __HAL_LINKDMA(uartHandle, hdmarx, hdma_usart2_rx);
+
+        /* USART2_TX Init */
+        hdma_usart2_tx.Instance = DMA1_Channel4;
+        hdma_usart2_tx.Init.Request = DMA_REQUEST_4;
+        hdma_usart2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+        hdma_usart2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_usart2_tx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_usart2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_usart2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_usart2_tx.Init.Mode = DMA_NORMAL;
+        hdma_usart2_tx.Init.Priority = DMA_PRIORITY_LOW;
+        if (HAL_DMA_Init(&hdma_usart2_tx) != HAL_OK) {
+            Error_Handler();
+        }
+
+        __HAL_LINKDMA(uartHandle, hdmatx, hdma_usart2_tx);
+
+        /* USART2 interrupt Init */
+        HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
+        HAL_NVIC_EnableIRQ(USART2_IRQn);
         /* USER CODE BEGIN USART2_MspInit 1 */
 
         /* USER CODE END USART2_MspInit 1 */
@@ -106,6 +194,12 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef *uartHandle) {
         */
         HAL_GPIO_DeInit(GPIOA, GPIO_PIN_9 | GPIO_PIN_10);
 
+        /* USART2 DMA DeInit */
+        HAL_DMA_DeInit(uartHandle->hdmarx);
+        HAL_DMA_DeInit(uartHandle->hdmatx);
+
+        /* USART2 interrupt Deinit */
+        HAL_NVIC_DisableIRQ(USART2_IRQn);
         /* USER CODE BEGIN USART2_MspDeInit 1 */
 
         /* USER CODE END USART2_MspDeInit 1 */
@@ -113,19 +207,191 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef *uartHandle) {
 }
 
 /* USER CODE BEGIN 1 */
+bool Sensors_ProtoRxPending(void) {
+    return rxWritten != rxRead;
+}
+
+/**
+ * Accounts for the bytes stored by the DMA up to `position` in `rxBuffer`. Called at least twice per turn of the buffer
+ * (half and full transfer), so that the distance from the previous position is never ambiguous
+ */
+static void Sensors_RxAdvance(uint32_t position) {
+    uint32_t offset = rxWritten % UART_RX_BUFFER_SIZE;
+
+    rxWritten += (position >= offset) ? position - offset : UART_RX_BUFFER_SIZE - offset + position;
+}
+
+static HAL_StatusTypeDef Sensors_StartReception(void) {
+    uint32_t offset = rxWritten % UART_RX_BUFFER_SIZE;
+
+    // The DMA starts again from the beginning of the buffer: the rest of it is skipped, and cleared so that no stale
+    // frame is parsed twice
+    if (offset != 0) {
+        memset(&rxBuffer[offset], 0, UART_RX_BUFFER_SIZE - offset);
+        rxWritten += UART_RX_BUFFER_SIZE - offset;
+    }
+
+    return HAL_UARTEx_ReceiveToIdle_DMA(&huart2, rxBuffer, UART_RX_BUFFER_SIZE);
+}
+
+static HAL_StatusTypeDef Sensors_StartTransmission(void) {
+    HAL_StatusTypeDef status = HAL_OK;
+    uint32_t primask = __get_PRIMASK();
+
+    // Called both by the writer and by the completion interrupt: only one of them may start the DMA
+    __disable_irq();
+    if (txInFlight == 0 && !txUrgentInFlight && txUrgentLength > 0) {
+        // Chunks end where a `write` call ended, and with COBS every frame is a single call
+        txUrgentInFlight = 1;
+        status = HAL_UART_Transmit_DMA(&huart2, txUrgent, txUrgentLength);
+        if (status != HAL_OK) {
+            txUrgentInFlight = 0;
+        }
+    } else if (txInFlight == 0 && !txUrgentInFlight && txHead != txTail) {
+        uint32_t offset = txTail % UART_TX_BUFFER_SIZE;
+        uint32_t pending = txHead - txTail;
+
+        txInFlight = (pending < UART_TX_BUFFER_SIZE - offset) ? pending : UART_TX_BUFFER_SIZE - offset;
+        status = HAL_UART_Transmit_DMA(&huart2, &txBuffer[offset], txInFlight);
+        if (status != HAL_OK) {
+            txInFlight = 0;
+        }
+    }
+    __set_PRIMASK(primask);
+
+    return status;
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size) {
+    // Idle line, half or full buffer: in circular mode `Size` is the position of the DMA in the buffer
+    if (huart->Instance == USART2) {
+        Sensors_RxAdvance(Size);
+    }
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    if (huart->Instance == USART2) {
+        if (txUrgentInFlight) {
+            txUrgentLength = 0;
+            txUrgentInFlight = 0;
+        }
+        txTail += txInFlight;
+        txInFlight = 0;
+        Sensors_StartTransmission();
+    }
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    // Noise and framing errors leave the DMA running and are caught by the CRC. An overrun stops the reception
+    if (huart->Instance == USART2 && huart->RxState == HAL_UART_STATE_READY) {
+        Sensors_RxAdvance(UART_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart->hdmarx));
+        Sensors_StartReception();
+    }
+}
+
 static int Sensors_ProtoWrite(void *writeCtx, size_t length, const uint8_t *data) {
-    if (HAL_UART_Transmit(&huart2, (uint8_t *)data, length, UART_TIMEOUT) != HAL_OK) {
+    uint32_t start = HAL_GetTick();
+
+    if (length > UART_TX_BUFFER_SIZE) {
+        return -1;
+    }
+
+    // Sleep until the DMA makes room
+    while (UART_TX_BUFFER_SIZE - (txHead - txTail) < length) {
+        if (HAL_GetTick() - start > UART_TIMEOUT) {
+            return -1;
+        }
+        HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    }
+
+    uint32_t offset = txHead % UART_TX_BUFFER_SIZE;
+    size_t first = (length < UART_TX_BUFFER_SIZE - offset) ? length : UART_TX_BUFFER_SIZE - offset;
+    memcpy(&txBuffer[offset], data, first);
+    memcpy(txBuffer, &data[first], length - first);
+    txHead += length;
+
+    if (Sensors_StartTransmission() != HAL_OK) {
         return -1;
     }
 
     return length;
 }
 
-static int Sensors_ProtoRead(void *readCtx, size_t length, uint8_t *data) {
-    if (HAL_UART_Receive(&huart2, data, length, UART_TIMEOUT) == HAL_ERROR) {
+#if PROTO_EVENTS_ENABLE
+static int Sensors_ProtoWriteUrgent(void *writeCtx, size_t length, const uint8_t *data) {
+    uint32_t start = HAL_GetTick();
+
+    if (length > sizeof(txUrgent)) {
+        return -1;
+    }
+
+    // Only a retransmission of the same event can still be waiting, for a few bytes at most
+    while (txUrgentLength > 0) {
+        if (HAL_GetTick() - start > UART_TIMEOUT) {
+            return -1;
+        }
+        HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    }
+
+    memcpy(txUrgent, data, length);
+    txUrgentLength = length;
+
+    if (Sensors_StartTransmission() != HAL_OK) {
         return -1;
     }
 
     return length;
 }
+#endif
+
+static int Sensors_ProtoRead(void *readCtx, size_t length, uint8_t *data) {
+    uint32_t written = rxWritten;
+    uint32_t available = written - rxRead;
+
+    if (available > UART_RX_BUFFER_SIZE) {
+        // The DMA went around the buffer before it was read: drop it all, the protocol recovers the lost frames
+        rxRead = written;
+        return 0;
+    }
+
+    size_t count = (length < available) ? length : available;
+    uint32_t offset = rxRead % UART_RX_BUFFER_SIZE;
+    size_t first = (count < UART_RX_BUFFER_SIZE - offset) ? count : UART_RX_BUFFER_SIZE - offset;
+    memcpy(data, &rxBuffer[offset], first);
+    memcpy(&data[first], rxBuffer, count - first);
+    rxRead += count;
+
+    return count;
+}
+
+#if PROTO_BAUD_ENABLE
+static int Sensors_ProtoSetBaudRate(void *writeCtx, uint32_t baudRate) {
+    uint32_t start = HAL_GetTick();
+
+    // Everything written so far must leave at the old rate: the completion callback runs after the last stop bit
+    while (txHead != txTail || txUrgentLength > 0) {
+        if (HAL_GetTick() - start > UART_TIMEOUT) {
+            return -1;
+        }
+        HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    }
+
+    // Keep what the DMA stored since the last reception event
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    HAL_StatusTypeDef status = HAL_UART_AbortReceive(&huart2);
+    Sensors_RxAdvance(UART_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart2.hdmarx));
+    __set_PRIMASK(primask);
+    if (status != HAL_OK) {
+        return -1;
+    }
+
+    huart2.Init.BaudRate = baudRate;
+    if (HAL_UART_Init(&huart2) != HAL_OK || Sensors_StartReception() != HAL_OK) {
+        return -1;
+    }
+
+    return 0;
+}
+#endif
 /* USER CODE END 1 */
@@ -0,0 +1,234 @@
+/**
+ * @file crc_bench.c
+ * @brief Differential check and speed of the CRC16 backend built with `CRC16_BACKEND`.
+ *
+ * Random buffers, at random offsets, split in two `Crc16Update` calls at a random point and continued from a random
+ * CRC, are checksummed by the backend and by a bit-at-a-time reference of CRC-16/MODBUS, which must agree. The same
+ * buffers go through a bit-level model of the STM32L0 CRC unit, programmed like `crc.c` does for the hardware
+ * backend: the host can not run the peripheral, but the configuration is checked. The backend is then timed over a
+ * buffer, in bytes per cycle. Build it once for `CRC16_BACKEND_TABLE` and once for `CRC16_BACKEND_SLICE4`.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "crc.h"
+
+/// @brief Longest random buffer checked, a frame with a long payload
+#define BENCH_MAX_LENGTH (600u)
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -r, --random N               random buffers checked against the reference (200000)\n"
+        "  -n, --count N                checksums of the buffer timed (200000)\n"
+        "  -l, --length N               length of the buffer timed, in bytes (256)\n",
+        name);
+}
+
+static uint64_t NowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// @brief The time stamp counter where there is one: its rate may differ from the core clock under frequency scaling
+static uint64_t NowCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/// @brief CRC-16/MODBUS one bit at a time, straight from the reflected polynomial
+static uint16_t Crc16Reference(uint16_t crc, size_t length, const uint8_t *data) {
+    while (length-- > 0) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1u) ? (uint16_t)((crc >> 1) ^ 0xA001u) : (uint16_t)(crc >> 1);
+        }
+    }
+
+    return crc;
+}
+
+static uint16_t Reflect(uint16_t value, int bits) {
+    uint16_t reflected = 0;
+
+    for (int bit = 0; bit < bits; bit++) {
+        reflected = (uint16_t)((reflected << 1) | ((value >> bit) & 1u));
+    }
+
+    return reflected;
+}
+
+/// @brief Shifts `bits` bits of `value` into the register of the unit, most significant first
+static uint16_t HardwareShift(uint16_t reg, uint32_t value, int bits) {
+    for (int bit = bits - 1; bit >= 0; bit--) {
+        uint16_t feedback = (uint16_t)((reg >> 15) ^ ((value >> bit) & 1u));
+        reg = (uint16_t)(reg << 1);
+        if (feedback) {
+            reg ^= 0x8005u;
+        }
+    }
+
+    return reg;
+}
+
+/**
+ * Model of the STM32L0 CRC unit as `crc.c` programs it: POL 0x8005 on 16 bits, INIT the reflected CRC, REV_IN by
+ * byte, REV_OUT. Words are written with the first byte on top, then the remaining bytes one by one
+ */
+static uint16_t Crc16Hardware(uint16_t crc, size_t length, const uint8_t *data) {
+    uint16_t reg = Reflect(crc, 16);
+
+    for (; length >= 4; length -= 4, data += 4) {
+        // REV_IN by byte reverses each byte in place, the word still goes in from its top byte
+        for (int i = 0; i < 4; i++) {
+            reg = HardwareShift(reg, Reflect(data[i], 8), 8);
+        }
+    }
+    while (length-- > 0) {
+        reg = HardwareShift(reg, Reflect(*data++, 8), 8);
+    }
+
+    return Reflect(reg, 16);
+}
+
+/// @brief Checksums random buffers with `Crc16Update` and the model, counts the results differing from the reference
+static int CheckRandom(uint32_t count, int *hardwareFailures) {
+    static uint8_t buffer[BENCH_MAX_LENGTH + 8];
+    int failures = 0;
+
+    *hardwareFailures = 0;
+    srand(1);
+    for (uint32_t n = 0; n < count; n++) {
+        size_t offset = (size_t)rand() % 8;
+        size_t length = (size_t)rand() % (BENCH_MAX_LENGTH + 1);
+        size_t split = (size_t)rand() % (length + 1);
+        uint16_t seed = (n % 2 == 0) ? CRC16_INIT : (uint16_t)rand();
+        const uint8_t *data = &buffer[offset];
+
+        for (size_t i = 0; i < length; i++) {
+            buffer[offset + i] = (uint8_t)rand();
+        }
+
+        uint16_t expected = Crc16Reference(seed, length, data);
+        uint16_t actual = Crc16Update(Crc16Update(seed, split, data), length - split, &data[split]);
+        uint16_t hardware = Crc16Hardware(Crc16Hardware(seed, split, data), length - split, &data[split]);
+        if (actual != expected) {
+            if (failures == 0) {
+                fprintf(stderr,
+                    "length %zu, offset %zu, split %zu, seed 0x%04X: got 0x%04X, expected 0x%04X\n",
+                    length,
+                    offset,
+                    split,
+                    seed,
+                    actual,
+                    expected);
+            }
+            failures++;
+        }
+        if (hardware != expected) {
+            (*hardwareFailures)++;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    static const struct option longOptions[] = {
+        {"random", required_argument, NULL, 'r'},
+        {"count", required_argument, NULL, 'n'},
+        {"length", required_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0},
+    };
+    static const uint8_t check[] = "123456789";
+    uint32_t random = 200000;
+    uint32_t count = 200000;
+    uint32_t length = 256;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "r:n:l:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'r':
+            random = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            length = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (count == 0 || length == 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    // The check value of CRC-16/MODBUS
+    uint16_t backendCheck = Crc16(sizeof(check) - 1, check);
+    uint16_t hardwareCheck = Crc16Hardware(CRC16_INIT, sizeof(check) - 1, check);
+    int hardwareFailures;
+    int failures = CheckRandom(random, &hardwareFailures);
+
+    printf("CRC16_BACKEND=%d: check 0x%04X, %d of %" PRIu32 " random buffers differ from the reference\n",
+           CRC16_BACKEND,
+           backendCheck,
+           failures,
+           random);
+    printf("hardware model: check 0x%04X, %d of %" PRIu32 " random buffers differ from the reference\n",
+           hardwareCheck,
+           hardwareFailures,
+           random);
+    if (backendCheck != 0x4B37 || hardwareCheck != 0x4B37 || failures > 0 || hardwareFailures > 0) {
+        return 1;
+    }
+
+    uint8_t *buffer = malloc(length);
+    if (buffer == NULL) {
+        return 2;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        buffer[i] = (uint8_t)(i * 13u + 5u);
+    }
+
+    // Each checksum depends on the previous one, so that the loop is not folded
+    uint16_t crc = CRC16_INIT;
+    uint64_t startNs = NowNs();
+    uint64_t startCycles = NowCycles();
+    for (uint32_t i = 0; i < count; i++) {
+        buffer[0] = (uint8_t)crc;
+        crc = Crc16(length, buffer);
+    }
+    uint64_t cycles = NowCycles() - startCycles;
+    uint64_t elapsedNs = NowNs() - startNs;
+    double bytes = (double)count * length;
+
+    printf("  %" PRIu32 " x %" PRIu32 " bytes: %.2f ns/B, %.0f MB/s",
+           count,
+           length,
+           elapsedNs / bytes,
+           bytes * 1e3 / elapsedNs);
+    if (cycles > 0) {
+        printf(", %.2f bytes/cycle", bytes / cycles);
+    }
+    printf(" (last 0x%04X)\n", crc);
+
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file crypto_backend_openssl.c
+ * @brief SHA-256 from OpenSSL, for the host tools built with `CRYPTO_BACKEND=CRYPTO_BACKEND_OPENSSL`.
+ *
+ * A reference to check the other backends against, and a speed to compare them with. Aborts if OpenSSL fails, which
+ * only happens when out of memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "crypto_backend.h"
+
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_OPENSSL
+
+static void Check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "OpenSSL: %s failed\n", what);
+        abort();
+    }
+}
+
+void Crypto_Sha256Init(CryptoSha256Ctx *ctx) {
+    ctx->md = EVP_MD_CTX_new();
+    Check(ctx->md != NULL, "EVP_MD_CTX_new");
+    Check(EVP_DigestInit_ex(ctx->md, EVP_sha256(), NULL), "EVP_DigestInit_ex");
+}
+
+void Crypto_Sha256Update(CryptoSha256Ctx *ctx, const void *data, size_t length) {
+    Check(EVP_DigestUpdate(ctx->md, data, length), "EVP_DigestUpdate");
+}
+
+void Crypto_Sha256Final(CryptoSha256Ctx *ctx, uint8_t digest[SHA256_HASH_SIZE]) {
+    Check(EVP_DigestFinal_ex(ctx->md, digest, NULL), "EVP_DigestFinal_ex");
+    // Cleans the context before freeing it
+    EVP_MD_CTX_free(ctx->md);
+    ctx->md = NULL;
+}
+
+#endif
@@ -0,0 +1,332 @@
+/**
+ * @file ed25519_bench.c
+ * @brief Known answers, OpenSSL cross-check and speed of `Ed25519Verify`, which checks the sensors MCU images.
+ *
+ * Checks the FIPS 180-2 examples of SHA-512 and the RFC 8032 test vectors, then signs random messages with OpenSSL:
+ * each signature must verify, and must stop verifying once a bit of the message, of the signature or of the key is
+ * flipped, or once `L` is added to its scalar. Then times the verification of an image filling the application
+ * flash of the sensors MCU.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <openssl/evp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ed25519.h"
+
+/// @brief Longest random message signed, a few SHA-512 blocks
+#define BENCH_MAX_MESSAGE (1024u)
+
+typedef struct HashVector {
+    const char *message;
+    uint32_t repeat;
+    const char *digest;
+} HashVector;
+
+typedef struct SignatureVector {
+    const char *publicKey;
+    const char *message;
+    const char *signature;
+} SignatureVector;
+
+static const HashVector hashVectors[] = {
+    {"",
+     1,
+     "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+     "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"},
+    {"abc",
+     1,
+     "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+     "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"},
+    {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+     1,
+     "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018"
+     "501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909"},
+    // The padding fitting the block, spilling over to a second block, and whole blocks
+    {"a",
+     111,
+     "fa9121c7b32b9e01733d034cfc78cbf67f926c7ed83e82200ef86818196921760"
+     "b4beff48404df811b953828274461673c68d04e297b0eb7b2b4d60fc6b566a2"},
+    {"a",
+     112,
+     "c01d080efd492776a1c43bd23dd99d0a2e626d481e16782e75d54c2503b5dc32"
+     "bd05f0f1ba33e568b88fd2d970929b719ecbb152f58f130a407c8830604b70ca"},
+    {"a",
+     128,
+     "b73d1929aa615934e61a871596b3f3b33359f42b8175602e89f7e06e5f658a24"
+     "3667807ed300314b95cacdd579f3e33abdfbe351909519a846d465c59582f321"},
+    {"a",
+     1000000,
+     "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+     "de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b"},
+};
+
+// RFC 8032 section 7.1, tests 1 to 3
+static const SignatureVector signatureVectors[] = {
+    {"d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+     "",
+     "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555"
+     "fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b"},
+    {"3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+     "72",
+     "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+     "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00"},
+    {"fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+     "af82",
+     "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+     "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a"},
+};
+
+// The order of the base point, little endian
+static const uint8_t order[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10};
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n, --count N                random messages signed by OpenSSL and checked (1000)\n"
+        "  -v, --verifications N        verifications of the image timed (200)\n"
+        "  -l, --length N               length of the image, in bytes (20480)\n",
+        name);
+}
+
+static uint64_t NowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// @brief The time stamp counter where there is one: its rate may differ from the core clock under frequency scaling
+static uint64_t NowCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static size_t FromHex(const char *hex, uint8_t *out) {
+    size_t length = strlen(hex) / 2;
+
+    for (size_t i = 0; i < length; i++) {
+        sscanf(&hex[2 * i], "%2hhx", &out[i]);
+    }
+    return length;
+}
+
+static int CheckHashVectors(void) {
+    int failures = 0;
+
+    for (size_t v = 0; v < sizeof(hashVectors) / sizeof(hashVectors[0]); v++) {
+        const HashVector *vector = &hashVectors[v];
+        Sha512Context ctx;
+        uint8_t digest[SHA512_HASH_SIZE];
+        char hex[2 * SHA512_HASH_SIZE + 1];
+
+        // The message is fed in pieces of its own length, across the block boundaries
+        Sha512Initialise(&ctx);
+        for (uint32_t i = 0; i < vector->repeat; i++) {
+            Sha512Update(&ctx, vector->message, strlen(vector->message));
+        }
+        Sha512Finalise(&ctx, digest);
+
+        for (size_t i = 0; i < SHA512_HASH_SIZE; i++) {
+            sprintf(&hex[2 * i], "%02x", digest[i]);
+        }
+        if (strcmp(hex, vector->digest) != 0) {
+            fprintf(stderr, "SHA-512 vector %zu: got %s, expected %s\n", v, hex, vector->digest);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static int CheckSignatureVectors(void) {
+    int failures = 0;
+
+    for (size_t v = 0; v < sizeof(signatureVectors) / sizeof(signatureVectors[0]); v++) {
+        const SignatureVector *vector = &signatureVectors[v];
+        uint8_t publicKey[ED25519_PUBLIC_KEY_SIZE];
+        uint8_t signature[ED25519_SIGNATURE_SIZE];
+        uint8_t message[16];
+
+        FromHex(vector->publicKey, publicKey);
+        FromHex(vector->signature, signature);
+        size_t length = FromHex(vector->message, message);
+        if (!Ed25519Verify(signature, publicKey, length, message)) {
+            fprintf(stderr, "RFC 8032 vector %zu: refused\n", v);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+/// @brief Adds the order of the base point to the scalar of a signature: the same point, a second encoding
+static void AddOrder(uint8_t *signature) {
+    unsigned carry = 0;
+
+    for (size_t i = 0; i < sizeof(order); i++) {
+        carry += signature[32 + i] + order[i];
+        signature[32 + i] = (uint8_t)carry;
+        carry >>= 8;
+    }
+}
+
+/// @brief Signs random messages with OpenSSL, and counts the signatures `Ed25519Verify` gets wrong
+static int CheckAgainstOpenssl(uint32_t count) {
+    uint8_t message[BENCH_MAX_MESSAGE];
+    uint8_t publicKey[ED25519_PUBLIC_KEY_SIZE];
+    uint8_t signature[ED25519_SIGNATURE_SIZE];
+    size_t keyLength = sizeof(publicKey);
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, NULL);
+    int failures = 0;
+
+    if (keyCtx == NULL || EVP_PKEY_keygen_init(keyCtx) <= 0 || EVP_PKEY_keygen(keyCtx, &key) <= 0 ||
+        EVP_PKEY_get_raw_public_key(key, publicKey, &keyLength) <= 0) {
+        fprintf(stderr, "OpenSSL: no Ed25519 key\n");
+        EVP_PKEY_CTX_free(keyCtx);
+        return 1;
+    }
+
+    srand(1);
+    for (uint32_t m = 0; m < count; m++) {
+        size_t length = (size_t)rand() % (sizeof(message) + 1);
+        size_t signatureLength = sizeof(signature);
+        EVP_MD_CTX *mdCtx = EVP_MD_CTX_new();
+
+        for (size_t i = 0; i < length; i++) {
+            message[i] = (uint8_t)rand();
+        }
+        if (mdCtx == NULL || EVP_DigestSignInit(mdCtx, NULL, NULL, NULL, key) <= 0 ||
+            EVP_DigestSign(mdCtx, signature, &signatureLength, message, length) <= 0) {
+            fprintf(stderr, "OpenSSL: signing failed\n");
+            EVP_MD_CTX_free(mdCtx);
+            failures++;
+            break;
+        }
+        EVP_MD_CTX_free(mdCtx);
+
+        if (!Ed25519Verify(signature, publicKey, length, message)) {
+            fprintf(stderr, "message %" PRIu32 ": valid signature refused\n", m);
+            failures++;
+        }
+
+        // One bit flipped in turn in the message, the signature and the key
+        uint8_t *targets[] = {message, signature, publicKey};
+        size_t lengths[] = {length, sizeof(signature), sizeof(publicKey)};
+        for (size_t t = 0; t < 3; t++) {
+            if (lengths[t] == 0) {
+                continue;
+            }
+            size_t bit = (size_t)rand() % (8 * lengths[t]);
+            targets[t][bit / 8] ^= (uint8_t)(1u << (bit % 8));
+            if (Ed25519Verify(signature, publicKey, length, message)) {
+                fprintf(stderr, "message %" PRIu32 ": accepted with bit %zu of %s flipped\n",
+                        m,
+                        bit,
+                        (t == 0) ? "the message" : (t == 1) ? "the signature" : "the key");
+                failures++;
+            }
+            targets[t][bit / 8] ^= (uint8_t)(1u << (bit % 8));
+        }
+
+        AddOrder(signature);
+        if (Ed25519Verify(signature, publicKey, length, message)) {
+            fprintf(stderr, "message %" PRIu32 ": accepted with S + L\n", m);
+            failures++;
+        }
+    }
+
+    EVP_PKEY_free(key);
+    EVP_PKEY_CTX_free(keyCtx);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    static const struct option longOptions[] = {
+        {"count", required_argument, NULL, 'n'},
+        {"verifications", required_argument, NULL, 'v'},
+        {"length", required_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0},
+    };
+    uint32_t count = 1000;
+    uint32_t verifications = 200;
+    uint32_t length = 20480;
+    uint8_t publicKey[ED25519_PUBLIC_KEY_SIZE];
+    uint8_t signature[ED25519_SIGNATURE_SIZE];
+    uint8_t *image;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:v:l:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            verifications = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            length = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    image = calloc(length, 1);
+    if (verifications == 0 || length == 0 || image == NULL) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    int hashFailures = CheckHashVectors();
+    int signatureFailures = CheckSignatureVectors();
+    printf("%zu SHA-512 vectors, %d failed; %zu RFC 8032 vectors, %d failed\n",
+           sizeof(hashVectors) / sizeof(hashVectors[0]),
+           hashFailures,
+           sizeof(signatureVectors) / sizeof(signatureVectors[0]),
+           signatureFailures);
+    int opensslFailures = CheckAgainstOpenssl(count);
+    printf("%" PRIu32 " messages signed by OpenSSL, %d wrong answers\n", count, opensslFailures);
+
+    // The verification of an image only depends on its length through the hash: any signature does for the timing
+    for (size_t i = 0; i < length; i++) {
+        image[i] = (uint8_t)(i * 7u + 1u);
+    }
+    FromHex(signatureVectors[0].publicKey, publicKey);
+    FromHex(signatureVectors[0].signature, signature);
+    uint64_t startNs = NowNs();
+    uint64_t startCycles = NowCycles();
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < verifications; i++) {
+        image[0] = (uint8_t)i;
+        accepted += Ed25519Verify(signature, publicKey, length, image);
+    }
+    uint64_t cycles = NowCycles() - startCycles;
+    uint64_t elapsedNs = NowNs() - startNs;
+
+    printf("%" PRIu32 " x %" PRIu32 " bytes: %.3f ms, %.0f verifications/s",
+           verifications,
+           length,
+           elapsedNs / 1e6 / verifications,
+           verifications * 1e9 / elapsedNs);
+    if (cycles > 0) {
+        printf(", %.2f Mcycles", cycles / 1e6 / verifications);
+    }
+    printf("\n");
+
+    free(image);
+    return (hashFailures + signatureFailures + opensslFailures > 0 || accepted > 0) ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file hmac_bench.c
+ * @brief Cost of the HMAC of the sensor payloads, with the key passed to every call or with its states precomputed.
+ *
+ * The payloads are hashed as by `PayloadHash` and `PayloadBatchHash`, with a key as long as the factory one. Each
+ * case reports the time per message and per sample, for `Crypto_HMAC` and for `Crypto_HMACWithKey`. The RFC 4231
+ * examples are checked first, so that a build with another `CRYPTO_BACKEND` is checked too.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "crypto_hmac.h"
+#include "proto_payload.h"
+#include "sha256.h"
+
+/// @brief Length of the factory key, `HMAC_KEY_LENGTH` of both MCUs
+#define BENCH_KEY_LENGTH (128u)
+
+typedef struct BenchVector {
+    const char *key;
+    size_t keyLength;
+    const char *data;
+    const char *tag;
+} BenchVector;
+
+typedef struct BenchCase {
+    const char *name;
+    size_t dataLength;
+    uint32_t samples;
+} BenchCase;
+
+// RFC 4231 test cases 1, 2 and 6, the last with a key longer than a block
+static const BenchVector vectors[] = {
+    {"\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b",
+     20,
+     "Hi There",
+     "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7"},
+    {"Jefe", 4, "what do ya want for nothing?", "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"},
+    {NULL,
+     131,
+     "Test Using Larger Than Block-Size Key - Hash Key First",
+     "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"},
+};
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n, --count N                messages hashed per case (200000)\n",
+        name);
+}
+
+static uint64_t NowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static int CheckVectors(void) {
+    int failures = 0;
+
+    for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        const BenchVector *vector = &vectors[v];
+        uint8_t key[256];
+        uint8_t tag[SHA256_HASH_SIZE];
+        char hex[2 * SHA256_HASH_SIZE + 1];
+
+        // A NULL key is the 0xaa bytes of the long key cases
+        if (vector->key != NULL) {
+            memcpy(key, vector->key, vector->keyLength);
+        } else {
+            memset(key, 0xaa, vector->keyLength);
+        }
+        Crypto_HMAC(key, vector->keyLength, (const uint8_t *)vector->data, strlen(vector->data), tag, sizeof(tag));
+
+        for (size_t i = 0; i < SHA256_HASH_SIZE; i++) {
+            sprintf(&hex[2 * i], "%02x", tag[i]);
+        }
+        if (strcmp(hex, vector->tag) != 0) {
+            fprintf(stderr, "vector %zu: got %s, expected %s\n", v, hex, vector->tag);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    static const struct option longOptions[] = {
+        {"count", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0},
+    };
+    // The hashed bytes start at `SensorBatch.count`, the offsets follow the samples sent
+    const BenchCase cases[] = {
+        {"SensorPayload", sizeof(SensorDataV1), 1},
+        {"SensorBatch x1", SENSOR_BATCH_LENGTH(1) - offsetof(SensorBatch, count), 1},
+        {"SensorBatch x15",
+         SENSOR_BATCH_LENGTH(SENSOR_BATCH_MAX_SAMPLES) - offsetof(SensorBatch, count),
+         SENSOR_BATCH_MAX_SAMPLES},
+    };
+    uint8_t key[BENCH_KEY_LENGTH];
+    uint8_t data[sizeof(SensorBatch)];
+    uint8_t legacy[SHA256_HASH_SIZE];
+    uint8_t keyed[SHA256_HASH_SIZE];
+    HmacKeyCtx keyCtx;
+    uint32_t count = 200000;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (count == 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = (uint8_t)(i * 7u + 1u);
+    }
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 13u + 5u);
+    }
+
+    int failures = CheckVectors();
+    printf("CRYPTO_BACKEND=%d: %zu vectors, %d failed\n",
+           CRYPTO_BACKEND,
+           sizeof(vectors) / sizeof(vectors[0]),
+           failures);
+    if (failures > 0) {
+        return 1;
+    }
+
+    uint64_t start = NowNs();
+    for (uint32_t i = 0; i < count; i++) {
+        Crypto_HMACKeyInit(&keyCtx, key, sizeof(key));
+    }
+    printf("%-16s %10.1f ns\n", "key init", (double)(NowNs() - start) / count);
+    printf("%-16s %10s %10s %10s %10s\n", "case", "before", "after", "per sample", "speedup");
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        start = NowNs();
+        for (uint32_t i = 0; i < count; i++) {
+            data[0] = (uint8_t)i;
+            Crypto_HMAC(key, sizeof(key), data, cases[c].dataLength, legacy, sizeof(legacy));
+        }
+        double beforeNs = (double)(NowNs() - start) / count;
+
+        start = NowNs();
+        for (uint32_t i = 0; i < count; i++) {
+            data[0] = (uint8_t)i;
+            Crypto_HMACWithKey(&keyCtx, data, cases[c].dataLength, keyed, sizeof(keyed));
+        }
+        double afterNs = (double)(NowNs() - start) / count;
+
+        // The last message of both loops is the same, their tags must be too
+        if (memcmp(legacy, keyed, sizeof(keyed)) != 0) {
+            fprintf(stderr, "%s: tags differ\n", cases[c].name);
+            return 1;
+        }
+        printf("%-16s %7.1f ns %7.1f ns %7.1f ns %9.2fx\n",
+               cases[c].name,
+               beforeNs,
+               afterNs,
+               afterNs / cases[c].samples,
+               beforeNs / afterNs);
+    }
+
+    Crypto_HMACKeyWipe(&keyCtx);
+    return 0;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file loopback.c
+ * @brief Host loopback transport for the protocol, with throttling and error injection.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "loopback.h"
+
+/// @brief Bits on the line for every byte, start and stop bits included
+#define LOOPBACK_BITS_PER_BYTE (10u)
+
+/// @brief Bytes a throttled line can accumulate while nobody reads, like a UART FIFO
+#define LOOPBACK_MAX_CREDIT (16.0)
+
+static int SetNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return -1;
+    }
+
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int SetRaw(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        return -1;
+    }
+    cfmakeraw(&tio);
+
+    return tcsetattr(fd, TCSANOW, &tio);
+}
+
+/// @brief xorshift32, uniform in [0, 1)
+static double Random(LoopbackEnd *end) {
+    uint32_t x = end->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    end->random = x;
+
+    return (double)x / 4294967296.0;
+}
+
+static void InitEnd(LoopbackEnd *end, int fd, LoopbackEnd *peer, uint32_t seed) {
+    memset(end, 0, sizeof(*end));
+    end->fd = fd;
+    end->peer = peer;
+    end->random = seed != 0 ? seed : 1;
+    end->creditAt = LoopbackTimeUs();
+}
+
+/// @brief Forgets the calls whose bytes were all handed to the kernel
+static void ConsumeCalls(LoopbackEnd *end, size_t written) {
+    size_t done = 0;
+
+    end->callFlushed += written;
+    while (done < end->callCount && end->callFlushed >= end->calls[done]) {
+        end->callFlushed -= end->calls[done];
+        done++;
+    }
+    memmove(end->calls, &end->calls[done], (end->callCount - done) * sizeof(end->calls[0]));
+    end->callCount -= done;
+}
+
+/// @brief Hands the backlog to the kernel, as far as it and `wireLimit` take it
+static int Flush(LoopbackEnd *end) {
+    size_t written = 0;
+    while (written < end->backlogLength) {
+        size_t length = end->backlogLength - written;
+        if (end->wireLimit > 0) {
+            size_t onWire = (size_t)(end->flushedBytes + written - end->peer->stats.lineBytes);
+            if (onWire >= end->wireLimit) {
+                break;
+            }
+            length = MIN(length, end->wireLimit - onWire);
+        }
+
+        ssize_t ret = write(end->fd, &end->backlog[written], length);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        written += (size_t)ret;
+    }
+    end->flushedBytes += written;
+
+    memmove(end->backlog, &end->backlog[written], end->backlogLength - written);
+    end->backlogLength -= written;
+    ConsumeCalls(end, written);
+
+    return 0;
+}
+
+/// @brief Applies the drops and bit flips in place, returns the number of bytes left
+static size_t Impair(LoopbackEnd *end, size_t length, uint8_t *data) {
+    LoopbackLine *line = &end->line;
+    bool outage = line->outageUntilUs > LoopbackTimeUs();
+    size_t kept = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        if (outage || (line->dropRate > 0 && Random(end) < line->dropRate)) {
+            end->stats.droppedBytes++;
+            continue;
+        }
+
+        uint8_t byte = data[i];
+        if (line->bitErrorRate > 0) {
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                if (Random(end) < line->bitErrorRate) {
+                    byte ^= (uint8_t)(1u << bit);
+                    end->stats.flippedBits++;
+                }
+            }
+        }
+        data[kept++] = byte;
+    }
+
+    return kept;
+}
+
+int LoopbackOpen(LoopbackKind kind, LoopbackEnd *a, LoopbackEnd *b, uint32_t seed) {
+    int fds[2];
+
+    if (kind == LOOPBACK_PTY) {
+        if (openpty(&fds[0], &fds[1], NULL, NULL, NULL) != 0) {
+            return -1;
+        }
+        if (SetRaw(fds[0]) != 0 || SetRaw(fds[1]) != 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+    } else if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1;
+    }
+
+    if (SetNonBlocking(fds[0]) != 0 || SetNonBlocking(fds[1]) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    InitEnd(a, fds[0], b, seed);
+    InitEnd(b, fds[1], a, seed * 2654435761u);
+
+    return 0;
+}
+
+void LoopbackClose(LoopbackEnd *a, LoopbackEnd *b) {
+    close(a->fd);
+    close(b->fd);
+    a->fd = -1;
+    b->fd = -1;
+}
+
+void LoopbackAttach(ProtoCtx *ctx, LoopbackEnd *end) {
+    ctx->write = LoopbackWrite;
+    ctx->writeUrgent = LoopbackWriteUrgent;
+    ctx->writeCtx = end;
+    ctx->read = LoopbackRead;
+    ctx->readCtx = end;
+    ctx->getTimeMs = LoopbackTimeMs;
+}
+
+int LoopbackWrite(void *writeCtx, size_t length, const uint8_t *data) {
+    LoopbackEnd *end = writeCtx;
+
+    if (end->backlogLength + length > sizeof(end->backlog) || end->callCount == LOOPBACK_MAX_CALLS) {
+        return -1;
+    }
+    memcpy(&end->backlog[end->backlogLength], data, length);
+    end->backlogLength += length;
+    end->calls[end->callCount++] = (uint32_t)length;
+
+    if (Flush(end) != 0) {
+        return -1;
+    }
+
+    return (int)length;
+}
+
+int LoopbackWriteUrgent(void *writeCtx, size_t length, const uint8_t *data) {
+    LoopbackEnd *end = writeCtx;
+
+    if (end->backlogLength + length > sizeof(end->backlog) || end->callCount == LOOPBACK_MAX_CALLS) {
+        return -1;
+    }
+
+    /* the call the kernel took a part of must be finished first, or both frames would be broken */
+    size_t call = (end->callFlushed > 0) ? 1 : 0;
+    size_t offset = (call > 0) ? end->calls[0] - end->callFlushed : 0;
+
+    memmove(&end->backlog[offset + length], &end->backlog[offset], end->backlogLength - offset);
+    memcpy(&end->backlog[offset], data, length);
+    end->backlogLength += length;
+    memmove(&end->calls[call + 1], &end->calls[call], (end->callCount - call) * sizeof(end->calls[0]));
+    end->calls[call] = (uint32_t)length;
+    end->callCount++;
+
+    if (Flush(end) != 0) {
+        return -1;
+    }
+
+    return (int)length;
+}
+
+int LoopbackRead(void *readCtx, size_t length, uint8_t *data) {
+    LoopbackEnd *end = readCtx;
+    LoopbackLine *line = &end->line;
+
+    if (Flush(end->peer) != 0) {
+        return -1;
+    }
+
+    if (line->baudRate > 0) {
+        uint64_t now = LoopbackTimeUs();
+        end->credit += (double)(now - end->creditAt) * line->baudRate / LOOPBACK_BITS_PER_BYTE / 1e6;
+        end->creditAt = now;
+        if (end->credit > LOOPBACK_MAX_CREDIT) {
+            end->credit = LOOPBACK_MAX_CREDIT;
+        }
+        if (length > (size_t)end->credit) {
+            length = (size_t)end->credit;
+        }
+        if (length == 0) {
+            return 0;
+        }
+    }
+
+    ssize_t ret = read(end->fd, data, length);
+    if (ret < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    if (line->baudRate > 0) {
+        end->credit -= (double)ret;
+    }
+    end->stats.lineBytes += (uint64_t)ret;
+
+    return (int)Impair(end, (size_t)ret, data);
+}
+
+size_t LoopbackPending(LoopbackEnd *end) {
+    return end->backlogLength + (size_t)(end->flushedBytes - end->peer->stats.lineBytes);
+}
+
+uint32_t LoopbackTimeMs(void) {
+    return (uint32_t)(LoopbackTimeUs() / 1000u);
+}
+
+uint64_t LoopbackTimeUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/// @brief Size of the userspace queue for the bytes the kernel did not accept yet
+#define LOOPBACK_BACKLOG_LEN (64u * 1024u)
+
+/// @brief Maximum number of `write` calls waiting in the backlog
+#define LOOPBACK_MAX_CALLS (1024u)
+
+/**
+ * @enum LoopbackKind
+ * @brief Kernel object carrying the bytes between the two ends
+ */
+typedef enum LoopbackKind {
+    /** Unix stream socket pair, large kernel buffers */
+    LOOPBACK_SOCKETPAIR = 0,
+
+    /** Pseudo-terminal master and slave in raw mode, the closest thing to a UART */
+    LOOPBACK_PTY = 1,
+} LoopbackKind;
+
+/**
+ * @struct LoopbackLine
+ * @brief Conditions of the line going into an end. Applied when the bytes are read, so they can be changed at any
+ * time without affecting the bytes already delivered
+ */
+typedef struct LoopbackLine {
+    /** @brief Simulated baud rate with 10 bits per byte, `0` for no throttling */
+    uint32_t baudRate;
+
+    /** @brief Probability of a byte being lost */
+    double dropRate;
+
+    /** @brief Probability of each bit being flipped */
+    double bitErrorRate;
+
+    /** @brief Every byte is lost until this `LoopbackTimeUs` time, to simulate a disconnected cable */
+    uint64_t outageUntilUs;
+} LoopbackLine;
+
+/**
+ * @struct LoopbackStats
+ * @brief Counters of the line going into an end
+ */
+typedef struct LoopbackStats {
+    /** @brief Bytes taken off the line, including the dropped ones */
+    uint64_t lineBytes;
+
+    /** @brief Bytes dropped by `dropRate` or an outage */
+    uint64_t droppedBytes;
+
+    /** @brief Bits flipped by `bitErrorRate` */
+    uint64_t flippedBits;
+} LoopbackStats;
+
+/**
+ * @struct LoopbackEnd
+ * @brief One end of the loopback, to be used as both `writeCtx` and `readCtx` of a `ProtoCtx`
+ */
+typedef struct LoopbackEnd {
+    /** @brief File descriptor of this end, non-blocking */
+    int fd;
+
+    /** @brief The other end, whose backlog is flushed before reading */
+    struct LoopbackEnd *peer;
+
+    /** @brief Conditions of the incoming line */
+    LoopbackLine line;
+
+    /** @brief Counters of the incoming line */
+    LoopbackStats stats;
+
+    /** @brief Bytes the line can deliver right now, when throttled */
+    double credit;
+
+    /** @brief Time `credit` was last updated */
+    uint64_t creditAt;
+
+    /** @brief State of the random generator used for the impairments */
+    uint32_t random;
+
+    /** @brief Written bytes not yet accepted by the kernel */
+    uint8_t backlog[LOOPBACK_BACKLOG_LEN];
+
+    /** @brief Number of bytes in `backlog` */
+    size_t backlogLength;
+
+    /** @brief Bytes handed to the kernel so far */
+    uint64_t flushedBytes;
+
+    /** @brief Bytes the kernel may hold for the other end, like the FIFO of a UART, so that the rest waits in the
+     * backlog where urgent frames can overtake it. `0` for no limit */
+    size_t wireLimit;
+
+    /** @brief Lengths of the `write` calls in the backlog, oldest first */
+    uint32_t calls[LOOPBACK_MAX_CALLS];
+
+    /** @brief Number of entries in `calls` */
+    size_t callCount;
+
+    /** @brief Bytes of the oldest call already handed to the kernel */
+    size_t callFlushed;
+} LoopbackEnd;
+
+/**
+ * @brief Opens a connected pair of ends, with a clean line in both directions
+ *
+ * @param kind The kernel object to use
+ * @param a The first end
+ * @param b The second end
+ * @param seed Seed of the impairments, so that runs can be reproduced
+ * @return `0` on success, `-1` with `errno` set otherwise
+ */
+int LoopbackOpen(LoopbackKind kind, LoopbackEnd *a, LoopbackEnd *b, uint32_t seed);
+
+/**
+ * @brief Closes both ends of a pair
+ *
+ * @param a The first end
+ * @param b The second end
+ */
+void LoopbackClose(LoopbackEnd *a, LoopbackEnd *b);
+
+/**
+ * @brief Installs the loopback HAL in a protocol context: `write`, `writeUrgent`, `read` and `getTimeMs`
+ *
+ * @param ctx The protocol context
+ * @param end The end used by the context
+ */
+void LoopbackAttach(ProtoCtx *ctx, LoopbackEnd *end);
+
+/**
+ * @brief `ProtoCtx.write` implementation. Never blocks: what the kernel does not take is queued in the backlog
+ *
+ * @param writeCtx The `LoopbackEnd` writing
+ * @param length Length of the data buffer
+ * @param data The data buffer to be written
+ * @return `length`, or `-1` if the backlog overflowed
+ */
+int LoopbackWrite(void *writeCtx, size_t length, const uint8_t *data);
+
+/**
+ * @brief `ProtoCtx.writeUrgent` implementation. The frame goes ahead of every call still waiting in the backlog, but
+ * after the one the kernel already took a part of
+ *
+ * @param writeCtx The `LoopbackEnd` writing
+ * @param length Length of the frame
+ * @param data The whole frame
+ * @return `length`, or `-1` if the backlog overflowed
+ */
+int LoopbackWriteUrgent(void *writeCtx, size_t length, const uint8_t *data);
+
+/**
+ * @brief `ProtoCtx.read` implementation. Never blocks, and returns only what the throttled line could have carried
+ * since the last call
+ *
+ * @param readCtx The `LoopbackEnd` reading
+ * @param length Length of the data buffer
+ * @param data The data buffer to be filled
+ * @return The number of bytes that survived the line, `-1` on error
+ */
+int LoopbackRead(void *readCtx, size_t length, uint8_t *data);
+
+/**
+ * @brief Tells how many bytes written by an end are still on their way, in the backlog or in the kernel.
+ * Counted on both ends rather than asked to the kernel, because a pty hides the bytes it is still moving
+ *
+ * @param end The end writing
+ * @return The number of bytes not yet read by the other end
+ */
+size_t LoopbackPending(LoopbackEnd *end);
+
+/**
+ * @brief Monotonic clock in milliseconds, `ProtoCtx.getTimeMs` implementation
+ *
+ * @return The current time in milliseconds
+ */
+uint32_t LoopbackTimeMs(void);
+
+/**
+ * @brief Monotonic clock in microseconds
+ *
+ * @return The current time in microseconds
+ */
+uint64_t LoopbackTimeUs(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
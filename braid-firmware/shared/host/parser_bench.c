@@ -0,0 +1,405 @@
+/**
+ * @file parser_bench.c
+ * @brief Frames per second and cycles per frame of the receive path, the bulk `ProtoReceive` against the byte at a
+ * time parser it replaced.
+ *
+ * Byte streams are recorded from `ProtoSend` in memory, then replayed through both parsers by a `read` HAL which hands
+ * out at most a FIFO worth of bytes per call, like the UART driver. The old parser is kept here as it was before the
+ * bulk reads: one `read` call per byte, the rest of the frame collected in a busy loop. Both must deliver every
+ * recorded payload. Responses are not sent by either side, so that only the reception is measured.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "crc.h"
+#include "proto.h"
+
+/// @brief Frame buffer of the old parser: TYP, LEN, PAYLOAD and CRC, without the start byte
+#define OLD_MSG_MAX_LEN (1 + 1 + PROTO_MSG_SHORT_PAYLOAD_MAX_LEN + 2)
+
+typedef struct BenchOptions {
+    uint32_t count;
+    uint32_t passes;
+    size_t fifoBytes;
+} BenchOptions;
+
+/**
+ * @struct BenchStream
+ * @brief A recorded byte stream, and where the payload of each frame lies in it
+ */
+typedef struct BenchStream {
+    const char *name;
+    uint8_t *bytes;
+    size_t length;
+    uint32_t frames;
+    size_t *payloadOffsets;
+    size_t *payloadLengths;
+} BenchStream;
+
+/**
+ * @struct BenchReader
+ * @brief State of the `read` HAL replaying a stream, `readCtx` of both parsers
+ */
+typedef struct BenchReader {
+    const BenchStream *stream;
+    size_t offset;
+    size_t fifoBytes;
+    uint64_t calls;
+} BenchReader;
+
+/**
+ * @struct BenchSink
+ * @brief What the message callback received, `messageCallbackCtx` of both parsers
+ */
+typedef struct BenchSink {
+    const BenchStream *stream;
+    bool verify;
+    uint32_t frames;
+    uint32_t mismatches;
+} BenchSink;
+
+typedef enum OldState {
+    OLD_STATE_WAIT_START,
+    OLD_STATE_RECV,
+    OLD_STATE_EXEC,
+    OLD_STATE_CRC_ERROR,
+} OldState;
+
+/**
+ * @struct OldParser
+ * @brief The globals of the old parser, gathered so that every run starts clean
+ */
+typedef struct OldParser {
+    OldState state;
+    size_t rxBufferIdx;
+    uint8_t rxBuffer[OLD_MSG_MAX_LEN];
+    uint8_t payloadBuffer[PROTO_MSG_SHORT_PAYLOAD_MAX_LEN];
+} OldParser;
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n, --count N                frames in each recorded stream (20000)\n"
+        "  -r, --passes N               replays of each stream timed (20)\n"
+        "  -f, --fifo BYTES             bytes a read may return at most, like the UART FIFO (128)\n",
+        name);
+}
+
+static uint64_t NowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// @brief The time stamp counter where there is one: its rate may differ from the core clock under frequency scaling
+static uint64_t NowCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int RecordWrite(void *writeCtx, size_t length, const uint8_t *data) {
+    BenchStream *stream = writeCtx;
+
+    memcpy(&stream->bytes[stream->length], data, length);
+    stream->length += length;
+    return (int)length;
+}
+
+static int DiscardWrite(void *writeCtx, size_t length, const uint8_t *data) {
+    (void)writeCtx;
+    (void)data;
+
+    return (int)length;
+}
+
+static int StreamRead(void *readCtx, size_t length, uint8_t *data) {
+    BenchReader *reader = readCtx;
+    size_t left = reader->stream->length - reader->offset;
+
+    if (length > reader->fifoBytes) {
+        length = reader->fifoBytes;
+    }
+    if (length > left) {
+        length = left;
+    }
+    memcpy(data, &reader->stream->bytes[reader->offset], length);
+    reader->offset += length;
+    reader->calls++;
+    return (int)length;
+}
+
+static void SinkCallback(void *messageCallbackCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload) {
+    BenchSink *sink = messageCallbackCtx;
+    (void)msgType;
+
+    if (sink->verify) {
+        const BenchStream *stream = sink->stream;
+        if (sink->frames >= stream->frames || payloadLength != stream->payloadLengths[sink->frames] ||
+            memcmp(payload, &stream->bytes[stream->payloadOffsets[sink->frames]], payloadLength) != 0) {
+            sink->mismatches++;
+        }
+    }
+    sink->frames++;
+}
+
+/**
+ * Records `count` `SENSOR_BATCH` frames as `ProtoSend` writes them, with payloads from `minLength` to `maxLength`
+ */
+static int RecordStream(BenchStream *stream, const char *name, uint32_t count, size_t minLength, size_t maxLength) {
+    static uint8_t payload[PROTO_MSG_SHORT_PAYLOAD_MAX_LEN];
+    ProtoCtx ctx;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->name = name;
+    stream->bytes = malloc((size_t)count * PROTO_MSG_MAX_LEN);
+    stream->payloadOffsets = calloc(count, sizeof(*stream->payloadOffsets));
+    stream->payloadLengths = calloc(count, sizeof(*stream->payloadLengths));
+    if (stream->bytes == NULL || stream->payloadOffsets == NULL || stream->payloadLengths == NULL) {
+        return -1;
+    }
+
+    ProtoInit(&ctx);
+    ctx.write = RecordWrite;
+    ctx.writeCtx = stream;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t length = minLength + (size_t)rand() % (maxLength - minLength + 1);
+        for (size_t j = 0; j < length; j++) {
+            payload[j] = (uint8_t)rand();
+        }
+
+        // Unsequenced, so the payload follows the classic header
+        stream->payloadOffsets[i] = stream->length + 1 + PROTO_MSG_PAYLOAD_OFFSET;
+        stream->payloadLengths[i] = length;
+        if (ProtoSend(&ctx, PROTO_MSG_TYPE_SENSOR_BATCH, length, payload) != PROTO_SUCCESS) {
+            return -1;
+        }
+        stream->frames++;
+    }
+
+    return 0;
+}
+
+static void FreeStream(BenchStream *stream) {
+    free(stream->bytes);
+    free(stream->payloadOffsets);
+    free(stream->payloadLengths);
+}
+
+/**
+ * After detecting the packet start byte, read all bytes and check the CRC
+ */
+static ProtoErrorCode OldRecvLoop(OldParser *parser, BenchReader *reader) {
+    uint8_t rxChar = 0;
+
+    while (true) {
+        int readRet = StreamRead(reader, 1, &rxChar);
+        if (readRet < 0) {
+            return PROTO_ERROR_HAL;
+        } else if (readRet > 0) {
+            parser->rxBuffer[parser->rxBufferIdx++] = rxChar;
+        }
+
+        if (parser->rxBufferIdx > PROTO_MSG_LEN_OFFSET &&
+            parser->rxBufferIdx == (size_t)(4 + parser->rxBuffer[PROTO_MSG_LEN_OFFSET])) {
+            if (CheckCrc16(parser->rxBufferIdx, parser->rxBuffer)) {
+                parser->state = OLD_STATE_EXEC;
+            } else {
+                parser->state = OLD_STATE_CRC_ERROR;
+                return PROTO_ERROR_CRC;
+            }
+            break;
+        }
+    }
+
+    return PROTO_SUCCESS;
+}
+
+static ProtoErrorCode OldReceive(OldParser *parser, BenchReader *reader) {
+    uint8_t rxChar = 0;
+
+    switch (parser->state) {
+    case OLD_STATE_WAIT_START:
+        if (StreamRead(reader, 1, &rxChar) < 0) {
+            return PROTO_ERROR_HAL;
+        }
+
+        if (rxChar == PROTO_MSG_START_BYTE) {
+            parser->rxBufferIdx = 0;
+            parser->state = OLD_STATE_RECV;
+        }
+        break;
+    case OLD_STATE_RECV:
+        return OldRecvLoop(parser, reader);
+    case OLD_STATE_EXEC:
+        break;
+    case OLD_STATE_CRC_ERROR:
+        return PROTO_ERROR_CRC;
+    }
+
+    return PROTO_SUCCESS;
+}
+
+/// @brief `ProtoProcessMessage` of the old parser, delivering every type and without the response
+static void OldProcessMessage(OldParser *parser, BenchSink *sink) {
+    switch (parser->state) {
+    case OLD_STATE_EXEC: {
+        size_t payloadLength = parser->rxBuffer[PROTO_MSG_LEN_OFFSET];
+        memcpy(parser->payloadBuffer, &parser->rxBuffer[PROTO_MSG_PAYLOAD_OFFSET], payloadLength);
+        SinkCallback(sink,
+                     (ProtoMsgType)parser->rxBuffer[PROTO_MSG_TYP_OFFSET],
+                     payloadLength,
+                     parser->payloadBuffer);
+        parser->state = OLD_STATE_WAIT_START;
+        break;
+    }
+    case OLD_STATE_CRC_ERROR:
+        parser->state = OLD_STATE_WAIT_START;
+        break;
+    default:
+        break;
+    }
+}
+
+/// @brief Replays the stream through the old parser, polled like the old main loops
+static void RunOld(const BenchStream *stream, BenchReader *reader, BenchSink *sink) {
+    static OldParser parser;
+
+    memset(&parser, 0, sizeof(parser));
+    reader->offset = 0;
+    while (reader->offset < stream->length || parser.state != OLD_STATE_WAIT_START) {
+        OldReceive(&parser, reader);
+        OldProcessMessage(&parser, sink);
+    }
+}
+
+/// @brief Replays the stream through `ProtoReceive`
+static void RunNew(const BenchStream *stream, BenchReader *reader, BenchSink *sink) {
+    static ProtoCtx ctx;
+
+    ProtoInit(&ctx);
+    ctx.write = DiscardWrite;
+    ctx.read = StreamRead;
+    ctx.readCtx = reader;
+    ctx.messageCallback = SinkCallback;
+    ctx.messageCallbackCtx = sink;
+    reader->offset = 0;
+    while (reader->offset < stream->length) {
+        ProtoReceive(&ctx);
+    }
+}
+
+/**
+ * Checks that a parser delivers the stream, then times it. Returns the number of payloads missed or altered
+ */
+static uint32_t Measure(const char *name,
+                        void (*run)(const BenchStream *, BenchReader *, BenchSink *),
+                        const BenchStream *stream,
+                        const BenchOptions *options,
+                        double *cyclesPerFrame) {
+    BenchReader reader = {.stream = stream, .fifoBytes = options->fifoBytes};
+    BenchSink sink = {.stream = stream, .verify = true};
+
+    run(stream, &reader, &sink);
+    uint32_t failures = sink.mismatches + (sink.frames < stream->frames ? stream->frames - sink.frames : 0);
+
+    memset(&sink, 0, sizeof(sink));
+    reader.calls = 0;
+    uint64_t startNs = NowNs();
+    uint64_t startCycles = NowCycles();
+    for (uint32_t pass = 0; pass < options->passes; pass++) {
+        run(stream, &reader, &sink);
+    }
+    uint64_t cycles = NowCycles() - startCycles;
+    uint64_t elapsedNs = NowNs() - startNs;
+    double frames = (double)stream->frames * options->passes;
+
+    *cyclesPerFrame = cycles / frames;
+    printf("  %-4s %12.0f frames/s %9.0f cycles/frame %8.1f reads/frame %8.0f MB/s\n",
+           name,
+           frames * 1e9 / elapsedNs,
+           *cyclesPerFrame,
+           reader.calls / frames,
+           (double)stream->length * options->passes * 1e3 / elapsedNs);
+
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    static const struct option longOptions[] = {
+        {"count", required_argument, NULL, 'n'},
+        {"passes", required_argument, NULL, 'r'},
+        {"fifo", required_argument, NULL, 'f'},
+        {NULL, 0, NULL, 0},
+    };
+    BenchOptions options = {.count = 20000, .passes = 20, .fifoBytes = 128};
+    BenchStream streams[3];
+    uint32_t failures = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:r:f:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            options.count = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            options.passes = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            options.fifoBytes = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.count == 0 || options.passes == 0 || options.fifoBytes == 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    // Requests and events, full sample batches, and everything in between
+    srand(1);
+    if (RecordStream(&streams[0], "short", options.count, 2, 8) != 0 ||
+        RecordStream(&streams[1], "long", options.count, 250, 250) != 0 ||
+        RecordStream(&streams[2], "mixed", options.count, 0, PROTO_MSG_SHORT_PAYLOAD_MAX_LEN) != 0) {
+        perror("record");
+        return 2;
+    }
+
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+        const BenchStream *stream = &streams[i];
+        double oldCycles, newCycles;
+
+        printf("%s: %" PRIu32 " frames, %zu bytes, fifo %zu bytes\n",
+               stream->name,
+               stream->frames,
+               stream->length,
+               options.fifoBytes);
+        failures += Measure("old", RunOld, stream, &options, &oldCycles);
+        failures += Measure("new", RunNew, stream, &options, &newCycles);
+        if (newCycles > 0) {
+            printf("  speedup %.2fx\n", oldCycles / newCycles);
+        }
+    }
+
+    if (failures > 0) {
+        printf("%" PRIu32 " payloads missed or altered\n", failures);
+    }
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+        FreeStream(&streams[i]);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,423 @@
+/**
+ * @file proto_bench.c
+ * @brief Throughput, latency and recovery benchmark of the protocol over the host loopback.
+ *
+ * One side sends `SENSOR_BATCH` messages carrying a sequence number and a timestamp as fast as the line takes them,
+ * the other side counts what arrives. Both contexts run in the same thread, polled in turn like the firmware loops.
+ * Events can be sent on top of the stream, to measure how long they wait behind the samples.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "loopback.h"
+
+/// @brief Time the benchmark waits for the last messages before giving up on them
+#define BENCH_DRAIN_US (1000000u)
+
+/// @brief Bytes the line holds when a HAL queue is simulated, like the FIFO of a UART
+#define BENCH_WIRE_BYTES (16u)
+
+typedef struct BenchOptions {
+    LoopbackKind kind;
+    LoopbackLine line;
+    uint8_t window;
+    uint8_t cobs;
+    size_t payloadLength;
+    uint32_t count;
+    uint32_t outageMs;
+    uint32_t seed;
+    uint32_t timeoutS;
+    size_t queueBytes;
+    uint32_t eventEvery;
+    uint8_t noUrgent;
+} BenchOptions;
+
+typedef struct BenchHeader {
+    uint32_t sequence;
+    uint64_t sentAtUs;
+} __attribute__((packed)) BenchHeader;
+
+typedef struct BenchResult {
+    uint32_t count;
+    uint32_t delivered;
+    uint32_t duplicates;
+    uint32_t reordered;
+    uint32_t next;
+    uint32_t *latencyUs;
+    uint8_t *seen;
+    uint64_t lastDeliveryUs;
+    uint64_t outageEndUs;
+    uint64_t recoveryUs;
+    uint64_t eventSentAtUs[256];
+    uint32_t eventsSent;
+    uint32_t eventsDelivered;
+    uint32_t *eventLatencyUs;
+} BenchResult;
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -t, --transport socket|pty   kernel object carrying the bytes (socket)\n"
+        "  -b, --baud RATE              throttle the line, 0 for none (0)\n"
+        "  -d, --drop RATE              probability of a byte being lost (0)\n"
+        "  -e, --ber RATE               probability of a bit being flipped (0)\n"
+        "  -w, --window N               windowed link mode, 0 to disable (%u)\n"
+        "  -c, --cobs                   request the COBS framing\n"
+        "  -p, --payload N              payload length, at least %zu and at most %u, one less when windowed (64)\n"
+        "  -n, --count N                messages to send (10000)\n"
+        "  -o, --outage MS              cut the line for MS halfway through (0)\n"
+        "  -s, --seed N                 seed of the impairments (1)\n"
+        "  -T, --timeout S              give up after S seconds (60)\n"
+        "  -q, --queue BYTES            keep up to BYTES queued in the sender HAL, like a TX ring (0)\n"
+        "  -E, --events N               send an event every N messages (0)\n"
+        "  -u, --no-urgent              send the events behind the queued bytes\n",
+        name,
+        PROTO_WINDOW_SIZE,
+        sizeof(BenchHeader),
+        (unsigned)PROTO_MSG_PAYLOAD_MAX_LEN);
+}
+
+static int ParseOptions(int argc, char **argv, BenchOptions *options) {
+    static const struct option longOptions[] = {
+        {"transport", required_argument, NULL, 't'},
+        {"baud", required_argument, NULL, 'b'},
+        {"drop", required_argument, NULL, 'd'},
+        {"ber", required_argument, NULL, 'e'},
+        {"window", required_argument, NULL, 'w'},
+        {"cobs", no_argument, NULL, 'c'},
+        {"payload", required_argument, NULL, 'p'},
+        {"count", required_argument, NULL, 'n'},
+        {"outage", required_argument, NULL, 'o'},
+        {"seed", required_argument, NULL, 's'},
+        {"timeout", required_argument, NULL, 'T'},
+        {"queue", required_argument, NULL, 'q'},
+        {"events", required_argument, NULL, 'E'},
+        {"no-urgent", no_argument, NULL, 'u'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+
+    memset(options, 0, sizeof(*options));
+    options->kind = LOOPBACK_SOCKETPAIR;
+    options->window = PROTO_WINDOW_SIZE;
+    options->payloadLength = 64;
+    options->count = 10000;
+    options->seed = 1;
+    options->timeoutS = 60;
+
+    while ((opt = getopt_long(argc, argv, "t:b:d:e:w:cp:n:o:s:T:q:E:u", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 't':
+                if (strcmp(optarg, "pty") == 0) {
+                    options->kind = LOOPBACK_PTY;
+                } else if (strcmp(optarg, "socket") != 0) {
+                    return -1;
+                }
+                break;
+            case 'b':
+                options->line.baudRate = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                options->line.dropRate = strtod(optarg, NULL);
+                break;
+            case 'e':
+                options->line.bitErrorRate = strtod(optarg, NULL);
+                break;
+            case 'w':
+                options->window = (uint8_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                options->cobs = 1;
+                break;
+            case 'p':
+                options->payloadLength = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                options->count = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                options->outageMs = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                options->seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'T':
+                options->timeoutS = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                options->queueBytes = strtoul(optarg, NULL, 0);
+                break;
+            case 'E':
+                options->eventEvery = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'u':
+                options->noUrgent = 1;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    /* a sequenced frame spends a byte of the payload length on its sequence number */
+    if (options->payloadLength < sizeof(BenchHeader) ||
+        options->payloadLength > PROTO_MSG_PAYLOAD_MAX_LEN - (options->window > 0 ? 1u : 0u) ||
+        options->window > PROTO_WINDOW_SIZE || options->count == 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void ReceiverCallback(void *messageCallbackCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload) {
+    BenchResult *result = messageCallbackCtx;
+    BenchHeader header;
+
+    if (msgType == PROTO_MSG_TYPE_EVENT && payloadLength >= sizeof(ProtoEventPayload)) {
+        ProtoEventPayload event;
+        memcpy(&event, payload, sizeof(event));
+        result->eventLatencyUs[result->eventsDelivered++] =
+            (uint32_t)(LoopbackTimeUs() - result->eventSentAtUs[event.id]);
+        return;
+    }
+    if (msgType != PROTO_MSG_TYPE_SENSOR_BATCH || payloadLength < sizeof(header)) {
+        return;
+    }
+    memcpy(&header, payload, sizeof(header));
+    if (header.sequence >= result->count) {
+        return;
+    }
+
+    if (result->seen[header.sequence]) {
+        result->duplicates++;
+        return;
+    }
+
+    /* behind a message delivered already */
+    if (header.sequence < result->next) {
+        result->reordered++;
+    } else {
+        result->next = header.sequence + 1;
+    }
+
+    uint64_t now = LoopbackTimeUs();
+    result->seen[header.sequence] = 1;
+    result->latencyUs[result->delivered++] = (uint32_t)(now - header.sentAtUs);
+    result->lastDeliveryUs = now;
+    if (result->outageEndUs != 0 && result->recoveryUs == 0 && now > result->outageEndUs) {
+        result->recoveryUs = now - result->outageEndUs;
+    }
+}
+
+static void SenderCallback(void *messageCallbackCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload) {
+    bool *negotiated = messageCallbackCtx;
+    (void)payloadLength;
+    (void)payload;
+
+    if (msgType == PROTO_MSG_TYPE_PING) {
+        *negotiated = true;
+    }
+}
+
+static int CompareLatency(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t Percentile(const uint32_t *sorted, uint32_t count, uint32_t percent) {
+    if (count == 0) {
+        return 0;
+    }
+
+    return sorted[(uint64_t)(count - 1) * percent / 100u];
+}
+
+/// @brief Runs the handshake on a clean line, so that every run starts from the same negotiated mode
+static int Negotiate(ProtoCtx *sender, ProtoCtx *receiver) {
+    uint64_t deadline = LoopbackTimeUs() + 1000000u;
+    bool negotiated = false;
+
+    sender->messageCallback = SenderCallback;
+    sender->messageCallbackCtx = &negotiated;
+    if (ProtoPing(sender) != PROTO_SUCCESS) {
+        return -1;
+    }
+    while (!negotiated) {
+        if (LoopbackTimeUs() > deadline) {
+            return -1;
+        }
+        ProtoReceive(receiver);
+        ProtoReceive(sender);
+    }
+    sender->messageCallback = NULL;
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static LoopbackEnd senderEnd, receiverEnd;
+    static ProtoCtx sender, receiver;
+    static uint8_t payload[PROTO_MSG_PAYLOAD_MAX_LEN];
+    BenchOptions options;
+    BenchResult result;
+
+    if (ParseOptions(argc, argv, &options) != 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.count = options.count;
+    result.latencyUs = calloc(options.count, sizeof(*result.latencyUs));
+    result.seen = calloc(options.count, sizeof(*result.seen));
+    result.eventLatencyUs = calloc(options.count, sizeof(*result.eventLatencyUs));
+    if (result.latencyUs == NULL || result.seen == NULL || result.eventLatencyUs == NULL ||
+        LoopbackOpen(options.kind, &senderEnd, &receiverEnd, options.seed) != 0) {
+        perror("setup");
+        return 1;
+    }
+
+    ProtoInit(&sender);
+    ProtoInit(&receiver);
+    LoopbackAttach(&sender, &senderEnd);
+    LoopbackAttach(&receiver, &receiverEnd);
+    sender.window = receiver.window = options.window;
+    sender.cobs = receiver.cobs = options.cobs;
+    if (options.noUrgent) {
+        sender.writeUrgent = NULL;
+    }
+    receiver.messageCallback = ReceiverCallback;
+    receiver.messageCallbackCtx = &result;
+
+    if (Negotiate(&sender, &receiver) != 0) {
+        fprintf(stderr, "handshake failed\n");
+        return 1;
+    }
+    senderEnd.line = options.line;
+    receiverEnd.line = options.line;
+    if (options.queueBytes > 0) {
+        senderEnd.wireLimit = BENCH_WIRE_BYTES;
+        receiverEnd.wireLimit = BENCH_WIRE_BYTES;
+    }
+
+    uint64_t start = LoopbackTimeUs();
+    uint64_t deadline = start + (uint64_t)options.timeoutS * 1000000u;
+    uint64_t lastSendUs = start;
+    uint32_t sent = 0;
+    uint32_t nextEvent = options.eventEvery;
+    bool outageDone = options.outageMs == 0;
+
+    while (result.delivered < options.count || result.eventsDelivered < result.eventsSent) {
+        uint64_t now = LoopbackTimeUs();
+        uint64_t idleUs = now - MAX(lastSendUs, result.lastDeliveryUs);
+        if (now > deadline || (sent == options.count && idleUs > BENCH_DRAIN_US)) {
+            break;
+        }
+
+        if (!outageDone && result.delivered >= options.count / 2) {
+            receiverEnd.line.outageUntilUs = now + (uint64_t)options.outageMs * 1000u;
+            senderEnd.line.outageUntilUs = receiverEnd.line.outageUntilUs;
+            result.outageEndUs = receiverEnd.line.outageUntilUs;
+            outageDone = true;
+        }
+
+        /* an event every `eventEvery` messages, once the previous one was acknowledged */
+        if (options.eventEvery > 0 && sent >= nextEvent && ProtoEventAcked(&sender)) {
+            ProtoErrorCode status = ProtoSendEvent(&sender, PROTO_EVENT_SHOCK, (uint16_t)sent);
+            if (status != PROTO_SUCCESS) {
+                fprintf(stderr, "event error %d\n", status);
+                return 1;
+            }
+            result.eventSentAtUs[(uint8_t)(sender.state.eventNext - 1)] = now;
+            result.eventsSent++;
+            nextEvent += options.eventEvery;
+        }
+
+        /* like a UART driver, only accept a new frame once the queue has room for it */
+        if (sent < options.count && LoopbackPending(&senderEnd) <= options.queueBytes) {
+            BenchHeader header = {.sequence = sent, .sentAtUs = now};
+            memcpy(payload, &header, sizeof(header));
+            ProtoErrorCode status =
+                ProtoSend(&sender, PROTO_MSG_TYPE_SENSOR_BATCH, options.payloadLength, payload);
+            if (status == PROTO_SUCCESS) {
+                sent++;
+                lastSendUs = now;
+            } else if (status != PROTO_ERROR_BUSY) {
+                fprintf(stderr, "send error %d\n", status);
+                return 1;
+            }
+        }
+
+        ProtoReceive(&receiver);
+        ProtoReceive(&sender);
+    }
+
+    double elapsed = (double)(MAX(result.lastDeliveryUs, start) - start) / 1e6;
+    ProtoStats *tx = &sender.state.stats;
+    ProtoStats *rx = &receiver.state.stats;
+
+    qsort(result.latencyUs, result.delivered, sizeof(*result.latencyUs), CompareLatency);
+    qsort(result.eventLatencyUs, result.eventsDelivered, sizeof(*result.eventLatencyUs), CompareLatency);
+
+    printf("mode: %s, window %u, cobs %u, baud %" PRIu32 ", drop %g, ber %g, payload %zu\n",
+        options.kind == LOOPBACK_PTY ? "pty" : "socket",
+        receiver.state.window,
+        options.cobs,
+        options.line.baudRate,
+        options.line.dropRate,
+        options.line.bitErrorRate,
+        options.payloadLength);
+    printf("delivered %" PRIu32 "/%" PRIu32 " (%" PRIu32 " duplicates, %" PRIu32 " out of order) in %.3f s\n",
+        result.delivered,
+        options.count,
+        result.duplicates,
+        result.reordered,
+        elapsed);
+    if (elapsed > 0) {
+        double goodput = (double)result.delivered * (double)options.payloadLength / elapsed;
+        printf("frames/s %.0f, goodput %.0f B/s", (double)result.delivered / elapsed, goodput);
+        if (options.line.baudRate > 0) {
+            printf(" (%.1f%% of the line)", 100.0 * goodput * 10.0 / options.line.baudRate);
+        }
+        printf("\n");
+    }
+    printf("latency us: p50 %" PRIu32 ", p90 %" PRIu32 ", p99 %" PRIu32 ", max %" PRIu32 "\n",
+        Percentile(result.latencyUs, result.delivered, 50),
+        Percentile(result.latencyUs, result.delivered, 90),
+        Percentile(result.latencyUs, result.delivered, 99),
+        Percentile(result.latencyUs, result.delivered, 100));
+    if (options.eventEvery > 0) {
+        printf("events %" PRIu32 "/%" PRIu32 " (%s), latency us: p50 %" PRIu32 ", p99 %" PRIu32 ", max %" PRIu32 "\n",
+            result.eventsDelivered,
+            result.eventsSent,
+            sender.writeUrgent != NULL ? "urgent" : "queued",
+            Percentile(result.eventLatencyUs, result.eventsDelivered, 50),
+            Percentile(result.eventLatencyUs, result.eventsDelivered, 99),
+            Percentile(result.eventLatencyUs, result.eventsDelivered, 100));
+    }
+    if (options.outageMs > 0) {
+        printf("recovery after a %" PRIu32 " ms outage: %.1f ms\n", options.outageMs, result.recoveryUs / 1e3);
+    }
+    printf("sender: txBytes %" PRIu32 ", retransmits %" PRIu32 "\n", tx->txBytes, tx->retransmits);
+    printf("receiver: rxFrames %" PRIu32 ", crcErrors %" PRIu32 ", resyncs %" PRIu32 ", discardedBytes %" PRIu32 "\n",
+        rx->rxFrames,
+        rx->crcErrors,
+        rx->resyncs,
+        rx->discardedBytes);
+
+    LoopbackClose(&senderEnd, &receiverEnd);
+    free(result.latencyUs);
+    free(result.seen);
+    free(result.eventLatencyUs);
+
+    return result.delivered == options.count && result.reordered == 0 && result.eventsDelivered == result.eventsSent
+               ? 0
+               : 1;
+}
@@ -0,0 +1,377 @@
+/**
+ * @file proto_stress.c
+ * @brief Many independent protocol links driven at once, one thread per link.
+ *
+ * Each thread opens its own loopback pair and `ProtoCtx` pair, negotiates, then both sides stream `SENSOR_BATCH`
+ * messages to each other. Every payload carries the link and direction it belongs to, its sequence number and a
+ * pattern derived from them: a message landing on the wrong link, altered or delivered out of order shows that two
+ * contexts shared state. The threads start together and are never synchronized afterwards.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loopback.h"
+
+/// @brief Time a link waits for its last messages before giving up on them
+#define STRESS_DRAIN_US (1000000u)
+
+typedef struct StressOptions {
+    LoopbackKind kind;
+    LoopbackLine line;
+    uint8_t window;
+    uint8_t cobs;
+    size_t payloadLength;
+    uint32_t count;
+    uint32_t links;
+    uint32_t seed;
+    uint32_t timeoutS;
+} StressOptions;
+
+typedef struct StressHeader {
+    uint32_t link;
+    uint32_t direction;
+    uint32_t sequence;
+} __attribute__((packed)) StressHeader;
+
+/**
+ * @struct StressSide
+ * @brief What one side of a link expects and got, `messageCallbackCtx` of its context
+ */
+typedef struct StressSide {
+    uint32_t link;
+    uint32_t direction;
+    size_t payloadLength;
+    bool negotiated;
+    uint32_t next;
+    uint32_t delivered;
+    uint32_t foreign;
+    uint32_t corrupted;
+    uint32_t reordered;
+} StressSide;
+
+typedef struct StressLink {
+    pthread_t thread;
+    uint32_t id;
+    const StressOptions *options;
+    pthread_barrier_t *start;
+    LoopbackEnd ends[2];
+    ProtoCtx ctx[2];
+    StressSide sides[2];
+    int error;
+} StressLink;
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -j, --links N                links driven at once, one thread each (16)\n"
+        "  -t, --transport socket|pty   kernel object carrying the bytes (socket)\n"
+        "  -d, --drop RATE              probability of a byte being lost (0)\n"
+        "  -e, --ber RATE               probability of a bit being flipped (1e-5)\n"
+        "  -w, --window N               windowed link mode, 0 to disable (%u)\n"
+        "  -c, --cobs                   request the COBS framing\n"
+        "  -p, --payload N              payload length, at least %zu (64)\n"
+        "  -n, --count N                messages sent by each side of each link (2000)\n"
+        "  -s, --seed N                 seed of the impairments, added to the link number (1)\n"
+        "  -T, --timeout S              give up after S seconds (60)\n",
+        name,
+        PROTO_WINDOW_SIZE,
+        sizeof(StressHeader));
+}
+
+static int ParseOptions(int argc, char **argv, StressOptions *options) {
+    static const struct option longOptions[] = {
+        {"links", required_argument, NULL, 'j'},
+        {"transport", required_argument, NULL, 't'},
+        {"drop", required_argument, NULL, 'd'},
+        {"ber", required_argument, NULL, 'e'},
+        {"window", required_argument, NULL, 'w'},
+        {"cobs", no_argument, NULL, 'c'},
+        {"payload", required_argument, NULL, 'p'},
+        {"count", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 's'},
+        {"timeout", required_argument, NULL, 'T'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+
+    memset(options, 0, sizeof(*options));
+    options->kind = LOOPBACK_SOCKETPAIR;
+    options->line.bitErrorRate = 1e-5;
+    options->window = PROTO_WINDOW_SIZE;
+    options->payloadLength = 64;
+    options->count = 2000;
+    options->links = 16;
+    options->seed = 1;
+    options->timeoutS = 60;
+
+    while ((opt = getopt_long(argc, argv, "j:t:d:e:w:cp:n:s:T:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'j':
+                options->links = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                if (strcmp(optarg, "pty") == 0) {
+                    options->kind = LOOPBACK_PTY;
+                } else if (strcmp(optarg, "socket") != 0) {
+                    return -1;
+                }
+                break;
+            case 'd':
+                options->line.dropRate = strtod(optarg, NULL);
+                break;
+            case 'e':
+                options->line.bitErrorRate = strtod(optarg, NULL);
+                break;
+            case 'w':
+                options->window = (uint8_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                options->cobs = 1;
+                break;
+            case 'p':
+                options->payloadLength = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                options->count = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                options->seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'T':
+                options->timeoutS = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if (options->payloadLength < sizeof(StressHeader) || options->payloadLength > PROTO_MSG_SHORT_PAYLOAD_MAX_LEN - 1 ||
+        options->window > PROTO_WINDOW_SIZE || options->count == 0 || options->links == 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/// @brief Byte `index` of the payload after the header, different for every link, direction and message
+static uint8_t Pattern(const StressHeader *header, size_t index) {
+    return (uint8_t)(header->link * 131u + header->direction * 71u + header->sequence * 29u + index);
+}
+
+static void FillPayload(uint8_t *payload, size_t length, const StressHeader *header) {
+    memcpy(payload, header, sizeof(*header));
+    for (size_t i = sizeof(*header); i < length; i++) {
+        payload[i] = Pattern(header, i);
+    }
+}
+
+static void StressCallback(void *messageCallbackCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload) {
+    StressSide *side = messageCallbackCtx;
+    StressHeader header;
+
+    if (msgType == PROTO_MSG_TYPE_PING) {
+        side->negotiated = true;
+        return;
+    }
+    if (msgType != PROTO_MSG_TYPE_SENSOR_BATCH) {
+        return;
+    }
+    if (payloadLength != side->payloadLength) {
+        side->corrupted++;
+        return;
+    }
+
+    memcpy(&header, payload, sizeof(header));
+    if (header.link != side->link || header.direction == side->direction) {
+        side->foreign++;
+        return;
+    }
+    for (size_t i = sizeof(header); i < payloadLength; i++) {
+        if (payload[i] != Pattern(&header, i)) {
+            side->corrupted++;
+            return;
+        }
+    }
+
+    /* behind a message delivered already, or a duplicate */
+    if (header.sequence < side->next) {
+        side->reordered++;
+        return;
+    }
+    side->next = header.sequence + 1;
+    side->delivered++;
+}
+
+/// @brief Runs the handshake on a clean line, so that every link starts from the same negotiated mode
+static int Negotiate(StressLink *link) {
+    uint64_t deadline = LoopbackTimeUs() + 1000000u;
+
+    if (ProtoPing(&link->ctx[0]) != PROTO_SUCCESS) {
+        return -1;
+    }
+    while (!link->sides[0].negotiated) {
+        if (LoopbackTimeUs() > deadline) {
+            return -1;
+        }
+        ProtoReceive(&link->ctx[1]);
+        ProtoReceive(&link->ctx[0]);
+    }
+
+    return 0;
+}
+
+static void *StressThread(void *arg) {
+    StressLink *link = arg;
+    const StressOptions *options = link->options;
+    uint8_t payload[PROTO_MSG_SHORT_PAYLOAD_MAX_LEN];
+    uint32_t sent[2] = {0, 0};
+
+    pthread_barrier_wait(link->start);
+
+    if (Negotiate(link) != 0) {
+        link->error = -1;
+        return NULL;
+    }
+    link->ends[0].line = options->line;
+    link->ends[1].line = options->line;
+
+    uint64_t deadline = LoopbackTimeUs() + (uint64_t)options->timeoutS * 1000000u;
+    uint64_t lastProgressUs = LoopbackTimeUs();
+    uint32_t lastDelivered = 0;
+
+    while (link->sides[0].delivered < options->count || link->sides[1].delivered < options->count) {
+        uint64_t now = LoopbackTimeUs();
+        uint32_t delivered = link->sides[0].delivered + link->sides[1].delivered;
+        if (delivered != lastDelivered) {
+            lastDelivered = delivered;
+            lastProgressUs = now;
+        }
+        if (now > deadline || (sent[0] == options->count && sent[1] == options->count &&
+                               now - lastProgressUs > STRESS_DRAIN_US)) {
+            break;
+        }
+
+        for (int side = 0; side < 2; side++) {
+            if (sent[side] == options->count) {
+                continue;
+            }
+            StressHeader header = {.link = link->id, .direction = (uint32_t)side, .sequence = sent[side]};
+            FillPayload(payload, options->payloadLength, &header);
+            ProtoErrorCode status =
+                ProtoSend(&link->ctx[side], PROTO_MSG_TYPE_SENSOR_BATCH, options->payloadLength, payload);
+            if (status == PROTO_SUCCESS) {
+                sent[side]++;
+            } else if (status != PROTO_ERROR_BUSY) {
+                link->error = status;
+                return NULL;
+            }
+        }
+
+        ProtoReceive(&link->ctx[0]);
+        ProtoReceive(&link->ctx[1]);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    StressOptions options;
+    pthread_barrier_t start;
+    int failed = 0;
+
+    if (ParseOptions(argc, argv, &options) != 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    // Each end holds a 64 KiB backlog: off the stack
+    StressLink *links = calloc(options.links, sizeof(*links));
+    if (links == NULL || pthread_barrier_init(&start, NULL, options.links) != 0) {
+        perror("setup");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < options.links; i++) {
+        StressLink *link = &links[i];
+        link->id = i;
+        link->options = &options;
+        link->start = &start;
+        if (LoopbackOpen(options.kind, &link->ends[0], &link->ends[1], options.seed + i) != 0) {
+            perror("loopback");
+            return 1;
+        }
+        for (int side = 0; side < 2; side++) {
+            ProtoInit(&link->ctx[side]);
+            LoopbackAttach(&link->ctx[side], &link->ends[side]);
+            link->ctx[side].window = options.window;
+            link->ctx[side].cobs = options.cobs;
+            link->ctx[side].messageCallback = StressCallback;
+            link->ctx[side].messageCallbackCtx = &link->sides[side];
+            link->sides[side].link = i;
+            link->sides[side].direction = (uint32_t)side;
+            link->sides[side].payloadLength = options.payloadLength;
+        }
+    }
+
+    uint64_t startUs = LoopbackTimeUs();
+    for (uint32_t i = 0; i < options.links; i++) {
+        if (pthread_create(&links[i].thread, NULL, StressThread, &links[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    for (uint32_t i = 0; i < options.links; i++) {
+        pthread_join(links[i].thread, NULL);
+    }
+    double elapsed = (double)(LoopbackTimeUs() - startUs) / 1e6;
+
+    uint64_t delivered = 0;
+    uint64_t retransmits = 0;
+    uint64_t crcErrors = 0;
+    for (uint32_t i = 0; i < options.links; i++) {
+        StressLink *link = &links[i];
+        bool ok = link->error == 0;
+
+        for (int side = 0; side < 2; side++) {
+            const StressSide *s = &link->sides[side];
+            delivered += s->delivered;
+            retransmits += link->ctx[side].state.stats.retransmits;
+            crcErrors += link->ctx[side].state.stats.crcErrors;
+            ok = ok && s->delivered == options.count && s->foreign == 0 && s->corrupted == 0 && s->reordered == 0;
+        }
+        if (!ok) {
+            printf("link %" PRIu32 ": error %d", i, link->error);
+            for (int side = 0; side < 2; side++) {
+                const StressSide *s = &link->sides[side];
+                printf(", side %d delivered %" PRIu32 " foreign %" PRIu32 " corrupted %" PRIu32
+                       " out of order %" PRIu32,
+                       side,
+                       s->delivered,
+                       s->foreign,
+                       s->corrupted,
+                       s->reordered);
+            }
+            printf("\n");
+            failed++;
+        }
+        LoopbackClose(&link->ends[0], &link->ends[1]);
+    }
+
+    printf("%" PRIu32 " links x 2 x %" PRIu32 " messages: %" PRIu64 " delivered in %.3f s, %" PRIu32 " links failed\n",
+           options.links,
+           options.count,
+           delivered,
+           elapsed,
+           failed);
+    printf("retransmits %" PRIu64 ", crcErrors %" PRIu64 "\n", retransmits, crcErrors);
+
+    pthread_barrier_destroy(&start);
+    free(links);
+    return failed == 0 ? 0 : 1;
+}
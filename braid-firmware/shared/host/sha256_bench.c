@@ -0,0 +1,252 @@
+/**
+ * @file sha256_bench.c
+ * @brief Known answers and speed of the SHA-256 compression built with `SHA256_UNROLLED` or `SHA256_HOST_ACCEL`.
+ *
+ * Checks the FIPS 180-2 examples and messages around the block boundaries, then hashes a buffer repeatedly to report
+ * cycles per byte, and MACs a `SensorPayload` repeatedly to report HMACs per second. Build it once with each value of
+ * `SHA256_UNROLLED` and compare. With `SHA256_HOST_ACCEL`, every kernel the CPU runs is measured, after checking that
+ * it hashes random messages exactly like the portable one.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "crypto_hmac.h"
+#include "proto_payload.h"
+#include "sha256.h"
+
+/// @brief Length of the factory key, `HMAC_KEY_LENGTH` of both MCUs
+#define BENCH_KEY_LENGTH (128u)
+
+/// @brief Random messages hashed by every kernel and compared with the portable one, up to 4 blocks long
+#define BENCH_RANDOM_MESSAGES (2000u)
+
+typedef struct BenchVector {
+    const char *message;
+    uint32_t repeat;
+    const char *digest;
+} BenchVector;
+
+static const BenchVector vectors[] = {
+    {"", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {"abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     1,
+     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+    {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+     1,
+     "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+    // One byte short of a block, a whole block, and the padding spilling over to a second block
+    {"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+     1,
+     "7d3e74a05d7db15bce4ad9ec0658ea98e3f06eeecf16b4c6fff2da457ddc2f34"},
+    {"a", 64, "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb"},
+    {"a", 56, "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a"},
+    {"a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+};
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n, --count N                hashes of the buffer timed (20000)\n"
+        "  -l, --length N               length of the buffer hashed, in bytes (1024)\n"
+        "  -m, --macs N                 HMACs of a SensorPayload timed (200000)\n",
+        name);
+}
+
+static uint64_t NowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// @brief The time stamp counter where there is one: its rate may differ from the core clock under frequency scaling
+static uint64_t NowCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int CheckVectors(void) {
+    int failures = 0;
+
+    for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        const BenchVector *vector = &vectors[v];
+        Sha256Context ctx;
+        SHA256_HASH digest;
+        char hex[2 * SHA256_HASH_SIZE + 1];
+
+        // The message is fed in pieces of its own length, across the block boundaries
+        Sha256Initialise(&ctx);
+        for (uint32_t i = 0; i < vector->repeat; i++) {
+            Sha256Update(&ctx, vector->message, strlen(vector->message));
+        }
+        Sha256Finalise(&ctx, &digest);
+
+        for (size_t i = 0; i < SHA256_HASH_SIZE; i++) {
+            sprintf(&hex[2 * i], "%02x", digest.bytes[i]);
+        }
+        if (strcmp(hex, vector->digest) != 0) {
+            fprintf(stderr, "vector %zu: got %s, expected %s\n", v, hex, vector->digest);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+#if SHA256_HOST_ACCEL
+/// @brief Hashes random messages at random offsets with `kernel`, and counts the digests that differ from the portable
+static int CheckAgainstPortable(Sha256Kernel kernel) {
+    uint8_t message[4 * 64 + 16];
+    int failures = 0;
+
+    srand(1);
+    for (uint32_t m = 0; m < BENCH_RANDOM_MESSAGES; m++) {
+        size_t offset = (size_t)rand() % 16;
+        size_t length = (size_t)rand() % (sizeof(message) - offset);
+        SHA256_HASH expected;
+        SHA256_HASH digest;
+
+        for (size_t i = 0; i < length; i++) {
+            message[offset + i] = (uint8_t)rand();
+        }
+        Sha256SetKernel(SHA256_KERNEL_PORTABLE);
+        Sha256Calculate(&message[offset], length, &expected);
+        Sha256SetKernel(kernel);
+        Sha256Calculate(&message[offset], length, &digest);
+        if (memcmp(digest.bytes, expected.bytes, SHA256_HASH_SIZE) != 0) {
+            failures++;
+        }
+    }
+
+    return failures;
+}
+#endif
+
+/// @brief Checks and times the kernel in use
+static int RunKernel(const char *name, uint32_t count, uint32_t length, uint8_t *buffer, uint32_t macs) {
+    SHA256_HASH digest;
+    HmacKeyCtx keyCtx;
+    SensorPayload payload;
+    uint8_t key[BENCH_KEY_LENGTH];
+
+    int failures = CheckVectors();
+    printf("%s: %zu vectors, %d failed", name, sizeof(vectors) / sizeof(vectors[0]), failures);
+#if SHA256_HOST_ACCEL
+    Sha256Kernel kernel = Sha256GetKernel();
+    if (kernel != SHA256_KERNEL_PORTABLE) {
+        int different = CheckAgainstPortable(kernel);
+        printf(", %d of %u random messages differ from portable", different, BENCH_RANDOM_MESSAGES);
+        failures += different;
+    }
+#endif
+    printf("\n");
+
+    uint64_t startNs = NowNs();
+    uint64_t startCycles = NowCycles();
+    for (uint32_t i = 0; i < count; i++) {
+        buffer[0] = (uint8_t)i;
+        Sha256Calculate(buffer, length, &digest);
+    }
+    uint64_t cycles = NowCycles() - startCycles;
+    uint64_t elapsedNs = NowNs() - startNs;
+    double bytes = (double)count * length;
+
+    printf("  %" PRIu32 " x %" PRIu32 " bytes: %.2f ns/B, %.3f GB/s",
+           count,
+           length,
+           elapsedNs / bytes,
+           bytes / elapsedNs);
+    if (cycles > 0) {
+        printf(", %.2f cycles/B", cycles / bytes);
+    }
+    printf("\n");
+
+    // As PayloadVerify: the key states are precomputed, each MAC costs two compressions
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = (uint8_t)(i * 7u + 1u);
+    }
+    memset(&payload, 0x5a, sizeof(payload));
+    Crypto_HMACKeyInit(&keyCtx, key, sizeof(key));
+    startNs = NowNs();
+    for (uint32_t i = 0; i < macs; i++) {
+        payload.data.temperature = (int32_t)i;
+        PayloadHash(&payload, &keyCtx);
+    }
+    elapsedNs = NowNs() - startNs;
+    Crypto_HMACKeyWipe(&keyCtx);
+
+    printf("  %" PRIu32 " x SensorPayload: %.1f ns, %.0f HMACs/s\n",
+           macs,
+           (double)elapsedNs / macs,
+           macs * 1e9 / elapsedNs);
+
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    static const struct option longOptions[] = {
+        {"count", required_argument, NULL, 'n'},
+        {"length", required_argument, NULL, 'l'},
+        {"macs", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0},
+    };
+    uint32_t count = 20000;
+    uint32_t length = 1024;
+    uint32_t macs = 200000;
+    uint8_t *buffer;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:l:m:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            length = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            macs = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    buffer = calloc(length, 1);
+    if (count == 0 || length == 0 || macs == 0 || buffer == NULL) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    printf("SHA256_UNROLLED=%d\n", SHA256_UNROLLED);
+#if SHA256_HOST_ACCEL
+    Sha256Kernel best = Sha256GetKernel();
+    for (int k = 0; k < SHA256_KERNEL_COUNT; k++) {
+        if (!Sha256SetKernel((Sha256Kernel)k)) {
+            printf("%s: not supported\n", Sha256KernelName((Sha256Kernel)k));
+            continue;
+        }
+        failures += RunKernel(Sha256KernelName((Sha256Kernel)k), count, length, buffer, macs);
+    }
+    Sha256SetKernel(best);
+    printf("dispatched to %s\n", Sha256KernelName(best));
+#else
+    failures += RunKernel("portable", count, length, buffer, macs);
+#endif
+
+    free(buffer);
+    return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file verify_bench.c
+ * @brief Verifications per second of recorded `SensorPayload`s, with `PayloadVerifyMany` against a loop over
+ * `PayloadVerify`.
+ *
+ * Generates random payloads hashed with a key as long as the factory one, and spoils the hash of some of them. Both
+ * ways must find the same payloads valid. With `SHA256_HOST_ACCEL`, `PayloadVerifyMany` is measured with each number
+ * of lanes the CPU runs.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "crypto_hmac.h"
+#include "proto_payload.h"
+#include "sha256.h"
+
+/// @brief Length of the factory key, `HMAC_KEY_LENGTH` of both MCUs
+#define BENCH_KEY_LENGTH (128u)
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n, --count N                payloads in the dataset (1000000)\n"
+        "  -b, --bad N                  one payload in N has a wrong hash (100)\n",
+        name);
+}
+
+static uint64_t NowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// @brief Verifies the dataset with `PayloadVerifyMany`, prints the rate and returns the number of results that differ
+static size_t RunMany(const char *name,
+                      const SensorPayload *payloads,
+                      uint32_t count,
+                      const HmacKeyCtx *key,
+                      const bool *expected,
+                      bool *valid,
+                      double loopRate) {
+    size_t differ = 0;
+
+    memset(valid, 0, count * sizeof(valid[0]));
+    uint64_t start = NowNs();
+    size_t matching = PayloadVerifyMany(payloads, count, key, valid);
+    double rate = count * 1e9 / (NowNs() - start);
+
+    for (uint32_t i = 0; i < count; i++) {
+        differ += (valid[i] != expected[i]);
+    }
+    printf("%-24s %12.0f %9.2fx %8zu %8zu\n", name, rate, rate / loopRate, matching, differ);
+    return differ;
+}
+
+int main(int argc, char **argv) {
+    static const struct option longOptions[] = {
+        {"count", required_argument, NULL, 'n'},
+        {"bad", required_argument, NULL, 'b'},
+        {NULL, 0, NULL, 0},
+    };
+    uint32_t count = 1000000;
+    uint32_t bad = 100;
+    uint8_t key[BENCH_KEY_LENGTH];
+    HmacKeyCtx keyCtx;
+    size_t differ = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:b:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            bad = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    SensorPayload *payloads = calloc(count, sizeof(SensorPayload));
+    bool *expected = calloc(count, sizeof(bool));
+    bool *valid = calloc(count, sizeof(bool));
+    if (count == 0 || bad == 0 || payloads == NULL || expected == NULL || valid == NULL) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = (uint8_t)rand();
+    }
+    Crypto_HMACKeyInit(&keyCtx, key, sizeof(key));
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *data = (uint8_t *)&payloads[i].data;
+
+        for (size_t j = 0; j < sizeof(payloads[i].data); j++) {
+            data[j] = (uint8_t)rand();
+        }
+        PayloadHash(&payloads[i], &keyCtx);
+        if (rand() % bad == 0) {
+            payloads[i].hash[rand() % SHA256_HASH_SIZE] ^= (uint8_t)(1u << (rand() % 8));
+        }
+    }
+
+    // The reference: the loop the master runs on each message
+    size_t loopMatching = 0;
+    uint64_t start = NowNs();
+    for (uint32_t i = 0; i < count; i++) {
+        expected[i] = PayloadVerify(&payloads[i], &keyCtx);
+        loopMatching += expected[i];
+    }
+    double loopRate = count * 1e9 / (NowNs() - start);
+
+    printf("%" PRIu32 " payloads, CRYPTO_HMAC_LANES=%d\n", count, CRYPTO_HMAC_LANES);
+    printf("%-24s %12s %10s %8s %8s\n", "method", "verifies/s", "speedup", "valid", "differ");
+#if SHA256_HOST_ACCEL
+    printf("%-24s %12.0f %9.2fx %8zu %8d\n", "PayloadVerify loop", loopRate, 1.0, loopMatching, 0);
+    uint32_t bestLanes = Sha256GetLanes();
+    const uint32_t lanes[] = {1, 8, 16};
+    for (size_t l = 0; l < sizeof(lanes) / sizeof(lanes[0]); l++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "PayloadVerifyMany x%" PRIu32, lanes[l]);
+        if (!Sha256SetLanes(lanes[l])) {
+            printf("%-24s not supported\n", name);
+            continue;
+        }
+        differ += RunMany(name, payloads, count, &keyCtx, expected, valid, loopRate);
+    }
+    Sha256SetLanes(bestLanes);
+    printf("single block kernel %s\n", Sha256KernelName(Sha256GetKernel()));
+#else
+    printf("%-24s %12.0f %9.2fx %8zu %8d\n", "PayloadVerify loop", loopRate, 1.0, loopMatching, 0);
+    differ += RunMany("PayloadVerifyMany", payloads, count, &keyCtx, expected, valid, loopRate);
+#endif
+
+    Crypto_HMACKeyWipe(&keyCtx);
+    free(payloads);
+    free(expected);
+    free(valid);
+    return (differ > 0) ? 1 : 0;
+}
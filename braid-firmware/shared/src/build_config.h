@@ -39,6 +39,17 @@
 #define CFG_LOG_USE_COLORS 1
 #endif
 
+#ifndef CFG_FW_SIGNING_KEY
+/* Public key of the sensors MCU images, 32 comma separated bytes: see scripts/sign_sensors_fw.py */
+#warning "fw signing key not defined, every sensors MCU image will be refused"
+#define CFG_FW_SIGNING_KEY 0
+#endif
+
+#ifndef CFG_SHADOW_LINK_STATS
+/* Opt-in: adds the sensors link counters to every shadow sent */
+#define CFG_SHADOW_LINK_STATS 0
+#endif
+
 #define STR(x)  #x
 #define XSTR(x) STR(x)
 #define VERSION_STR                                                                                                    \
@@ -0,0 +1,56 @@
+#include "cobs.h"
+
+size_t CobsEncode(uint8_t *dst, const uint8_t *src, size_t length) {
+    size_t codeIdx = 0;
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (src[i] == 0) {
+            /* close the block: its code points to the zero */
+            dst[codeIdx] = code;
+            codeIdx = out++;
+            code = 1;
+        } else {
+            dst[out++] = src[i];
+            code++;
+            if (code == 0xFF) {
+                /* longest block without zeros */
+                dst[codeIdx] = code;
+                codeIdx = out++;
+                code = 1;
+            }
+        }
+    }
+    dst[codeIdx] = code;
+
+    return out;
+}
+
+size_t CobsDecode(uint8_t *dst, const uint8_t *src, size_t length) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < length) {
+        uint8_t code = src[in++];
+
+        if (code == 0 || in + code - 1 > length) {
+            /* zero inside the frame, or block past its end */
+            return 0;
+        }
+
+        for (uint8_t i = 1; i < code; i++) {
+            if (src[in] == 0) {
+                return 0;
+            }
+            dst[out++] = src[in++];
+        }
+
+        /* every block but the longest ones and the last one is followed by a zero */
+        if (code != 0xFF && in < length) {
+            dst[out++] = 0;
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/// @brief Maximum number of bytes added by `CobsEncode` to `length` bytes of data
+#define COBS_MAX_OVERHEAD(length) (1 + (length) / 254)
+
+/**
+ * @brief Encodes a buffer with Consistent Overhead Byte Stuffing, so that the output contains no zero byte
+ *
+ * @note `dst` can overlap `src` as long as it starts at least `COBS_MAX_OVERHEAD(length)` bytes before it
+ *
+ * @param[out] dst Output buffer, at least `length + COBS_MAX_OVERHEAD(length)` bytes long
+ * @param[in] src Data to encode
+ * @param length Length of the data
+ * @return The length of the encoded data
+ */
+size_t CobsEncode(uint8_t *dst, const uint8_t *src, size_t length);
+
+/**
+ * @brief Decodes a buffer encoded with `CobsEncode`, without the zero delimiter
+ *
+ * @note `dst` can be the same buffer as `src`
+ *
+ * @param[out] dst Output buffer, at least `length` bytes long
+ * @param[in] src Data to decode
+ * @param length Length of the encoded data
+ * @return The length of the decoded data, `0` if `src` is not valid COBS
+ */
+size_t CobsDecode(uint8_t *dst, const uint8_t *src, size_t length);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
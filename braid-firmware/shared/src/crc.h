@@ -8,6 +8,38 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/// @brief Initial value of the CRC16, to be passed to the first `Crc16Update` call
+#define CRC16_INIT 0xFFFF
+
+/// @brief Byte-at-a-time table lookup, the reference implementation
+#define CRC16_BACKEND_TABLE 0
+/// @brief Slice-by-4 table lookup, 2 KiB of tables in flash
+#define CRC16_BACKEND_SLICE4 1
+/// @brief STM32L0 CRC peripheral, no tables
+#define CRC16_BACKEND_HARDWARE 2
+
+#ifndef CRC16_BACKEND
+#if defined(STM32L031xx)
+#define CRC16_BACKEND CRC16_BACKEND_HARDWARE
+#else
+#define CRC16_BACKEND CRC16_BACKEND_SLICE4
+#endif
+#endif
+
+/**
+ * @brief Continues a CRC16 computation over another data buffer, so that data split in several buffers can be
+ * checksummed without copying it.
+ *
+ * With the hardware backend this reprograms the CRC peripheral on every call, so it must not be called from an
+ * interrupt that can preempt another call.
+ *
+ * @param crc The CRC16 of the previous data, or `CRC16_INIT`
+ * @param length The length of the data buffer
+ * @param[in] data A pointer to the data buffer
+ * @return The CRC16 checksum of the previous data followed by `data`
+ */
+uint16_t Crc16Update(uint16_t crc, size_t length, const uint8_t *data);
+
 /**
  * @brief Computes the CRC16 checksum for a given data buffer.
  *
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+/** @brief Length of a SHA-256 block, in bytes */
+#define SHA256_BLOCK_SIZE 64
+
+/** @brief The portable SHA-256 of `sha256.c`, see `SHA256_UNROLLED` and `SHA256_ARMV6M` */
+#define CRYPTO_BACKEND_SOFTWARE 0
+/** @brief The SHA accelerator of the ESP32, through mbedTLS */
+#define CRYPTO_BACKEND_ESP32 1
+/** @brief OpenSSL, for the host tools */
+#define CRYPTO_BACKEND_OPENSSL 2
+
+/**
+ * @brief Implementation of the `Crypto_Sha256*` functions behind the HMAC, chosen at build time. The software one is
+ * inlined and resumes a MAC from the precomputed key states, the others hash the padded key blocks again: 4 blocks per
+ * short message instead of 2, for the SHA peripheral of the master to make up. Both MCUs keep the default until
+ * `sha256-bench` shows on the board that the peripheral wins, the host tools can use OpenSSL
+ */
+#ifndef CRYPTO_BACKEND
+#define CRYPTO_BACKEND CRYPTO_BACKEND_SOFTWARE
+#endif
+
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_ESP32
+#include <mbedtls/sha256.h>
+#elif CRYPTO_BACKEND == CRYPTO_BACKEND_OPENSSL
+#include <openssl/evp.h>
+#elif CRYPTO_BACKEND != CRYPTO_BACKEND_SOFTWARE
+#error "Unknown CRYPTO_BACKEND"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * @struct CryptoSha256Ctx
+ * @brief A SHA-256 computation in progress, in the format of the backend
+ */
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_ESP32
+typedef mbedtls_sha256_context CryptoSha256Ctx;
+#elif CRYPTO_BACKEND == CRYPTO_BACKEND_OPENSSL
+typedef struct CryptoSha256Ctx {
+    EVP_MD_CTX *md;
+} CryptoSha256Ctx;
+#else
+typedef Sha256Context CryptoSha256Ctx;
+#endif
+
+/**
+ * @brief Zeroes a buffer holding secrets. Unlike `memset`, never optimized away
+ *
+ * @param data The buffer
+ * @param length Length of the buffer
+ */
+void Crypto_Wipe(void *data, size_t length);
+
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_SOFTWARE
+
+/* Inlined: the software backend costs no call over `sha256.c` */
+
+static inline void Crypto_Sha256Init(CryptoSha256Ctx *ctx) {
+    Sha256Initialise(ctx);
+}
+
+static inline void Crypto_Sha256Update(CryptoSha256Ctx *ctx, const void *data, size_t length) {
+    Sha256Update(ctx, data, (uint32_t)length);
+}
+
+static inline void Crypto_Sha256Final(CryptoSha256Ctx *ctx, uint8_t digest[SHA256_HASH_SIZE]) {
+    Sha256Finalise(ctx, (SHA256_HASH *)digest);
+    Crypto_Wipe(ctx, sizeof(*ctx));
+}
+
+#else
+
+/**
+ * @brief Starts a SHA-256 computation
+ *
+ * @param[out] ctx The context to initialize
+ */
+void Crypto_Sha256Init(CryptoSha256Ctx *ctx);
+
+/**
+ * @brief Adds data to a SHA-256 computation
+ *
+ * @param ctx The context
+ * @param[in] data The data to hash
+ * @param length Length of the data
+ */
+void Crypto_Sha256Update(CryptoSha256Ctx *ctx, const void *data, size_t length);
+
+/**
+ * @brief Finishes a SHA-256 computation and releases its context, which must be initialized again to be reused
+ *
+ * @param ctx The context
+ * @param[out] digest The hash
+ */
+void Crypto_Sha256Final(CryptoSha256Ctx *ctx, uint8_t digest[SHA256_HASH_SIZE]);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,27 @@
+/**
+ * @file crypto_backend_esp32.c
+ * @brief SHA-256 on the accelerator of the ESP32, through the mbedTLS of ESP-IDF.
+ *
+ * With `CONFIG_MBEDTLS_HARDWARE_SHA`, mbedTLS feeds the blocks to the peripheral and falls back to its own software
+ * when another context holds it. The contexts are independent, so the tasks can hash concurrently.
+ */
+#include "crypto_backend.h"
+
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_ESP32
+
+void Crypto_Sha256Init(CryptoSha256Ctx *ctx) {
+    mbedtls_sha256_init(ctx);
+    mbedtls_sha256_starts(ctx, 0);
+}
+
+void Crypto_Sha256Update(CryptoSha256Ctx *ctx, const void *data, size_t length) {
+    mbedtls_sha256_update(ctx, data, length);
+}
+
+void Crypto_Sha256Final(CryptoSha256Ctx *ctx, uint8_t digest[SHA256_HASH_SIZE]) {
+    mbedtls_sha256_finish(ctx, digest);
+    // Also releases the peripheral if the context held it, and zeroes the context
+    mbedtls_sha256_free(ctx);
+}
+
+#endif
@@ -1,13 +1,28 @@
 #include "crypto_hmac.h"
+#include "crypto_backend.h"
 #include "sha256.h"
 
 #include <stdlib.h>
 #include <string.h>
 
-#define SHA256_BLOCK_SIZE 64
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_SOFTWARE
+// Hashes `x` into a fresh context and returns its state, `x` must be a single block
+static void Crypto_Sha256Block(const uint8_t *x, uint32_t state[8]);
 
-// Concatenate X & Y, return hash.
-static void *H(const void *x, const size_t xlen, const void *y, const size_t ylen, void *out, const size_t outlen);
+// Finishes the hash of `y` from the state after one block
+static void *H(const uint32_t state[8], const void *y, const size_t ylen, void *out, const size_t outlen);
+#else
+// Hashes the padded key block `x`, then `y`
+static void *H(const uint8_t x[SHA256_BLOCK_SIZE], const void *y, const size_t ylen, void *out, const size_t outlen);
+#endif
+
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_SOFTWARE
+// Fills `block` with the message `x` and its padding, as the block following the padded key block
+static void Crypto_PadBlock(uint8_t block[SHA256_BLOCK_SIZE], const uint8_t *x, const size_t xlen);
+
+// Writes `state` as a digest
+static void Crypto_StoreState(const uint32_t state[8], uint8_t digest[SHA256_HASH_SIZE]);
+#endif
 
 // Wrapper for Crypto_Sha256
 static void *Crypto_Sha256(const void *data, const size_t datalen, void *out, const size_t outlen);
@@ -18,12 +33,20 @@ size_t Crypto_HMAC(const void *key,
                    const size_t datalen,
                    uint8_t *out,
                    const size_t outlen) {
+    HmacKeyCtx ctx;
+    size_t sz;
+
+    Crypto_HMACKeyInit(&ctx, key, keylen);
+    sz = Crypto_HMACWithKey(&ctx, data, datalen, out, outlen);
+    Crypto_HMACKeyWipe(&ctx);
+
+    return sz;
+}
+
+void Crypto_HMACKeyInit(HmacKeyCtx *ctx, const void *key, const size_t keylen) {
     uint8_t k[SHA256_BLOCK_SIZE];
     uint8_t k_ipad[SHA256_BLOCK_SIZE];
     uint8_t k_opad[SHA256_BLOCK_SIZE];
-    uint8_t ihash[SHA256_HASH_SIZE];
-    uint8_t ohash[SHA256_HASH_SIZE];
-    size_t sz;
     int i;
 
     memset(k, 0, sizeof(k));
@@ -43,39 +66,176 @@ size_t Crypto_HMAC(const void *key,
         k_opad[i] ^= k[i];
     }
 
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_SOFTWARE
+    // The padded keys fill a block each: every MAC starts from the states after them
+    Crypto_Sha256Block(k_ipad, ctx->inner);
+    Crypto_Sha256Block(k_opad, ctx->outer);
+#else
+    memcpy(ctx->inner, k_ipad, sizeof(ctx->inner));
+    memcpy(ctx->outer, k_opad, sizeof(ctx->outer));
+#endif
+
+    Crypto_Wipe(k, sizeof(k));
+    Crypto_Wipe(k_ipad, sizeof(k_ipad));
+    Crypto_Wipe(k_opad, sizeof(k_opad));
+}
+
+size_t Crypto_HMACWithKey(
+    const HmacKeyCtx *ctx, const uint8_t *data, const size_t datalen, uint8_t *out, const size_t outlen) {
+    uint8_t ihash[SHA256_HASH_SIZE];
+    uint8_t ohash[SHA256_HASH_SIZE];
+    size_t sz;
+
     // Perform HMAC algorithm: (https://tools.ietf.org/html/rfc2104)
     //      `H(K XOR opad, H(K XOR ipad, data))`
-    H(k_ipad, sizeof(k_ipad), data, datalen, ihash, sizeof(ihash));
-    H(k_opad, sizeof(k_opad), ihash, sizeof(ihash), ohash, sizeof(ohash));
+    H(ctx->inner, data, datalen, ihash, sizeof(ihash));
+    H(ctx->outer, ihash, sizeof(ihash), ohash, sizeof(ohash));
 
     sz = (outlen > SHA256_HASH_SIZE) ? SHA256_HASH_SIZE : outlen;
     memcpy(out, ohash, sz);
     return sz;
 }
 
-static void *H(const void *x, const size_t xlen, const void *y, const size_t ylen, void *out, const size_t outlen) {
+void Crypto_HMACWithKeyMany(const HmacKeyCtx *ctx,
+                            const uint8_t *data,
+                            const size_t datalen,
+                            const size_t stride,
+                            size_t count,
+                            uint8_t (*out)[SHA256_HASH_SIZE]) {
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_SOFTWARE
+    // The message and its padding fit in the block after the key block, 1 byte for the '1' bit and 8 for the length
+    if (datalen <= SHA256_BLOCK_SIZE - 9) {
+        uint32_t states[CRYPTO_HMAC_LANES][8];
+        uint8_t blocks[CRYPTO_HMAC_LANES][SHA256_BLOCK_SIZE];
+        uint8_t ihash[SHA256_HASH_SIZE];
+        size_t n, i;
+
+        while (count > 0) {
+            n = (count > CRYPTO_HMAC_LANES) ? CRYPTO_HMAC_LANES : count;
+
+            for (i = 0; i < n; i++) {
+                memcpy(states[i], ctx->inner, sizeof(states[i]));
+                Crypto_PadBlock(blocks[i], data + i * stride, datalen);
+            }
+            Sha256TransformMany(&states[0][0], &blocks[0][0], n);
+
+            for (i = 0; i < n; i++) {
+                Crypto_StoreState(states[i], ihash);
+                memcpy(states[i], ctx->outer, sizeof(states[i]));
+                Crypto_PadBlock(blocks[i], ihash, sizeof(ihash));
+            }
+            Sha256TransformMany(&states[0][0], &blocks[0][0], n);
+
+            for (i = 0; i < n; i++) {
+                Crypto_StoreState(states[i], out[i]);
+            }
+
+            data += n * stride;
+            out += n;
+            count -= n;
+        }
+
+        Crypto_Wipe(states, sizeof(states));
+        Crypto_Wipe(blocks, sizeof(blocks));
+        Crypto_Wipe(ihash, sizeof(ihash));
+        return;
+    }
+#endif
+
+    for (; count > 0; count--, data += stride, out++) {
+        Crypto_HMACWithKey(ctx, data, datalen, *out, SHA256_HASH_SIZE);
+    }
+}
+
+void Crypto_HMACKeyWipe(HmacKeyCtx *ctx) {
+    Crypto_Wipe(ctx, sizeof(*ctx));
+}
+
+void Crypto_Wipe(void *data, size_t length) {
+    volatile uint8_t *bytes = (volatile uint8_t *)data;
+
+    while (length-- > 0) {
+        *bytes++ = 0;
+    }
+}
+
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_SOFTWARE
+static void Crypto_Sha256Block(const uint8_t *x, uint32_t state[8]) {
+    Sha256Context ctx;
+
+    Sha256Initialise(&ctx);
+    Sha256Update(&ctx, x, SHA256_BLOCK_SIZE);
+    memcpy(state, ctx.state, sizeof(ctx.state));
+    Crypto_Wipe(&ctx, sizeof(ctx));
+}
+
+static void *H(const uint32_t state[8], const void *y, const size_t ylen, void *out, const size_t outlen) {
     size_t sz;
     Sha256Context ctx;
     SHA256_HASH hash;
 
+    // As if the block of the padded key was just hashed
     Sha256Initialise(&ctx);
-    Sha256Update(&ctx, x, xlen);
+    memcpy(ctx.state, state, sizeof(ctx.state));
+    ctx.length = SHA256_BLOCK_SIZE * 8;
     Sha256Update(&ctx, y, ylen);
     Sha256Finalise(&ctx, &hash);
+    Crypto_Wipe(&ctx, sizeof(ctx));
 
     sz = (outlen > SHA256_HASH_SIZE) ? SHA256_HASH_SIZE : outlen;
     return memcpy(out, hash.bytes, sz);
 }
 
+static void Crypto_PadBlock(uint8_t block[SHA256_BLOCK_SIZE], const uint8_t *x, const size_t xlen) {
+    // Bits hashed, the padded key block included
+    uint64_t length = (uint64_t)(SHA256_BLOCK_SIZE + xlen) * 8;
+    int i;
+
+    memcpy(block, x, xlen);
+    block[xlen] = 0x80;
+    memset(&block[xlen + 1], 0, SHA256_BLOCK_SIZE - 8 - (xlen + 1));
+    for (i = 0; i < 8; i++) {
+        block[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(length >> (8 * i));
+    }
+}
+
+static void Crypto_StoreState(const uint32_t state[8], uint8_t digest[SHA256_HASH_SIZE]) {
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        digest[4 * i + 0] = (uint8_t)(state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)state[i];
+    }
+}
+#else
+static void *H(const uint8_t x[SHA256_BLOCK_SIZE], const void *y, const size_t ylen, void *out, const size_t outlen) {
+    size_t sz;
+    CryptoSha256Ctx ctx;
+    uint8_t hash[SHA256_HASH_SIZE];
+
+    Crypto_Sha256Init(&ctx);
+    Crypto_Sha256Update(&ctx, x, SHA256_BLOCK_SIZE);
+    Crypto_Sha256Update(&ctx, y, ylen);
+    Crypto_Sha256Final(&ctx, hash);
+
+    sz = (outlen > SHA256_HASH_SIZE) ? SHA256_HASH_SIZE : outlen;
+    memcpy(out, hash, sz);
+    Crypto_Wipe(hash, sizeof(hash));
+    return out;
+}
+#endif
+
 static void *Crypto_Sha256(const void *data, const size_t datalen, void *out, const size_t outlen) {
     size_t sz;
-    Sha256Context ctx;
-    SHA256_HASH hash;
+    CryptoSha256Ctx ctx;
+    uint8_t hash[SHA256_HASH_SIZE];
 
-    Sha256Initialise(&ctx);
-    Sha256Update(&ctx, data, datalen);
-    Sha256Finalise(&ctx, &hash);
+    Crypto_Sha256Init(&ctx);
+    Crypto_Sha256Update(&ctx, data, datalen);
+    Crypto_Sha256Final(&ctx, hash);
 
     sz = (outlen > SHA256_HASH_SIZE) ? SHA256_HASH_SIZE : outlen;
-    return memcpy(out, hash.bytes, sz);
-}
\ No newline at end of file
+    return memcpy(out, hash, sz);
+}
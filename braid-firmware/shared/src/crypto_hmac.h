@@ -3,10 +3,95 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "crypto_backend.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
 
+/**
+ * @brief Messages MACed at once by `Crypto_HMACWithKeyMany`, the widest lanes of `Sha256TransformMany`
+ */
+#ifndef CRYPTO_HMAC_LANES
+#if SHA256_HOST_ACCEL
+#define CRYPTO_HMAC_LANES 16
+#else
+#define CRYPTO_HMAC_LANES 1
+#endif
+#endif
+
+/**
+ * @struct HmacKeyCtx
+ * @brief A HMAC-SHA256 key, kept as the SHA256 states after the `K XOR ipad` and `K XOR opad` blocks. MACing a short
+ * message then costs two compressions, whatever the length of the key. Other backends than the software one can not
+ * be resumed from a state, they keep the padded blocks and hash them again for every message. As good as the key
+ * itself: wipe it with `Crypto_HMACKeyWipe` once it is not needed anymore
+ */
+typedef struct HmacKeyCtx {
+#if CRYPTO_BACKEND == CRYPTO_BACKEND_SOFTWARE
+    /** @brief State after the inner padded key block */
+    uint32_t inner[8];
+
+    /** @brief State after the outer padded key block */
+    uint32_t outer[8];
+#else
+    /** @brief The inner padded key block, `K XOR ipad` */
+    uint8_t inner[SHA256_BLOCK_SIZE];
+
+    /** @brief The outer padded key block, `K XOR opad` */
+    uint8_t outer[SHA256_BLOCK_SIZE];
+#endif
+} HmacKeyCtx;
+
+/**
+ * @brief Precomputes the HMAC states of a key
+ *
+ * @param[out] ctx The keyed context
+ * @param key The key. Should be at least 32 bytes long for optimal security
+ * @param keylen Length of the key buffer
+ */
+void Crypto_HMACKeyInit(HmacKeyCtx *ctx, const void *key, const size_t keylen);
+
+/**
+ * @brief Hashes some data using HMAC and SHA256, with a key prepared by `Crypto_HMACKeyInit`
+ *
+ * @param ctx The keyed context
+ * @param[in] data The data to hash alongside the key
+ * @param datalen Length of the data buffer
+ * @param[out] out The output hash. Should be 32 bytes long. If it's less than 32 bytes, the resulting hash will be
+ * truncated to the specified length
+ * @param outlen Length of the output buffer
+ * @return The number of bytes written to `out`
+ */
+size_t Crypto_HMACWithKey(
+    const HmacKeyCtx *ctx, const uint8_t *data, const size_t datalen, uint8_t *out, const size_t outlen);
+
+/**
+ * @brief Hashes messages of the same length using HMAC and SHA256, like as many `Crypto_HMACWithKey`. With the
+ * software backend, messages up to 55 bytes long are a single block per hash from the key states, which
+ * `Sha256TransformMany` runs `CRYPTO_HMAC_LANES` at a time
+ *
+ * @param ctx The keyed context
+ * @param[in] data The first message, the others following every `stride` bytes
+ * @param datalen Length of each message
+ * @param stride Distance between the starts of two messages, in bytes
+ * @param count Number of messages
+ * @param[out] out The hashes of the messages, in order
+ */
+void Crypto_HMACWithKeyMany(const HmacKeyCtx *ctx,
+                            const uint8_t *data,
+                            const size_t datalen,
+                            const size_t stride,
+                            size_t count,
+                            uint8_t (*out)[SHA256_HASH_SIZE]);
+
+/**
+ * @brief Erases a keyed context, so that the key cannot be recovered from memory
+ *
+ * @param ctx The keyed context
+ */
+void Crypto_HMACKeyWipe(HmacKeyCtx *ctx);
+
 /**
  * @brief Hashes some data with a key using HMAC and SHA256
  *
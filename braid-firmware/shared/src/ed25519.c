@@ -0,0 +1,493 @@
+/**
+ * @file ed25519.c
+ * @brief Verification of Ed25519 signatures, see `ed25519.h`. The helpers keep the names and the structure of
+ * TweetNaCl, so that the code can be compared line by line with it. The helpers called once are kept out of line: their
+ * frames are off the stack during the scalar multiplications, which matters on the 8 KiB of RAM of the sensors MCU.
+ */
+#include <string.h>
+
+#include "ed25519.h"
+
+/* a field element, modulo 2^255 - 19: 16 limbs of 16 bits, carried after every multiplication */
+typedef int32_t gf[16];
+
+static const gf gf0 = {0};
+static const gf gf1 = {1};
+
+/* the curve constant d, 2 * d, the coordinates of the base point and sqrt(-1) */
+static const gf D = {
+    0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070,
+    0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203};
+static const gf D2 = {
+    0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+    0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406};
+static const gf X = {
+    0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+    0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169};
+static const gf Y = {
+    0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+    0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666};
+static const gf I = {
+    0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43,
+    0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83};
+
+/* the order of the base point, little endian */
+static const uint8_t L[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10};
+
+static const uint64_t K[80] = {
+    0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full, 0xe9b5dba58189dbbcull,
+    0x3956c25bf348b538ull, 0x59f111f1b605d019ull, 0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull,
+    0xd807aa98a3030242ull, 0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+    0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull, 0xc19bf174cf692694ull,
+    0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull, 0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull,
+    0x2de92c6f592b0275ull, 0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+    0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full, 0xbf597fc7beef0ee4ull,
+    0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull, 0x06ca6351e003826full, 0x142929670a0e6e70ull,
+    0x27b70a8546d22ffcull, 0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+    0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull, 0x92722c851482353bull,
+    0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull, 0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull,
+    0xd192e819d6ef5218ull, 0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+    0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull, 0x34b0bcb5e19b48a8ull,
+    0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull, 0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull,
+    0x748f82ee5defb2fcull, 0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+    0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull, 0xc67178f2e372532bull,
+    0xca273eceea26619cull, 0xd186b8c721c0c207ull, 0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull,
+    0x06f067aa72176fbaull, 0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+    0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull, 0x431d67c49c100d4cull,
+    0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull, 0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull,
+};
+
+static const uint64_t H0[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull,
+};
+
+#define ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+static uint64_t Load64(const uint8_t *p) {
+    uint64_t x = 0;
+
+    for (int i = 0; i < 8; i++) {
+        x = (x << 8) | p[i];
+    }
+    return x;
+}
+
+static void Store64(uint8_t *p, uint64_t x) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)x;
+        x >>= 8;
+    }
+}
+
+static void Sha512Compress(uint64_t *state, const uint8_t *block) {
+    uint64_t w[16];
+    uint64_t s[8];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = Load64(&block[8 * i]);
+    }
+    memcpy(s, state, sizeof(s));
+
+    for (int i = 0; i < 80; i++) {
+        /* the schedule is rolled in 16 words: w[i & 15] holds the word of round i - 16 until it is replaced */
+        if (i >= 16) {
+            uint64_t w15 = w[(i - 15) & 15];
+            uint64_t w2 = w[(i - 2) & 15];
+            w[i & 15] += (ROR64(w2, 19) ^ ROR64(w2, 61) ^ (w2 >> 6)) + w[(i - 7) & 15] +
+                         (ROR64(w15, 1) ^ ROR64(w15, 8) ^ (w15 >> 7));
+        }
+        uint64_t t1 = s[7] + (ROR64(s[4], 14) ^ ROR64(s[4], 18) ^ ROR64(s[4], 41)) +
+                      ((s[4] & s[5]) ^ (~s[4] & s[6])) + K[i] + w[i & 15];
+        uint64_t t2 = (ROR64(s[0], 28) ^ ROR64(s[0], 34) ^ ROR64(s[0], 39)) +
+                      ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(&s[1], &s[0], 7 * sizeof(s[0]));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        state[i] += s[i];
+    }
+}
+
+void Sha512Initialise(Sha512Context *ctx) {
+    memcpy(ctx->state, H0, sizeof(ctx->state));
+    ctx->length = 0;
+    ctx->curlen = 0;
+}
+
+void Sha512Update(Sha512Context *ctx, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+
+    ctx->length += length;
+    while (length > 0) {
+        if (ctx->curlen == 0 && length >= sizeof(ctx->buf)) {
+            Sha512Compress(ctx->state, bytes);
+            bytes += sizeof(ctx->buf);
+            length -= sizeof(ctx->buf);
+            continue;
+        }
+        size_t n = sizeof(ctx->buf) - ctx->curlen;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(&ctx->buf[ctx->curlen], bytes, n);
+        ctx->curlen += (uint32_t)n;
+        bytes += n;
+        length -= n;
+        if (ctx->curlen == sizeof(ctx->buf)) {
+            Sha512Compress(ctx->state, ctx->buf);
+            ctx->curlen = 0;
+        }
+    }
+}
+
+void Sha512Finalise(Sha512Context *ctx, uint8_t *hash) {
+    ctx->buf[ctx->curlen++] = 0x80;
+    if (ctx->curlen > sizeof(ctx->buf) - 16u) {
+        memset(&ctx->buf[ctx->curlen], 0, sizeof(ctx->buf) - ctx->curlen);
+        Sha512Compress(ctx->state, ctx->buf);
+        ctx->curlen = 0;
+    }
+    /* the length in bits, on 128 bits */
+    memset(&ctx->buf[ctx->curlen], 0, sizeof(ctx->buf) - 8u - ctx->curlen);
+    Store64(&ctx->buf[sizeof(ctx->buf) - 16u], ctx->length >> 61);
+    Store64(&ctx->buf[sizeof(ctx->buf) - 8u], ctx->length << 3);
+    Sha512Compress(ctx->state, ctx->buf);
+
+    for (int i = 0; i < 8; i++) {
+        Store64(&hash[8 * i], ctx->state[i]);
+    }
+}
+
+static void set25519(gf r, const gf a) {
+    memcpy(r, a, sizeof(gf));
+}
+
+static void car25519(gf o) {
+    for (int i = 0; i < 16; i++) {
+        o[i] += (1 << 16);
+        int32_t c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * (1 << 16);
+    }
+}
+
+static void sel25519(gf p, gf q, int b) {
+    int32_t c = ~(b - 1);
+
+    for (int i = 0; i < 16; i++) {
+        int32_t t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void pack25519(uint8_t *o, const gf n) {
+    gf m;
+    gf t;
+
+    set25519(t, n);
+    car25519(t);
+    car25519(t);
+    car25519(t);
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int b = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        sel25519(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = (uint8_t)t[i];
+        o[2 * i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+static int neq25519(const gf a, const gf b) {
+    uint8_t c[32];
+    uint8_t d[32];
+
+    pack25519(c, a);
+    pack25519(d, b);
+    return memcmp(c, d, sizeof(c)) != 0;
+}
+
+static uint8_t par25519(const gf a) {
+    uint8_t d[32];
+
+    pack25519(d, a);
+    return d[0] & 1;
+}
+
+static void unpack25519(gf o, const uint8_t *n) {
+    for (int i = 0; i < 16; i++) {
+        o[i] = n[2 * i] + ((int32_t)n[2 * i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+static void A(gf o, const gf a, const gf b) {
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void Z(gf o, const gf a, const gf b) {
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void M(gf o, const gf a, const gf b) {
+    int64_t t[31] = {0};
+
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[i + j] += (int64_t)a[i] * b[j];
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    /* carried on 64 bits: the limbs only fit 32 bits again after the second pass */
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 16; i++) {
+            t[i] += (1 << 16);
+            int64_t c = t[i] >> 16;
+            t[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+            t[i] -= c * (1 << 16);
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        o[i] = (int32_t)t[i];
+    }
+}
+
+static void S(gf o, const gf a) {
+    M(o, a, a);
+}
+
+static void inv25519(gf o, const gf i) {
+    gf c;
+
+    set25519(c, i);
+    for (int a = 253; a >= 0; a--) {
+        S(c, c);
+        if (a != 2 && a != 4) {
+            M(c, c, i);
+        }
+    }
+    set25519(o, c);
+}
+
+static void pow2523(gf o, const gf i) {
+    gf c;
+
+    set25519(c, i);
+    for (int a = 250; a >= 0; a--) {
+        S(c, c);
+        if (a != 1) {
+            M(c, c, i);
+        }
+    }
+    set25519(o, c);
+}
+
+/* p += q. The sums and differences of the last step overwrite the values they come from, to save 4 elements of stack */
+static void add(gf p[4], gf q[4]) {
+    gf a, b, c, d, t;
+
+    Z(a, p[1], p[0]);
+    Z(t, q[1], q[0]);
+    M(a, a, t);
+    A(b, p[0], p[1]);
+    A(t, q[0], q[1]);
+    M(b, b, t);
+    M(c, p[3], q[3]);
+    M(c, c, D2);
+    M(d, p[2], q[2]);
+    A(d, d, d);
+    Z(t, b, a); /* e */
+    A(b, b, a); /* h */
+    Z(a, d, c); /* f */
+    A(d, d, c); /* g */
+
+    M(p[0], t, a);
+    M(p[1], b, d);
+    M(p[2], d, a);
+    M(p[3], t, b);
+}
+
+static void cswap(gf p[4], gf q[4], uint8_t b) {
+    for (int i = 0; i < 4; i++) {
+        sel25519(p[i], q[i], b);
+    }
+}
+
+__attribute__((noinline)) static void pack(uint8_t *r, gf p[4]) {
+    gf tx, ty, zi;
+
+    inv25519(zi, p[2]);
+    M(tx, p[0], zi);
+    M(ty, p[1], zi);
+    pack25519(r, ty);
+    r[31] ^= par25519(tx) << 7;
+}
+
+/* p = s * q, q is lost */
+static void scalarmult(gf p[4], gf q[4], const uint8_t *s) {
+    set25519(p[0], gf0);
+    set25519(p[1], gf1);
+    set25519(p[2], gf1);
+    set25519(p[3], gf0);
+    for (int i = 255; i >= 0; --i) {
+        uint8_t b = (s[i / 8] >> (i & 7)) & 1;
+        cswap(p, q, b);
+        add(q, p);
+        add(p, p);
+        cswap(p, q, b);
+    }
+}
+
+__attribute__((noinline)) static void scalarbase(gf p[4], const uint8_t *s) {
+    gf q[4];
+
+    set25519(q[0], X);
+    set25519(q[1], Y);
+    set25519(q[2], gf1);
+    M(q[3], X, Y);
+    scalarmult(p, q, s);
+}
+
+/* r = x mod L, x on 64 limbs of 8 bits */
+static void modL(uint8_t *r, int64_t x[64]) {
+    int64_t carry;
+    int i, j;
+
+    for (i = 63; i >= 32; --i) {
+        carry = 0;
+        for (j = i - 32; j < i - 12; ++j) {
+            x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (j = 0; j < 32; j++) {
+        x[j] -= carry * L[j];
+    }
+    for (i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+__attribute__((noinline)) static void reduce(uint8_t *r) {
+    int64_t x[64];
+
+    for (int i = 0; i < 64; i++) {
+        x[i] = r[i];
+    }
+    memset(r, 0, 64);
+    modL(r, x);
+}
+
+/* -A from its encoding, -1 if it is not a point of the curve */
+__attribute__((noinline)) static int unpackneg(gf r[4], const uint8_t *p) {
+    gf t, chk, num, den, den2, den4, den6;
+
+    set25519(r[2], gf1);
+    unpack25519(r[1], p);
+    S(num, r[1]);
+    M(den, num, D);
+    Z(num, num, r[2]);
+    A(den, r[2], den);
+
+    S(den2, den);
+    S(den4, den2);
+    M(den6, den4, den2);
+    M(t, den6, num);
+    M(t, t, den);
+
+    pow2523(t, t);
+    M(t, t, num);
+    M(t, t, den);
+    M(t, t, den);
+    M(r[0], t, den);
+
+    S(chk, r[0]);
+    M(chk, chk, den);
+    if (neq25519(chk, num)) {
+        M(r[0], r[0], I);
+    }
+
+    S(chk, r[0]);
+    M(chk, chk, den);
+    if (neq25519(chk, num)) {
+        return -1;
+    }
+
+    if (par25519(r[0]) == (p[31] >> 7)) {
+        Z(r[0], gf0, r[0]);
+    }
+
+    M(r[3], r[0], r[1]);
+    return 0;
+}
+
+/* S < L, so that a signature has a single encoding */
+static bool ScalarReduced(const uint8_t *s) {
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] != L[i]) {
+            return s[i] < L[i];
+        }
+    }
+    return false;
+}
+
+/* h = SHA-512(R || A || message) mod L */
+__attribute__((noinline)) static void HashChallenge(
+    uint8_t *h, const uint8_t *signature, const uint8_t *publicKey, size_t length, const uint8_t *message) {
+    Sha512Context ctx;
+
+    Sha512Initialise(&ctx);
+    Sha512Update(&ctx, signature, 32);
+    Sha512Update(&ctx, publicKey, ED25519_PUBLIC_KEY_SIZE);
+    Sha512Update(&ctx, message, length);
+    Sha512Finalise(&ctx, h);
+    reduce(h);
+}
+
+bool Ed25519Verify(const uint8_t *signature, const uint8_t *publicKey, size_t length, const uint8_t *message) {
+    uint8_t h[SHA512_HASH_SIZE];
+    uint8_t t[32];
+    gf p[4], q[4];
+
+    if (!ScalarReduced(&signature[32]) || unpackneg(q, publicKey) != 0) {
+        return false;
+    }
+    HashChallenge(h, signature, publicKey, length, message);
+
+    /* R must be S * B - h * A */
+    scalarmult(p, q, h);
+    scalarbase(q, &signature[32]);
+    add(p, q);
+    pack(t, p);
+
+    return memcmp(signature, t, sizeof(t)) == 0;
+}
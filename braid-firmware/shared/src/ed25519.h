@@ -0,0 +1,88 @@
+/**
+ * @file ed25519.h
+ * @brief Verification of Ed25519 signatures (RFC 8032), and the SHA-512 it hashes with.
+ *
+ * Derived from TweetNaCl by Daniel J. Bernstein, Bernard van Gastel, Wesley Janssen, Tanja Lange, Peter Schwabe and
+ * Sjaak Smetsers, in the public domain. Small rather than fast: field elements are 16 limbs of 16 bits, kept in 32-bit
+ * words to halve the stack, and the two scalar multiplications are plain double-and-add ladders. Only verification is
+ * here, the private key never leaves the machine signing the images.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/// @brief Length of an Ed25519 public key, in bytes
+#define ED25519_PUBLIC_KEY_SIZE (32u)
+
+/// @brief Length of an Ed25519 signature, in bytes: the point `R` then the scalar `S`
+#define ED25519_SIGNATURE_SIZE (64u)
+
+/// @brief Length of a SHA-512 hash, in bytes
+#define SHA512_HASH_SIZE (64u)
+
+/**
+ * @struct Sha512Context
+ * @brief State of a SHA-512 computation
+ */
+typedef struct Sha512Context {
+    /** @brief The current state of the hash */
+    uint64_t state[8];
+
+    /** @brief Total length of the data processed, in bytes */
+    uint64_t length;
+
+    /** @brief Bytes waiting in `buf` */
+    uint32_t curlen;
+
+    /** @brief Data not compressed yet */
+    uint8_t buf[128];
+} Sha512Context;
+
+/**
+ * @brief Starts a SHA-512 computation
+ *
+ * @param[out] ctx The context
+ */
+void Sha512Initialise(Sha512Context *ctx);
+
+/**
+ * @brief Adds data to a SHA-512 computation
+ *
+ * @param ctx The context
+ * @param data The data
+ * @param length Length of the data, in bytes
+ */
+void Sha512Update(Sha512Context *ctx, const void *data, size_t length);
+
+/**
+ * @brief Ends a SHA-512 computation
+ *
+ * @param ctx The context, to be initialised again before another use
+ * @param[out] hash The hash, `SHA512_HASH_SIZE` bytes
+ */
+void Sha512Finalise(Sha512Context *ctx, uint8_t *hash);
+
+/**
+ * @brief Tells whether `signature` is a valid Ed25519 signature of a message under `publicKey`. Signatures whose `S`
+ * is not reduced are refused, as RFC 8032 requires. Nothing secret goes in, so the time taken depends on the inputs.
+ *
+ * The message is hashed once, then the two scalar multiplications take about 9000 field multiplications of 256
+ * products on 64 bits each: on the Cortex-M0+ of the sensors MCU, which has no long multiply, that is seconds.
+ *
+ * @param signature The signature, `ED25519_SIGNATURE_SIZE` bytes
+ * @param publicKey The public key, `ED25519_PUBLIC_KEY_SIZE` bytes
+ * @param length Length of the message
+ * @param message The message
+ * @return `true` if the signature is valid
+ */
+bool Ed25519Verify(const uint8_t *signature, const uint8_t *publicKey, size_t length, const uint8_t *message);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
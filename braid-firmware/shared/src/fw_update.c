@@ -0,0 +1,193 @@
+#include <string.h>
+#include <sys/param.h>
+
+#include "crc.h"
+#include "ed25519.h"
+#include "fw_update.h"
+
+/* the signature is an Ed25519 one */
+_Static_assert(PROTO_FW_SIGNATURE_LEN == ED25519_SIGNATURE_SIZE, "PROTO_FW_SIGNATURE_LEN is not an Ed25519 signature");
+
+static bool IsWritten(const FwUpdateCtx *ctx, uint32_t block) {
+    return (ctx->written[block / 8u] & (1u << (block % 8u))) != 0;
+}
+
+static void SetWritten(FwUpdateCtx *ctx, uint32_t block) {
+    ctx->written[block / 8u] |= (uint8_t)(1u << (block % 8u));
+}
+
+static size_t BlockLength(const FwUpdateCtx *ctx, uint32_t block) {
+    return MIN(PROTO_FW_BLOCK_LEN, ctx->progress.length - block * PROTO_FW_BLOCK_LEN);
+}
+
+static bool KeySet(const uint8_t *publicKey) {
+    uint8_t bits = 0;
+
+    for (size_t i = 0; i < ED25519_PUBLIC_KEY_SIZE; i++) {
+        bits |= publicKey[i];
+    }
+    return bits != 0;
+}
+
+static int Save(FwUpdateCtx *ctx) {
+    return (ctx->save != NULL) ? ctx->save(ctx->halCtx, &ctx->progress) : 0;
+}
+
+/**
+ * Checks the signature once every block is written
+ */
+static void Finish(FwUpdateCtx *ctx) {
+    if (!FwUpdateVerify(ctx->image, ctx->progress.length, ctx->progress.signature, ctx->publicKey)) {
+        /* a block was wrong despite its CRC, or the image was not signed with our key: start over next time */
+        memset(&ctx->progress, 0, sizeof(ctx->progress));
+        Save(ctx);
+        ctx->state = PROTO_FW_STATE_FAILED;
+        ctx->error = PROTO_FW_ERROR_SIGNATURE;
+        return;
+    }
+
+    ctx->progress.valid = 1;
+    if (Save(ctx) != 0) {
+        ctx->state = PROTO_FW_STATE_FAILED;
+        ctx->error = PROTO_FW_ERROR_FLASH;
+        return;
+    }
+    ctx->state = PROTO_FW_STATE_DONE;
+    ctx->error = PROTO_FW_ERROR_NONE;
+}
+
+/**
+ * Moves `nextBlock` past the blocks written, and saves it. The blocks written further only count until a restart
+ */
+static void Advance(FwUpdateCtx *ctx) {
+    uint32_t blocks = FW_UPDATE_BLOCKS(ctx->progress.length);
+    uint32_t next = ctx->progress.nextBlock;
+
+    while (next < blocks && IsWritten(ctx, next)) {
+        next++;
+    }
+    if (next != ctx->progress.nextBlock) {
+        ctx->progress.nextBlock = (uint16_t)next;
+        /* a lost save only costs the blocks to be sent again */
+        Save(ctx);
+    }
+    if (next == blocks) {
+        Finish(ctx);
+    }
+}
+
+void FwUpdateInit(FwUpdateCtx *ctx, const FwUpdateProgress *saved) {
+    memset(&ctx->progress, 0, sizeof(ctx->progress));
+    if (saved != NULL) {
+        ctx->progress = *saved;
+    }
+    ctx->state = PROTO_FW_STATE_IDLE;
+    ctx->error = PROTO_FW_ERROR_NONE;
+    memset(ctx->written, 0, sizeof(ctx->written));
+}
+
+void FwUpdateBegin(FwUpdateCtx *ctx, const ProtoFwBeginPayload *begin, ProtoFwStatusPayload *status) {
+    uint32_t blocks = FW_UPDATE_BLOCKS(begin->length);
+
+    ctx->error = PROTO_FW_ERROR_NONE;
+    memset(ctx->written, 0, sizeof(ctx->written));
+
+    if (!KeySet(ctx->publicKey)) {
+        /* nothing could be verified: refused before anything is erased */
+        ctx->state = PROTO_FW_STATE_FAILED;
+        ctx->error = PROTO_FW_ERROR_SIGNATURE;
+    } else if (begin->length == 0 || begin->length > ctx->maxLength || blocks > FW_UPDATE_MAX_BLOCKS) {
+        ctx->state = PROTO_FW_STATE_FAILED;
+        ctx->error = PROTO_FW_ERROR_TOO_LARGE;
+    } else if (ctx->progress.length == begin->length &&
+               memcmp(ctx->progress.signature, begin->signature, PROTO_FW_SIGNATURE_LEN) == 0) {
+        /* the same image: keep what was written before the interruption */
+        for (uint32_t block = 0; block < ctx->progress.nextBlock; block++) {
+            SetWritten(ctx, block);
+        }
+        if (ctx->progress.valid) {
+            ctx->state = PROTO_FW_STATE_DONE;
+        } else {
+            ctx->state = PROTO_FW_STATE_RECEIVING;
+            /* the restart may have happened between the last block and the check of the signature */
+            Advance(ctx);
+        }
+    } else {
+        /* the old image is not valid anymore as soon as a block is erased */
+        memset(&ctx->progress, 0, sizeof(ctx->progress));
+        ctx->progress.length = begin->length;
+        memcpy(ctx->progress.signature, begin->signature, PROTO_FW_SIGNATURE_LEN);
+        if (Save(ctx) != 0) {
+            ctx->state = PROTO_FW_STATE_FAILED;
+            ctx->error = PROTO_FW_ERROR_FLASH;
+        } else {
+            ctx->state = PROTO_FW_STATE_RECEIVING;
+        }
+    }
+
+    FwUpdateStatus(ctx, status);
+}
+
+bool FwUpdateBlock(FwUpdateCtx *ctx, size_t payloadLength, const uint8_t *payload, ProtoFwStatusPayload *status) {
+    ProtoFwBlockHeader header;
+
+    if (ctx->state != PROTO_FW_STATE_RECEIVING) {
+        /* a block still in flight when the update ended, or sent without announcing the image */
+        FwUpdateStatus(ctx, status);
+        return true;
+    }
+
+    if (payloadLength < sizeof(header)) {
+        ctx->error = PROTO_FW_ERROR_BLOCK;
+        FwUpdateStatus(ctx, status);
+        return true;
+    }
+    memcpy(&header, payload, sizeof(header));
+    const uint8_t *data = &payload[sizeof(header)];
+    size_t length = payloadLength - sizeof(header);
+
+    if (header.index >= FW_UPDATE_BLOCKS(ctx->progress.length) || length != BlockLength(ctx, header.index)) {
+        ctx->error = PROTO_FW_ERROR_BLOCK;
+        FwUpdateStatus(ctx, status);
+        return true;
+    }
+    if (Crc16(length, data) != header.crc) {
+        ctx->error = PROTO_FW_ERROR_CRC;
+        FwUpdateStatus(ctx, status);
+        return true;
+    }
+
+    /* retransmissions and blocks sent again after a rewind are dropped */
+    if (IsWritten(ctx, header.index)) {
+        return false;
+    }
+
+    /* blocks left by an interrupted transfer, or unchanged since the previous image, are not written again */
+    uint32_t offset = (uint32_t)header.index * PROTO_FW_BLOCK_LEN;
+    if (memcmp(&ctx->image[offset], data, length) != 0) {
+        if (ctx->program(ctx->halCtx, offset, length, data) != 0 || Crc16(length, &ctx->image[offset]) != header.crc) {
+            ctx->error = PROTO_FW_ERROR_FLASH;
+            FwUpdateStatus(ctx, status);
+            return true;
+        }
+    }
+    SetWritten(ctx, header.index);
+    Advance(ctx);
+
+    if (ctx->state != PROTO_FW_STATE_RECEIVING) {
+        FwUpdateStatus(ctx, status);
+        return true;
+    }
+
+    return false;
+}
+
+void FwUpdateStatus(const FwUpdateCtx *ctx, ProtoFwStatusPayload *status) {
+    status->state = ctx->state;
+    status->error = ctx->error;
+    status->nextBlock = ctx->progress.nextBlock;
+}
+
+bool FwUpdateVerify(const uint8_t *image, uint32_t length, const uint8_t *signature, const uint8_t *publicKey) {
+    return KeySet(publicKey) && Ed25519Verify(signature, publicKey, length, image);
+}
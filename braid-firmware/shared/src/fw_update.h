@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ed25519.h"
+#include "proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/// @brief Maximum number of blocks of an image, `PROTO_FW_BLOCK_LEN` bytes each
+#ifndef FW_UPDATE_MAX_BLOCKS
+#define FW_UPDATE_MAX_BLOCKS (64u)
+#endif
+
+/// @brief Number of blocks of an image of `length` bytes
+#define FW_UPDATE_BLOCKS(length) (((length) + PROTO_FW_BLOCK_LEN - 1u) / PROTO_FW_BLOCK_LEN)
+
+/**
+ * @struct FwUpdateProgress
+ * @brief What the receiver must remember across restarts to resume a transfer, saved with `FwUpdateCtx.save`
+ */
+typedef struct FwUpdateProgress {
+    /** @brief Length of the image being received or received last, `0` if none */
+    uint32_t length;
+
+    /** @brief Signature of that image, as announced in its `ProtoFwBeginPayload` */
+    uint8_t signature[PROTO_FW_SIGNATURE_LEN];
+
+    /** @brief Index of the first block not written yet */
+    uint16_t nextBlock;
+
+    /** @brief Set once the whole image was written and its signature verified */
+    uint8_t valid;
+
+    /** @brief Keeps the struct a whole number of words, always 0 */
+    uint8_t reserved;
+} FwUpdateProgress;
+
+/**
+ * @struct FwUpdateCtx
+ * @brief Receiver of a firmware image streamed with `PROTO_MSG_TYPE_FW_BEGIN` and `PROTO_MSG_TYPE_FW_BLOCK`.
+ * Blocks are tracked one by one, so they may come again after a rewind, or in any order
+ */
+typedef struct FwUpdateCtx {
+    /**
+     * @brief HAL implementation erasing the flash under a block and writing it.
+     * Called with offsets multiple of `PROTO_FW_BLOCK_LEN`
+     *
+     * @param halCtx This context
+     * @param offset Offset of the block in the image
+     * @param length Length of the block, shorter than `PROTO_FW_BLOCK_LEN` for the last one
+     * @param data The block data
+     * @return `0` on success
+     */
+    int (*program)(void *halCtx, uint32_t offset, size_t length, const uint8_t *data);
+
+    /**
+     * @brief HAL implementation storing the progress in non-volatile memory
+     *
+     * @param halCtx This context
+     * @param progress The progress to store
+     * @return `0` on success
+     */
+    int (*save)(void *halCtx, const FwUpdateProgress *progress);
+
+    /** @brief Extra arguments for the HAL functions */
+    void *halCtx;
+
+    /** @brief Where the image is written, memory mapped, to read the blocks back */
+    const uint8_t *image;
+
+    /** @brief Room for the image, in bytes */
+    uint32_t maxLength;
+
+    /** @brief Public key the image signature is checked with, `ED25519_PUBLIC_KEY_SIZE` bytes */
+    const uint8_t *publicKey;
+
+    /** @brief Progress of the transfer, as last saved */
+    FwUpdateProgress progress;
+
+    /** @brief Current state, a `ProtoFwState` */
+    uint8_t state;
+
+    /** @brief Last error, a `ProtoFwError` */
+    uint8_t error;
+
+    /** @brief Blocks written since the image was announced, bit `n % 8` of byte `n / 8` for block `n` */
+    uint8_t written[(FW_UPDATE_MAX_BLOCKS + 7u) / 8u];
+} FwUpdateCtx;
+
+/**
+ * @brief Resets the receiver. HAL functions, image and key are left untouched
+ *
+ * @param ctx The receiver
+ * @param saved The progress saved before a restart, `NULL` if none
+ */
+void FwUpdateInit(FwUpdateCtx *ctx, const FwUpdateProgress *saved);
+
+/**
+ * @brief Starts receiving an image, or resumes it if it is the one saved in the progress. A new image is marked as
+ * not valid before anything is erased. Every image is refused while `FwUpdateCtx.publicKey` is all zeros
+ *
+ * @param ctx The receiver
+ * @param begin The announcement of the image
+ * @param[out] status The status to send back
+ */
+void FwUpdateBegin(FwUpdateCtx *ctx, const ProtoFwBeginPayload *begin, ProtoFwStatusPayload *status);
+
+/**
+ * @brief Checks and writes a block. Blocks already in flash with the same data are not written again. The signature
+ * is checked once the last missing block is written
+ *
+ * @param ctx The receiver
+ * @param payloadLength Length of the `PROTO_MSG_TYPE_FW_BLOCK` payload
+ * @param payload The payload, a `ProtoFwBlockHeader` followed by the block data
+ * @param[out] status The status to send back, if any
+ * @return `true` if `status` must be sent: the block was refused, or the update is over
+ */
+bool FwUpdateBlock(FwUpdateCtx *ctx, size_t payloadLength, const uint8_t *payload, ProtoFwStatusPayload *status);
+
+/**
+ * @brief Describes the state of the receiver
+ *
+ * @param ctx The receiver
+ * @param[out] status The status
+ */
+void FwUpdateStatus(const FwUpdateCtx *ctx, ProtoFwStatusPayload *status);
+
+/**
+ * @brief Tells whether an image matches its signature
+ *
+ * The images are signed with Ed25519 by whoever holds the private firmware signing key, which stays off the devices:
+ * the masters and the sensors MCUs only hold the public key, `CFG_FW_SIGNING_KEY`, and nothing read out of them can
+ * sign an image. The all zeros key of a build without `CFG_FW_SIGNING_KEY` is a point of small order, under which
+ * signatures could be forged: it refuses every image
+ *
+ * @param image The image
+ * @param length Length of the image
+ * @param signature The signature announced in its `ProtoFwBeginPayload`
+ * @param publicKey The public key, `ED25519_PUBLIC_KEY_SIZE` bytes
+ * @return `true` if the signature of the image is valid
+ */
+bool FwUpdateVerify(const uint8_t *image, uint32_t length, const uint8_t *signature, const uint8_t *publicKey);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
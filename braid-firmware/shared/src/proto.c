@@ -1,66 +1,896 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "build_config.h"
+#include "cobs.h"
 #include "crc.h"
 #include "proto.h"
 
-size_t uartRxBufferIdx;
-uint8_t uartRxBuffer[PROTO_MSG_MAX_LEN];
-uint8_t uartPayloadBuffer[PROTO_MSG_PAYLOAD_MAX_LEN];
+_Static_assert(PROTO_WINDOW_SIZE > 0 && PROTO_WINDOW_SIZE <= 8 && (PROTO_WINDOW_SIZE & (PROTO_WINDOW_SIZE - 1)) == 0,
+               "PROTO_WINDOW_SIZE must be a power of 2, at most 8");
+_Static_assert(PROTO_MSG_PAYLOAD_MAX_LEN >= PROTO_MSG_SHORT_PAYLOAD_MAX_LEN && PROTO_MSG_PAYLOAD_MAX_LEN <= 0xfff0,
+               "PROTO_MSG_PAYLOAD_MAX_LEN must be between 255 and 65520");
 
-static volatile bool txDone;
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
-enum UartState {
-    UART_STATE_WAIT_START,
-    UART_STATE_RECV,
-    UART_STATE_EXEC,
-    UART_STATE_CRC_ERROR,
+/** Returns the transmission slot of a sequence number */
+#define TX_SLOT(state, seq) (&(state)->txWindow[(uint8_t)(seq) & (PROTO_WINDOW_SIZE - 1)])
+
+#if PROTO_BAUD_ENABLE
+/** Baud rates tried by the negotiation, in increasing order */
+static const uint32_t baudRates[] = {PROTO_BAUD_DEFAULT, 230400, 460800, 921600, 2000000};
+
+/** Alternating bits and long runs: the bytes most likely to be sampled wrong at a bad rate */
+static const uint8_t baudPattern[PROTO_BAUD_PATTERN_LEN] = {
+    0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC, 0x01, 0x80, 0xFE, 0x7F, 0xA5, 0x5A, 0x96, 0x69,
 };
-volatile enum UartState uartState = UART_STATE_WAIT_START;
+#endif
+
+/** Returns the offset of the payload in a frame (without start byte) with the given type byte */
+#define PAYLOAD_OFFSET(type) (((type) & PROTO_MSG_FLAG_LONG) ? PROTO_MSG_LONG_PAYLOAD_OFFSET : PROTO_MSG_PAYLOAD_OFFSET)
+
+/**
+ * Reads LEN from a frame (without start byte), in both the short and the long format
+ */
+static size_t PayloadLength(const uint8_t *frame) {
+    if (frame[PROTO_MSG_TYP_OFFSET] & PROTO_MSG_FLAG_LONG) {
+        return ((size_t)frame[PROTO_MSG_LEN_OFFSET] << 8) | frame[PROTO_MSG_LEN_OFFSET + 1];
+    }
+
+    return frame[PROTO_MSG_LEN_OFFSET];
+}
+
+/**
+ * Returns the total length of a list of segments
+ */
+static size_t SegmentsLength(size_t segmentCount, const ProtoSegment *segments) {
+    size_t length = 0;
+
+    for (size_t i = 0; i < segmentCount; i++) {
+        length += segments[i].length;
+    }
+
+    return length;
+}
+
+/**
+ * Encodes start byte, TYP and LEN into `frame`. The long format is used only if LEN does not fit a single byte.
+ *
+ * @return The length of the encoded header
+ */
+static size_t EncodeHeader(uint8_t *frame, uint8_t type, size_t length) {
+    size_t offset = 1 + PROTO_MSG_LEN_OFFSET;
+
+    /* add start byte */
+    frame[0] = PROTO_MSG_START_BYTE;
+    if (length > PROTO_MSG_SHORT_PAYLOAD_MAX_LEN) {
+        type |= PROTO_MSG_FLAG_LONG;
+        frame[offset++] = (uint8_t)((length >> 8) & 0xFF);
+    }
+    frame[offset++] = (uint8_t)(length & 0xFF);
+    frame[1 + PROTO_MSG_TYP_OFFSET] = type;
+
+    return offset;
+}
+
+/**
+ * Encodes a frame into `frame`, gathering the payload from `segments`. `header` is placed between LEN and the payload,
+ * and counted in LEN.
+ *
+ * @return The length of the encoded frame
+ */
+static size_t EncodeFrame(uint8_t *frame,
+                          bool cobs,
+                          uint8_t type,
+                          size_t headerLength,
+                          const uint8_t *header,
+                          size_t segmentCount,
+                          const ProtoSegment *segments) {
+    uint8_t *raw = frame;
+
+    if (cobs) {
+        /* build the plain frame further in the buffer, then encode it in place towards the beginning */
+        frame = raw + PROTO_MSG_COBS_OVERHEAD - 1;
+    }
+
+    size_t length = headerLength + SegmentsLength(segmentCount, segments);
+    size_t offset = EncodeHeader(frame, type, length);
+
+    /* add header and payload bytes */
+    if (headerLength > 0) {
+        memcpy(&frame[offset], header, headerLength);
+    }
+    for (size_t i = 0, copied = headerLength; i < segmentCount; copied += segments[i].length, i++) {
+        memcpy(&frame[offset + copied], segments[i].data, segments[i].length);
+    }
+
+    /* compute CRC */
+    uint16_t crc = Crc16(offset - 1 + length, frame + 1);
+    frame[offset + length] = (uint8_t)((crc >> 8) & 0xFF);
+    frame[offset + length + 1] = (uint8_t)(crc & 0xFF);
+
+    if (cobs) {
+        size_t encoded = CobsEncode(&raw[1], frame + 1, offset - 1 + length + 2);
+        raw[0] = PROTO_MSG_COBS_DELIMITER;
+        raw[1 + encoded] = PROTO_MSG_COBS_DELIMITER;
+        return encoded + 2;
+    }
+
+    return offset + length + 2;
+}
+
+static ProtoErrorCode Write(ProtoCtx *ctx, size_t length, const uint8_t *frame) {
+    if (length > 0 && ctx->write(ctx->writeCtx, length, frame) != (int)length) {
+        return PROTO_ERROR_HAL;
+    }
+    ctx->state.stats.txBytes += length;
+
+    return PROTO_SUCCESS;
+}
+
+/**
+ * Sends a message outside of the window, without sequence number
+ */
+static ProtoErrorCode SendUnsequenced(ProtoCtx *ctx,
+                                      ProtoMsgType type,
+                                      size_t segmentCount,
+                                      const ProtoSegment *segments) {
+    size_t payloadLength = SegmentsLength(segmentCount, segments);
+    ProtoErrorCode result;
+
+    if (payloadLength > ctx->state.maxPayloadLength) {
+        return PROTO_ERROR_INVALID_ARG;
+    }
+    ctx->state.stats.txFrames++;
+
+    /* pings are always understood, even by a side which restarted and does not know about COBS yet. Every frame is
+     * still written with a single call, so that an event may go between any two (see `ProtoCtx.writeUrgent`) */
+    if (ctx->state.features & PROTO_FEATURE_COBS) {
+        bool cobs = type != PROTO_MSG_TYPE_PING;
+        size_t length = EncodeFrame(ctx->state.txBuffer, cobs, (uint8_t)type, 0, NULL, segmentCount, segments);
+        return Write(ctx, length, ctx->state.txBuffer);
+    }
+
+    /* plain frames are written straight from the segments, with the CRC computed along the way */
+    uint8_t header[1 + 1 + PROTO_MSG_LEN_MAX_SIZE];
+    size_t headerLength = EncodeHeader(header, (uint8_t)type, payloadLength);
+    uint16_t crc = Crc16Update(CRC16_INIT, headerLength - 1, &header[1]);
+    for (size_t i = 0; i < segmentCount; i++) {
+        crc = Crc16Update(crc, segments[i].length, segments[i].data);
+    }
+    uint8_t crcBytes[2] = {(uint8_t)((crc >> 8) & 0xFF), (uint8_t)(crc & 0xFF)};
+
+    result = Write(ctx, headerLength, header);
+    for (size_t i = 0; i < segmentCount && result == PROTO_SUCCESS; i++) {
+        result = Write(ctx, segments[i].length, segments[i].data);
+    }
+    if (result == PROTO_SUCCESS) {
+        result = Write(ctx, sizeof(crcBytes), crcBytes);
+    }
+
+    return result;
+}
+
+/**
+ * Sends a single buffer outside of the window
+ */
+static ProtoErrorCode SendUnsequencedBuffer(ProtoCtx *ctx, ProtoMsgType type, size_t length, const void *data) {
+    ProtoSegment segment = {.data = (const uint8_t *)data, .length = length};
+
+    return SendUnsequenced(ctx, type, 1, &segment);
+}
+
+static ProtoErrorCode SendSequenced(ProtoCtx *ctx,
+                                    ProtoMsgType type,
+                                    size_t segmentCount,
+                                    const ProtoSegment *segments) {
+    ProtoState *state = &ctx->state;
+
+    if (SegmentsLength(segmentCount, segments) > state->maxPayloadLength - 1u) {
+        return PROTO_ERROR_INVALID_ARG;
+    }
+
+    if ((uint8_t)(state->txNext - state->txBase) >= state->window) {
+        return PROTO_ERROR_BUSY;
+    }
+
+    /* the frame is gathered directly in its slot, so that it can be sent again as is */
+    ProtoTxSlot *slot = TX_SLOT(state, state->txNext);
+    slot->length = EncodeFrame(slot->frame,
+                               state->features & PROTO_FEATURE_COBS,
+                               (uint8_t)type | PROTO_MSG_FLAG_SEQUENCED,
+                               1,
+                               &state->txNext,
+                               segmentCount,
+                               segments);
+    slot->acked = 0;
+    slot->sentAt = ctx->getTimeMs();
+    slot->sentIndex = state->txWrites++;
+    state->txNext++;
+    state->stats.txFrames++;
+
+    return Write(ctx, slot->length, slot->frame);
+}
+
+static ProtoErrorCode Retransmit(ProtoCtx *ctx, uint8_t seq) {
+    ProtoTxSlot *slot = TX_SLOT(&ctx->state, seq);
+
+    slot->sentAt = ctx->getTimeMs();
+    slot->sentIndex = ctx->state.txWrites++;
+    ctx->state.stats.retransmits++;
+    return Write(ctx, slot->length, slot->frame);
+}
 
 static ProtoErrorCode Respond(ProtoCtx *ctx, ProtoErrorCode response) {
-    return ProtoSend(ctx, PROTO_MSG_TYPE_RESPONSE, 1, (uint8_t *)&response);
+    uint8_t status = (uint8_t)response;
+
+    return SendUnsequencedBuffer(ctx, PROTO_MSG_TYPE_RESPONSE, sizeof(status), &status);
+}
+
+/**
+ * Sends the state of the window, and the id of an event with `PROTO_ACK_FLAG_EVENT`
+ */
+static ProtoErrorCode SendAck(ProtoCtx *ctx, uint8_t flags, uint8_t event) {
+    ProtoAckPayload ack = {
+        .next = ctx->state.rxNext,
+        .received = ctx->state.rxReceived,
+        .flags = flags,
+        .event = event,
+    };
+
+    ctx->state.rxUnacked = 0;
+    return SendUnsequencedBuffer(ctx, PROTO_MSG_TYPE_ACK, sizeof(ack), &ack);
+}
+
+/**
+ * Returns the features this side can enable
+ */
+static uint8_t LocalFeatures(const ProtoCtx *ctx) {
+    uint8_t features = 0;
+
+    if (ctx->window > 0 && ctx->getTimeMs != NULL) {
+        features |= PROTO_FEATURE_WINDOW;
+    }
+    if (PROTO_MSG_PAYLOAD_MAX_LEN > PROTO_MSG_SHORT_PAYLOAD_MAX_LEN) {
+        features |= PROTO_FEATURE_LONG_FRAMES;
+    }
+    if (ctx->cobs) {
+        features |= PROTO_FEATURE_COBS;
+    }
+    if (PROTO_BAUD_ENABLE && ctx->setBaudRate != NULL && ctx->getTimeMs != NULL &&
+        ctx->maxBaudRate > PROTO_BAUD_DEFAULT) {
+        features |= PROTO_FEATURE_BAUD;
+    }
+    if (ctx->pull) {
+        features |= PROTO_FEATURE_PULL;
+    }
+    if (PROTO_EVENTS_ENABLE && ctx->getTimeMs != NULL) {
+        features |= PROTO_FEATURE_EVENTS;
+    }
+    if (ctx->fwUpdate) {
+        features |= PROTO_FEATURE_FW_UPDATE;
+    }
+
+    return features;
+}
+
+static ProtoErrorCode SendPing(ProtoCtx *ctx, uint8_t flags) {
+    uint8_t features = LocalFeatures(ctx);
+    ProtoPingPayload ping = {
+        .version = {CFG_FW_VERSION_MAJOR, CFG_FW_VERSION_MINOR, CFG_FW_VERSION_PATCH},
+        .features = features,
+        .window = (features & PROTO_FEATURE_WINDOW) ? MIN(ctx->window, PROTO_WINDOW_SIZE) : 0,
+        .flags = flags,
+        .maxPayloadLength = PROTO_MSG_PAYLOAD_MAX_LEN,
+        .maxBaudRate = (features & PROTO_FEATURE_BAUD) ? ctx->maxBaudRate : PROTO_BAUD_DEFAULT,
+    };
+
+    return SendUnsequencedBuffer(ctx, PROTO_MSG_TYPE_PING, sizeof(ping), &ping);
+}
+
+/**
+ * Forgets all the sequenced messages, both received and in flight
+ */
+static void ResetWindow(ProtoState *state) {
+    state->rxNext = 0;
+    state->rxReceived = 0;
+    state->rxUnacked = 0;
+    state->rxRequested = 0;
+    state->rxHead = 0;
+    state->txBase = 0;
+    state->txNext = 0;
+}
+
+static void Deliver(ProtoCtx *ctx, ProtoMsgType msgType, size_t payloadLength, const uint8_t *payload) {
+    memcpy(ctx->state.payloadBuffer, payload, payloadLength);
+    if (ctx->messageCallback != NULL) {
+        ctx->messageCallback(ctx->messageCallbackCtx, msgType, payloadLength, ctx->state.payloadBuffer);
+    }
+}
+
+/**
+ * Returns the reception slot of the message `offset` after `rxNext`, `offset` from 1 to `PROTO_RX_SLOTS`. No modulo:
+ * the Cortex-M0+ has no divide instruction
+ */
+static ProtoRxSlot *RxSlot(ProtoState *state, uint8_t offset) {
+    uint8_t index = state->rxHead + offset - 1;
+
+    return &state->rxWindow[(index >= PROTO_RX_SLOTS) ? index - PROTO_RX_SLOTS : index];
+}
+
+/**
+ * Moves past `rxNext`, and returns the slot which held the new `rxNext`
+ */
+static ProtoRxSlot *AdvanceRx(ProtoState *state) {
+    ProtoRxSlot *slot = &state->rxWindow[state->rxHead];
+
+    state->rxHead = (state->rxHead + 1u == PROTO_RX_SLOTS) ? 0 : state->rxHead + 1u;
+    state->rxReceived >>= 1;
+    state->rxNext++;
+    return slot;
+}
+
+static ProtoErrorCode HandlePing(ProtoCtx *ctx, size_t payloadLength, const uint8_t *payload) {
+    ProtoState *state = &ctx->state;
+    ProtoPingPayload ping;
+
+    /* older firmwares only send the version: the missing fields read as zero */
+    memset(&ping, 0, sizeof(ping));
+    memcpy(&ping, payload, MIN(payloadLength, sizeof(ping)));
+
+    memcpy(state->peerVersion, ping.version, sizeof(state->peerVersion));
+    state->features = ping.features & LocalFeatures(ctx);
+    state->maxPayloadLength = (state->features & PROTO_FEATURE_LONG_FRAMES)
+                                  ? MIN(MAX(ping.maxPayloadLength, PROTO_MSG_SHORT_PAYLOAD_MAX_LEN),
+                                        PROTO_MSG_PAYLOAD_MAX_LEN)
+                                  : PROTO_MSG_SHORT_PAYLOAD_MAX_LEN;
+    state->peerMaxBaudRate = (state->features & PROTO_FEATURE_BAUD) ? ping.maxBaudRate : PROTO_BAUD_DEFAULT;
+    state->window = (state->features & PROTO_FEATURE_WINDOW) ? MIN(MIN(ctx->window, ping.window), PROTO_WINDOW_SIZE)
+                                                             : 0;
+    if (state->window == 0) {
+        state->features &= ~PROTO_FEATURE_WINDOW;
+    }
+
+    /* the other side (re)started its link, and its event ids */
+    ResetWindow(state);
+    state->rxEventSeen = 0;
+    if (!(state->features & PROTO_FEATURE_EVENTS)) {
+        state->eventPending = 0;
+    }
+
+    if (ping.flags & PROTO_PING_FLAG_REPLY) {
+        return PROTO_SUCCESS;
+    }
+
+    return SendPing(ctx, PROTO_PING_FLAG_REPLY);
+}
+
+static ProtoErrorCode HandleAck(ProtoCtx *ctx, size_t payloadLength, const uint8_t *payload) {
+    ProtoState *state = &ctx->state;
+    ProtoAckPayload ack;
+    ProtoErrorCode result = PROTO_SUCCESS;
+    uint8_t highest = 0;
+    bool delivered = false;
+    uint32_t newest = 0;
+
+    /* older firmwares do not send the event id */
+    if (payloadLength < offsetof(ProtoAckPayload, event)) {
+        return PROTO_ERROR_INVALID_ARG;
+    }
+    memset(&ack, 0, sizeof(ack));
+    memcpy(&ack, payload, MIN(payloadLength, sizeof(ack)));
+
+    if ((ack.flags & PROTO_ACK_FLAG_EVENT) && state->eventPending && ack.event == (uint8_t)(state->eventNext - 1)) {
+        state->eventPending = 0;
+    }
+
+    uint8_t inFlight = state->txNext - state->txBase;
+    uint8_t acked = ack.next - state->txBase;
+    if (acked > inFlight) {
+        /* stale acknowledgement */
+        return PROTO_SUCCESS;
+    }
+
+    /* everything before `next` was received, and the messages flagged after it: find the newest transmission */
+    for (uint8_t i = 0; i < inFlight; i++) {
+        ProtoTxSlot *slot = TX_SLOT(state, state->txBase + i);
+        if (i >= acked) {
+            if (!(ack.received & (1u << (i - acked)))) {
+                continue;
+            }
+            slot->acked = 1;
+            highest = i - acked + 1;
+        }
+        if (!delivered || (int32_t)(slot->sentIndex - newest) > 0) {
+            newest = slot->sentIndex;
+            delivered = true;
+        }
+    }
+
+    /* free the slots before `next` */
+    state->txBase = ack.next;
+    inFlight -= acked;
+
+    /* the UART never reorders bytes: a hole sent before a received message was lost. One sent after it, like a
+     * retransmission still in flight, waits for a later acknowledgement or for the timeout */
+    for (uint8_t i = 0; i < highest && result == PROTO_SUCCESS; i++) {
+        ProtoTxSlot *slot = TX_SLOT(state, ack.next + i);
+        if (!slot->acked && (int32_t)(newest - slot->sentIndex) > 0) {
+            result = Retransmit(ctx, ack.next + i);
+        }
+    }
+
+    if (highest == 0 && inFlight > 0 && (ack.flags & PROTO_ACK_FLAG_NAK)) {
+        result = Retransmit(ctx, ack.next);
+    }
+
+    return result;
+}
+
+static ProtoErrorCode HandleSequenced(ProtoCtx *ctx,
+                                      ProtoMsgType msgType,
+                                      size_t payloadLength,
+                                      const uint8_t *payload) {
+    ProtoState *state = &ctx->state;
+    uint8_t offset = payload[0] - state->rxNext;
+    uint8_t ackEvery = (state->window > 1) ? state->window / 2 : 1;
+
+    bool hole = false;
+
+    if (offset >= PROTO_WINDOW_SIZE || (state->rxReceived & (1u << offset))) {
+        /* duplicate: our acknowledgement was probably lost */
+        return SendAck(ctx, 0, 0);
+    }
+
+    state->rxReceived |= 1u << offset;
+    state->rxUnacked++;
+
+    if (offset > 0) {
+        /* a message was skipped: keep this one until it arrives, so that the application sees them in order */
+        ProtoRxSlot *slot = RxSlot(state, offset);
+        slot->type = (uint8_t)msgType;
+        slot->length = (uint16_t)(payloadLength - 1);
+        memcpy(slot->payload, &payload[1], slot->length);
+
+        /* ask for it once, the retransmission timeout covers the rest */
+        if (!state->rxRequested) {
+            hole = true;
+            state->rxRequested = 1;
+        }
+    } else {
+        ProtoRxSlot *slot = AdvanceRx(state);
+        state->rxRequested = 0;
+        Deliver(ctx, msgType, payloadLength - 1, &payload[1]);
+
+        /* then the ones kept behind it */
+        while (state->rxReceived & 1u) {
+            ProtoRxSlot *next = AdvanceRx(state);
+            Deliver(ctx, (ProtoMsgType)slot->type, slot->length, slot->payload);
+            slot = next;
+        }
+    }
+
+    if (hole || state->rxUnacked >= ackEvery) {
+        return SendAck(ctx, 0, 0);
+    }
+
+    return PROTO_SUCCESS;
+}
+
+#if PROTO_EVENTS_ENABLE
+/**
+ * Acknowledges an event right away, and delivers it unless it is a retransmission
+ */
+static ProtoErrorCode HandleEvent(ProtoCtx *ctx, size_t payloadLength, const uint8_t *payload) {
+    ProtoState *state = &ctx->state;
+    ProtoEventPayload event;
+
+    if (payloadLength < sizeof(event)) {
+        return PROTO_ERROR_INVALID_ARG;
+    }
+    memcpy(&event, payload, sizeof(event));
+
+    /* the ack goes out before the callback, which may take its time with the event */
+    ProtoErrorCode result = SendAck(ctx, PROTO_ACK_FLAG_EVENT, event.id);
+
+    if (!state->rxEventSeen || event.id != state->rxEventLast) {
+        state->rxEventSeen = 1;
+        state->rxEventLast = event.id;
+        Deliver(ctx, PROTO_MSG_TYPE_EVENT, payloadLength, payload);
+    }
+
+    return result;
+}
+
+/**
+ * Writes the event frame, ahead of the queued frames if the HAL can
+ */
+static ProtoErrorCode WriteEvent(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+
+    state->eventSentAt = ctx->getTimeMs();
+    if (ctx->writeUrgent != NULL && (state->features & PROTO_FEATURE_COBS)) {
+        if (ctx->writeUrgent(ctx->writeCtx, state->eventLength, state->eventFrame) != (int)state->eventLength) {
+            return PROTO_ERROR_HAL;
+        }
+        state->stats.txBytes += state->eventLength;
+        return PROTO_SUCCESS;
+    }
+
+    return Write(ctx, state->eventLength, state->eventFrame);
+}
+
+/**
+ * Sends the event again if it was not acknowledged in time. Checked before the window, which may be stuck behind it
+ */
+static ProtoErrorCode CheckEvent(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+
+    if (!state->eventPending || ctx->getTimeMs() - state->eventSentAt < PROTO_EVENT_RETRANSMIT_TIMEOUT_MS) {
+        return PROTO_SUCCESS;
+    }
+    state->stats.retransmits++;
+
+    return WriteEvent(ctx);
+}
+#endif
+
+/**
+ * Sends again the messages which were not acknowledged in time
+ */
+static ProtoErrorCode CheckRetransmit(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+    ProtoErrorCode result = PROTO_SUCCESS;
+
+    if (state->txBase == state->txNext || ctx->getTimeMs == NULL) {
+        return PROTO_SUCCESS;
+    }
+
+    uint32_t now = ctx->getTimeMs();
+    for (uint8_t seq = state->txBase; seq != state->txNext && result == PROTO_SUCCESS; seq++) {
+        ProtoTxSlot *slot = TX_SLOT(state, seq);
+        if (!slot->acked && now - slot->sentAt >= PROTO_RETRANSMIT_TIMEOUT_MS) {
+            result = Retransmit(ctx, seq);
+        }
+    }
+
+    return result;
+}
+
+#if PROTO_BAUD_ENABLE
+/**
+ * Returns the highest baud rate this side accepts, lowered by the previous failures
+ */
+static uint32_t LocalBaudLimit(const ProtoCtx *ctx) {
+    uint32_t limit = ctx->maxBaudRate;
+
+    if (ctx->state.baudCeiling != 0) {
+        limit = MIN(limit, ctx->state.baudCeiling);
+    }
+
+    return limit;
+}
+
+/**
+ * Returns the highest rate of `baudRates` lower than `baudRate`
+ */
+static uint32_t LowerBaudRate(uint32_t baudRate) {
+    uint32_t lower = PROTO_BAUD_DEFAULT;
+
+    for (size_t i = 0; i < sizeof(baudRates) / sizeof(baudRates[0]) && baudRates[i] < baudRate; i++) {
+        lower = baudRates[i];
+    }
+
+    return lower;
+}
+
+/**
+ * Returns the next rate to try, `0` if the link already runs at the highest rate both sides accept
+ */
+static uint32_t NextBaudRate(const ProtoCtx *ctx) {
+    uint32_t limit = MIN(LocalBaudLimit(ctx), ctx->state.peerMaxBaudRate);
+
+    for (size_t i = 0; i < sizeof(baudRates) / sizeof(baudRates[0]); i++) {
+        if (baudRates[i] > ctx->state.baudRate && baudRates[i] <= limit) {
+            return baudRates[i];
+        }
+    }
+
+    return 0;
+}
+
+static ProtoErrorCode SendBaud(ProtoCtx *ctx, ProtoBaudOp op, uint32_t baudRate) {
+    ProtoBaudPayload baud = {
+        .op = (uint8_t)op,
+        .baudRate = baudRate,
+    };
+
+    memcpy(baud.pattern, baudPattern, sizeof(baud.pattern));
+    return SendUnsequencedBuffer(ctx, PROTO_MSG_TYPE_BAUD, sizeof(baud), &baud);
+}
+
+static ProtoErrorCode SetBaudRate(ProtoCtx *ctx, uint32_t baudRate) {
+    ProtoState *state = &ctx->state;
+
+    if (ctx->setBaudRate(ctx->writeCtx, baudRate) != 0) {
+        return PROTO_ERROR_HAL;
+    }
+
+    /* errors caused by the switch itself do not count */
+    state->baudRate = baudRate;
+    state->lastRxAt = ctx->getTimeMs();
+    state->monitorStart = state->lastRxAt;
+    state->monitorErrors = 0;
+
+    return PROTO_SUCCESS;
+}
+
+/**
+ * Gives up a baud rate step, going back to the last verified rate. The failed rate is not tried again
+ */
+static ProtoErrorCode AbortBaudStep(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+
+    state->baudCeiling = LowerBaudRate(state->baudTarget);
+    state->baudStep = PROTO_BAUD_STEP_IDLE;
+    if (state->baudRate == state->baudVerified) {
+        return PROTO_SUCCESS;
+    }
+
+    return SetBaudRate(ctx, state->baudVerified);
+}
+
+/**
+ * Goes back to the default baud rate and renegotiates the link from scratch
+ */
+static ProtoErrorCode FallBack(ProtoCtx *ctx, bool notify) {
+    ProtoState *state = &ctx->state;
+    ProtoErrorCode result = PROTO_SUCCESS;
+
+    /* the other side may still understand us: tell it not to wait for its own errors */
+    if (notify) {
+        result = SendBaud(ctx, PROTO_BAUD_OP_REVERT, PROTO_BAUD_DEFAULT);
+    }
+
+    state->baudCeiling = LowerBaudRate(state->baudRate);
+    state->baudVerified = PROTO_BAUD_DEFAULT;
+    state->baudStep = PROTO_BAUD_STEP_IDLE;
+    state->stats.baudFallbacks++;
+    if (result == PROTO_SUCCESS) {
+        result = SetBaudRate(ctx, PROTO_BAUD_DEFAULT);
+    }
+    if (result == PROTO_SUCCESS) {
+        result = SendPing(ctx, 0);
+    }
+
+    return result;
+}
+
+static ProtoErrorCode HandleBaud(ProtoCtx *ctx, size_t payloadLength, const uint8_t *payload) {
+    ProtoState *state = &ctx->state;
+    ProtoBaudPayload baud;
+    ProtoErrorCode result = PROTO_SUCCESS;
+
+    if (payloadLength < sizeof(baud) || !(state->features & PROTO_FEATURE_BAUD)) {
+        return PROTO_SUCCESS;
+    }
+    memcpy(&baud, payload, sizeof(baud));
+    bool patternOk = memcmp(baud.pattern, baudPattern, sizeof(baudPattern)) == 0;
+
+    switch (baud.op) {
+    case PROTO_BAUD_OP_PROPOSE: {
+        bool known = false;
+        for (size_t i = 0; i < sizeof(baudRates) / sizeof(baudRates[0]); i++) {
+            known |= baudRates[i] == baud.baudRate;
+        }
+        if (!known || baud.baudRate > LocalBaudLimit(ctx)) {
+            return SendBaud(ctx, PROTO_BAUD_OP_REJECT, LocalBaudLimit(ctx));
+        }
+
+        /* the acceptance is still sent at the current rate */
+        result = SendBaud(ctx, PROTO_BAUD_OP_ACCEPT, baud.baudRate);
+        if (result == PROTO_SUCCESS) {
+            state->baudTarget = baud.baudRate;
+            state->baudStep = PROTO_BAUD_STEP_SWITCHED;
+            state->baudStepAt = ctx->getTimeMs();
+            result = SetBaudRate(ctx, baud.baudRate);
+        }
+        break;
+    }
+    case PROTO_BAUD_OP_ACCEPT:
+        if (state->baudStep == PROTO_BAUD_STEP_PROPOSED && baud.baudRate == state->baudTarget) {
+            state->baudStep = PROTO_BAUD_STEP_TESTING;
+            state->baudStepAt = ctx->getTimeMs();
+            result = SetBaudRate(ctx, baud.baudRate);
+            if (result == PROTO_SUCCESS) {
+                result = SendBaud(ctx, PROTO_BAUD_OP_TEST, baud.baudRate);
+            }
+        }
+        break;
+    case PROTO_BAUD_OP_REJECT:
+        if (state->baudStep == PROTO_BAUD_STEP_PROPOSED) {
+            /* try again with what the other side accepts, if it is still faster than now */
+            state->baudStep = PROTO_BAUD_STEP_IDLE;
+            state->baudCeiling = baud.baudRate;
+            result = ProtoBaudStart(ctx);
+        }
+        break;
+    case PROTO_BAUD_OP_TEST:
+        if (state->baudStep == PROTO_BAUD_STEP_SWITCHED && baud.baudRate == state->baudRate && patternOk) {
+            state->baudVerified = state->baudRate;
+            state->baudStep = PROTO_BAUD_STEP_IDLE;
+            result = SendBaud(ctx, PROTO_BAUD_OP_TEST_ECHO, baud.baudRate);
+        }
+        break;
+    case PROTO_BAUD_OP_TEST_ECHO:
+        if (state->baudStep == PROTO_BAUD_STEP_TESTING && baud.baudRate == state->baudRate && patternOk) {
+            /* verified: go on with the next step */
+            state->baudVerified = state->baudRate;
+            state->baudStep = PROTO_BAUD_STEP_IDLE;
+            result = ProtoBaudStart(ctx);
+        }
+        break;
+    case PROTO_BAUD_OP_REVERT:
+        if (state->baudRate != PROTO_BAUD_DEFAULT) {
+            result = FallBack(ctx, false);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return (result == PROTO_ERROR_HAL) ? result : PROTO_SUCCESS;
+}
+
+/**
+ * Reverts the baud rate steps which did not complete in time, and falls back to the default rate if the link degrades
+ */
+static ProtoErrorCode CheckBaud(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+
+    if (!(state->features & PROTO_FEATURE_BAUD)) {
+        return PROTO_SUCCESS;
+    }
+
+    uint32_t now = ctx->getTimeMs();
+    switch (state->baudStep) {
+    case PROTO_BAUD_STEP_PROPOSED:
+    case PROTO_BAUD_STEP_TESTING:
+        if (now - state->baudStepAt >= PROTO_BAUD_STEP_TIMEOUT_MS) {
+            return AbortBaudStep(ctx);
+        }
+        break;
+    case PROTO_BAUD_STEP_SWITCHED:
+        /* the initiator gives up first, so that both sides are back at the old rate when this expires */
+        if (now - state->baudStepAt >= 2 * PROTO_BAUD_STEP_TIMEOUT_MS) {
+            return AbortBaudStep(ctx);
+        }
+        break;
+    default:
+        if (state->baudRate == PROTO_BAUD_DEFAULT) {
+            break;
+        }
+
+        /* after an aborted step the other side may still be sending at the failed rate for a while */
+        if (now - state->monitorStart >= PROTO_BAUD_MONITOR_MS ||
+            now - state->baudStepAt < 2 * PROTO_BAUD_STEP_TIMEOUT_MS) {
+            state->monitorStart = now;
+            state->monitorErrors = 0;
+        }
+        if (state->monitorErrors >= PROTO_BAUD_FALLBACK_ERRORS || now - state->lastRxAt >= PROTO_BAUD_SILENCE_MS) {
+            return FallBack(ctx, true);
+        }
+        break;
+    }
+
+    return PROTO_SUCCESS;
+}
+#endif
+
+void ProtoInit(ProtoCtx *ctx) {
+    memset(&ctx->state, 0, sizeof(ctx->state));
+    ctx->state.rxState = PROTO_RX_STATE_WAIT_START;
+    ctx->state.maxPayloadLength = PROTO_MSG_SHORT_PAYLOAD_MAX_LEN;
+    ctx->state.baudRate = PROTO_BAUD_DEFAULT;
+    ctx->state.baudVerified = PROTO_BAUD_DEFAULT;
+}
+
+void ProtoHistogramAdd(ProtoHistogram *histogram, uint32_t value) {
+    /* the bucket is the number of significant bits */
+    uint32_t bucket = (value == 0) ? 0 : 32 - (uint32_t)__builtin_clz(value);
+
+    histogram->buckets[MIN(bucket, PROTO_HISTOGRAM_BUCKETS - 1)]++;
 }
 
 ProtoErrorCode ProtoProcessMessage(ProtoCtx *ctx) {
     ProtoErrorCode result = PROTO_SUCCESS;
-    int payloadLength = 0;
 
     /* check if there is a command to execute */
-    switch (uartState) {
-    case UART_STATE_EXEC: {
-        ProtoMsgType msgType = uartRxBuffer[PROTO_MSG_TYP_OFFSET];
-        /* process the message here */
-        switch (msgType) {
-        case PROTO_MSG_TYPE_RESPONSE:
-            // fall through
-        case PROTO_MSG_TYPE_PING:
-            // fall through
-        case PROTO_MSG_TYPE_SENSOR_REQUEST:
-            payloadLength = uartRxBuffer[PROTO_MSG_LEN_OFFSET];
-            memcpy(uartPayloadBuffer, &uartRxBuffer[PROTO_MSG_PAYLOAD_OFFSET], payloadLength);
-            if (ctx->messageCallback != NULL) {
-                ctx->messageCallback(ctx->messageCallbackCtx, msgType, uartPayloadBuffer);
+    switch (ctx->state.rxState) {
+    case PROTO_RX_STATE_EXEC: {
+        uint8_t type = ctx->state.rxBuffer[PROTO_MSG_TYP_OFFSET];
+        ProtoMsgType msgType = (ProtoMsgType)(type & PROTO_MSG_TYPE_MASK);
+        size_t payloadLength = PayloadLength(ctx->state.rxBuffer);
+        const uint8_t *payload = &ctx->state.rxBuffer[PAYLOAD_OFFSET(type)];
+
+        if (ctx->getTimeMs != NULL) {
+            uint32_t now = ctx->getTimeMs();
+            if (ctx->state.stats.rxFrames > 0) {
+                ProtoHistogramAdd(&ctx->state.stats.rxInterval, now - ctx->state.lastRxAt);
             }
-            break;
-        default:
-            /* unknown command */
-            result = PROTO_ERROR_INVALID_CMD;
-            break;
+            ctx->state.lastRxAt = now;
         }
+        ctx->state.stats.rxFrames++;
 
-        /* make the Innophase know that the command was successfully accepted/rejected */
-        result = Respond(ctx, result);
+        /* process the message here */
+        if (type & PROTO_MSG_FLAG_SEQUENCED) {
+            /* acknowledged with the window, never with a response */
+            result = (payloadLength > 0) ? HandleSequenced(ctx, msgType, payloadLength, payload) : PROTO_SUCCESS;
+        } else {
+            switch (msgType) {
+            case PROTO_MSG_TYPE_RESPONSE:
+            case PROTO_MSG_TYPE_SENSOR_BATCH:
+                /* never answer a response, or the two sides would keep answering each other */
+                Deliver(ctx, msgType, payloadLength, payload);
+                break;
+            case PROTO_MSG_TYPE_ACK:
+                result = HandleAck(ctx, payloadLength, payload);
+                break;
+#if PROTO_BAUD_ENABLE
+            case PROTO_MSG_TYPE_BAUD:
+                result = HandleBaud(ctx, payloadLength, payload);
+                break;
+#endif
+            case PROTO_MSG_TYPE_TIME_SYNC:
+            case PROTO_MSG_TYPE_FW_STATUS:
+                /* not answered either: the answer would not tell the sender anything useful */
+                Deliver(ctx, msgType, payloadLength, payload);
+                break;
+#if PROTO_EVENTS_ENABLE
+            case PROTO_MSG_TYPE_EVENT:
+                result = HandleEvent(ctx, payloadLength, payload);
+                break;
+#endif
+            case PROTO_MSG_TYPE_PING:
+                /* answered with our own ping */
+                result = HandlePing(ctx, payloadLength, payload);
+                Deliver(ctx, msgType, payloadLength, payload);
+                break;
+            case PROTO_MSG_TYPE_SENSOR_REQUEST:
+            case PROTO_MSG_TYPE_SENSOR_CONFIG:
+            case PROTO_MSG_TYPE_FW_BEGIN:
+            case PROTO_MSG_TYPE_FW_BLOCK:
+                Deliver(ctx, msgType, payloadLength, payload);
+                /* make the other side know that the command was successfully accepted */
+                result = Respond(ctx, PROTO_SUCCESS);
+                break;
+            default:
+                /* unknown command */
+                result = Respond(ctx, PROTO_ERROR_INVALID_CMD);
+                break;
+            }
+        }
 
         /* done processing: wait for another command to start */
-        uartState = UART_STATE_WAIT_START;
+        ctx->state.rxState = PROTO_RX_STATE_WAIT_START;
 
         break;
     }
-    case UART_STATE_CRC_ERROR:
-        result = Respond(ctx, PROTO_ERROR_CRC);
-        uartState = UART_STATE_WAIT_START;
+    case PROTO_RX_STATE_CRC_ERROR:
+        ctx->state.stats.crcErrors++;
+        ctx->state.monitorErrors++;
+        if (ctx->state.window > 0) {
+            /* ask for the missing message only */
+            if (!ctx->state.rxRequested) {
+                ctx->state.rxRequested = 1;
+                result = SendAck(ctx, PROTO_ACK_FLAG_NAK, 0);
+            }
+        } else {
+            result = Respond(ctx, PROTO_ERROR_CRC);
+        }
+        ctx->state.rxState = PROTO_RX_STATE_WAIT_START;
         break;
 
     default:
@@ -70,88 +900,341 @@ ProtoErrorCode ProtoProcessMessage(ProtoCtx *ctx) {
     return result;
 }
 
-ProtoErrorCode ProtoSend(ProtoCtx *ctx, ProtoMsgType type, uint8_t payloadLength, const uint8_t *payload) {
-    static uint8_t sendBuffer[PROTO_MSG_MAX_LEN];
+ProtoErrorCode ProtoSendv(ProtoCtx *ctx, ProtoMsgType type, size_t segmentCount, const ProtoSegment *segments) {
+    /* a lost time sync is replaced by the next one, a retransmitted one would be late */
+    if (ctx->state.window > 0 && type != PROTO_MSG_TYPE_TIME_SYNC) {
+        return SendSequenced(ctx, type, segmentCount, segments);
+    }
 
-    /* add start byte */
-    sendBuffer[0] = PROTO_MSG_START_BYTE;
-    sendBuffer[1 + PROTO_MSG_TYP_OFFSET] = (uint8_t)type;
-    sendBuffer[1 + PROTO_MSG_LEN_OFFSET] = payloadLength;
+    return SendUnsequenced(ctx, type, segmentCount, segments);
+}
 
-    /* add payload bytes */
-    for (size_t i = 0; i < payloadLength; i++)
-        sendBuffer[i + PROTO_MSG_LEN_OFFSET + 2] = payload[i];
+ProtoErrorCode ProtoSend(ProtoCtx *ctx, ProtoMsgType type, size_t payloadLength, const uint8_t *payload) {
+    ProtoSegment segment = {.data = payload, .length = payloadLength};
 
-    /* compute CRC */
-    uint16_t crc = Crc16(payloadLength + 2, sendBuffer + 1);
-    sendBuffer[payloadLength + 3] = (uint8_t)((crc >> 8) & 0xFF);
-    sendBuffer[payloadLength + 4] = (uint8_t)(crc & 0xFF);
+    return ProtoSendv(ctx, type, 1, &segment);
+}
 
-    /* send payload */
-    int messageLength = payloadLength + 5;
-    if (ctx->write(ctx->writeCtx, messageLength, sendBuffer) != messageLength) {
-        return PROTO_ERROR_HAL;
+/**
+ * Decodes in place the COBS frame collected in `rxBuffer`, and checks it like a plain one
+ *
+ * @return The next state of the receiver
+ */
+static ProtoRxState DecodeCobsFrame(ProtoState *state) {
+    size_t length = CobsDecode(state->rxBuffer, state->rxBuffer, state->rxBufferIdx);
+
+    if (length < PROTO_MSG_PAYLOAD_OFFSET + 2 ||
+        length != PAYLOAD_OFFSET(state->rxBuffer[PROTO_MSG_TYP_OFFSET]) + PayloadLength(state->rxBuffer) + 2) {
+        return PROTO_RX_STATE_CRC_ERROR;
     }
+    state->rxBufferIdx = length;
 
-    return PROTO_SUCCESS;
+    return CheckCrc16(length, state->rxBuffer) ? PROTO_RX_STATE_EXEC : PROTO_RX_STATE_CRC_ERROR;
 }
 
 /**
- * After detecting the packet start byte, read all bytes and check the CRC
+ * Feeds a chunk of received bytes to the framing state machine. Stops as soon as a whole frame has been collected, so
+ * that it can be processed before the rest of the chunk overwrites the receive buffer.
+ *
+ * @return The number of bytes consumed from `data`
  */
-static ProtoErrorCode RecvLoop(ProtoCtx *ctx) {
-    uint8_t rxChar = 0;
+static size_t FrameChunk(ProtoState *state, const uint8_t *data, size_t length) {
+    size_t consumed = 0;
 
-    while (true) {
-        int readRet = ctx->read(ctx->readCtx, 1, &rxChar);
-        if (readRet < 0) {
-            return PROTO_ERROR_HAL;
-        } else if (readRet > 0) {
-            uartRxBuffer[uartRxBufferIdx++] = rxChar;
+    while (consumed < length) {
+        switch (state->rxState) {
+        case PROTO_RX_STATE_WAIT_START:
+            if (data[consumed] == PROTO_MSG_START_BYTE) {
+                state->rxBufferIdx = 0;
+                state->rxState = PROTO_RX_STATE_RECV;
+            } else if (data[consumed] == PROTO_MSG_COBS_DELIMITER && (state->features & PROTO_FEATURE_COBS)) {
+                state->rxBufferIdx = 0;
+                state->rxState = PROTO_RX_STATE_RECV_COBS;
+            } else {
+                state->stats.discardedBytes++;
+                state->rxDiscarding = 1;
+            }
+            if (state->rxState != PROTO_RX_STATE_WAIT_START && state->rxDiscarding) {
+                state->stats.resyncs++;
+                state->rxDiscarding = 0;
+            }
+            consumed++;
+            break;
+        case PROTO_RX_STATE_RECV_COBS: {
+            /* take everything up to the delimiter at once */
+            const uint8_t *end = memchr(&data[consumed], PROTO_MSG_COBS_DELIMITER, length - consumed);
+            size_t needed = (end != NULL) ? (size_t)(end - &data[consumed]) : length - consumed;
+
+            if (needed > sizeof(state->rxBuffer) - state->rxBufferIdx) {
+                /* too long for a valid frame: the next delimiter starts a new one */
+                state->rxState = PROTO_RX_STATE_CRC_ERROR;
+                return consumed;
+            }
+            memcpy(&state->rxBuffer[state->rxBufferIdx], &data[consumed], needed);
+            state->rxBufferIdx += needed;
+            consumed += needed;
+
+            if (end != NULL) {
+                /* back to back delimiters: the frame did not start yet */
+                if (state->rxBufferIdx == 0) {
+                    consumed++;
+                    break;
+                }
+
+                state->rxState = DecodeCobsFrame(state);
+                /* a damaged frame may have lost its closing delimiter: then this one opens the next frame */
+                if (state->rxState != PROTO_RX_STATE_CRC_ERROR) {
+                    consumed++;
+                }
+                return consumed;
+            }
+            break;
         }
+        case PROTO_RX_STATE_RECV: {
+            /* the type byte tells how long the header is */
+            size_t headerLength = (state->rxBufferIdx > PROTO_MSG_TYP_OFFSET)
+                                      ? PAYLOAD_OFFSET(state->rxBuffer[PROTO_MSG_TYP_OFFSET])
+                                      : PROTO_MSG_PAYLOAD_OFFSET;
+            size_t needed;
 
-        if (uartRxBufferIdx > PROTO_MSG_LEN_OFFSET &&
-            uartRxBufferIdx == (size_t)(4 + uartRxBuffer[PROTO_MSG_LEN_OFFSET])) {
-            if (CheckCrc16(uartRxBufferIdx, uartRxBuffer)) {
-                uartState = UART_STATE_EXEC;
+            if (state->rxBufferIdx < headerLength) {
+                /* the frame length is still unknown: take the header one byte at a time */
+                needed = 1;
             } else {
-                uartState = UART_STATE_CRC_ERROR;
-                return PROTO_ERROR_CRC;
+                needed = headerLength + PayloadLength(state->rxBuffer) + 2 - state->rxBufferIdx;
+            }
+
+            if (needed > length - consumed) {
+                needed = length - consumed;
+            }
+            memcpy(&state->rxBuffer[state->rxBufferIdx], &data[consumed], needed);
+            state->rxBufferIdx += needed;
+            consumed += needed;
+
+            if (state->rxBufferIdx == headerLength && PayloadLength(state->rxBuffer) > PROTO_MSG_PAYLOAD_MAX_LEN) {
+                /* would not fit the buffer: either corrupted or not meant for us */
+                state->rxState = PROTO_RX_STATE_CRC_ERROR;
+                return consumed;
+            }
+
+            if (state->rxBufferIdx == headerLength && (state->features & PROTO_FEATURE_COBS) &&
+                (state->rxBuffer[PROTO_MSG_TYP_OFFSET] != PROTO_MSG_TYPE_PING ||
+                 PayloadLength(state->rxBuffer) > sizeof(ProtoPingPayload))) {
+                /* only pings are sent without COBS: the start byte was part of a COBS frame which lost its start */
+                state->rxState = PROTO_RX_STATE_CRC_ERROR;
+                return consumed;
+            }
+
+            if (state->rxBufferIdx > headerLength &&
+                state->rxBufferIdx == headerLength + PayloadLength(state->rxBuffer) + 2) {
+                state->rxState = CheckCrc16(state->rxBufferIdx, state->rxBuffer) ? PROTO_RX_STATE_EXEC
+                                                                                 : PROTO_RX_STATE_CRC_ERROR;
+                return consumed;
             }
             break;
         }
+        default:
+            /* a frame is waiting to be processed */
+            return consumed;
+        }
     }
 
-    return PROTO_SUCCESS;
+    return consumed;
+}
+
+/**
+ * Drops the classic frame being received once reads found the line idle for `PROTO_RX_IDLE_MS`: its end was lost
+ */
+static void CheckRxIdle(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+    uint32_t now = ctx->getTimeMs();
+
+    if (!state->rxIdle) {
+        state->rxIdle = 1;
+        state->rxIdleAt = now;
+    } else if (now - state->rxIdleAt >= PROTO_RX_IDLE_MS) {
+        state->rxState = PROTO_RX_STATE_CRC_ERROR;
+    }
 }
 
 ProtoErrorCode ProtoReceive(ProtoCtx *ctx) {
-    uint8_t rxChar = 0;
+    ProtoErrorCode result = PROTO_SUCCESS;
+    size_t offset = 0;
 
-    switch (uartState) {
-    case UART_STATE_WAIT_START:
-        if (ctx->read(ctx->readCtx, 1, &rxChar) < 0) {
+    /* drain whatever the HAL has buffered with a single call */
+    int readRet = ctx->read(ctx->readCtx, sizeof(ctx->state.rxChunk), ctx->state.rxChunk);
+    if (readRet < 0) {
+        return PROTO_ERROR_HAL;
+    }
+    ctx->state.stats.rxBytes += (uint32_t)readRet;
+    if (readRet > 0) {
+        ctx->state.rxIdle = 0;
+    }
+
+    while (offset < (size_t)readRet) {
+        offset += FrameChunk(&ctx->state, &ctx->state.rxChunk[offset], (size_t)readRet - offset);
+
+        if (ctx->state.rxState == PROTO_RX_STATE_EXEC || ctx->state.rxState == PROTO_RX_STATE_CRC_ERROR) {
+            if (ctx->state.rxState == PROTO_RX_STATE_CRC_ERROR) {
+                result = PROTO_ERROR_CRC;
+            }
+
+            /* process every complete frame found in the chunk, in order */
+            ProtoErrorCode processRet = ProtoProcessMessage(ctx);
+            if (processRet == PROTO_ERROR_HAL) {
+                return processRet;
+            }
+        }
+    }
+
+    /* handled like a damaged frame: counted, and asked for again in the windowed mode */
+    if (readRet == 0 && ctx->state.rxState == PROTO_RX_STATE_RECV && ctx->getTimeMs != NULL) {
+        CheckRxIdle(ctx);
+        if (ctx->state.rxState == PROTO_RX_STATE_CRC_ERROR) {
+            result = PROTO_ERROR_CRC;
+            if (ProtoProcessMessage(ctx) == PROTO_ERROR_HAL) {
+                return PROTO_ERROR_HAL;
+            }
+        }
+    }
+
+    /* the line went idle: acknowledge what was received so far */
+    if (readRet == 0 && ctx->state.rxUnacked > 0) {
+        if (SendAck(ctx, 0, 0) != PROTO_SUCCESS) {
             return PROTO_ERROR_HAL;
         }
+    }
+
+#if PROTO_EVENTS_ENABLE
+    if (CheckEvent(ctx) != PROTO_SUCCESS) {
+        return PROTO_ERROR_HAL;
+    }
+#endif
+    if (CheckRetransmit(ctx) != PROTO_SUCCESS) {
+        return PROTO_ERROR_HAL;
+    }
+#if PROTO_BAUD_ENABLE
+    if (CheckBaud(ctx) != PROTO_SUCCESS) {
+        return PROTO_ERROR_HAL;
+    }
+#endif
+
+    return result;
+}
 
-        if (rxChar == PROTO_MSG_START_BYTE) {
-            uartRxBufferIdx = 0;
-            uartState = UART_STATE_RECV;
+/**
+ * Returns the time left before `duration` has passed since `since`
+ */
+static uint32_t Remaining(uint32_t now, uint32_t since, uint32_t duration) {
+    uint32_t elapsed = now - since;
+
+    return (elapsed >= duration) ? 0 : duration - elapsed;
+}
+
+uint32_t ProtoNextTimeoutMs(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+    uint32_t timeout = PROTO_TIMEOUT_NONE;
+
+    /* the acknowledgement goes out as soon as a read finds the line idle */
+    if (state->rxUnacked > 0) {
+        return 0;
+    }
+    if (ctx->getTimeMs == NULL) {
+        return timeout;
+    }
+
+    uint32_t now = ctx->getTimeMs();
+    if (state->rxState == PROTO_RX_STATE_RECV) {
+        /* a read must find the line idle before the frame can time out */
+        timeout = state->rxIdle ? Remaining(now, state->rxIdleAt, PROTO_RX_IDLE_MS) : 0;
+    }
+#if PROTO_EVENTS_ENABLE
+    if (state->eventPending) {
+        timeout = MIN(timeout, Remaining(now, state->eventSentAt, PROTO_EVENT_RETRANSMIT_TIMEOUT_MS));
+    }
+#endif
+    for (uint8_t seq = state->txBase; seq != state->txNext; seq++) {
+        ProtoTxSlot *slot = TX_SLOT(state, seq);
+        if (!slot->acked) {
+            timeout = MIN(timeout, Remaining(now, slot->sentAt, PROTO_RETRANSMIT_TIMEOUT_MS));
         }
-        break;
-    case UART_STATE_RECV:
-        return RecvLoop(ctx);
-    case UART_STATE_EXEC:
-        break;
-    case UART_STATE_CRC_ERROR:
-        return PROTO_ERROR_CRC;
     }
 
-    return PROTO_SUCCESS;
+#if PROTO_BAUD_ENABLE
+    if (state->features & PROTO_FEATURE_BAUD) {
+        switch (state->baudStep) {
+        case PROTO_BAUD_STEP_PROPOSED:
+        case PROTO_BAUD_STEP_TESTING:
+            timeout = MIN(timeout, Remaining(now, state->baudStepAt, PROTO_BAUD_STEP_TIMEOUT_MS));
+            break;
+        case PROTO_BAUD_STEP_SWITCHED:
+            timeout = MIN(timeout, Remaining(now, state->baudStepAt, 2 * PROTO_BAUD_STEP_TIMEOUT_MS));
+            break;
+        default:
+            /* error bursts are checked when the corrupted frames arrive, silence needs a timer */
+            if (state->baudRate != PROTO_BAUD_DEFAULT) {
+                timeout = MIN(timeout, Remaining(now, state->lastRxAt, PROTO_BAUD_SILENCE_MS));
+            }
+            break;
+        }
+    }
+#endif
+
+    return timeout;
 }
 
 ProtoErrorCode ProtoPing(ProtoCtx *ctx) {
-    uint8_t version[3] = {CFG_FW_VERSION_MAJOR, CFG_FW_VERSION_MINOR, CFG_FW_VERSION_PATCH};
+    return SendPing(ctx, 0);
+}
+
+#if PROTO_EVENTS_ENABLE
+ProtoErrorCode ProtoSendEvent(ProtoCtx *ctx, ProtoEventType type, uint16_t detail) {
+    ProtoState *state = &ctx->state;
+
+    if (!(state->features & PROTO_FEATURE_EVENTS)) {
+        return PROTO_ERROR_INVALID_STATE;
+    }
+    if (state->eventPending) {
+        return PROTO_ERROR_BUSY;
+    }
+
+    ProtoEventPayload event = {.id = state->eventNext, .type = (uint8_t)type, .detail = detail};
+    ProtoSegment segment = {.data = (const uint8_t *)&event, .length = sizeof(event)};
+
+    /* never sequenced: the window may be full of samples, and the event lane has its own ids */
+    state->eventLength = (uint8_t)EncodeFrame(
+        state->eventFrame, state->features & PROTO_FEATURE_COBS, PROTO_MSG_TYPE_EVENT, 0, NULL, 1, &segment);
+    state->eventPending = 1;
+    state->eventNext++;
+    state->stats.txFrames++;
+
+    return WriteEvent(ctx);
+}
+
+uint8_t ProtoEventAcked(const ProtoCtx *ctx) {
+    return !ctx->state.eventPending;
+}
+#endif
+
+#if PROTO_BAUD_ENABLE
+ProtoErrorCode ProtoBaudStart(ProtoCtx *ctx) {
+    ProtoState *state = &ctx->state;
+
+    if (!(state->features & PROTO_FEATURE_BAUD)) {
+        return PROTO_ERROR_INVALID_STATE;
+    }
+    if (state->baudStep != PROTO_BAUD_STEP_IDLE) {
+        return PROTO_ERROR_BUSY;
+    }
+
+    uint32_t baudRate = NextBaudRate(ctx);
+    if (baudRate == 0) {
+        return PROTO_SUCCESS;
+    }
 
-    return ProtoSend(ctx, PROTO_MSG_TYPE_PING, 3, version);
+    state->baudTarget = baudRate;
+    state->baudStep = PROTO_BAUD_STEP_PROPOSED;
+    state->baudStepAt = ctx->getTimeMs();
+    return SendBaud(ctx, PROTO_BAUD_OP_PROPOSE, baudRate);
 }
+#endif
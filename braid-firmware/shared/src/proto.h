@@ -19,14 +19,119 @@ extern "C" {
  * LEN      - payload length (1 byte)
  * PAYLOAD  - optional payload of LEN bytes
  * CRC      - CRC 16 of TYP, LEN and PAYLOAD (MSB)
+ *
+ * Sequenced messages (windowed link mode) have `PROTO_MSG_FLAG_SEQUENCED` set in TYP, and the first byte of PAYLOAD
+ * is the sequence number of the message. LEN includes the sequence number, so the framing is the same for both.
+ *
+ * Long messages (v2 framing) have `PROTO_MSG_FLAG_LONG` set in TYP, and LEN takes 2 bytes (MSB first). They are only
+ * used for payloads longer than 255 bytes, and only if the other side advertised `PROTO_FEATURE_LONG_FRAMES`.
+ *
+ * If both sides advertised `PROTO_FEATURE_COBS`, every message but the ping is sent as
+ *
+ * +------+-------------------------------+------+
+ * | 0x00 | COBS(TYP, LEN, PAYLOAD, CRC)  | 0x00 |
+ * +------+-------------------------------+------+
+ *
+ * COBS removes every zero byte from the message, so the receiver finds the next message at the next zero whatever
+ * was corrupted. Pings keep the format above, so that a side which restarted can always be understood. The receiver
+ * accepts both formats at any time.
  */
 
 /// @brief Message start magic byte
 #define PROTO_MSG_START_BYTE 0xA5
-/// @brief Maximum length in bytes of the payload
-#define PROTO_MSG_PAYLOAD_MAX_LEN (0xff)
-/// @brief Maximum length in bytes of the whole message
-#define PROTO_MSG_MAX_LEN (1 + 1 + 1 + PROTO_MSG_PAYLOAD_MAX_LEN + 2)
+/// @brief Delimiter of COBS encoded messages
+#define PROTO_MSG_COBS_DELIMITER 0x00
+/// @brief Maximum length in bytes of the payload of a message with a 1 byte LEN, accepted by any firmware
+#define PROTO_MSG_SHORT_PAYLOAD_MAX_LEN (0xff)
+/// @brief Maximum length in bytes of the payload. Long messages are supported if greater than 255
+#ifndef PROTO_MSG_PAYLOAD_MAX_LEN
+#define PROTO_MSG_PAYLOAD_MAX_LEN PROTO_MSG_SHORT_PAYLOAD_MAX_LEN
+#endif
+/// @brief Maximum length in bytes of the LEN field
+#if PROTO_MSG_PAYLOAD_MAX_LEN > PROTO_MSG_SHORT_PAYLOAD_MAX_LEN
+#define PROTO_MSG_LEN_MAX_SIZE 2
+#else
+#define PROTO_MSG_LEN_MAX_SIZE 1
+#endif
+/// @brief Maximum length in bytes of TYP, LEN, PAYLOAD and CRC
+#define PROTO_MSG_RAW_MAX_LEN (1 + PROTO_MSG_LEN_MAX_SIZE + PROTO_MSG_PAYLOAD_MAX_LEN + 2)
+/// @brief Maximum number of bytes added to TYP, LEN, PAYLOAD and CRC by the COBS framing, delimiters included
+#define PROTO_MSG_COBS_OVERHEAD (2 + 1 + PROTO_MSG_RAW_MAX_LEN / 254)
+/// @brief Maximum length in bytes of the whole message, in any format
+#define PROTO_MSG_MAX_LEN (PROTO_MSG_RAW_MAX_LEN + PROTO_MSG_COBS_OVERHEAD)
+
+/// @brief Maximum number of bytes fetched from the HAL with a single `read` call
+#ifndef PROTO_RX_CHUNK_LEN
+#define PROTO_RX_CHUNK_LEN (64u)
+#endif
+
+/// @brief Maximum number of sequenced messages in flight. Must be a power of 2, at most 8
+#ifndef PROTO_WINDOW_SIZE
+#define PROTO_WINDOW_SIZE (4u)
+#endif
+
+/// @brief Number of sequenced messages kept on reception while a message before them is missing
+#define PROTO_RX_SLOTS (PROTO_WINDOW_SIZE > 1 ? PROTO_WINDOW_SIZE - 1 : 1)
+
+/// @brief Time after which an unacknowledged sequenced message is sent again
+#ifndef PROTO_RETRANSMIT_TIMEOUT_MS
+#define PROTO_RETRANSMIT_TIMEOUT_MS (200u)
+#endif
+
+/// @brief Time the line may stay idle in the middle of a classic frame before the frame is dropped as damaged. A
+/// corrupted length can make the receiver wait for bytes that will not come, then take the start of the next frame as
+/// the end of this one: retransmissions, sent again in the same bursts, would be misread the same way every time
+#ifndef PROTO_RX_IDLE_MS
+#define PROTO_RX_IDLE_MS (PROTO_RETRANSMIT_TIMEOUT_MS / 4u)
+#endif
+
+/// @brief Time after which an unacknowledged event is sent again. Shorter than for the window: events are rare and
+/// small, and the ack is sent as soon as the event is received
+#ifndef PROTO_EVENT_RETRANSMIT_TIMEOUT_MS
+#define PROTO_EVENT_RETRANSMIT_TIMEOUT_MS (50u)
+#endif
+
+/// @brief `0` compiles the baud rate negotiation out: `PROTO_FEATURE_BAUD` is never advertised and the link stays at
+/// `PROTO_BAUD_DEFAULT`. For the sensors MCU bootloader, which has no flash to spare
+#ifndef PROTO_BAUD_ENABLE
+#define PROTO_BAUD_ENABLE 1
+#endif
+
+/// @brief `0` compiles the event lane out: `PROTO_FEATURE_EVENTS` is never advertised, for the same reason
+#ifndef PROTO_EVENTS_ENABLE
+#define PROTO_EVENTS_ENABLE 1
+#endif
+
+/// @brief Baud rate of the link at startup, and after a fallback
+#ifndef PROTO_BAUD_DEFAULT
+#define PROTO_BAUD_DEFAULT (115200u)
+#endif
+
+/// @brief Time allowed to a baud rate step before going back to the last verified rate
+#ifndef PROTO_BAUD_STEP_TIMEOUT_MS
+#define PROTO_BAUD_STEP_TIMEOUT_MS (500u)
+#endif
+
+/// @brief Number of CRC errors within `PROTO_BAUD_MONITOR_MS` which makes a fast link fall back to the default rate
+#ifndef PROTO_BAUD_FALLBACK_ERRORS
+#define PROTO_BAUD_FALLBACK_ERRORS (4u)
+#endif
+
+/// @brief Period over which CRC errors are counted on a fast link
+#ifndef PROTO_BAUD_MONITOR_MS
+#define PROTO_BAUD_MONITOR_MS (5000u)
+#endif
+
+/// @brief Time without valid messages after which a fast link falls back to the default rate
+#ifndef PROTO_BAUD_SILENCE_MS
+#define PROTO_BAUD_SILENCE_MS (15000u)
+#endif
+
+/// @brief Length of the test pattern exchanged to verify a new baud rate
+#define PROTO_BAUD_PATTERN_LEN (16u)
+
+/// @brief Returned by `ProtoNextTimeoutMs` when no timer is running
+#define PROTO_TIMEOUT_NONE UINT32_MAX
 
 /// @brief Index for the message type byte (the magic byte is discarded)
 #define PROTO_MSG_TYP_OFFSET 0
@@ -34,6 +139,15 @@ extern "C" {
 #define PROTO_MSG_LEN_OFFSET 1
 /// @brief Index for the beginning of the payload (the magic byte is discarded)
 #define PROTO_MSG_PAYLOAD_OFFSET 2
+/// @brief Index for the beginning of the payload of long messages (the magic byte is discarded)
+#define PROTO_MSG_LONG_PAYLOAD_OFFSET 3
+
+/// @brief Set in the message type byte of sequenced messages
+#define PROTO_MSG_FLAG_SEQUENCED 0x80
+/// @brief Set in the message type byte of long messages
+#define PROTO_MSG_FLAG_LONG 0x40
+/// @brief Mask for the actual message type inside the type byte
+#define PROTO_MSG_TYPE_MASK 0x3f
 
 /**
  * @enum ProtoMsgType
@@ -44,13 +158,646 @@ typedef enum ProtoMsgType {
     /** Command response. Payload should be the status code as 1 byte */
     PROTO_MSG_TYPE_RESPONSE = 0x00,
 
-    /** Firmware started. Payload should be the fimware version as 3 bytes (major, minor, patch) */
+    /** Firmware started. Payload is a `ProtoPingPayload` (older firmwares only send the version as 3 bytes) */
     PROTO_MSG_TYPE_PING = 0x01,
 
-    /** Sensor request command */
+    /** Asks for new samples, answered with `PROTO_MSG_TYPE_SENSOR_BATCH`. Payload is a `ProtoSensorRequestPayload` */
     PROTO_MSG_TYPE_SENSOR_REQUEST = 0x02,
+
+    /** Cumulative acknowledgement of sequenced messages. Payload is a `ProtoAckPayload` */
+    PROTO_MSG_TYPE_ACK = 0x03,
+
+    /** Timestamped sensor samples authenticated by a single hash. Payload is a `SensorBatch` */
+    PROTO_MSG_TYPE_SENSOR_BATCH = 0x04,
+
+    /** Baud rate negotiation step. Payload is a `ProtoBaudPayload` */
+    PROTO_MSG_TYPE_BAUD = 0x05,
+
+    /** Changes how the sensors are sampled. Payload is a `ProtoSensorConfigPayload` */
+    PROTO_MSG_TYPE_SENSOR_CONFIG = 0x06,
+
+    /** Clock of the master, never sequenced: a retransmission would deliver it late. Payload is a
+     * `ProtoTimeSyncPayload` */
+    PROTO_MSG_TYPE_TIME_SYNC = 0x07,
+
+    /** Urgent notification, sent on its own lane ahead of the window and acknowledged right away. Payload is a
+     * `ProtoEventPayload` */
+    PROTO_MSG_TYPE_EVENT = 0x08,
+
+    /** Announces the firmware image about to be streamed, answered with `PROTO_MSG_TYPE_FW_STATUS`. Payload is a
+     * `ProtoFwBeginPayload` */
+    PROTO_MSG_TYPE_FW_BEGIN = 0x09,
+
+    /** A block of the firmware image. Payload is a `ProtoFwBlockHeader` followed by the block data */
+    PROTO_MSG_TYPE_FW_BLOCK = 0x0A,
+
+    /** Progress of the firmware update on the receiving side. Payload is a `ProtoFwStatusPayload` */
+    PROTO_MSG_TYPE_FW_STATUS = 0x0B,
 } ProtoMsgType;
 
+/**
+ * @enum ProtoFeature
+ * @brief Optional link features, advertised in the ping and enabled only if both sides support them
+ */
+typedef enum ProtoFeature {
+    /** Sequenced messages, delivered in order, with cumulative acknowledgements instead of a response for each one */
+    PROTO_FEATURE_WINDOW = 0x01,
+
+    /** Messages with a 2 bytes LEN, for payloads longer than 255 bytes */
+    PROTO_FEATURE_LONG_FRAMES = 0x02,
+
+    /** COBS encoded messages between zero delimiters */
+    PROTO_FEATURE_COBS = 0x04,
+
+    /** Baud rate negotiation with `PROTO_MSG_TYPE_BAUD` */
+    PROTO_FEATURE_BAUD = 0x08,
+
+    /** Samples taken only when asked with `PROTO_MSG_TYPE_SENSOR_REQUEST`, instead of continuously */
+    PROTO_FEATURE_PULL = 0x10,
+
+    /** Event lane: `PROTO_MSG_TYPE_EVENT` acknowledged with `PROTO_ACK_FLAG_EVENT` */
+    PROTO_FEATURE_EVENTS = 0x20,
+
+    /** Firmware images are received with `PROTO_MSG_TYPE_FW_BEGIN` and `PROTO_MSG_TYPE_FW_BLOCK`. Advertised by the
+     * bootloader of the sensors MCU, the application only restarts into it on a `PROTO_MSG_TYPE_FW_BEGIN` */
+    PROTO_FEATURE_FW_UPDATE = 0x40,
+} ProtoFeature;
+
+/// @brief Set in `ProtoPingPayload.flags` when the ping is the answer to a ping of the other side
+#define PROTO_PING_FLAG_REPLY 0x01
+
+/**
+ * @struct ProtoPingPayload
+ * @brief Payload of `PROTO_MSG_TYPE_PING`, used to negotiate the link features
+ */
+typedef struct ProtoPingPayload {
+    /** @brief Firmware version (major, minor, patch) */
+    uint8_t version[3];
+
+    /** @brief Bitmask of the supported `ProtoFeature`s */
+    uint8_t features;
+
+    /** @brief Maximum number of sequenced messages in flight accepted */
+    uint8_t window;
+
+    /** @brief Ping flags (`PROTO_PING_FLAG_*`) */
+    uint8_t flags;
+
+    /** @brief Maximum payload length accepted. Only meaningful with `PROTO_FEATURE_LONG_FRAMES` */
+    uint16_t maxPayloadLength;
+
+    /** @brief Highest baud rate supported. Only meaningful with `PROTO_FEATURE_BAUD` */
+    uint32_t maxBaudRate;
+} __attribute__((packed)) ProtoPingPayload;
+
+/// @brief Set in `ProtoAckPayload.flags` when the acknowledgement was caused by a corrupted message
+#define PROTO_ACK_FLAG_NAK 0x01
+/// @brief Set in `ProtoAckPayload.flags` when the acknowledgement also covers the event `ProtoAckPayload.event`
+#define PROTO_ACK_FLAG_EVENT 0x02
+
+/**
+ * @struct ProtoAckPayload
+ * @brief Payload of `PROTO_MSG_TYPE_ACK`
+ */
+typedef struct ProtoAckPayload {
+    /** @brief Sequence number of the first message not received yet. All the previous ones were received */
+    uint8_t next;
+
+    /** @brief Bitmask of the messages received after `next`: bit `n` is set if `next + n` was received */
+    uint8_t received;
+
+    /** @brief Acknowledgement flags (`PROTO_ACK_FLAG_*`) */
+    uint8_t flags;
+
+    /** @brief Id of the acknowledged event, with `PROTO_ACK_FLAG_EVENT`. Missing from the acks of older firmwares */
+    uint8_t event;
+} __attribute__((packed)) ProtoAckPayload;
+
+/**
+ * @enum ProtoBaudOp
+ * @brief Baud rate negotiation steps.
+ *
+ * The initiator proposes the next rate, the responder accepts it and switches. The initiator switches too and sends a
+ * test pattern, which the responder echoes. A step which does not complete in time is reverted by both sides.
+ */
+typedef enum ProtoBaudOp {
+    /** Asks the responder to switch to `baudRate` */
+    PROTO_BAUD_OP_PROPOSE = 0x00,
+
+    /** The responder is switching to `baudRate` */
+    PROTO_BAUD_OP_ACCEPT = 0x01,
+
+    /** The responder refuses the proposed rate. `baudRate` is the highest rate it accepts */
+    PROTO_BAUD_OP_REJECT = 0x02,
+
+    /** Test pattern, sent by the initiator at the new rate */
+    PROTO_BAUD_OP_TEST = 0x03,
+
+    /** Test pattern received correctly: `baudRate` is verified */
+    PROTO_BAUD_OP_TEST_ECHO = 0x04,
+
+    /** Too many errors: the sender is going back to `PROTO_BAUD_DEFAULT` */
+    PROTO_BAUD_OP_REVERT = 0x05,
+} ProtoBaudOp;
+
+/**
+ * @struct ProtoBaudPayload
+ * @brief Payload of `PROTO_MSG_TYPE_BAUD`
+ */
+typedef struct ProtoBaudPayload {
+    /** @brief The negotiation step (`ProtoBaudOp`) */
+    uint8_t op;
+
+    /** @brief The baud rate the step refers to */
+    uint32_t baudRate;
+
+    /** @brief Test pattern, checked in `PROTO_BAUD_OP_TEST` and `PROTO_BAUD_OP_TEST_ECHO` */
+    uint8_t pattern[PROTO_BAUD_PATTERN_LEN];
+} __attribute__((packed)) ProtoBaudPayload;
+
+/**
+ * @struct ProtoSensorRequestPayload
+ * @brief Payload of `PROTO_MSG_TYPE_SENSOR_REQUEST`. A request replaces the one still in progress
+ */
+typedef struct ProtoSensorRequestPayload {
+    /** @brief Number of samples to take, the first one right away. `0` cancels the request in progress */
+    uint8_t count;
+} __attribute__((packed)) ProtoSensorRequestPayload;
+
+/**
+ * @enum ProtoAccelOdr
+ * @brief Output data rate of the accelerometer
+ */
+typedef enum ProtoAccelOdr {
+    PROTO_ACCEL_ODR_KEEP = 0,
+    PROTO_ACCEL_ODR_1HZ = 1,
+    PROTO_ACCEL_ODR_10HZ = 2,
+    PROTO_ACCEL_ODR_25HZ = 3,
+    PROTO_ACCEL_ODR_50HZ = 4,
+    PROTO_ACCEL_ODR_100HZ = 5,
+    PROTO_ACCEL_ODR_200HZ = 6,
+    PROTO_ACCEL_ODR_400HZ = 7,
+} ProtoAccelOdr;
+
+/**
+ * @enum ProtoAccelScale
+ * @brief Full scale of the accelerometer
+ */
+typedef enum ProtoAccelScale {
+    PROTO_ACCEL_SCALE_KEEP = 0,
+    PROTO_ACCEL_SCALE_2G = 1,
+    PROTO_ACCEL_SCALE_4G = 2,
+    PROTO_ACCEL_SCALE_8G = 3,
+    PROTO_ACCEL_SCALE_16G = 4,
+} ProtoAccelScale;
+
+/**
+ * @enum ProtoHumidityPrecision
+ * @brief Measurement mode of the temperature and humidity sensor
+ */
+typedef enum ProtoHumidityPrecision {
+    PROTO_HUMIDITY_PRECISION_KEEP = 0,
+    PROTO_HUMIDITY_PRECISION_HIGH = 1,
+    PROTO_HUMIDITY_PRECISION_LOW = 2,
+} ProtoHumidityPrecision;
+
+/**
+ * @struct ProtoSensorConfigPayload
+ * @brief Payload of `PROTO_MSG_TYPE_SENSOR_CONFIG`. Fields set to `0` keep their current value
+ */
+typedef struct ProtoSensorConfigPayload {
+    /** @brief Time between two samples, in milliseconds */
+    uint16_t samplePeriodMs;
+
+    /** @brief Accelerometer output data rate, a `ProtoAccelOdr` */
+    uint8_t accelOdr;
+
+    /** @brief Accelerometer full scale, a `ProtoAccelScale` */
+    uint8_t accelScale;
+
+    /** @brief Temperature and humidity precision, a `ProtoHumidityPrecision` */
+    uint8_t humidityPrecision;
+
+    /** @brief Samples sent together in a `SensorBatch`, up to `SENSOR_BATCH_MAX_SAMPLES` */
+    uint8_t batchSize;
+} __attribute__((packed)) ProtoSensorConfigPayload;
+
+/**
+ * @struct ProtoTimeSyncPayload
+ * @brief Payload of `PROTO_MSG_TYPE_TIME_SYNC`, the time of the master when the message was sent
+ */
+typedef struct ProtoTimeSyncPayload {
+    /** @brief Unix time, in seconds */
+    uint32_t seconds;
+
+    /** @brief Milliseconds elapsed in `seconds` */
+    uint16_t milliseconds;
+} __attribute__((packed)) ProtoTimeSyncPayload;
+
+/**
+ * @enum ProtoEventType
+ * @brief Kinds of `PROTO_MSG_TYPE_EVENT`
+ */
+typedef enum ProtoEventType {
+    /** A tamper input fired: the sender erases its secrets and restarts. `detail` is the tamper input number */
+    PROTO_EVENT_TAMPER = 0x01,
+
+    /** The acceleration went over the shock threshold. `detail` is the peak, in milli-g */
+    PROTO_EVENT_SHOCK = 0x02,
+
+    /** A sensor stopped answering. `detail` is the `ProtoEventSensor` */
+    PROTO_EVENT_SENSOR_FAULT = 0x03,
+} ProtoEventType;
+
+/**
+ * @enum ProtoEventSensor
+ * @brief Sensors named by `PROTO_EVENT_SENSOR_FAULT`
+ */
+typedef enum ProtoEventSensor {
+    PROTO_EVENT_SENSOR_HUMIDITY = 0x01,
+    PROTO_EVENT_SENSOR_ACCEL = 0x02,
+} ProtoEventSensor;
+
+/**
+ * @struct ProtoEventPayload
+ * @brief Payload of `PROTO_MSG_TYPE_EVENT`. Not authenticated: the receiver should only take it as a reason to
+ * report sooner
+ */
+typedef struct ProtoEventPayload {
+    /** @brief Id of the event, set by the protocol. Retransmissions keep it, so that duplicates are recognized */
+    uint8_t id;
+
+    /** @brief What happened, a `ProtoEventType` */
+    uint8_t type;
+
+    /** @brief Meaning depends on `type` */
+    uint16_t detail;
+} __attribute__((packed)) ProtoEventPayload;
+
+/// @brief Length of the image data carried by a `PROTO_MSG_TYPE_FW_BLOCK`, 4 flash pages of the sensors MCU. The last
+/// block of an image is shorter
+#define PROTO_FW_BLOCK_LEN (512u)
+/// @brief Length of the signature of a firmware image, an Ed25519 one
+#define PROTO_FW_SIGNATURE_LEN (64u)
+
+/**
+ * @struct ProtoFwBeginPayload
+ * @brief Payload of `PROTO_MSG_TYPE_FW_BEGIN`. Sending it again for the same image resumes the transfer
+ */
+typedef struct ProtoFwBeginPayload {
+    /** @brief Length of the image, in bytes */
+    uint32_t length;
+
+    /** @brief Firmware version of the image (major, minor, patch) */
+    uint8_t version[3];
+
+    /** @brief Reserved, `0` */
+    uint8_t reserved;
+
+    /** @brief Ed25519 signature of the image with the firmware signing key. Also identifies the image when resuming */
+    uint8_t signature[PROTO_FW_SIGNATURE_LEN];
+} __attribute__((packed)) ProtoFwBeginPayload;
+
+/**
+ * @struct ProtoFwBlockHeader
+ * @brief Start of the payload of `PROTO_MSG_TYPE_FW_BLOCK`, followed by up to `PROTO_FW_BLOCK_LEN` bytes of the image
+ */
+typedef struct ProtoFwBlockHeader {
+    /** @brief Index of the block, its data starts at `index * PROTO_FW_BLOCK_LEN` in the image */
+    uint16_t index;
+
+    /** @brief CRC16 of the block data, checked again on the data read back from flash */
+    uint16_t crc;
+} __attribute__((packed)) ProtoFwBlockHeader;
+
+/// @brief Longest payload of a `PROTO_MSG_TYPE_FW_BLOCK`. Both sides need a `PROTO_MSG_PAYLOAD_MAX_LEN` of at least
+/// this plus the sequence number
+#define PROTO_FW_BLOCK_PAYLOAD_LEN (sizeof(ProtoFwBlockHeader) + PROTO_FW_BLOCK_LEN)
+
+/**
+ * @enum ProtoFwState
+ * @brief States of the firmware update on the receiving side
+ */
+typedef enum ProtoFwState {
+    /** No image announced */
+    PROTO_FW_STATE_IDLE = 0x00,
+
+    /** Waiting for blocks, starting from `ProtoFwStatusPayload.nextBlock` */
+    PROTO_FW_STATE_RECEIVING = 0x01,
+
+    /** The whole image was written and its signature verified */
+    PROTO_FW_STATE_DONE = 0x02,
+
+    /** The image was refused, see `ProtoFwStatusPayload.error`. A new `PROTO_MSG_TYPE_FW_BEGIN` starts over */
+    PROTO_FW_STATE_FAILED = 0x03,
+} ProtoFwState;
+
+/**
+ * @enum ProtoFwError
+ * @brief Reasons of a firmware update error. Block errors keep the update going: the sender starts again from
+ * `ProtoFwStatusPayload.nextBlock`
+ */
+typedef enum ProtoFwError {
+    PROTO_FW_ERROR_NONE = 0x00,
+
+    /** The image does not fit the flash of the receiver */
+    PROTO_FW_ERROR_TOO_LARGE = 0x01,
+
+    /** A block with a wrong index or length */
+    PROTO_FW_ERROR_BLOCK = 0x02,
+
+    /** The data of a block did not match its CRC */
+    PROTO_FW_ERROR_CRC = 0x03,
+
+    /** The block could not be written, or read back with a different CRC */
+    PROTO_FW_ERROR_FLASH = 0x04,
+
+    /** The image written does not match the signature, or the receiver has no signing key */
+    PROTO_FW_ERROR_SIGNATURE = 0x05,
+} ProtoFwError;
+
+/**
+ * @struct ProtoFwStatusPayload
+ * @brief Payload of `PROTO_MSG_TYPE_FW_STATUS`
+ */
+typedef struct ProtoFwStatusPayload {
+    /** @brief The update state, a `ProtoFwState` */
+    uint8_t state;
+
+    /** @brief What went wrong last, a `ProtoFwError` */
+    uint8_t error;
+
+    /** @brief Index of the first block not written yet. All the previous ones are */
+    uint16_t nextBlock;
+} __attribute__((packed)) ProtoFwStatusPayload;
+
+/// @brief Room for an event frame in any format
+#define PROTO_EVENT_FRAME_MAX_LEN (PROTO_MSG_COBS_OVERHEAD + 2 + PROTO_MSG_LEN_MAX_SIZE + sizeof(ProtoEventPayload) + 2)
+
+/**
+ * @enum ProtoBaudStep
+ * @brief States of the baud rate negotiation
+ */
+typedef enum ProtoBaudStep {
+    /** No negotiation in progress */
+    PROTO_BAUD_STEP_IDLE = 0,
+
+    /** Initiator: waiting for the responder to accept the proposed rate */
+    PROTO_BAUD_STEP_PROPOSED,
+
+    /** Initiator: switched, waiting for the test pattern echo */
+    PROTO_BAUD_STEP_TESTING,
+
+    /** Responder: switched, waiting for the test pattern */
+    PROTO_BAUD_STEP_SWITCHED,
+} ProtoBaudStep;
+
+/// @brief Number of buckets of a `ProtoHistogram`
+#define PROTO_HISTOGRAM_BUCKETS (16u)
+
+/**
+ * @struct ProtoHistogram
+ * @brief Log2 histogram. Bucket `0` counts the zero values, bucket `i` the values in [2^(i-1), 2^i). The last bucket
+ * also counts all the larger values
+ */
+typedef struct ProtoHistogram {
+    uint32_t buckets[PROTO_HISTOGRAM_BUCKETS];
+} ProtoHistogram;
+
+/**
+ * @struct ProtoStats
+ * @brief Link counters. They only grow, wrapping around, and are reset by `ProtoInit` only
+ */
+typedef struct ProtoStats {
+    /** @brief Bytes returned by `read` */
+    uint32_t rxBytes;
+
+    /** @brief Bytes passed to `write` */
+    uint32_t txBytes;
+
+    /** @brief Valid frames received */
+    uint32_t rxFrames;
+
+    /** @brief Frames sent, retransmissions excluded */
+    uint32_t txFrames;
+
+    /** @brief Sequenced frames and events sent again */
+    uint32_t retransmits;
+
+    /** @brief Frames received with a wrong CRC or a broken framing */
+    uint32_t crcErrors;
+
+    /** @brief Frame starts found after skipping bytes */
+    uint32_t resyncs;
+
+    /** @brief Bytes skipped while looking for a frame start */
+    uint32_t discardedBytes;
+
+    /** @brief Times the link fell back to `PROTO_BAUD_DEFAULT` */
+    uint32_t baudFallbacks;
+
+    /** @brief Time between two valid frames, in milliseconds. Needs `ProtoCtx.getTimeMs` */
+    ProtoHistogram rxInterval;
+} ProtoStats;
+
+/**
+ * @enum ProtoRxState
+ * @brief States of the receiving state machine
+ */
+typedef enum ProtoRxState {
+    /** Waiting for `PROTO_MSG_START_BYTE` */
+    PROTO_RX_STATE_WAIT_START = 0,
+
+    /** Collecting the bytes of a frame */
+    PROTO_RX_STATE_RECV,
+
+    /** Collecting the bytes of a COBS encoded frame, up to the delimiter */
+    PROTO_RX_STATE_RECV_COBS,
+
+    /** A valid frame is waiting to be processed */
+    PROTO_RX_STATE_EXEC,
+
+    /** A frame with a wrong CRC is waiting to be rejected */
+    PROTO_RX_STATE_CRC_ERROR,
+} ProtoRxState;
+
+/**
+ * @struct ProtoTxSlot
+ * @brief A sequenced message kept until the other side acknowledges it
+ */
+typedef struct ProtoTxSlot {
+    /** @brief Time of the last transmission, from `ProtoCtx.getTimeMs` */
+    uint32_t sentAt;
+
+    /** @brief Length of the encoded frame */
+    uint16_t length;
+
+    /** @brief Set when the message was selectively acknowledged */
+    uint8_t acked;
+
+    /** @brief Value of `ProtoState.txWrites` at the last transmission */
+    uint32_t sentIndex;
+
+    /** @brief The encoded frame, ready to be sent again */
+    uint8_t frame[PROTO_MSG_MAX_LEN];
+} ProtoTxSlot;
+
+/**
+ * @struct ProtoRxSlot
+ * @brief A sequenced message received after a hole, kept until the messages before it are delivered
+ */
+typedef struct ProtoRxSlot {
+    /** @brief Type of the message, without `PROTO_MSG_FLAG_SEQUENCED` */
+    uint8_t type;
+
+    /** @brief Length of the payload */
+    uint16_t length;
+
+    /** @brief The payload, without the sequence number */
+    uint8_t payload[PROTO_MSG_PAYLOAD_MAX_LEN - 1];
+} ProtoRxSlot;
+
+/**
+ * @struct ProtoState
+ * @brief Internal state of a protocol link. Owned by the protocol functions, must not be modified by the HAL
+ */
+typedef struct ProtoState {
+    /** @brief Current state of the receiver */
+    ProtoRxState rxState;
+
+    /** @brief Number of bytes collected in `rxBuffer` */
+    size_t rxBufferIdx;
+
+    /** @brief Set while bytes are skipped looking for a frame start */
+    uint8_t rxDiscarding;
+
+    /** @brief Set when a read found no data since the last bytes, see `PROTO_RX_IDLE_MS` */
+    uint8_t rxIdle;
+
+    /** @brief Time of the first read which found no data since the last bytes */
+    uint32_t rxIdleAt;
+
+    /** @brief The frame being received, without the start byte */
+    uint8_t rxBuffer[PROTO_MSG_MAX_LEN];
+
+    /** @brief Staging area for the bytes returned by a single `read` call */
+    uint8_t rxChunk[PROTO_RX_CHUNK_LEN];
+
+    /** @brief Payload handed to the message callback, aligned so that it can be cast to a struct */
+    uint8_t payloadBuffer[PROTO_MSG_PAYLOAD_MAX_LEN] __attribute__((aligned(4)));
+
+    /** @brief The frame being sent */
+    uint8_t txBuffer[PROTO_MSG_MAX_LEN];
+
+    /** @brief Firmware version of the other side, as received in its ping */
+    uint8_t peerVersion[3];
+
+    /** @brief Features enabled on this link, negotiated with the ping */
+    uint8_t features;
+
+    /** @brief Negotiated window. `0` if the link is not windowed */
+    uint8_t window;
+
+    /** @brief Negotiated maximum payload length */
+    uint16_t maxPayloadLength;
+
+    /** @brief Sequence number of the first message not received yet */
+    uint8_t rxNext;
+
+    /** @brief Bitmask of the messages received starting from `rxNext` */
+    uint8_t rxReceived;
+
+    /** @brief Number of messages received since the last acknowledgement was sent */
+    uint8_t rxUnacked;
+
+    /** @brief Set once a retransmission of `rxNext` was requested */
+    uint8_t rxRequested;
+
+    /** @brief Slot of `rxWindow` for the message following `rxNext` */
+    uint8_t rxHead;
+
+    /** @brief Messages received after `rxNext`, in a ring starting at `rxHead` */
+    ProtoRxSlot rxWindow[PROTO_RX_SLOTS];
+
+    /** @brief Sequence number of the oldest message not acknowledged yet */
+    uint8_t txBase;
+
+    /** @brief Sequence number of the next message to send */
+    uint8_t txNext;
+
+    /** @brief Number of transmissions of sequenced messages, retransmissions included, to order them */
+    uint32_t txWrites;
+
+    /** @brief Messages in flight, indexed by sequence number */
+    ProtoTxSlot txWindow[PROTO_WINDOW_SIZE];
+
+    /** @brief Id of the next event to send */
+    uint8_t eventNext;
+
+    /** @brief Set while the event in `eventFrame` waits for its acknowledgement */
+    uint8_t eventPending;
+
+    /** @brief Length of the encoded event frame */
+    uint8_t eventLength;
+
+    /** @brief Time of the last transmission of the event */
+    uint32_t eventSentAt;
+
+    /** @brief The event in flight, encoded and ready to be sent again */
+    uint8_t eventFrame[PROTO_EVENT_FRAME_MAX_LEN];
+
+    /** @brief Id of the last event received, to drop the retransmissions */
+    uint8_t rxEventLast;
+
+    /** @brief Set once an event was received since the last ping */
+    uint8_t rxEventSeen;
+
+    /** @brief Highest baud rate supported by the other side */
+    uint32_t peerMaxBaudRate;
+
+    /** @brief Current baud rate of the link */
+    uint32_t baudRate;
+
+    /** @brief Last baud rate verified with the test pattern */
+    uint32_t baudVerified;
+
+    /** @brief Highest baud rate which may be tried again, lowered after each failure. `0` if there is no limit */
+    uint32_t baudCeiling;
+
+    /** @brief Current step of the baud rate negotiation */
+    ProtoBaudStep baudStep;
+
+    /** @brief Rate proposed in the current negotiation step */
+    uint32_t baudTarget;
+
+    /** @brief Start of the current negotiation step */
+    uint32_t baudStepAt;
+
+    /** @brief Time of the last valid message */
+    uint32_t lastRxAt;
+
+    /** @brief Start of the current CRC error counting period */
+    uint32_t monitorStart;
+
+    /** @brief CRC errors in the current counting period */
+    uint32_t monitorErrors;
+
+    /** @brief Link counters */
+    ProtoStats stats;
+} ProtoState;
+
+/**
+ * @struct ProtoSegment
+ * @brief A piece of a payload scattered in memory, for `ProtoSendv`
+ */
+typedef struct ProtoSegment {
+    /** @brief Start of the data */
+    const uint8_t *data;
+
+    /** @brief Length of the data */
+    size_t length;
+} ProtoSegment;
+
 /**
  * @struct ProtoCtx
  * @brief Implementation context for the protocol functions
@@ -58,7 +805,8 @@ typedef enum ProtoMsgType {
 typedef struct ProtoCtx {
     /**
      * @brief HAL implementation for the UART write function.
-     * Must return the number of bytes written for error checking
+     * Must return the number of bytes written for error checking.
+     * A message can be written with several calls, one for each segment, which must be sent back to back
      *
      * @param writeCtx This context
      * @param length Length of the data buffer
@@ -70,6 +818,7 @@ typedef struct ProtoCtx {
     /**
      * @brief HAL implementation for the UART read function.
      * Must return the number of bytes read for error checking.
+     * Should return whatever is already buffered (up to `length` bytes) instead of waiting for the buffer to fill.
      *
      * @note Can return:
      * @note - `0` in case there were no bytes to read (FIFO empty)
@@ -82,14 +831,23 @@ typedef struct ProtoCtx {
      */
     int (*read)(void *readCtx, size_t length, uint8_t *data);
 
+    /**
+     * @brief HAL implementation of a millisecond clock, used for retransmissions.
+     * The windowed link mode is not advertised if set to `NULL`
+     *
+     * @return The current time in milliseconds. Only differences are used, so it can wrap around
+     */
+    uint32_t (*getTimeMs)(void);
+
     /**
      * @brief Callback called when a valid packet is received and checked for integrity.
      * Will never be called if set to `NULL`
      *
      * @param msgType The message type from the enum
+     * @param payloadLength Length of the payload
      * @param payload The payload section is `memcpy`ed here
      */
-    void (*messageCallback)(void *messageCallbackCtx, ProtoMsgType msgType, uint8_t *payload);
+    void (*messageCallback)(void *messageCallbackCtx, ProtoMsgType msgType, size_t payloadLength, uint8_t *payload);
 
     /** @brief Extra arguments for the write function */
     void *writeCtx;
@@ -99,6 +857,47 @@ typedef struct ProtoCtx {
 
     /** @brief Extra arguments for the message callback function */
     void *messageCallbackCtx;
+
+    /** @brief Requested window for the windowed link mode, up to `PROTO_WINDOW_SIZE`. `0` disables it */
+    uint8_t window;
+
+    /** @brief Requests the COBS framing. `0` keeps the classic framing */
+    uint8_t cobs;
+
+    /**
+     * @brief HAL implementation to change the UART baud rate.
+     * Must wait for the bytes already written to be sent before switching.
+     * The baud rate negotiation is not advertised if set to `NULL`, nor without `PROTO_BAUD_ENABLE`
+     *
+     * @param writeCtx The context of the write function
+     * @param baudRate The new baud rate
+     * @return `0` on success
+     */
+    int (*setBaudRate)(void *writeCtx, uint32_t baudRate);
+
+    /** @brief Highest baud rate supported by this side */
+    uint32_t maxBaudRate;
+
+    /** @brief Advertises the pull-mode sampling (`PROTO_FEATURE_PULL`). `0` keeps the free-running sampling */
+    uint8_t pull;
+
+    /**
+     * @brief HAL implementation writing an event frame ahead of the bytes queued by `write` which did not start to
+     * leave yet. Only used with the COBS framing, where every frame is written with a single `write` call: the event
+     * may go between any two calls. `write` is used if set to `NULL`
+     *
+     * @param writeCtx The context of the write function
+     * @param length Length of the frame
+     * @param data The whole frame
+     * @return The number of bytes written
+     */
+    int (*writeUrgent)(void *writeCtx, size_t length, const uint8_t *data);
+
+    /** @brief Advertises the reception of firmware images (`PROTO_FEATURE_FW_UPDATE`). `0` for the application */
+    uint8_t fwUpdate;
+
+    /** @brief Link state. Every context is independent, so several links can run concurrently */
+    ProtoState state;
 } ProtoCtx;
 
 /**
@@ -124,10 +923,20 @@ typedef enum ProtoErrorCode {
     /** HAL error occurred */
     PROTO_ERROR_HAL = 0x05,
 
+    /** The window is full: the message was not sent and must be retried later */
+    PROTO_ERROR_BUSY = 0x06,
+
     /** General failure */
     PROTO_ERROR_FAILURE = 0xff,
 } ProtoErrorCode;
 
+/**
+ * @brief Resets the link state of the context. HAL functions and callbacks are left untouched
+ *
+ * @param ctx The protocol context
+ */
+void ProtoInit(ProtoCtx *ctx);
+
 /**
  * @brief Processes the current message packet, if any
  *
@@ -137,32 +946,113 @@ typedef enum ProtoErrorCode {
 ProtoErrorCode ProtoProcessMessage(ProtoCtx *ctx);
 
 /**
- * @brief Sends a ping message using the protocol context
+ * @brief Sends a ping message using the protocol context. The ping carries the features supported by this side, and
+ * the other side answers with its own ping so that the link mode can be negotiated
  *
  * @param ctx The protocol context
  * @return ProtoErrorCode indicating success or type of failure
  */
 ProtoErrorCode ProtoPing(ProtoCtx *ctx);
 
+#if PROTO_BAUD_ENABLE
 /**
- * @brief Sends a message using the protocol context
+ * @brief Steps the baud rate up to the highest rate supported by both sides, one verified step at a time.
+ * Must be called on one side only, once the link was negotiated with a ping. The negotiation continues in
+ * `ProtoReceive`. The link falls back to `PROTO_BAUD_DEFAULT` and pings again if the CRC error rate rises
+ *
+ * @param ctx The protocol context
+ * @return ProtoErrorCode indicating success or type of failure
+ * @return - `PROTO_SUCCESS` also if the link already runs at the highest rate
+ * @return - `PROTO_ERROR_INVALID_STATE` if the other side does not support the negotiation
+ * @return - `PROTO_ERROR_BUSY` if a negotiation step is in progress
+ */
+ProtoErrorCode ProtoBaudStart(ProtoCtx *ctx);
+#endif
+
+/**
+ * @brief Sends a message using the protocol context.
+ * If the windowed link mode was negotiated, the message is sequenced and kept until acknowledged
  *
  * @param ctx The protocol context
  * @param type The message type
- * @param payloadLength The length of the payload
+ * @param payloadLength The length of the payload. Payloads longer than 255 bytes are sent as long messages
  * @param payload The payload data to be sent
  * @return ProtoErrorCode indicating success or type of failure
+ * @return - `PROTO_ERROR_BUSY` if the window is full
+ * @return - `PROTO_ERROR_INVALID_ARG` if the payload is longer than the negotiated maximum, or than the negotiated
+ * maximum minus one in the windowed link mode, where the sequence number takes a byte of the payload length
+ */
+ProtoErrorCode ProtoSend(ProtoCtx *ctx, ProtoMsgType type, size_t payloadLength, const uint8_t *payload);
+
+/**
+ * @brief Sends a message whose payload is the concatenation of `segments`, without gathering it in a buffer first.
+ * Plain unsequenced messages are written segment by segment, with the CRC computed along the way. Sequenced and COBS
+ * messages are gathered directly into their frame buffer.
+ *
+ * @param ctx The protocol context
+ * @param type The message type
+ * @param segmentCount Number of segments
+ * @param segments The payload segments, in order
+ * @return ProtoErrorCode indicating success or type of failure
+ * @return - `PROTO_ERROR_BUSY` if the window is full
+ * @return - `PROTO_ERROR_INVALID_ARG` if the payload is longer than the negotiated maximum, minus one in the windowed
+ * link mode like `ProtoSend`
  */
-ProtoErrorCode ProtoSend(ProtoCtx *ctx, ProtoMsgType type, uint8_t payloadLength, const uint8_t *payload);
+ProtoErrorCode ProtoSendv(ProtoCtx *ctx, ProtoMsgType type, size_t segmentCount, const ProtoSegment *segments);
+
+#if PROTO_EVENTS_ENABLE
+/**
+ * @brief Sends an event on the event lane. The event does not wait for the window, goes ahead of the queued frames
+ * when the HAL has a `writeUrgent`, and is sent again every `PROTO_EVENT_RETRANSMIT_TIMEOUT_MS` until the other side
+ * acknowledges it. The other side delivers it once, as a `PROTO_MSG_TYPE_EVENT` with its `ProtoEventPayload`
+ *
+ * @param ctx The protocol context
+ * @param type What happened
+ * @param detail Meaning depends on `type`
+ * @return ProtoErrorCode indicating success or type of failure
+ * @return - `PROTO_ERROR_BUSY` if the previous event was not acknowledged yet
+ * @return - `PROTO_ERROR_INVALID_STATE` if the other side does not support events
+ */
+ProtoErrorCode ProtoSendEvent(ProtoCtx *ctx, ProtoEventType type, uint16_t detail);
+
+/**
+ * @brief Tells whether the last event sent was acknowledged
+ *
+ * @param ctx The protocol context
+ * @return `1` if no event waits for its acknowledgement
+ */
+uint8_t ProtoEventAcked(const ProtoCtx *ctx);
+#endif
 
 /**
  * @brief Receives a message using the protocol context. Must be called in a loop.
+ * All the bytes available from the HAL are read at once and every complete frame among them is processed
+ * with `ProtoProcessMessage`. Also sends pending acknowledgements and retransmissions in windowed mode.
  *
  * @param ctx The protocol context
  * @return ProtoErrorCode indicating success or type of failure
  */
 ProtoErrorCode ProtoReceive(ProtoCtx *ctx);
 
+/**
+ * @brief Adds a value to a histogram. Costs a count leading zeros and an increment
+ *
+ * @param histogram The histogram to update
+ * @param value The value to count
+ */
+void ProtoHistogramAdd(ProtoHistogram *histogram, uint32_t value);
+
+/**
+ * @brief Tells how long the caller may wait for data before calling `ProtoReceive` again.
+ * Lets event driven HALs sleep until bytes arrive or a retransmission, acknowledgement or baud rate timer expires,
+ * instead of polling `ProtoReceive`
+ *
+ * @param ctx The protocol context
+ * @return The time to the next deadline in milliseconds, `0` if `ProtoReceive` has work to do right away,
+ * `PROTO_TIMEOUT_NONE` if only incoming data matters
+ */
+uint32_t ProtoNextTimeoutMs(ProtoCtx *ctx);
+
 #ifdef __cplusplus
 }
-#endif /* __cplusplus */
\ No newline at end of file
+#endif /* __cplusplus */
@@ -1,22 +1,102 @@
 #include <string.h>
 
 #include "crypto_hmac.h"
+#include "proto.h"
 #include "proto_payload.h"
 #include "sha256.h"
 
-bool PayloadVerify(SensorPayload *payload, const uint8_t *key, const size_t keyLength) {
+/* a full batch must fit a sequenced message to any peer, and the sequence number takes one byte of payload */
+_Static_assert(SENSOR_BATCH_LENGTH(SENSOR_BATCH_MAX_SAMPLES) <= PROTO_MSG_SHORT_PAYLOAD_MAX_LEN - 1,
+               "SENSOR_BATCH_MAX_SAMPLES does not fit a message");
+
+bool PayloadVerify(SensorPayload *payload, const HmacKeyCtx *key) {
     uint8_t hash[SHA256_HASH_SIZE];
     uint8_t *dataBytes = (uint8_t *)&payload->data;
     size_t written = 0;
 
-    written = Crypto_HMAC(key, keyLength, dataBytes, sizeof(SensorData), hash, SHA256_HASH_SIZE);
+    written = Crypto_HMACWithKey(key, dataBytes, sizeof(payload->data), hash, SHA256_HASH_SIZE);
 
     return memcmp(hash, payload->hash, written) == 0;
 }
 
-void PayloadHash(SensorPayload *payload, const void *key, const size_t keyLength) {
+size_t PayloadVerifyMany(const SensorPayload *payloads, size_t count, const HmacKeyCtx *key, bool *valid) {
+    uint8_t hashes[CRYPTO_HMAC_LANES][SHA256_HASH_SIZE];
+    size_t matching = 0;
+    size_t n;
+
+    for (size_t first = 0; first < count; first += n) {
+        n = (count - first > CRYPTO_HMAC_LANES) ? CRYPTO_HMAC_LANES : count - first;
+        Crypto_HMACWithKeyMany(key,
+                               (const uint8_t *)&payloads[first].data,
+                               sizeof(payloads[first].data),
+                               sizeof(SensorPayload),
+                               n,
+                               hashes);
+
+        for (size_t i = 0; i < n; i++) {
+            bool match = memcmp(hashes[i], payloads[first + i].hash, SHA256_HASH_SIZE) == 0;
+
+            if (valid != NULL) {
+                valid[first + i] = match;
+            }
+            matching += match;
+        }
+    }
+
+    return matching;
+}
+
+void PayloadHash(SensorPayload *payload, const HmacKeyCtx *key) {
     const uint8_t *dataBytes = (const uint8_t *)&payload->data;
 
     memset(payload->hash, 0, SHA256_HASH_SIZE);
-    Crypto_HMAC(key, keyLength, dataBytes, sizeof(SensorData), payload->hash, SHA256_HASH_SIZE);
+    Crypto_HMACWithKey(key, dataBytes, sizeof(payload->data), payload->hash, SHA256_HASH_SIZE);
+}
+
+bool PayloadBatchVerify(SensorBatch *batch, const HmacKeyCtx *key) {
+    uint8_t hash[SHA256_HASH_SIZE];
+    uint8_t *dataBytes = &batch->count;
+    size_t written = 0;
+
+    if (batch->count == 0 || batch->count > SENSOR_BATCH_MAX_SAMPLES) {
+        return false;
+    }
+
+    written = Crypto_HMACWithKey(key,
+                                 dataBytes,
+                                 SENSOR_BATCH_LENGTH(batch->count) - offsetof(SensorBatch, count),
+                                 hash,
+                                 SHA256_HASH_SIZE);
+
+    return memcmp(hash, batch->hash, written) == 0;
+}
+
+void PayloadBatchHash(SensorBatch *batch, const HmacKeyCtx *key) {
+    const uint8_t *dataBytes = &batch->count;
+
+    memset(batch->hash, 0, SHA256_HASH_SIZE);
+    memset(batch->reserved, 0, sizeof(batch->reserved));
+    memmove(SENSOR_BATCH_OFFSETS(batch), batch->offsets, batch->count * sizeof(uint16_t));
+    Crypto_HMACWithKey(key,
+                       dataBytes,
+                       SENSOR_BATCH_LENGTH(batch->count) - offsetof(SensorBatch, count),
+                       batch->hash,
+                       SHA256_HASH_SIZE);
+}
+
+int32_t PayloadAccelerationMg(int16_t raw, uint8_t accelScale) {
+    /* LIS2DH12 sensitivity in high resolution mode, milli-g per 12-bit digit */
+    static const uint8_t sensitivity[] = {
+        [PROTO_ACCEL_SCALE_2G] = 1,
+        [PROTO_ACCEL_SCALE_4G] = 2,
+        [PROTO_ACCEL_SCALE_8G] = 4,
+        [PROTO_ACCEL_SCALE_16G] = 12,
+    };
+
+    if (accelScale >= sizeof(sensitivity) / sizeof(sensitivity[0])) {
+        return 0;
+    }
+
+    /* the 12 bits are left-justified in the 16-bit count */
+    return (int32_t)raw * sensitivity[accelScale] / 16;
 }
@@ -4,43 +4,150 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "crypto_hmac.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * @brief A sample as read from the sensors. The sensors MCU has no FPU: values are kept in integer units and the
+ * acceleration is converted by the receiver, see `PayloadAccelerationMg`
+ */
 typedef struct SensorData {
+    /** @brief Temperature in hundredths of degree Celsius */
+    int16_t temperature;
+
+    /** @brief Relative humidity in hundredths of percent. The SHT4x formula goes slightly below 0% and above 100% */
+    int16_t humidity;
+
+    /** @brief Raw LIS2DH12 acceleration on X, Y and Z. The counts are left-justified, so their weight only depends on
+     * the full scale and not on the resolution mode */
+    int16_t acceleration[3];
+
+    /** @brief Full scale of `acceleration`, a `ProtoAccelScale` */
+    uint8_t accelScale;
+
+    /** @brief Keeps the samples 2-byte aligned, always 0 */
+    uint8_t reserved;
+} __attribute__((packed, aligned(2))) SensorData;
+
+/// @brief Sample layout of the firmwares sending a single `SensorPayload`, in thousandths and float milli-g
+typedef struct SensorDataV1 {
     int32_t temperature;
     int32_t humidity;
     float acceleration_mg[3];
-} __attribute__((packed, aligned(4))) SensorData;
+} __attribute__((packed, aligned(4))) SensorDataV1;
 
 typedef struct SensorPayload {
     /** @brief The actual data */
-    SensorData data;
+    SensorDataV1 data;
 
     /** @brief The HMAC SHA256 hash of this message */
     uint8_t hash[32];
 } __attribute__((packed, aligned(4))) SensorPayload;
 
+/// @brief Maximum number of samples in a `SensorBatch`, so that it fits a sequenced message
+#define SENSOR_BATCH_MAX_SAMPLES (15u)
+
+/// @brief Length in bytes of a `SensorBatch` carrying `count` samples, and their offsets
+#define SENSOR_BATCH_LENGTH(count)                                                                                     \
+    (offsetof(SensorBatch, samples) + (count) * (sizeof(SensorData) + sizeof(uint16_t)))
+
+/// @brief Offsets of the samples of a `SensorBatch` as sent, right after the last sample
+#define SENSOR_BATCH_OFFSETS(batch) ((uint16_t *)&(batch)->samples[(batch)->count])
+
+/// @brief Set in `SensorBatch.flags` when `epoch` is a Unix time, synchronized with the master
+#define SENSOR_BATCH_FLAG_SYNCED 0x01
+
+/// @brief Unit of the sample offsets of a `SensorBatch`, in milliseconds
+#define SENSOR_BATCH_OFFSET_MS (10u)
+
+/// @brief Longest time between the epoch and the last sample of a `SensorBatch`, in milliseconds
+#define SENSOR_BATCH_MAX_SPAN_MS ((uint32_t)UINT16_MAX * SENSOR_BATCH_OFFSET_MS)
+
+typedef struct SensorBatch {
+    /** @brief The HMAC SHA256 hash of everything following it, up to the last offset sent */
+    uint8_t hash[32];
+
+    /** @brief Number of valid samples */
+    uint8_t count;
+
+    /** @brief Batch flags (`SENSOR_BATCH_FLAG_*`) */
+    uint8_t flags;
+
+    /** @brief Keeps the samples 4-byte aligned, always 0 */
+    uint8_t reserved[2];
+
+    /** @brief Seconds the offsets count from: Unix time if `SENSOR_BATCH_FLAG_SYNCED`, else since the sensors MCU
+     * started */
+    uint32_t epoch;
+
+    /** @brief Samples, oldest first. Only the first `count` are sent, followed by when each one was taken, as
+     * `uint16_t` offsets from `epoch` in `SENSOR_BATCH_OFFSET_MS` units (`SENSOR_BATCH_OFFSETS`) */
+    SensorData samples[SENSOR_BATCH_MAX_SAMPLES];
+
+    /** @brief Where the sender collects the offsets, before moving them after the last sample */
+    uint16_t offsets[SENSOR_BATCH_MAX_SAMPLES];
+} __attribute__((packed, aligned(4))) SensorBatch;
+
 /**
  * @brief Verifies a payload containing a HMAC-SHA256 hash
  *
  * @param payload Payload to verify
- * @param[in] key The key used for hashing
- * @param keyLength Length of the key
+ * @param[in] key The key used for hashing, see `Crypto_HMACKeyInit`
  * @return - `true` if the payload hash and the calculated hash are the same
  * @return - `false` if the payload hash and the calculated hash DO NOT match
  */
-bool PayloadVerify(SensorPayload *payload, const uint8_t *key, const size_t keyLength);
+bool PayloadVerify(SensorPayload *payload, const HmacKeyCtx *key);
+
+/**
+ * @brief Verifies payloads like as many `PayloadVerify`, several at once where the SHA-256 can: see
+ * `Crypto_HMACWithKeyMany`. Meant for the tools checking recorded payloads in bulk
+ *
+ * @param[in] payloads Payloads to verify
+ * @param count Number of payloads
+ * @param[in] key The key used for hashing, see `Crypto_HMACKeyInit`
+ * @param[out] valid Optional, receives the result of `PayloadVerify` for each payload
+ * @return The number of payloads whose hash matches
+ */
+size_t PayloadVerifyMany(const SensorPayload *payloads, size_t count, const HmacKeyCtx *key, bool *valid);
 
 /**
  * @brief Hashes the data and stores the hash in the `hash` field of `SensorPayload`
  *
  * @param[in, out] payload Payload to hash data in
- * @param[in] key The key used for hashing
- * @param keyLength Length of the key
+ * @param[in] key The key used for hashing, see `Crypto_HMACKeyInit`
+ */
+void PayloadHash(SensorPayload *payload, const HmacKeyCtx *key);
+
+/**
+ * @brief Verifies a batch of samples containing a HMAC-SHA256 hash
+ *
+ * @param batch Batch to verify
+ * @param[in] key The key used for hashing, see `Crypto_HMACKeyInit`
+ * @return - `true` if the sample count is valid and the batch hash and the calculated hash are the same
+ * @return - `false` otherwise
+ */
+bool PayloadBatchVerify(SensorBatch *batch, const HmacKeyCtx *key);
+
+/**
+ * @brief Moves the offsets right after the last sample, where they are sent, then hashes the batch and stores the
+ * hash in the `hash` field of `SensorBatch`
+ *
+ * @param[in, out] batch Batch to hash samples in
+ * @param[in] key The key used for hashing, see `Crypto_HMACKeyInit`
+ */
+void PayloadBatchHash(SensorBatch *batch, const HmacKeyCtx *key);
+
+/**
+ * @brief Converts a raw acceleration count of a `SensorData` to milli-g
+ *
+ * @param raw The left-justified count
+ * @param accelScale The full scale it was read with, a `ProtoAccelScale`
+ * @return The acceleration in milli-g, `0` if `accelScale` is not valid
  */
-void PayloadHash(SensorPayload *payload, const void *key, const size_t keyLength);
+int32_t PayloadAccelerationMg(int16_t raw, uint8_t accelScale);
 
 #ifdef __cplusplus
 }
@@ -17,6 +17,13 @@
 
 #include "sha256.h"
 
+#if SHA256_HOST_ACCEL && defined(__x86_64__)
+#include <cpuid.h>
+#elif SHA256_HOST_ACCEL && defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //  MACROS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -55,6 +62,7 @@
 //  CONSTANTS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#if !SHA256_ARMV6M
 // The K array
 static const uint32_t K[64] = {
     0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
@@ -65,6 +73,7 @@ static const uint32_t K[64] = {
     0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
     0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
     0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL, 0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL};
+#endif
 
 #define BLOCK_SIZE 64
 
@@ -88,6 +97,98 @@ static const uint32_t K[64] = {
     d += t0;                                                                                                           \
     h = t0 + t1;
 
+#if SHA256_HOST_ACCEL
+// The compression below is the portable kernel of the dispatch
+#define TransformFunction TransformPortable
+#endif
+
+#if SHA256_ARMV6M
+
+// Implemented in sha256_armv6m.S
+void Sha256TransformArmv6m(uint32_t state[8], uint8_t const *block);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  TransformFunction
+//
+//  Compress 512-bits, in Thumb-1 assembly
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void TransformFunction(Sha256Context *Context, uint8_t const *Buffer) {
+    Sha256TransformArmv6m(Context->state, Buffer);
+}
+
+#elif SHA256_UNROLLED
+
+// Word i of the message schedule, in a window of the last 16 words
+#define Wi(i) W[(i) & 15]
+
+// Word i of the message schedule, computed in place of word i - 16
+#define Expand(i) (Wi(i) += Gamma1(Wi((i) - 2)) + Wi((i) - 7) + Gamma0(Wi((i) - 15)))
+
+#define Sha256RoundW(a, b, c, d, e, f, g, h, i, w)                                                                     \
+    t0 = h + Sigma1(e) + Ch(e, f, g) + K[i] + (w);                                                                     \
+    t1 = Sigma0(a) + Maj(a, b, c);                                                                                     \
+    d += t0;                                                                                                           \
+    h = t0 + t1;
+
+// Eight rounds, after which the variables are back in place. `w` picks the schedule word of a round
+#define Sha256Rounds8(i, w)                                                                                            \
+    Sha256RoundW(a, b, c, d, e, f, g, h, (i) + 0, w((i) + 0));                                                         \
+    Sha256RoundW(h, a, b, c, d, e, f, g, (i) + 1, w((i) + 1));                                                         \
+    Sha256RoundW(g, h, a, b, c, d, e, f, (i) + 2, w((i) + 2));                                                         \
+    Sha256RoundW(f, g, h, a, b, c, d, e, (i) + 3, w((i) + 3));                                                         \
+    Sha256RoundW(e, f, g, h, a, b, c, d, (i) + 4, w((i) + 4));                                                         \
+    Sha256RoundW(d, e, f, g, h, a, b, c, (i) + 5, w((i) + 5));                                                         \
+    Sha256RoundW(c, d, e, f, g, h, a, b, (i) + 6, w((i) + 6));                                                         \
+    Sha256RoundW(b, c, d, e, f, g, h, a, (i) + 7, w((i) + 7));
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  TransformFunction
+//
+//  Compress 512-bits. Unrolled: the roles of the state words rotate with the rounds instead of the words themselves,
+//  and each schedule word is computed right before its round, over the one 16 rounds older
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void TransformFunction(Sha256Context *Context, uint8_t const *Buffer) {
+    uint32_t a = Context->state[0];
+    uint32_t b = Context->state[1];
+    uint32_t c = Context->state[2];
+    uint32_t d = Context->state[3];
+    uint32_t e = Context->state[4];
+    uint32_t f = Context->state[5];
+    uint32_t g = Context->state[6];
+    uint32_t h = Context->state[7];
+    uint32_t W[16];
+    uint32_t t0;
+    uint32_t t1;
+    int i;
+
+    // Copy the state into 512-bits into W[0..15]
+    for (i = 0; i < 16; i++) {
+        LOAD32H(W[i], Buffer + (4 * i));
+    }
+
+    // Compress
+    Sha256Rounds8(0, Wi);
+    Sha256Rounds8(8, Wi);
+    Sha256Rounds8(16, Expand);
+    Sha256Rounds8(24, Expand);
+    Sha256Rounds8(32, Expand);
+    Sha256Rounds8(40, Expand);
+    Sha256Rounds8(48, Expand);
+    Sha256Rounds8(56, Expand);
+
+    // Feedback
+    Context->state[0] += a;
+    Context->state[1] += b;
+    Context->state[2] += c;
+    Context->state[3] += d;
+    Context->state[4] += e;
+    Context->state[5] += f;
+    Context->state[6] += g;
+    Context->state[7] += h;
+}
+
+#else
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //  TransformFunction
 //
@@ -136,6 +237,123 @@ static void TransformFunction(Sha256Context *Context, uint8_t const *Buffer) {
     }
 }
 
+#endif /* SHA256_ARMV6M, SHA256_UNROLLED */
+
+#if SHA256_HOST_ACCEL
+
+#undef TransformFunction
+
+typedef void (*TransformKernel)(Sha256Context *Context, uint8_t const *Buffer);
+
+#if defined(__x86_64__)
+
+// Implemented in sha256_shani.c
+void Sha256TransformShaNi(uint32_t state[8], uint8_t const *block);
+
+// Implemented in sha256_mb.c, 8 and 16 states and blocks
+void Sha256TransformAvx2x8(uint32_t *states, uint8_t const *blocks);
+void Sha256TransformAvx512x16(uint32_t *states, uint8_t const *blocks);
+
+static void TransformShaNi(Sha256Context *Context, uint8_t const *Buffer) {
+    Sha256TransformShaNi(Context->state, Buffer);
+}
+
+#elif defined(__aarch64__)
+
+// Implemented in sha256_armv8.c
+void Sha256TransformArmv8(uint32_t state[8], uint8_t const *block);
+
+static void TransformArmv8(Sha256Context *Context, uint8_t const *Buffer) {
+    Sha256TransformArmv8(Context->state, Buffer);
+}
+
+#endif
+
+// Kernels by `Sha256Kernel`, NULL when not built for this architecture
+static const struct {
+    const char *name;
+    TransformKernel transform;
+} kernels[SHA256_KERNEL_COUNT] = {
+    [SHA256_KERNEL_PORTABLE] = {"portable", TransformPortable},
+#if defined(__x86_64__)
+    [SHA256_KERNEL_SHANI] = {"sha-ni", TransformShaNi},
+#else
+    [SHA256_KERNEL_SHANI] = {"sha-ni", NULL},
+#endif
+#if defined(__aarch64__)
+    [SHA256_KERNEL_ARMV8] = {"armv8-ce", TransformArmv8},
+#else
+    [SHA256_KERNEL_ARMV8] = {"armv8-ce", NULL},
+#endif
+};
+
+static Sha256Kernel kernel = SHA256_KERNEL_PORTABLE;
+static TransformKernel transform = TransformPortable;
+static uint32_t lanes = 1;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  KernelSupported
+//
+//  Whether the CPU runs a kernel
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool KernelSupported(Sha256Kernel Kernel) {
+    if (Kernel >= SHA256_KERNEL_COUNT || kernels[Kernel].transform == NULL) {
+        return false;
+    }
+
+    switch (Kernel) {
+#if defined(__x86_64__)
+    case SHA256_KERNEL_SHANI: {
+        unsigned int eax, ebx, ecx, edx;
+
+        // SSSE3 and SSE4.1 for the shuffles around the SHA instructions
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)) {
+            return false;
+        }
+        return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+    }
+#elif defined(__aarch64__)
+    case SHA256_KERNEL_ARMV8:
+        return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#endif
+    default:
+        return true;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  SelectKernel
+//
+//  Picks the fastest kernel of the CPU before main, so that no hash races with it
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+__attribute__((constructor)) static void SelectKernel(void) {
+#if defined(__x86_64__)
+    // Before the other constructors, `__builtin_cpu_supports` needs this
+    __builtin_cpu_init();
+#endif
+    for (int k = SHA256_KERNEL_COUNT - 1; k > SHA256_KERNEL_PORTABLE; k--) {
+        if (Sha256SetKernel((Sha256Kernel)k)) {
+            break;
+        }
+    }
+
+    // 8 AVX2 lanes are slower than SHA-NI hashing the blocks one by one, 16 AVX-512 lanes are not
+    if (!Sha256SetLanes(16) && kernel == SHA256_KERNEL_PORTABLE) {
+        Sha256SetLanes(8);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  TransformFunction
+//
+//  Compress 512-bits, with the selected kernel
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void TransformFunction(Sha256Context *Context, uint8_t const *Buffer) {
+    transform(Context, Buffer);
+}
+
+#endif /* SHA256_HOST_ACCEL */
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //  PUBLIC FUNCTIONS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -226,4 +444,74 @@ void Sha256Calculate(void const *Buffer, uint32_t BufferSize, SHA256_HASH *Diges
     Sha256Initialise(&context);
     Sha256Update(&context, Buffer, BufferSize);
     Sha256Finalise(&context, Digest);
-}
\ No newline at end of file
+}
+
+void Sha256TransformMany(uint32_t *States, uint8_t const *Blocks, uint32_t Count) {
+    Sha256Context context;
+
+#if SHA256_HOST_ACCEL && defined(__x86_64__)
+    for (; lanes == 16 && Count >= 16; Count -= 16, States += 16 * 8, Blocks += 16 * BLOCK_SIZE) {
+        Sha256TransformAvx512x16(States, Blocks);
+    }
+    for (; lanes == 8 && Count >= 8; Count -= 8, States += 8 * 8, Blocks += 8 * BLOCK_SIZE) {
+        Sha256TransformAvx2x8(States, Blocks);
+    }
+#endif
+
+    for (; Count > 0; Count--, States += 8, Blocks += BLOCK_SIZE) {
+        memcpy(context.state, States, sizeof(context.state));
+        TransformFunction(&context, Blocks);
+        memcpy(States, context.state, sizeof(context.state));
+    }
+}
+
+#if SHA256_HOST_ACCEL
+
+Sha256Kernel Sha256GetKernel(void) {
+    return kernel;
+}
+
+bool Sha256SetKernel(Sha256Kernel Kernel) {
+    if (!KernelSupported(Kernel)) {
+        return false;
+    }
+
+    kernel = Kernel;
+    transform = kernels[Kernel].transform;
+    return true;
+}
+
+uint32_t Sha256GetLanes(void) {
+    return lanes;
+}
+
+bool Sha256SetLanes(uint32_t Lanes) {
+    switch (Lanes) {
+    case 1:
+        break;
+#if defined(__x86_64__)
+    case 8:
+        if (!__builtin_cpu_supports("avx2")) {
+            return false;
+        }
+        break;
+    case 16:
+        // AVX512BW for the byte swaps
+        if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw")) {
+            return false;
+        }
+        break;
+#endif
+    default:
+        return false;
+    }
+
+    lanes = Lanes;
+    return true;
+}
+
+const char *Sha256KernelName(Sha256Kernel Kernel) {
+    return (Kernel < SHA256_KERNEL_COUNT) ? kernels[Kernel].name : "unknown";
+}
+
+#endif
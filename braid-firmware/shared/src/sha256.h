@@ -13,6 +13,36 @@
 
 #include <stdint.h>
 
+/*!
+ * @brief Selects the fully unrolled compression function, which keeps the state in registers and the message schedule
+ * in 16 words. About 5 times the code of the compact loop: enabled on the master.
+ */
+#ifndef SHA256_UNROLLED
+#define SHA256_UNROLLED 0
+#endif
+
+/*!
+ * @brief Selects the Thumb-1 assembly compression function of `sha256_armv6m.S`. Set by default when the target is
+ * ARMv6-M, like the Cortex-M0+ of the sensors MCU, where it takes over `SHA256_UNROLLED`.
+ */
+#ifndef SHA256_ARMV6M
+#if defined(__ARM_ARCH_6M__)
+#define SHA256_ARMV6M 1
+#else
+#define SHA256_ARMV6M 0
+#endif
+#endif
+
+/*!
+ * @brief Dispatches the compression at run time on x86-64 and AArch64 hosts, to the SHA-NI or ARMv8 crypto extension
+ * kernels of `sha256_shani.c` and `sha256_armv8.c` when the CPU has them, the portable code being the fallback. Also
+ * enables the AVX2 and AVX-512 lanes of `sha256_mb.c` for `Sha256TransformMany`. Meant for the host tools that verify
+ * recorded payloads: the MCUs have none of these.
+ */
+#ifndef SHA256_HOST_ACCEL
+#define SHA256_HOST_ACCEL 0
+#endif
+
 /*!
  * @struct Sha256Context
  * @brief SHA256 context structure.
@@ -82,3 +112,66 @@ void Sha256Finalise(Sha256Context *Context, SHA256_HASH *Digest);
  * @param[out] Digest Pointer to the SHA256 hash structure to store the final hash.
  */
 void Sha256Calculate(void const *Buffer, uint32_t BufferSize, SHA256_HASH *Digest);
+
+/*!
+ * @brief Compresses independent blocks, each into its own state, like as many contexts resumed from these states and
+ * fed a block. With `SHA256_HOST_ACCEL`, 16 or 8 blocks go at once on AVX-512 or AVX2: see `Sha256SetLanes`.
+ *
+ * @param[in, out] States `Count` states of 8 words, one after the other.
+ * @param[in] Blocks `Count` blocks of 64 bytes, one after the other.
+ * @param[in] Count Number of blocks.
+ */
+void Sha256TransformMany(uint32_t *States, uint8_t const *Blocks, uint32_t Count);
+
+#if SHA256_HOST_ACCEL
+
+#include <stdbool.h>
+
+/*!
+ * @brief Compression kernels of `SHA256_HOST_ACCEL`
+ */
+typedef enum Sha256Kernel {
+    SHA256_KERNEL_PORTABLE, /*!< The portable C, see `SHA256_UNROLLED` */
+    SHA256_KERNEL_SHANI,    /*!< x86 SHA extensions */
+    SHA256_KERNEL_ARMV8,    /*!< ARMv8 crypto extension */
+    SHA256_KERNEL_COUNT,
+} Sha256Kernel;
+
+/*!
+ * @brief Returns the kernel used by the functions above, the fastest one of the CPU unless `Sha256SetKernel` was
+ * called.
+ */
+Sha256Kernel Sha256GetKernel(void);
+
+/*!
+ * @brief Selects the kernel used by the functions above, for benchmarks and comparisons. Not thread safe: call it
+ * while no hash is computed.
+ *
+ * @param[in] Kernel The kernel to use.
+ * @return `false` if the CPU or the build does not support it, the kernel in use is kept then.
+ */
+bool Sha256SetKernel(Sha256Kernel Kernel);
+
+/*!
+ * @brief Returns the number of blocks `Sha256TransformMany` compresses at once: 16 with AVX-512, 8 with AVX2 when
+ * there is no SHA-NI, else 1 with the kernel in use. The blocks left over are compressed one by one.
+ */
+uint32_t Sha256GetLanes(void);
+
+/*!
+ * @brief Selects the number of blocks `Sha256TransformMany` compresses at once, for benchmarks. Not thread safe: call
+ * it while no hash is computed.
+ *
+ * @param[in] Lanes 1, 8 or 16.
+ * @return `false` if the CPU or the build does not support it, the number in use is kept then.
+ */
+bool Sha256SetLanes(uint32_t Lanes);
+
+/*!
+ * @brief Returns the name of a kernel, for logs.
+ *
+ * @param[in] Kernel The kernel.
+ */
+const char *Sha256KernelName(Sha256Kernel Kernel);
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * @file sha256_armv8.c
+ * @brief SHA-256 compression function on the ARMv8 crypto extension, used by `sha256.c` when `SHA256_HOST_ACCEL` is
+ * set and the CPU has it.
+ *
+ * `sha256h` and `sha256h2` run four rounds on the `ABCD` and `EFGH` halves of the state, `sha256su0` and `sha256su1`
+ * expand the schedule 4 words at a time. Built for the extension only, whatever the flags of the rest of the build.
+ *
+ * void Sha256TransformArmv8(uint32_t state[8], const uint8_t block[64]);
+ */
+#include "sha256.h"
+
+#if SHA256_HOST_ACCEL && defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#if defined(__clang__)
+#define SHA256_ARMV8_TARGET __attribute__((target("sha2")))
+#else
+#define SHA256_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL, 0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL, 0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL, 0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL, 0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL};
+
+// Rounds i to i + 3, `w` holding their message words
+#define Armv8Rounds4(i, w)                                                                                             \
+    do {                                                                                                               \
+        uint32x4_t wk = vaddq_u32((w), vld1q_u32(&K[i]));                                                              \
+        uint32x4_t abcdPrevious = abcd;                                                                                \
+        abcd = vsha256hq_u32(abcd, efgh, wk);                                                                          \
+        efgh = vsha256h2q_u32(efgh, abcdPrevious, wk);                                                                 \
+    } while (0)
+
+// Replaces the oldest 4 words `w0` of the schedule by the next 4, `w3` being the newest
+#define Armv8Expand(w0, w1, w2, w3) (w0 = vsha256su1q_u32(vsha256su0q_u32(w0, w1), w2, w3))
+
+SHA256_ARMV8_TARGET void Sha256TransformArmv8(uint32_t state[8], uint8_t const *block) {
+    uint32x4_t abcd = vld1q_u32(&state[0]);
+    uint32x4_t efgh = vld1q_u32(&state[4]);
+    uint32x4_t abcdSaved = abcd;
+    uint32x4_t efghSaved = efgh;
+
+    // Big-endian words
+    uint32x4_t w0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 0)));
+    uint32x4_t w1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 16)));
+    uint32x4_t w2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 32)));
+    uint32x4_t w3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 48)));
+
+    Armv8Rounds4(0, w0);
+    Armv8Rounds4(4, w1);
+    Armv8Rounds4(8, w2);
+    Armv8Rounds4(12, w3);
+    for (int i = 16; i < 64; i += 16) {
+        Armv8Expand(w0, w1, w2, w3);
+        Armv8Rounds4(i, w0);
+        Armv8Expand(w1, w2, w3, w0);
+        Armv8Rounds4(i + 4, w1);
+        Armv8Expand(w2, w3, w0, w1);
+        Armv8Rounds4(i + 8, w2);
+        Armv8Expand(w3, w0, w1, w2);
+        Armv8Rounds4(i + 12, w3);
+    }
+
+    vst1q_u32(&state[0], vaddq_u32(abcd, abcdSaved));
+    vst1q_u32(&state[4], vaddq_u32(efgh, efghSaved));
+}
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @file sha256_mb.c
+ * @brief SHA-256 compression of 8 or 16 independent blocks at once on AVX2 or AVX-512, used by `Sha256TransformMany`
+ * when `SHA256_HOST_ACCEL` is set and the CPU has them.
+ *
+ * Each 32 bits lane of a vector holds a word of another message: the rounds are those of the portable code, run on
+ * whole vectors. Short messages, like the HMAC of a payload resumed from the key states, are a single dependent chain
+ * of 64 rounds that SHA-NI can not overlap, when the lanes hash 8 or 16 of them in the same time. The blocks are read
+ * with gathers, the states are transposed through the stack. Built for these instructions only, whatever the flags of
+ * the rest of the build.
+ *
+ * void Sha256TransformAvx2x8(uint32_t *states, const uint8_t *blocks);
+ * void Sha256TransformAvx512x16(uint32_t *states, const uint8_t *blocks);
+ */
+#include "sha256.h"
+
+#if SHA256_HOST_ACCEL && defined(__x86_64__)
+
+#include <immintrin.h>
+
+static const uint32_t K[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL, 0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL, 0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL, 0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL, 0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL};
+
+// Word i of the message schedule, in a window of the last 16 words
+#define Wi(i) W[(i) & 15]
+
+// Rounds i to i + 7, `Round` and `Expand` being the macros of the instruction set
+#define Rounds8(Round, i)                                                                                              \
+    Round(a, b, c, d, e, f, g, h, (i) + 0);                                                                            \
+    Round(h, a, b, c, d, e, f, g, (i) + 1);                                                                            \
+    Round(g, h, a, b, c, d, e, f, (i) + 2);                                                                            \
+    Round(f, g, h, a, b, c, d, e, (i) + 3);                                                                            \
+    Round(e, f, g, h, a, b, c, d, (i) + 4);                                                                            \
+    Round(d, e, f, g, h, a, b, c, (i) + 5);                                                                            \
+    Round(c, d, e, f, g, h, a, b, (i) + 6);                                                                            \
+    Round(b, c, d, e, f, g, h, a, (i) + 7)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  AVX2, 8 lanes
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define Avx2Ror(x, n)     _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+#define Avx2Xor3(x, y, z) _mm256_xor_si256(_mm256_xor_si256((x), (y)), (z))
+#define Avx2Add3(x, y, z) _mm256_add_epi32(_mm256_add_epi32((x), (y)), (z))
+
+#define Avx2Round(a, b, c, d, e, f, g, h, i)                                                                           \
+    do {                                                                                                               \
+        __m256i sigma1 = Avx2Xor3(Avx2Ror(e, 6), Avx2Ror(e, 11), Avx2Ror(e, 25));                                      \
+        __m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));                                 \
+        __m256i t0 = Avx2Add3(Avx2Add3(h, sigma1, ch), _mm256_set1_epi32((int)K[i]), Wi(i));                           \
+        __m256i sigma0 = Avx2Xor3(Avx2Ror(a, 2), Avx2Ror(a, 13), Avx2Ror(a, 22));                                     \
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(_mm256_or_si256(a, b), c), _mm256_and_si256(a, b));            \
+        d = _mm256_add_epi32(d, t0);                                                                                   \
+        h = Avx2Add3(t0, sigma0, maj);                                                                                 \
+    } while (0)
+
+#define Avx2RoundExpand(a, b, c, d, e, f, g, h, i)                                                                     \
+    do {                                                                                                               \
+        __m256i x = Wi((i) - 15), y = Wi((i) - 2);                                                                     \
+        __m256i gamma0 = Avx2Xor3(Avx2Ror(x, 7), Avx2Ror(x, 18), _mm256_srli_epi32(x, 3));                             \
+        __m256i gamma1 = Avx2Xor3(Avx2Ror(y, 17), Avx2Ror(y, 19), _mm256_srli_epi32(y, 10));                           \
+        Wi(i) = _mm256_add_epi32(Avx2Add3(Wi(i), gamma0, gamma1), Wi((i) - 7));                                        \
+        Avx2Round(a, b, c, d, e, f, g, h, i);                                                                          \
+    } while (0)
+
+__attribute__((target("avx2"))) void Sha256TransformAvx2x8(uint32_t *states, uint8_t const *blocks) {
+    const __m256i byteSwap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    // Word offsets of the blocks and of the states of the lanes
+    const __m256i blockWords = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+    const __m256i stateWords = _mm256_setr_epi32(0, 8, 16, 24, 32, 40, 48, 56);
+    __m256i W[16];
+    __m256i S[8];
+    __m256i a, b, c, d, e, f, g, h;
+    uint32_t out[8][8];
+
+    for (int i = 0; i < 16; i++) {
+        __m256i words = _mm256_add_epi32(blockWords, _mm256_set1_epi32(i));
+        W[i] = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)blocks, words, 4), byteSwap);
+    }
+    for (int i = 0; i < 8; i++) {
+        __m256i words = _mm256_add_epi32(stateWords, _mm256_set1_epi32(i));
+        S[i] = _mm256_i32gather_epi32((const int *)states, words, 4);
+    }
+
+    a = S[0], b = S[1], c = S[2], d = S[3], e = S[4], f = S[5], g = S[6], h = S[7];
+    Rounds8(Avx2Round, 0);
+    Rounds8(Avx2Round, 8);
+    for (int i = 16; i < 64; i += 8) {
+        Rounds8(Avx2RoundExpand, i);
+    }
+
+    _mm256_storeu_si256((__m256i *)out[0], _mm256_add_epi32(S[0], a));
+    _mm256_storeu_si256((__m256i *)out[1], _mm256_add_epi32(S[1], b));
+    _mm256_storeu_si256((__m256i *)out[2], _mm256_add_epi32(S[2], c));
+    _mm256_storeu_si256((__m256i *)out[3], _mm256_add_epi32(S[3], d));
+    _mm256_storeu_si256((__m256i *)out[4], _mm256_add_epi32(S[4], e));
+    _mm256_storeu_si256((__m256i *)out[5], _mm256_add_epi32(S[5], f));
+    _mm256_storeu_si256((__m256i *)out[6], _mm256_add_epi32(S[6], g));
+    _mm256_storeu_si256((__m256i *)out[7], _mm256_add_epi32(S[7], h));
+    for (int lane = 0; lane < 8; lane++) {
+        for (int i = 0; i < 8; i++) {
+            states[8 * lane + i] = out[i][lane];
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  AVX-512, 16 lanes
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Ternary logic tables of x ^ y ^ z, z ^ (x & (y ^ z)) and the majority
+#define Avx512Xor3(x, y, z) _mm512_ternarylogic_epi32((x), (y), (z), 0x96)
+#define Avx512Ch(x, y, z)   _mm512_ternarylogic_epi32((x), (y), (z), 0xca)
+#define Avx512Maj(x, y, z)  _mm512_ternarylogic_epi32((x), (y), (z), 0xe8)
+#define Avx512Add3(x, y, z) _mm512_add_epi32(_mm512_add_epi32((x), (y)), (z))
+
+#define Avx512Round(a, b, c, d, e, f, g, h, i)                                                                         \
+    do {                                                                                                               \
+        __m512i sigma1 = Avx512Xor3(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11), _mm512_ror_epi32(e, 25));         \
+        __m512i t0 = Avx512Add3(Avx512Add3(h, sigma1, Avx512Ch(e, f, g)), _mm512_set1_epi32((int)K[i]), Wi(i));        \
+        __m512i sigma0 = Avx512Xor3(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13), _mm512_ror_epi32(a, 22));         \
+        d = _mm512_add_epi32(d, t0);                                                                                   \
+        h = Avx512Add3(t0, sigma0, Avx512Maj(a, b, c));                                                                \
+    } while (0)
+
+#define Avx512RoundExpand(a, b, c, d, e, f, g, h, i)                                                                   \
+    do {                                                                                                               \
+        __m512i x = Wi((i) - 15), y = Wi((i) - 2);                                                                     \
+        __m512i gamma0 = Avx512Xor3(_mm512_ror_epi32(x, 7), _mm512_ror_epi32(x, 18), _mm512_srli_epi32(x, 3));        \
+        __m512i gamma1 = Avx512Xor3(_mm512_ror_epi32(y, 17), _mm512_ror_epi32(y, 19), _mm512_srli_epi32(y, 10));       \
+        Wi(i) = _mm512_add_epi32(Avx512Add3(Wi(i), gamma0, gamma1), Wi((i) - 7));                                      \
+        Avx512Round(a, b, c, d, e, f, g, h, i);                                                                        \
+    } while (0)
+
+__attribute__((target("avx512f,avx512bw"))) void Sha256TransformAvx512x16(uint32_t *states, uint8_t const *blocks) {
+    const __m512i byteSwap = _mm512_broadcast_i32x4(
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+    // Word offsets of the blocks and of the states of the lanes
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i blockWords = _mm512_slli_epi32(lanes, 4);
+    const __m512i stateWords = _mm512_slli_epi32(lanes, 3);
+    __m512i W[16];
+    __m512i S[8];
+    __m512i a, b, c, d, e, f, g, h;
+
+    for (int i = 0; i < 16; i++) {
+        __m512i words = _mm512_add_epi32(blockWords, _mm512_set1_epi32(i));
+        W[i] = _mm512_shuffle_epi8(_mm512_i32gather_epi32(words, blocks, 4), byteSwap);
+    }
+    for (int i = 0; i < 8; i++) {
+        __m512i words = _mm512_add_epi32(stateWords, _mm512_set1_epi32(i));
+        S[i] = _mm512_i32gather_epi32(words, states, 4);
+    }
+
+    a = S[0], b = S[1], c = S[2], d = S[3], e = S[4], f = S[5], g = S[6], h = S[7];
+    Rounds8(Avx512Round, 0);
+    Rounds8(Avx512Round, 8);
+    for (int i = 16; i < 64; i += 8) {
+        Rounds8(Avx512RoundExpand, i);
+    }
+
+    S[0] = _mm512_add_epi32(S[0], a);
+    S[1] = _mm512_add_epi32(S[1], b);
+    S[2] = _mm512_add_epi32(S[2], c);
+    S[3] = _mm512_add_epi32(S[3], d);
+    S[4] = _mm512_add_epi32(S[4], e);
+    S[5] = _mm512_add_epi32(S[5], f);
+    S[6] = _mm512_add_epi32(S[6], g);
+    S[7] = _mm512_add_epi32(S[7], h);
+    for (int i = 0; i < 8; i++) {
+        __m512i words = _mm512_add_epi32(stateWords, _mm512_set1_epi32(i));
+        _mm512_i32scatter_epi32(states, words, S[i], 4);
+    }
+}
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file sha256_shani.c
+ * @brief SHA-256 compression function on the x86 SHA extensions, used by `sha256.c` when `SHA256_HOST_ACCEL` is set
+ * and the CPU has them.
+ *
+ * The state is kept as the `ABEF` and `CDGH` halves that `sha256rnds2` works on, each instruction running two rounds.
+ * `sha256msg1` and `sha256msg2` expand the schedule 4 words at a time, the `W[i - 7]` term being added in between.
+ * Built for these instructions only, whatever the flags of the rest of the build.
+ *
+ * void Sha256TransformShaNi(uint32_t state[8], const uint8_t block[64]);
+ */
+#include "sha256.h"
+
+#if SHA256_HOST_ACCEL && defined(__x86_64__)
+
+#include <immintrin.h>
+
+static const uint32_t K[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL, 0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL, 0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL, 0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL, 0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL};
+
+// Rounds i to i + 3, `w` holding their message words
+#define ShaNiRounds4(i, w)                                                                                             \
+    do {                                                                                                               \
+        __m128i wk = _mm_add_epi32((w), _mm_loadu_si128((const __m128i *)&K[i]));                                      \
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);                                                                  \
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));                                         \
+    } while (0)
+
+// Replaces the oldest 4 words `w0` of the schedule by the next 4, `w3` being the newest
+#define ShaNiExpand(w0, w1, w2, w3)                                                                                    \
+    (w0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)), w3))
+
+__attribute__((target("sha,ssse3,sse4.1"))) void Sha256TransformShaNi(uint32_t state[8], uint8_t const *block) {
+    // Big-endian words
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i abef, cdgh, abefSaved, cdghSaved;
+    __m128i w0, w1, w2, w3;
+    __m128i dcba, hgfe;
+
+    // DCBA and HGFE in memory order, to ABEF and CDGH
+    dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+    hgfe = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+    abef = _mm_alignr_epi8(dcba, hgfe, 8);
+    cdgh = _mm_blend_epi16(hgfe, dcba, 0xf0);
+    abefSaved = abef;
+    cdghSaved = cdgh;
+
+    w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 0)), byteSwap);
+    w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 16)), byteSwap);
+    w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 32)), byteSwap);
+    w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 48)), byteSwap);
+
+    ShaNiRounds4(0, w0);
+    ShaNiRounds4(4, w1);
+    ShaNiRounds4(8, w2);
+    ShaNiRounds4(12, w3);
+    for (int i = 16; i < 64; i += 16) {
+        ShaNiExpand(w0, w1, w2, w3);
+        ShaNiRounds4(i, w0);
+        ShaNiExpand(w1, w2, w3, w0);
+        ShaNiRounds4(i + 4, w1);
+        ShaNiExpand(w2, w3, w0, w1);
+        ShaNiRounds4(i + 8, w2);
+        ShaNiExpand(w3, w0, w1, w2);
+        ShaNiRounds4(i + 12, w3);
+    }
+
+    abef = _mm_add_epi32(abef, abefSaved);
+    cdgh = _mm_add_epi32(cdgh, cdghSaved);
+
+    // Back to DCBA and HGFE
+    abef = _mm_shuffle_epi32(abef, 0x1b);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(abef, cdgh, 0xf0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(cdgh, abef, 8));
+}
+
+#endif